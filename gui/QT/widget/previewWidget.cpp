@@ -79,8 +79,7 @@ static QOpenGLFunctions_3_3_Core *getOpenGLFuncs(){
 }
 
 PreviewWidget::PreviewWidget(QWidget *parent) :
-	QOpenGLWidget(parent),
-	ipc_frame(ipc_frame_new())
+	QOpenGLWidget(parent)
 {
 	connect(&timer, SIGNAL(timeout()), this, SLOT(update()));
 }
@@ -224,7 +223,8 @@ bool PreviewWidget::loadFrame(){
 
 
 	if(ipc_frame_reader_has_frame(ipc_frame_reader.get())){
-		if(!ipc_frame_reader_read(ipc_frame_reader.get(), ipc_frame.get()))
+		const Ipc_frame *ipc_frame = ipc_frame_reader_acquire(ipc_frame_reader.get());
+		if(!ipc_frame)
 			return false;
 
 		assert(ipc_frame->header.color_spec == IPC_FRAME_COLOR_RGB);
@@ -234,6 +234,7 @@ bool PreviewWidget::loadFrame(){
 				ipc_frame->header.width, ipc_frame->header.height,
 				0, GL_RGB, GL_UNSIGNED_BYTE, ipc_frame->data);
 		setVidSize(ipc_frame->header.width, ipc_frame->header.height);
+		ipc_frame_reader_release(ipc_frame_reader.get());
 	}
 
 	return true;
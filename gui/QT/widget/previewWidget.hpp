@@ -47,7 +47,6 @@ private:
 	void setVidSize(int w, int h);
 	void calculateScale();
 
-	Ipc_frame_uniq ipc_frame;
 	Ipc_frame_reader_uniq ipc_frame_reader;
 	QTimer timer;
 };
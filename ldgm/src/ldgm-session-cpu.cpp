@@ -16,14 +16,21 @@
  * =====================================================================================
  */
 
+#include <algorithm>
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #if defined __SSE2__ || _M_IX86_FP == 2
 #include <emmintrin.h>
 #endif
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define LDGM_X86_DISPATCH 1
+#endif
 #include <string.h>
 #include <time.h>
+#include <vector>
 
 #include "ldgm-session-cpu.h"
 #include "timer-util.h"
@@ -54,85 +61,142 @@ static inline void *aligned_malloc(size_t size, size_t alignment)
 #endif
 
 
-static char*
-xor_using_sse (char* source, char* dest, int packet_size)
-{
-    // int a = 0;
-    // int II = packet_size % 16;
-    // a=II*16;
-    // // uint64_t* p1 = (uint64_t*) (source);
-    // // uint64_t* p2 = (uint64_t*) (dest);
-
-    // __int128* p1 = (__int128*) (source);
-    // __int128* p2 = (__int128*) (dest);
-
-    // for(int i=0; i<II; i++){
-    //     *p2 ^= *p1;
-    //     p2++;
-    //     p1++;
-    // }
-    // while(a<packet_size){
-    //     *(dest + a) ^= *(source+a);
-    //     a++;
-    // }
-    //First, do as many 128-bit XORs as possible
-    int iter_bytes_16 = 0;
-    int iter_bytes_4 = 0;
-    int iter_bytes_1 = 0;
-#if defined __SSE2__ || _M_IX86_FP == 2
-    iter_bytes_16 = (packet_size/16)*16;
-
-    if ( iter_bytes_16 > 0)
-    {
-
-        //    printf ( "iter_bytes: %d\n", iter_bytes );
-        __m128i* wrd_ptr = (__m128i *)(void *) source;
-        __m128i* wrd_end = (__m128i *)(void *) (source + iter_bytes_16);
-        __m128i* dst_ptr = (__m128i *)(void *) dest;
+/*
+ * XOR kernels - dest = src[0] ^ src[1] ^ ... (or dest ^= ... when accumulating).
+ * All sources of a pass are combined in registers so that each source is read
+ * and dest written only once. SSE2 is baseline on x86-64, AVX2 and AVX-512
+ * variants are compiled with target attributes and selected at runtime.
+ */
+#define XOR_MAX_PASS_SOURCES 8 ///< limit of concurrently streamed sources
 
-        //    printf ( "wrd_ptr address: %p\n", wrd_ptr );
-        do
-        {
-            __m128i xmm1 = _mm_loadu_si128(wrd_ptr);
-            __m128i xmm2 = _mm_loadu_si128(dst_ptr);
+/// @returns number of bytes processed (multiple of the vector width)
+typedef int xor_pass_t(char *dest, const char *const *src, int count, int len, bool accumulate);
 
-            xmm1 = _mm_xor_si128(xmm1, xmm2);     //  XOR  4 32-bit words
-            _mm_storeu_si128(dst_ptr, xmm1);
-            ++wrd_ptr;
-            ++dst_ptr;
+static void
+xor_pass_scalar (char *dest, const char *const *src, int count, int start, int len, bool accumulate)
+{
+    int i = start;
+    for ( ; i + 8 <= len; i += 8) {
+        uint64_t acc = 0;
+        if (accumulate)
+            memcpy(&acc, dest + i, 8);
+        for (int s = 0; s < count; ++s) {
+            uint64_t v;
+            memcpy(&v, src[s] + i, 8);
+            acc ^= v;
+        }
+        memcpy(dest + i, &acc, 8);
+    }
+    for ( ; i < len; ++i) {
+        char acc = accumulate ? dest[i] : 0;
+        for (int s = 0; s < count; ++s)
+            acc ^= src[s][i];
+        dest[i] = acc;
+    }
+}
 
-        } while (wrd_ptr < wrd_end);
+#if defined __SSE2__ || _M_IX86_FP == 2
+static int
+xor_pass_sse2 (char *dest, const char *const *src, int count, int len, bool accumulate)
+{
+    int i = 0;
+    for ( ; i + 16 <= len; i += 16) {
+        __m128i acc = accumulate ? _mm_loadu_si128((__m128i *)(void *)(dest + i))
+                                 : _mm_setzero_si128();
+        for (int s = 0; s < count; ++s)
+            acc = _mm_xor_si128(acc, _mm_loadu_si128((const __m128i *)(const void *)(src[s] + i)));
+        _mm_storeu_si128((__m128i *)(void *)(dest + i), acc);
     }
+    return i;
+}
+#else
+static int
+xor_pass_none (char *, const char *const *, int, int, bool)
+{
+    return 0;
+}
 #endif
-    //Check, whether further XORing is necessary
-    if ( iter_bytes_16 < packet_size )
-    {
-        char *mark_source = source + iter_bytes_16;
-        char *mark_dest = dest + iter_bytes_16;
-
-        iter_bytes_4 = ((packet_size - iter_bytes_16)/4)*4;
 
-        for ( int i = 0; i < (packet_size - iter_bytes_16)/4; i++)
-        {
-            int *s = ((int*)(void *) mark_source) + i;
-            int *d = ((int*)(void *) mark_dest) + i;
-            *d ^= *s;
+#ifdef LDGM_X86_DISPATCH
+__attribute__((target("avx2"))) static int
+xor_pass_avx2 (char *dest, const char *const *src, int count, int len, bool accumulate)
+{
+    int i = 0;
+    for ( ; i + 64 <= len; i += 64) {
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        if (accumulate) {
+            acc0 = _mm256_loadu_si256((__m256i *)(void *)(dest + i));
+            acc1 = _mm256_loadu_si256((__m256i *)(void *)(dest + i + 32));
         }
+        for (int s = 0; s < count; ++s) {
+            acc0 = _mm256_xor_si256(acc0, _mm256_loadu_si256((const __m256i *)(const void *)(src[s] + i)));
+            acc1 = _mm256_xor_si256(acc1, _mm256_loadu_si256((const __m256i *)(const void *)(src[s] + i + 32)));
+        }
+        _mm256_storeu_si256((__m256i *)(void *)(dest + i), acc0);
+        _mm256_storeu_si256((__m256i *)(void *)(dest + i + 32), acc1);
+    }
+    return i;
+}
 
-        mark_source += iter_bytes_4;
-        mark_dest += iter_bytes_4;
-
-        iter_bytes_1 = packet_size - iter_bytes_16 - iter_bytes_4;
-
-        for ( int i = 0; i < iter_bytes_1; i++)
-        {
-            *(mark_dest + i) ^= *(mark_source+i);
+__attribute__((target("avx512f"))) static int
+xor_pass_avx512 (char *dest, const char *const *src, int count, int len, bool accumulate)
+{
+    int i = 0;
+    for ( ; i + 128 <= len; i += 128) {
+        __m512i acc0 = _mm512_setzero_si512();
+        __m512i acc1 = _mm512_setzero_si512();
+        if (accumulate) {
+            acc0 = _mm512_loadu_si512(dest + i);
+            acc1 = _mm512_loadu_si512(dest + i + 64);
+        }
+        for (int s = 0; s < count; ++s) {
+            acc0 = _mm512_xor_si512(acc0, _mm512_loadu_si512(src[s] + i));
+            acc1 = _mm512_xor_si512(acc1, _mm512_loadu_si512(src[s] + i + 64));
         }
+        _mm512_storeu_si512(dest + i, acc0);
+        _mm512_storeu_si512(dest + i + 64, acc1);
     }
+    return i;
+}
+#endif
 
-//   printf ( "XORed: %d bytes using SSE, %d bytes as ints and %d bytes byte-per-byte.\n",iter_bytes_16, iter_bytes_4, iter_bytes_1);
+static xor_pass_t *
+select_xor_pass ()
+{
+#ifdef LDGM_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return xor_pass_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return xor_pass_avx2;
+#endif
+#if defined __SSE2__ || _M_IX86_FP == 2
+    return xor_pass_sse2;
+#else
+    return xor_pass_none;
+#endif
+}
 
-    return dest;
+/**
+ * Stores XOR of count source packets to dest (zeroes dest if count is 0).
+ * dest must not alias any of the sources.
+ */
+static void
+xor_packets (char *dest, const char *const *src, int count, int packet_size)
+{
+    static xor_pass_t *const xor_pass = select_xor_pass();
+
+    if (count == 0) {
+        memset(dest, 0, packet_size);
+        return;
+    }
+    for (int first = 0; first < count; first += XOR_MAX_PASS_SOURCES) {
+        const int n = min(count - first, XOR_MAX_PASS_SOURCES);
+        const bool accumulate = first > 0;
+        const int done = xor_pass(dest, src + first, n, packet_size, accumulate);
+        xor_pass_scalar(dest, src + first, n, done, packet_size, accumulate);
+    }
 }
 
 void *
@@ -151,41 +215,25 @@ LDGM_session_cpu::alloc_buf (int buf_size)
 void
 LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
 {
-//    start encoding
-   // printf ( "packet_size: %d\n", this->packet_size );
-
-    char *parity_packet;
-
-	parity_packet = (char *) aligned_malloc(packet_size, 16);
-	if (!parity_packet)
-	{
-		printf ( "Error while using posix_memalign\n" );
-		return;
-	}
-	memset(parity_packet, 0, packet_size);
+    std::vector<const char *> src;
+    src.reserve(max_row_weight + 3);
 
     for ( int m = 0; m < param_m; ++m) {
-//	printf ( "m: %d\n", m );
+        src.clear();
+        //Apply inverted staircase matrix - parity accumulates previous one
+        if ( m > 0 )
+            src.push_back(parity_ptr + (m-1)*packet_size);
 
-//	printf ( "max w: %d\n", max_row_weight );
         //Find out which packets to XOR
         for ( int k = 0; k < max_row_weight+2; ++k) {
             int idx = pcm[m*(max_row_weight+2) + k];
-//	    printf ( "adept: %d\n", idx );
             if (idx > -1 && idx < param_k) {
-//		printf ( "xoring idx: %d\n", idx );
-                char *ptr = data_ptr + idx*packet_size;
-                parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
+                src.push_back(data_ptr + idx*packet_size);
             }
         }
 
-        //Add the new parity packet to overall parity
-        memcpy ( parity_ptr + m*packet_size, parity_packet, packet_size );
+        xor_packets(parity_ptr + m*packet_size, src.data(), src.size(), packet_size);
     }
-
-	aligned_free(parity_packet);
-
-    return ;
 }		/* -----  end of method LDGM_session_cpu::encode  ----- */
 
 void
@@ -253,8 +301,6 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
     interval.start();
 
 
-    Tanner_graph graph;
-
     int p_size = buf_size/(param_m+param_k);
     this->packet_size = p_size;
 //    printf ( "p_size %d\n", p_size );
@@ -263,7 +309,6 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
     //Timer_util timer;
 
     int i;
-    int index = 0;
 
 
 //    while ( i < (param_k + param_m)*p_size)
@@ -271,19 +316,17 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
 //	printf ( "%2d|", (unsigned char)received[i++] );
 //    }
 
-    //one variable node per each data packet in block K
-    for ( i = 0; i < param_k; ++i )
-        graph.add_node(Node::variable_node, index++, received + i*p_size);
-
-    //one variable node per each parity packet in block M
-    for ( i = 0; i < param_m; ++i)
-        graph.add_node(Node::variable_node, index++, received + (i + param_k)*p_size);
+    //one constraint node per each row of generation matrix, edges depend
+    //only on the matrix so the graph is reused for subsequent frames
+    if ( graph.empty() )
+        create_edges(&graph);
 
-    //one constraint node per each row of generation matrix
-    for ( i = 0; i < param_m; ++i)
-        graph.add_node(Node::constraint_node, index++, NULL);
-
-    create_edges(&graph);
+    //one variable node per each data packet in block K and per each parity
+    //packet in block M
+    for ( i = 0; i < param_k + param_m; ++i ) {
+        graph.set_data_ptr(i, received + i*p_size);
+        graph.set_done(i, false);
+    }
 
 //    printf("Graph created in: %.3f s\n", t);
 
@@ -338,51 +381,27 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
 
 
 
-    map<int, Node>::iterator it;
     if ( merged_intervals.size() != 0)
     {
-        it = graph.nodes.find(0);
-        const auto variable_node_end_it = graph.nodes.find(param_k+param_m); // == 1st constraint node
-        assert(variable_node_end_it != graph.nodes.end());
-        while (it != variable_node_end_it) {
-            (*it).second.setDone(false);
-            int node_offset = (*it).second.getDataPtr() - received;
-//	    printf ( "offset: %d\n", node_offset );
-
-            map_it = merged_intervals.begin();
-            //Find the offset in valid data which is equal, or the first offset which is
-            //lower than node offset
-            bool found = false;
-            while ( (map_it->first <= node_offset) && map_it != merged_intervals.end() )
-            {
-                map_it++;
-                found = true;
-            }
-            if ( found )
-                map_it--;
-
-            //Next, find out if some interval covers this symbol
-            if ( found && (map_it->first + map_it->second) >=
-                    (node_offset + p_size) )
-            {
-                (*it).second.setDone(true);
-//		printf ( "setting node %d with offset %d and size %d as done\n", it->first,
-//			node_offset, p_size);
-            }
-
-            ++it;
+        //both symbols and merged intervals are ordered by offset - walk them
+        //together, symbol is valid if the last interval starting at or before
+        //its offset covers it
+        map_it = merged_intervals.begin();
+        map<int,int>::iterator covering = merged_intervals.end();
+        for ( i = 0; i < param_k + param_m; ++i ) {
+            int node_offset = i * p_size;
+            while ( map_it != merged_intervals.end() && map_it->first <= node_offset )
+                covering = map_it++;
+            if ( covering != merged_intervals.end() &&
+                    covering->first + covering->second >= node_offset + p_size )
+                graph.set_done(i, true);
         }
     }
 
-    //int not_done = 0;
-    for ( it = graph.nodes.begin(); it != graph.nodes.find(param_k); it++)
+    for ( i = 0; i < param_k; ++i )
     {
-        if ( !it->second.isDone())
-        {
-            memset(it->second.getDataPtr(), 0, p_size);
-//	    printf ( "resetting node: %d\n", it->first );
-            //not_done++;
-        }
+        if ( !graph.is_done(i) )
+            memset(graph.get_data_ptr(i), 0, p_size);
     }
 //    printf ( "not done: %d\n", not_done );
     /*     srand(time(NULL));
@@ -405,12 +424,9 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
     //printf ( "iterations: %d\n", iter );
 
     int undecoded = 0;
-    it = graph.nodes.find(0);
-    while ( it != graph.nodes.find(param_k) ) {
-        if (!(*it).second.isDone())
+    for ( i = 0; i < param_k; ++i )
+        if ( !graph.is_done(i) )
             undecoded++;
-        ++it;
-    }
 //    printf ( "Number of not recovered data packets: %d\n", undecoded );
 
     //    printf("rest: %.3f s\n", t);
@@ -445,77 +461,33 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
 void
 LDGM_session_cpu::iterate ( Tanner_graph *graph )
 {
-    map<int, Node>::iterator it_c;
-    vector<int> vec;
-
-    //static int recovered = 0;
-
-    //select the first constraint node
-    it_c = graph->nodes.find ( param_k + param_m );
+    std::vector<const char *> src;
 
     //iterate through constraint nodes
-    while ( it_c != graph->nodes.end() ) {
+    for ( int c = 0; c < graph->constraint_count(); ++c ) {
         //iterate the node's neighbours to find out how many of them are not decoded
-        for(vector<int>::iterator j = it_c->second.neighbours.begin();
-                j != it_c->second.neighbours.end(); ++j) {
-            const auto it_v = graph->nodes.find(*j);
-            if ( !it_v->second.isDone() )
-                vec.push_back(*j);
+        int undone = 0;
+        int r_index = -1;
+        for ( const int *j = graph->neighbours_begin(c); j != graph->neighbours_end(c); ++j ) {
+            if ( !graph->is_done(*j) ) {
+                r_index = *j;
+                if ( ++undone > 1 )
+                    break;
+            }
         }
-//	printf ( "node %d has %d undecoded neighbours\n", it_c->first, vec.size() );
 
-        //we can restore the missing packet
-        if ( vec.size() == 1)
+        //we can restore the missing packet by XORing the other nodes
+        //connected to this constraint node
+        if ( undone == 1 )
         {
-            int r_index = vec.front();
-
-//	    if ( r_index == 0 )
-//	    {
-//		printf ( "repairing first block\n" );
-//	    }
-            auto &node = graph->nodes.at(r_index);
-            memset(node.getDataPtr(), 0, packet_size);
-            char *r_data = node.getDataPtr();
-            //find other nodes connected to this constraint node and XOR their values
-            int count = 0;
-            for(vector<int>::iterator j = it_c->second.neighbours.begin();
-                    j != it_c->second.neighbours.end(); ++j)
-            {
+            src.clear();
+            for ( const int *j = graph->neighbours_begin(c); j != graph->neighbours_end(c); ++j )
                 if ( *j != r_index )
-                {
-//		    printf ( "decode, packet_size: %d\n", packet_size );
-                    char *g_data = (graph->nodes.find(*j))->second.getDataPtr();
-                    //XOR
-                    xor_using_sse(g_data, r_data, packet_size);
-                    count++;
-                }
-            }
-            /*           //validate recovered packet
-             *          for ( int i = 0; i < param_k; ++i) {
-             *              if(!memcmp(r_data, lost_ptr + i*packet_size, packet_size)) {
-             *                  printf ( "packet ok\n" );
-             *                  break;
-             *              }
-             *          }
-             */
-            if ( count > 0 )
-                node.setDone(true);
-            //recovered++;
-            /*           printf ( "restored data: \n" );
-             *          for ( int  i = 0; i < packet_size; ++i)
-             *              printf ( "%2d|", (unsigned char)(*(it_v->second.getDataPtr() + i)) );
-             *          printf ( "---\n" );
-             */
-
+                    src.push_back(graph->get_data_ptr(*j));
 
+            xor_packets(graph->get_data_ptr(r_index), src.data(), src.size(), packet_size);
+            if ( !src.empty() )
+                graph->set_done(r_index, true);
         }
-        vec.clear();
-
-        ++it_c;
     }
-//    printf ( "recovered: %d\n", recovered );
-
-    return;
-
 }
-
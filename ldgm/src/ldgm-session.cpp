@@ -76,6 +76,7 @@ LDGM_session::set_pcMatrix ( char* fname)
         }
     }
     this->max_row_weight = w_f - 2; //w_f stores number of columns in adjacency list
+    graph = Tanner_graph();
 
     /*     for ( int i = 0; i < param_m; i++)
      *     {
@@ -357,16 +358,15 @@ void
 LDGM_session::create_edges ( Tanner_graph *graph )
 {
 //    printf ( "graph: %p, param_k: %d, param_m: %d\n", graph, param_k, param_m );
+    graph->init(param_k + param_m, param_m);
     for ( int m = 0; m < param_m; ++m) {
         for ( int k = 0; k < max_row_weight+2; ++k ) {
             int idx = pcm [ m*(max_row_weight+2) + k];
             if( idx > -1 ) {
-                auto &node = graph->nodes.at(idx);
-                node.neighbours.push_back(param_k + param_m + m);
-                auto &n2 = graph->nodes.at(param_k + param_m + m);
-                n2.neighbours.push_back(idx);
+                graph->add_edge(idx);
             }
         }
+        graph->finish_constraint();
     }
     /*     it = graph->nodes.find(0);
      *     while ( it != graph->nodes.end() )
@@ -400,7 +400,7 @@ bool
 LDGM_session::needs_decoding ( Tanner_graph *graph )
 {
     for ( int i = 0; i < param_k; i++)
-        if( ! graph->nodes.at(i).isDone() ) {
+        if( ! graph->is_done(i) ) {
             return true;
         }
     return false;
@@ -118,6 +118,8 @@ class LDGM_session : public Coding_session
 	char *received_ptr;
 	char *lost_ptr;
 
+	Tanner_graph graph; ///< decoding graph, created from pcm on first use
+
 	double elapsed_sum2;
 	long no_frames2;
 
@@ -29,6 +29,7 @@
 #include "ldgm-session-cpu.h"
 #include "ldgm-session-gpu.h"
 #include "timer-util.h"
+#include "../matrix-gen/matrix-generator.h"
 
 using namespace std;
 
@@ -45,8 +46,19 @@ void printMatrix ( char **m, int height, int width );
 void printData ( char *data, int count, int packet_size );
 void fillParityMatrix ( char** matrix, int height, int width );
 int demo( int m, int k, int frame_size, char* matrix_fname, char* data_fname, int cpu, int gpu);
+int benchmark( int frame_size );
 void demo_gpu();
 
+/// typical k/m/c values used by UltraGrid (default is 512/384/5)
+static const struct {
+    int k, m, c;
+} bench_configs[] = {
+    {  256,  192, 5 },
+    {  512,  384, 5 },
+    { 1024,  768, 5 },
+    { 2048, 1536, 5 },
+};
+
 /* 
 * ===  FUNCTION  ======================================================================
 *         Name:  main
@@ -63,11 +75,17 @@ main ( int argc, char *argv[] )
     int c;
     int gpu = 0;
     int cpu = 0;
+    int bench = 0;
     char fname[32];
     char matrix_fname[32];
 
-    while ( ( c = getopt ( argc, argv, "cf:gk:m:o:t:w:")) != -1 ) {
+    frame_size = 4000000;
+
+    while ( ( c = getopt ( argc, argv, "bcf:gk:m:o:t:w:")) != -1 ) {
 	switch(c) {
+	    case 'b':
+		bench = 1;
+		break;
 	    case 'w':
 		column_weight = atoi ( optarg );
 		break;
@@ -116,6 +134,9 @@ main ( int argc, char *argv[] )
 	}
     }
 
+    if (bench)
+	return benchmark(frame_size);
+
     demo( k, m, frame_size, matrix_fname, fname, cpu, gpu);
 
     //    demo_gpu();
@@ -235,14 +256,17 @@ demo(int k, int m, int frame_size, char* matrix_fname, char* data_fname, int cpu
     srand(time(NULL));
     if (cpu)
     {
-        t.start();
+        Timer_util t_enc, t_dec;
+        double enc_time = 0, dec_time = 0;
+        int good = 0, bad = 0;
 
         for ( int i = 0; i < ITERATIONS; i++)
         {
-                printf ( "encoding\n" );
+                t_enc.start();
                 output = coding_session_cpu->encode_frame ( (char*) data, frame_size, &buf_size );
+                t_enc.end();
+                enc_time += t_enc.elapsed_time();
                 ps = 1392; // coding_session_cpu->get_packet_size();
-                int total = 0;
 
                 valid_data.clear();
 
@@ -253,7 +277,6 @@ demo(int k, int m, int frame_size, char* matrix_fname, char* data_fname, int cpu
                         }
                         if(rand() % 100 > PACKET_LOSS * 100 ) {
                                 valid_data.insert(pair<int,int>(j, size));
-                                total += size;
                         } else {
                                 if(j == 0) {
                                         fprintf(stderr, "Dropping first packet!!!!!!!!!!!!\n");
@@ -262,15 +285,11 @@ demo(int k, int m, int frame_size, char* matrix_fname, char* data_fname, int cpu
                         }
                 }
 
-                int c;
-                printf ( "received bytes: %d\n", total );
-                printf ( "decoding\n" );
+                t_dec.start();
                 decoded = coding_session_cpu_2->decode_frame(output, buf_size, &f_size, valid_data);
-                printf ( "f_size: %d\n", f_size );
-                static int good = 0;
-                static int bad = 0;
+                t_dec.end();
+                dec_time += t_dec.elapsed_time();
                 if(f_size) good++; else bad++;
-                fprintf(stderr, "good: %d bad: %d\n", good, bad);
 
                 for (int x= 0; x < f_size; ++x) {
                         if(((char *)data)[x] != decoded[x]) {
@@ -278,11 +297,13 @@ demo(int k, int m, int frame_size, char* matrix_fname, char* data_fname, int cpu
                                 break;
                         }
                 }
-                //memset(decoded, 0, f_size);
                 coding_session_cpu->free_out_buf(output);
         }
-        t.end();
-        //	printf ( "CPU encoded in: %.6lf\n", t.elapsed_time(start, end) );
+        printf ( "CPU k=%d m=%d frame %d B: encode %.1f MB/s, decode %.1f MB/s "
+                        "(%d recovered, %d failed at %.0f %% loss)\n", k, m, frame_size,
+                        (double) frame_size * ITERATIONS / enc_time / 1e6,
+                        (double) frame_size * ITERATIONS / dec_time / 1e6,
+                        good, bad, PACKET_LOSS * 100 );
     } 
     if (gpu)
     {
@@ -329,6 +350,34 @@ demo(int k, int m, int frame_size, char* matrix_fname, char* data_fname, int cpu
 }
 
 
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  benchmark
+ *  Description:  Measures CPU encode/decode throughput for typical k/m/c values
+ * =====================================================================================
+ */
+    int
+benchmark ( int frame_size )
+{
+    for ( auto const &cfg : bench_configs )
+    {
+        char matrix_fname[64];
+        snprintf(matrix_fname, sizeof matrix_fname, "/tmp/ldgm_bench_matrix-%d-%d-%d.bin",
+                cfg.k, cfg.m, cfg.c);
+        if ( generate_ldgm_matrix(matrix_fname, cfg.k, cfg.m, cfg.c, 1, 0) != 0 )
+        {
+            fprintf ( stderr, "Unable to generate matrix %s.\n", matrix_fname );
+            return EXIT_FAILURE;
+        }
+        printf ( "LDGM k=%d m=%d c=%d\n", cfg.k, cfg.m, cfg.c );
+        int ret = demo ( cfg.k, cfg.m, frame_size, matrix_fname, NULL, 1, 0 );
+        unlink ( matrix_fname );
+        if ( ret != EXIT_SUCCESS )
+            return ret;
+    }
+    return EXIT_SUCCESS;
+}
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  printData
@@ -17,53 +17,10 @@
  */
 
 
-#include <cstring>
-#include <cstdlib>
-#include <cstdio>
 #include "tanner.h"
 
 using namespace std;
 
-/*-----------------------------------------------------------------------------
- *  Implementation of class Node
- *-----------------------------------------------------------------------------*/
-Node::Node(Tanner_graph * /* tanner */, Node::Node_type t, char *d) {
-//    int size = tanner->data_size;
-    this->type = t;
-    data = d;
-    done = false;
-//    neighbours[0] = 0;
-//    printf("Created node with data: %d\n", *data);
-    tanner = nullptr; /// @todo remove, it is no longer used
-}
-
-Node::~Node() {
-}
-
-#if 0
-// unused and seems quite suspicious (but since it is not called, it is unclear
-// what contents of pointer d is
-int Node::setDataPtr(char *d) {
-
-    if ( d != 0 ) {
-        sprintf(data, d, tanner->data_size);
-        return 0;
-    } else
-        return 1;
-}
-#endif
-
-
-/*-----------------------------------------------------------------------------
- *  Implementation fo class Edge
- *-----------------------------------------------------------------------------*/
-
-Edge::Edge(Node *a, Node *b) {
-    first = a;
-    second = b;
-}
-
-
 /*-----------------------------------------------------------------------------
  *  Implementation fo class Tanner_graph
  *-----------------------------------------------------------------------------*/
@@ -71,17 +28,20 @@ void Tanner_graph::set_data_size(int size) {
     data_size = size;
 }
 
-void Tanner_graph::add_node(Node::Node_type type, int index, char *data) {
-//    printf("Creating node with data: %d\n", *data);
-
-    if(data == NULL) {
-//	void *d = calloc(data_size, sizeof(char));
-        Node n(this, type, data);
-        nodes.insert(std::pair <int, Node>(index, n));
-    } else {
-        Node n(this, type, data);
-        nodes.insert(std::pair <int, Node>(index, n));
-    }
+void Tanner_graph::init(int variable_nodes, int constraint_nodes) {
+    var_count = variable_nodes;
+    data.assign(variable_nodes, nullptr);
+    done.assign(variable_nodes, false);
+    adj.clear();
+    adj_start.clear();
+    adj_start.reserve(constraint_nodes + 1);
+    adj_start.push_back(0);
 }
 
+void Tanner_graph::add_edge(int variable_node) {
+    adj.push_back(variable_node);
+}
 
+void Tanner_graph::finish_constraint() {
+    adj_start.push_back(adj.size());
+}
@@ -18,137 +18,66 @@
 
 
 #include <vector>
-#include <map>
 
 #ifndef TANNER_H
 #define TANNER_H
 
-class Tanner_graph;
-
-
 /*
  * =====================================================================================
- *        Class:  Node
- *  Description:  A node in Tanner graph
- * =====================================================================================
- */
-class Node
-{
-    
-    public:
-	enum Node_type {
-	    variable_node,
-	    constraint_node
-	};				/* ----------  end of enum nodeType  ---------- */
-
-	/* ====================  LIFECYCLE     ======================================= */
-	Node ( Tanner_graph *t, Node_type type, char *data);        /* constructor      */
-//	Node ( const Node &other );   /* copy constructor */
-	~Node ();                           /* destructor       */
-
-	/* ====================  ACCESSORS     ======================================= */
-
-	char* getDataPtr() { return data; }
-
-	Node_type getType() { return type; }
-
-	bool isDone() { return done; }
-
-	/* ====================  MUTATORS      ======================================= */
-
-	//int setDataPtr(char *d);
-	
-	void setType(Node_type t) { type = t; }
-
-	void setDone(bool v) { done = v; }
-	
-	std::vector <int> neighbours;
-
-	/* ====================  OPERATORS     ======================================= */
-
-//	Node& operator = ( const Node &other ); /* assignment operator */
-
-    protected:
-	/* ====================  DATA MEMBERS  ======================================= */
-	Tanner_graph *tanner;
-
-    private:
-	/* ====================  DATA MEMBERS  ======================================= */
-	char *data;
-	Node_type type;
-	bool done;
-
-
-}; /* -----  end of class Node  ----- */
-
-
-/*
- * =====================================================================================
- *        Class:  Edge
- *  Description:  Edge in Tanner graph
+ *        Class:  Tanner_graph
+ *  Description:  Tanner graph representation
+ *
+ *  Variable nodes (K data and M parity symbols) and constraint nodes (one per
+ *  row of the parity check matrix) are indexed separately from 0. Only
+ *  adjacency of constraint nodes is needed for decoding, it is kept flat in
+ *  CSR form (neighbours of constraint node c are adj[adj_start[c]] ..
+ *  adj[adj_start[c + 1] - 1]) so that the graph can be built once per matrix
+ *  and reused for every frame.
  * =====================================================================================
  */
-class Edge
+class Tanner_graph
 {
     public:
 	/* ====================  LIFECYCLE     ======================================= */
-	Edge (Node *first, Node *second);                             /* constructor      */
-	Edge ( const Edge &other );   /* copy constructor */
-	~Edge () { }                           /* destructor       */
 
 	/* ====================  ACCESSORS     ======================================= */
 
-	Node* getFirst() { return first; }
-	Node* getSecond() { return second; }
-	/* ====================  MUTATORS      ======================================= */
+	int get_data_size() { return data_size; }
 
-	/* ====================  OPERATORS     ======================================= */
+	bool empty() const { return adj_start.empty(); }
 
-	Edge& operator = ( const Edge &other ); /* assignment operator */
+	int variable_count() const { return var_count; }
 
-    protected:
-	/* ====================  DATA MEMBERS  ======================================= */
+	int constraint_count() const { return (int) adj_start.size() - 1; }
 
-    private:
-	/* ====================  DATA MEMBERS  ======================================= */
+	char *get_data_ptr(int var_node) { return data[var_node]; }
 
-	Node *first;
-	Node *second;
+	bool is_done(int var_node) const { return done[var_node]; }
 
-}; /* -----  end of class Edge  ----- */
+	const int *neighbours_begin(int constraint) const { return adj.data() + adj_start[constraint]; }
 
+	const int *neighbours_end(int constraint) const { return adj.data() + adj_start[constraint + 1]; }
 
-/*
- * =====================================================================================
- *        Class:  Tanner_graph
- *  Description:  Tanner graph representation
- * =====================================================================================
- */
-class Tanner_graph
-{
-    public:
-	/* ====================  LIFECYCLE     ======================================= */
-
-	/* ====================  ACCESSORS     ======================================= */
-
-	int get_data_size() { return data_size; }
-//	std::vector<Node>& getNodes() { return nodes; }
-//	std::vector<Edge>& getEdges() { return edges; }
 	/* ====================  MUTATORS      ======================================= */
 
-	void add_node(Node::Node_type t, int index, char *data);
+	void init(int variable_nodes, int constraint_nodes);
+	/// adds variable node as a neighbour of the last added constraint node
+	void add_edge(int variable_node);
+	/// closes adjacency list of current constraint node
+	void finish_constraint();
 	void set_data_size(int size);
-	/* ====================  OPERATORS     ======================================= */
-
-	Tanner_graph& operator = ( const Tanner_graph &other ); /* assignment operator */
-	int data_size;
-	std::map<int, Node> nodes;
+	void set_data_ptr(int var_node, char *ptr) { data[var_node] = ptr; }
+	void set_done(int var_node, bool v) { done[var_node] = v; }
 
-    protected:
-	/* ====================  DATA MEMBERS  ======================================= */
+	int data_size = 0;
 
     private:
 	/* ====================  DATA MEMBERS  ======================================= */
+	int var_count = 0;
+	std::vector<char *> data;
+	std::vector<char> done;
+	std::vector<int> adj_start;
+	std::vector<int> adj;
 
 }; /* -----  end of class Tanner_graph  ----- */
 
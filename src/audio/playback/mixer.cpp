@@ -55,7 +55,9 @@
 
 #include "audio/audio_playback.h"
 #include "audio/codec.h"
+#include "audio/playback/mixer_kernels.hpp"
 #include "audio/types.h"
+#include "audio/utils.h"           // for interleaved2noninterleaved2
 #include "compat/net.h"            // for sockaddr_in, sockaddr_in6, in6_addr...
 #include "debug.h"
 #include "host.h"                  // for get_commandline_param, uv_argv
@@ -67,21 +69,22 @@
 #include "types.h"                 // for tx_media_type
 #include "utils/audio_buffer.h"
 #include "utils/macros.h"
+#include "utils/misc.h"            // for get_cpu_core_count
 #include "utils/net.h"             // for get_sockaddr_addr_str
 #include "utils/thread.h"
+#include "utils/worker.h"
 
 #define MOD_NAME "[audio mixer] "
 
 #define SAMPLE_RATE 48000
 #define BPS     2 /// @todo 4?
-#define CHANNELS 1
+#define DEFAULT_CHANNELS 1
+#define MAX_CHANNELS 16
 #define FRAMES_PER_SEC 25
 static_assert(SAMPLE_RATE % FRAMES_PER_SEC == 0, "Sample rate not divisible by frames per sec!");
 #define SAMPLES_PER_FRAME (SAMPLE_RATE / FRAMES_PER_SEC)
 
 #define PARTICIPANT_TIMEOUT_S 60
-typedef int16_t sample_type_source;
-typedef int32_t sample_type_mixed;
 static_assert(sizeof(sample_type_source) == BPS, "sample_type source doesn't match BPS");
 static_assert(sizeof(sample_type_mixed) > sizeof(sample_type_source), "sample_type_mixed is not wider than sample_type_source");
 
@@ -101,10 +104,10 @@ static void mixer_dummy_rtp_callback(struct rtp *session [[gnu::unused]], rtp_ev
 
 struct am_participant {
         am_participant(struct socket_udp_local *l, struct sockaddr_storage *ss,
-                       string const &audio_codec)
+                       string const &audio_codec, int channels)
         {
                 assert(l != nullptr && ss != nullptr);
-                m_buffer = audio_buffer_init(SAMPLE_RATE, BPS, CHANNELS, get_commandline_param("low-latency-audio") ? 50 : 5);
+                m_buffer = audio_buffer_init(SAMPLE_RATE, BPS, channels, get_commandline_param("low-latency-audio") ? 50 : 5);
                 assert(m_buffer != NULL);
                 struct sockaddr *sa = (struct sockaddr *) ss;
                 assert(ss->ss_family == AF_INET || ss->ss_family == AF_INET6);
@@ -157,58 +160,11 @@ struct am_participant {
         chrono::steady_clock::time_point last_seen;
 };
 
-template<typename source_t, typename intermediate_t>
-class generic_mix_algo {
-public:
-        virtual ~generic_mix_algo() {}
-        virtual intermediate_t add_to_mix(intermediate_t dst, source_t sample) {
-                return dst + sample;
-        }
-
-        virtual intermediate_t get_mixed_without_source_sample(intermediate_t mix, source_t source_sample) {
-                return mix - source_sample;
-        }
-
-        virtual intermediate_t normalize(intermediate_t sample) = 0;
-};
-
-/**
- * In this mixer, no normalization takes place. After mixing and substracting each
- * participant signal, values are clamped (there is no point doing it prior that -
- * non-normalized mixed value can be out-of-bounds while resulting value with
- * substracted with substracted source may be ok.
- */
-template<typename source_t, typename intermediate_t>
-class linear_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
-public:
-        intermediate_t normalize(intermediate_t sample) override {
-                // clamp the value since linear mixer doesn't normalize values
-                return min<intermediate_t>(max<intermediate_t>(sample, numeric_limits<source_t>::min()), numeric_limits<source_t>::max());
-        }
-};
-
-/**
- * Logarithmic mixing according to:
- * https://www.voegler.eu/pub/audio/digital-audio-mixing-and-normalization.html
- * Copy (as the original link doesn't seem to be present any more) can be found here:
- * http://www.voidcn.com/blog/caohongfei881/article/p-3815311.html
- * Threshold is 0.5.
- */
-template<typename source_t, typename intermediate_t>
-class logarithmic_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
-public:
-        static constexpr double t = 0.5;
-        static constexpr double alpha = 5.71144;
-        intermediate_t normalize(intermediate_t sample) override {
-		if (sample >= numeric_limits<source_t>::min() / 2 &&
-				sample <= numeric_limits<source_t>::max() / 2) {
-			return sample;
-		} else {
-                        double sample_norm = (double) sample / numeric_limits<source_t>::max();
-                        double ret = sample_norm / fabs(sample_norm) * (t + (1.0 - t) * log(1.0 + alpha * (fabs(sample_norm) - t) / (2 - t)) / log(1.0 + alpha)) * numeric_limits<source_t>::max();
-                        return ret;
-                }
-        }
+/// participants sent by one worker
+struct mixer_send_job {
+        am_participant **participants;
+        audio_frame2 *frames;
+        int count;
 };
 
 struct state_audio_mixer final {
@@ -228,23 +184,23 @@ private:
                                    0) {
                                 string algo = item + strlen("algo=");
                                 if (algo == "linear") {
-                                        mixing_algorithm =
-                                            decltype(mixing_algorithm)(
-                                                new linear_mix_algo<
-                                                    sample_type_source,
-                                                    sample_type_mixed>());
+                                        kernels = get_mix_kernels<linear_mix_algo>();
                                 } else if (algo == "logarithmic") {
-                                        mixing_algorithm =
-                                            decltype(mixing_algorithm)(
-                                                new logarithmic_mix_algo<
-                                                    sample_type_source,
-                                                    sample_type_mixed>());
+                                        kernels = get_mix_kernels<logarithmic_mix_algo>();
                                 } else {
                                         LOG(LOG_LEVEL_ERROR)
                                             << "Unknown mixing algorithm: "
                                             << algo << "\n";
                                         throw 1;
                                 }
+                        } else if (strncmp(item, "channels=",
+                                           strlen("channels=")) == 0) {
+                                channels = atoi(item + strlen("channels="));
+                                if (channels < 1 || channels > MAX_CHANNELS) {
+                                        MSG(ERROR, "Wrong channel count: %s\n",
+                                            item + strlen("channels="));
+                                        throw 1;
+                                }
                         } else {
                                 LOG(LOG_LEVEL_ERROR)
                                     << "Unknown option: " << item << "\n";
@@ -283,18 +239,28 @@ public:
         state_audio_mixer& operator=(state_audio_mixer const&) = delete;
         void worker();
         void check_messages();
+        void mix(size_t participant_count);
+        void send(size_t participant_count);
 
         map<sockaddr_storage, am_participant, sockaddr_storage_less> participants;
         mutex participants_lock;
 
         struct socket_udp_local *recv_socket{};
         string audio_codec{"PCM"};
+        int channels = DEFAULT_CHANNELS;
         sockaddr_storage
             only_sender{}; ///< if !AF_UNSPEC, use stream just from this sender
 private:
         struct module mod;
         thread thread_id;
-        unique_ptr<generic_mix_algo<sample_type_source, sample_type_mixed>> mixing_algorithm{new linear_mix_algo<sample_type_source, sample_type_mixed>()};
+        mix_kernels kernels = get_mix_kernels<linear_mix_algo>();
+
+        // buffers reused across ticks
+        vector<char> read_buf; ///< interleaved participant samples
+        vector<sample_type_mixed> mixed; ///< non-interleaved
+        vector<am_participant *> active;
+        vector<audio_frame2> participant_frames;
+        vector<mixer_send_job> send_jobs;
 };
 
 void
@@ -390,63 +356,112 @@ void state_audio_mixer::worker()
                         }
                 }
 
-                size_t data_len_source = SAMPLES_PER_FRAME * sizeof(sample_type_source) * CHANNELS;
-                vector<sample_type_mixed> mixed(SAMPLES_PER_FRAME * CHANNELS);
-                vector<audio_frame2> participant_frames(participants.size());
-                int participant_index = 0;
-
-                // mix all together
-                for (auto & p : participants) {
-                        participant_frames[participant_index].init(CHANNELS, AC_PCM, BPS, SAMPLE_RATE);
-                        static_assert(CHANNELS == 1, "Currently only one channel is implemented here.");
-                        participant_frames[participant_index].resize(0, data_len_source);
-                        char *particip_data = participant_frames[participant_index].get_data(0);
-                        int ret = audio_buffer_read(p.second.m_buffer, particip_data, data_len_source);
-                        memset(particip_data, 0, data_len_source - ret);
-
-                        sample_type_source *src = (sample_type_source *)(void *) particip_data;
-                        auto dst = mixed.begin();
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *dst = mixing_algorithm->add_to_mix(*dst, *src);
-                                ++dst;
-                                ++src;
-                        }
-                        participant_index++;
+                const size_t participant_count = participants.size();
+                active.clear();
+                for (auto &p : participants) {
+                        active.push_back(&p.second);
                 }
+                mix(participant_count);
+                // participants are removed only by this thread and map
+                // insertions do not invalidate the pointers, so the lock
+                // doesn't need to be held while compressing and sending
+                plk.unlock();
 
-                // substract each source signal from the mix coming to that participant
-                for (auto & pb : participant_frames) {
-                        auto mix = mixed.begin();
-                        sample_type_source *part = (sample_type_source *)(void *) pb.get_data(0);
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *part = mixing_algorithm->normalize(mixing_algorithm->get_mixed_without_source_sample(*mix, *part));
-                                ++mix;
-                                ++part;
-                        }
+                send(participant_count);
+        }
+}
+
+void state_audio_mixer::mix(size_t participant_count)
+{
+        const size_t samples = SAMPLES_PER_FRAME;
+        const size_t data_len_source = samples * sizeof(sample_type_source);
+        read_buf.resize(data_len_source * channels);
+        mixed.assign(samples * channels, 0);
+        if (participant_frames.size() < participant_count) {
+                participant_frames.resize(participant_count);
+        }
+
+        // mix all together
+        char *channel_data[MAX_CHANNELS];
+        for (size_t i = 0; i < participant_count; ++i) {
+                audio_frame2 &frame = participant_frames[i];
+                if (frame.get_channel_count() != channels) {
+                        frame.init(channels, AC_PCM, BPS, SAMPLE_RATE);
+                }
+                for (int ch = 0; ch < channels; ++ch) {
+                        frame.resize(ch, data_len_source);
+                        channel_data[ch] = frame.get_data(ch);
+                }
+                char *buf = channels == 1 ? channel_data[0] : read_buf.data();
+                const size_t len = data_len_source * channels;
+                int ret = audio_buffer_read(active[i]->m_buffer, buf, len);
+                memset(buf + ret, 0, len - ret);
+                if (channels > 1) {
+                        interleaved2noninterleaved2(channel_data, buf, BPS,
+                                                    len, channels);
                 }
 
-                // send
-                participant_index = 0;
-                for (auto & p : participants) {
-                        audio_frame2 *uncompressed = &participant_frames[participant_index];
-                        while (audio_frame2 compressed = audio_codec_compress(p.second.m_audio_coder, uncompressed)) {
-                                audio_tx_send(p.second.m_tx_session, p.second.m_network_device, &compressed);
-                                uncompressed = nullptr;
-                        }
+                for (int ch = 0; ch < channels; ++ch) {
+                        kernels.add(mixed.data() + ch * samples,
+                                    (sample_type_source *)(void *) channel_data[ch],
+                                    samples);
+                }
+        }
 
-                        participant_index++;
+        // substract each source signal from the mix coming to that participant
+        for (size_t i = 0; i < participant_count; ++i) {
+                for (int ch = 0; ch < channels; ++ch) {
+                        kernels.minus_one(mixed.data() + ch * samples,
+                                          (sample_type_source *)(void *) participant_frames[i].get_data(ch),
+                                          samples);
                 }
-                plk.unlock();
         }
 }
 
+static void *mixer_send(void *arg)
+{
+        auto *job = (mixer_send_job *) arg;
+        for (int i = 0; i < job->count; ++i) {
+                am_participant *p = job->participants[i];
+                const audio_frame2 *uncompressed = &job->frames[i];
+                while (audio_frame2 compressed = audio_codec_compress(p->m_audio_coder, uncompressed)) {
+                        audio_tx_send(p->m_tx_session, p->m_network_device, &compressed);
+                        uncompressed = nullptr;
+                }
+        }
+        return nullptr;
+}
+
+/// compresses and sends the mixes, participants are spread over workers
+void state_audio_mixer::send(size_t participant_count)
+{
+        if (participant_count == 0) {
+                return;
+        }
+        const int workers = min<int>(participant_count, get_cpu_core_count());
+        send_jobs.resize(workers);
+        size_t first = 0;
+        for (int i = 0; i < workers; ++i) {
+                const size_t count = participant_count / workers +
+                                     (i < (int) (participant_count % workers) ? 1 : 0);
+                send_jobs[i] = { active.data() + first,
+                                 participant_frames.data() + first,
+                                 (int) count };
+                first += count;
+        }
+        task_run_parallel(mixer_send, workers, send_jobs.data(),
+                          sizeof send_jobs[0], nullptr);
+}
+
 static void audio_play_mixer_help()
 {
         printf("Usage:\n"
-               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}]\n"
+               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}][:channels=<n>]\n"
                "\n"
                "<codec>\n"
                "\taudio codec to use\n"
+               "<n>\n"
+               "\tnumber of mixed channels (default %d)\n"
                "linear\n"
                "\tlinear sum of signals (with clamping)\n"
                "logarithmic\n"
@@ -462,7 +477,7 @@ static void audio_play_mixer_help()
                "\ton machine that is a part of the conference, you should use something like:\n"
                "\t\t%s -s <your_capture> -P 5004:5004:5010:5006\n"
                "\tfor the UltraGrid instance that is part of the conference (not mixer!)\n",
-               uv_argv[0], uv_argv[0]);
+               uv_argv[0], DEFAULT_CHANNELS, uv_argv[0]);
 }
 
 static void audio_play_mixer_probe(struct device_info **available_devices, int *count, void (**deleter)(void *))
@@ -500,7 +515,7 @@ static void audio_play_mixer_put_frame(void *state, const struct audio_frame *fr
                     get_sockaddr_str((struct sockaddr *) &ss,
                                      sizeof(struct sockaddr_storage), buf,
                                      sizeof buf));
-                s->participants.emplace(ss, am_participant{s->recv_socket, &ss, s->audio_codec});
+                s->participants.emplace(ss, am_participant{s->recv_socket, &ss, s->audio_codec, s->channels});
         }
 
         s->participants.at(ss).last_seen = chrono::steady_clock::now();
@@ -530,7 +545,7 @@ static bool audio_play_mixer_ctl(void *state, int request, void *data, size_t *l
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 if (*len >= sizeof(struct audio_desc)) {
-                        struct audio_desc desc { BPS, SAMPLE_RATE, CHANNELS, AC_PCM };
+                        struct audio_desc desc { BPS, SAMPLE_RATE, s->channels, AC_PCM };
                         memcpy(data, &desc, sizeof desc);
                         *len = sizeof desc;
                         return true;
@@ -558,9 +573,10 @@ static bool audio_play_mixer_ctl(void *state, int request, void *data, size_t *l
         }
 }
 
-static bool audio_play_mixer_reconfigure(void *state [[gnu::unused]], struct audio_desc desc)
+static bool audio_play_mixer_reconfigure(void *state, struct audio_desc desc)
 {
-        audio_desc requested{BPS, SAMPLE_RATE, CHANNELS, AC_PCM};
+        auto *s = (struct state_audio_mixer *) state;
+        audio_desc requested{BPS, SAMPLE_RATE, s->channels, AC_PCM};
         assert(desc == requested);
         return true;
 }
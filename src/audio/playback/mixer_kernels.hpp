@@ -0,0 +1,174 @@
+/**
+ * @file   audio/playback/mixer_kernels.hpp
+ * @brief  sample mixing and normalization kernels of the audio mixer
+ */
+/*
+ * Copyright (c) 2016-2026 CESNET
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AUDIO_PLAYBACK_MIXER_KERNELS_HPP_2C4E7B19_5A3D_4F8E_9B61_D07A8C3E1F52
+#define AUDIO_PLAYBACK_MIXER_KERNELS_HPP_2C4E7B19_5A3D_4F8E_9B61_D07A8C3E1F52
+
+#include <algorithm>               // for max, min
+#include <cmath>                   // for fabs, log
+#include <cstddef>                 // for size_t
+#include <cstdint>                 // for int16_t, int32_t
+#include <limits>                  // for numeric_limits
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+typedef int16_t sample_type_source;
+typedef int32_t sample_type_mixed;
+
+/**
+ * In this mixer, no normalization takes place. After mixing and substracting each
+ * participant signal, values are clamped (there is no point doing it prior that -
+ * non-normalized mixed value can be out-of-bounds while resulting value with
+ * substracted with substracted source may be ok.
+ */
+struct linear_mix_algo {
+        static sample_type_mixed normalize(sample_type_mixed sample) {
+                // clamp the value since linear mixer doesn't normalize values
+                return std::min<sample_type_mixed>(std::max<sample_type_mixed>(sample, std::numeric_limits<sample_type_source>::min()), std::numeric_limits<sample_type_source>::max());
+        }
+#ifdef __SSE2__
+        /// normalizes 8 samples, packing with signed saturation is the clamp
+        static bool normalize_sse2(__m128i lo, __m128i hi, __m128i *out) {
+                *out = _mm_packs_epi32(lo, hi);
+                return true;
+        }
+#endif
+};
+
+/**
+ * Logarithmic mixing according to:
+ * https://www.voegler.eu/pub/audio/digital-audio-mixing-and-normalization.html
+ * Copy (as the original link doesn't seem to be present any more) can be found here:
+ * http://www.voidcn.com/blog/caohongfei881/article/p-3815311.html
+ * Threshold is 0.5.
+ */
+struct logarithmic_mix_algo {
+        static constexpr double t = 0.5;
+        static constexpr double alpha = 5.71144;
+        static constexpr sample_type_mixed thr_min = std::numeric_limits<sample_type_source>::min() / 2;
+        static constexpr sample_type_mixed thr_max = std::numeric_limits<sample_type_source>::max() / 2;
+        static sample_type_mixed normalize(sample_type_mixed sample) {
+		if (sample >= thr_min && sample <= thr_max) {
+			return sample;
+		} else {
+                        double sample_norm = (double) sample / std::numeric_limits<sample_type_source>::max();
+                        double ret = sample_norm / std::fabs(sample_norm) * (t + (1.0 - t) * std::log(1.0 + alpha * (std::fabs(sample_norm) - t) / (2 - t)) / std::log(1.0 + alpha)) * std::numeric_limits<sample_type_source>::max();
+                        return ret;
+                }
+        }
+#ifdef __SSE2__
+        /// @retval false if some of the samples is out of [thr_min, thr_max] - use normalize()
+        static bool normalize_sse2(__m128i lo, __m128i hi, __m128i *out) {
+                const __m128i vmin = _mm_set1_epi32(thr_min);
+                const __m128i vmax = _mm_set1_epi32(thr_max);
+                __m128i over = _mm_or_si128(
+                    _mm_or_si128(_mm_cmplt_epi32(lo, vmin), _mm_cmpgt_epi32(lo, vmax)),
+                    _mm_or_si128(_mm_cmplt_epi32(hi, vmin), _mm_cmpgt_epi32(hi, vmax)));
+                if (_mm_movemask_epi8(over) != 0) {
+                        return false;
+                }
+                *out = _mm_packs_epi32(lo, hi);
+                return true;
+        }
+#endif
+};
+
+#ifdef __SSE2__
+/// sign-extends 8 source samples to 2x4 mixed ones
+static inline void widen_sse2(__m128i in, __m128i *lo, __m128i *hi) {
+        *lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+        *hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+}
+#endif
+
+/// adds count samples from src to mix
+static inline void mix_add(sample_type_mixed *mix, const sample_type_source *src, size_t count) {
+        size_t i = 0;
+#ifdef __SSE2__
+        static_assert(sizeof(sample_type_source) == 2 && sizeof(sample_type_mixed) == 4);
+        for ( ; i + 8 <= count; i += 8) {
+                __m128i lo, hi;
+                widen_sse2(_mm_loadu_si128((const __m128i *)(const void *) (src + i)), &lo, &hi);
+                auto *dst = (__m128i *)(void *) (mix + i);
+                _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), lo));
+                _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), hi));
+        }
+#endif
+        for ( ; i < count; ++i) {
+                mix[i] += src[i];
+        }
+}
+
+/// replaces samples in part with normalized mix without part
+template<class algo>
+static inline void mix_minus_one(const sample_type_mixed *mix, sample_type_source *part, size_t count) {
+        size_t i = 0;
+#ifdef __SSE2__
+        for ( ; i + 8 <= count; i += 8) {
+                __m128i lo, hi;
+                auto *io = (__m128i *)(void *) (part + i);
+                widen_sse2(_mm_loadu_si128(io), &lo, &hi);
+                lo = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(const void *) (mix + i)), lo);
+                hi = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(const void *) (mix + i + 4)), hi);
+                __m128i out;
+                if (algo::normalize_sse2(lo, hi, &out)) {
+                        _mm_storeu_si128(io, out);
+                        continue;
+                }
+                for (size_t j = i; j < i + 8; ++j) {
+                        part[j] = algo::normalize(mix[j] - part[j]);
+                }
+        }
+#endif
+        for ( ; i < count; ++i) {
+                part[i] = algo::normalize(mix[i] - part[i]);
+        }
+}
+
+struct mix_kernels {
+        void (*add)(sample_type_mixed *mix, const sample_type_source *src, size_t count);
+        void (*minus_one)(const sample_type_mixed *mix, sample_type_source *part, size_t count);
+};
+
+template<class algo>
+static constexpr mix_kernels get_mix_kernels() {
+        return { mix_add, mix_minus_one<algo> };
+}
+
+#endif // defined AUDIO_PLAYBACK_MIXER_KERNELS_HPP_2C4E7B19_5A3D_4F8E_9B61_D07A8C3E1F52
@@ -41,26 +41,109 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <atomic>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+
 #include "capture_filter.h"
+#include "control_socket.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "messaging.h"
 #include "module.h"
+#include "tv.h"
 #include "utils/color_out.h"
 #include "utils/list.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
+#include "video_frame.h"
+
+#define STATS_REPORT_INTERVAL_NS NS_IN_SEC
 
 using namespace std;
 
 struct capture_filter {
         struct module mod;
         struct simple_linked_list *filters;
+        struct control_state *control;
+        time_ns_t last_stats_report;
+};
+
+namespace {
+/// counts frame data allocations done by the pool
+struct counting_allocator : public default_data_allocator {
+        explicit counting_allocator(atomic<uint64_t> *count) : count(count) {}
+        void *allocate(size_t size) override {
+                *count += 1;
+                return default_data_allocator::allocate(size);
+        }
+        struct video_frame_pool_allocator *clone() const override {
+                return new counting_allocator(*this);
+        }
+        atomic<uint64_t> *count;
+};
+} // end of anonymous namespace
+
+struct capture_filter_pool {
+        capture_filter_pool() : pool(0, counting_allocator(&allocs)) {}
+        atomic<uint64_t> allocs{0};
+        video_frame_pool pool;
+        struct video_desc desc{};
+        struct video_frame *last_frame = nullptr; ///< last handed out frame (to recognize chain-owned frames)
 };
 
 struct capture_filter_instance {
         const struct capture_filter_info *functions;
         void *state;
+        string name;
+        capture_filter_pool pool;
+
+        uint64_t frames = 0;
+        uint64_t frames_in_place = 0;
+        time_ns_t time_ns = 0;
+        uint64_t reported_allocs = 0;
 };
 
+static void destroy_instance(struct capture_filter_instance *inst)
+{
+        inst->functions->done(inst->state);
+        delete inst;
+}
+
+struct video_frame *capture_filter_get_out_frame(struct capture_filter_pool *pool,
+                struct video_desc desc, char *out_buffer)
+{
+        struct video_frame *out = nullptr;
+        if (out_buffer != nullptr) {
+                out = vf_alloc_desc(desc);
+                out->tiles[0].data = out_buffer;
+                out->callbacks.dispose = vf_free;
+                return out;
+        }
+        if (pool == nullptr) {
+                out = vf_alloc_desc(desc);
+                for (unsigned i = 0; i < desc.tile_count; ++i) {
+                        out->tiles[i].data = (char *) malloc(out->tiles[i].data_len + MAX_PADDING);
+                }
+                out->callbacks.data_deleter = vf_data_deleter;
+                out->callbacks.dispose = vf_free;
+                return out;
+        }
+
+        if (!video_desc_eq(pool->desc, desc)) {
+                pool->pool.reconfigure(desc, vc_get_datalen(desc.width, desc.height, desc.color_spec));
+                pool->desc = desc;
+        }
+        out = pool->pool.get_disposable_frame();
+        // frame may be reused, clear what previous consumers have set
+        memset(&out->VF_METADATA_START, 0, VF_METADATA_SIZE);
+        pool->last_frame = out;
+        return out;
+}
+
 static int create_filter(struct capture_filter *s, char *cfg)
 {
         bool found = false;
@@ -74,18 +157,21 @@ static int create_filter(struct capture_filter *s, char *cfg)
         for (auto && item : capture_filters) {
                 auto capture_filter_info = static_cast<const struct capture_filter_info*>(item.second);
                 if(strcasecmp(item.first.c_str(), filter_name) == 0) {
-                        struct capture_filter_instance *instance = (struct capture_filter_instance *)
-                                malloc(sizeof(struct capture_filter_instance));
+                        auto *instance = new capture_filter_instance();
                         instance->functions = capture_filter_info;
+                        instance->name = item.first;
                         int ret = capture_filter_info->init(&s->mod, options, &instance->state);
                         if(ret < 0) {
                                 fprintf(stderr, "Unable to initialize capture filter: %s\n",
                                                 filter_name);
                         }
                         if(ret != 0) {
-                                free(instance);
+                                delete instance;
                                 return ret;
                         }
+                        if (capture_filter_info->set_pool != nullptr) {
+                                capture_filter_info->set_pool(instance->state, &instance->pool);
+                        }
                         simple_linked_list_append(s->filters, instance);
                         found = true;
                         break;
@@ -123,6 +209,9 @@ int capture_filter_init(struct module *parent, const char *cfg, struct capture_f
         module_init_default(&s->mod);
         s->mod.cls = MODULE_CLASS_FILTER;
         module_register(&s->mod, parent);
+        if (parent != nullptr) {
+                s->control = (struct control_state *) get_module(get_root_module(parent), "control");
+        }
 
         if(cfg) {
                 filter_list_str = tmp = strdup(cfg);
@@ -155,8 +244,7 @@ void capture_filter_destroy(struct capture_filter *state)
 
         while(simple_linked_list_size(s->filters) > 0) {
                 struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_pop(s->filters);
-                inst->functions->done(inst->state);
-                free(inst);
+                destroy_instance(inst);
         }
 
         simple_linked_list_destroy(s->filters);
@@ -166,6 +254,48 @@ void capture_filter_destroy(struct capture_filter *state)
         free(state);
 }
 
+/**
+ * @returns counters of individual filters in format
+ * "<idx> <name> frames <n> in_place <n> avg_us <t> allocs <n>" separated by ';'
+ * @param reset  reset the counters (so that the next report covers the
+ *               interval since now), allocs are reported as increment
+ */
+static string get_stats(struct capture_filter *s, bool reset)
+{
+        ostringstream oss;
+        int idx = 0;
+        for (void *it = simple_linked_list_it_init(s->filters); it != NULL; ++idx) {
+                auto *inst = (struct capture_filter_instance *) simple_linked_list_it_next(&it);
+                uint64_t allocs = inst->pool.allocs;
+                if (idx > 0) {
+                        oss << ";";
+                }
+                oss << idx << " " << inst->name << " frames " << inst->frames
+                    << " in_place " << inst->frames_in_place << " avg_us "
+                    << (inst->frames > 0 ? inst->time_ns / inst->frames / 1000 : 0)
+                    << " allocs " << (reset ? allocs - inst->reported_allocs : allocs);
+                if (reset) {
+                        inst->frames = inst->frames_in_place = 0;
+                        inst->time_ns = 0;
+                        inst->reported_allocs = allocs;
+                }
+        }
+        return oss.str();
+}
+
+static void report_stats(struct capture_filter *s)
+{
+        if (!control_stats_enabled(s->control) || simple_linked_list_size(s->filters) == 0) {
+                return;
+        }
+        const time_ns_t now = get_time_in_ns();
+        if (now - s->last_stats_report < STATS_REPORT_INTERVAL_NS) {
+                return;
+        }
+        control_report_stats(s->control, "capture_filter " + get_stats(s, true));
+        s->last_stats_report = now;
+}
+
 static struct response *process_message(struct capture_filter *s, struct msg_universal *msg)
 {
         if (strncmp("delete ", msg->text, strlen("delete ")) == 0) {
@@ -178,19 +308,20 @@ static struct response *process_message(struct capture_filter *s, struct msg_uni
                         return new_response(RESPONSE_INT_SERV_ERR, NULL);
                 } else {
                         printf("Capture filter #%d removed successfully.\n", index);
-                        inst->functions->done(inst->state);
-                        free(inst);
+                        destroy_instance(inst);
                 }
         } else if (strcmp("flush", msg->text) == 0) {
                 while(simple_linked_list_size(s->filters) > 0) {
                         struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_pop(s->filters);
-                        inst->functions->done(inst->state);
-                        free(inst);
+                        destroy_instance(inst);
                 }
+        } else if (strcmp("stats", msg->text) == 0) {
+                return new_response(RESPONSE_OK, get_stats(s, false).c_str());
         } else if (strcmp("help", msg->text) == 0) {
                 printf("Capture filter control:\n"
                                 "\tflush      - remove all filters\n"
                                 "\tdelete <x> - delete x-th filter\n"
+                                "\tstats      - per-filter time and allocation counters\n"
                                 "\t<filter>   - append a filter named <filter>\n");
         } else {
                 char *fmt = strdup(msg->text);
@@ -218,14 +349,34 @@ struct video_frame *capture_filter(struct capture_filter *state, struct video_fr
                 free_message(msg, r);
         }
 
+        // frame is owned by the chain (returned from a filter pool), so that
+        // it can be modified in place
+        bool writable = false;
         for(void *it = simple_linked_list_it_init(s->filters);
                         it != NULL;
            ) {
                 struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_it_next(&it);
+                const time_ns_t start = get_time_in_ns();
+                inst->frames += 1;
+                if (writable && inst->functions->filter_in_place != nullptr
+                                && inst->functions->filter_in_place(inst->state, frame)) {
+                        inst->frames_in_place += 1;
+                        inst->time_ns += get_time_in_ns() - start;
+                        continue;
+                }
+                struct video_frame *in = frame;
+                inst->pool.last_frame = nullptr;
                 frame = inst->functions->filter(inst->state, frame);
+                inst->time_ns += get_time_in_ns() - start;
                 if(!frame)
                         return NULL;
+                if (frame == inst->pool.last_frame) {
+                        writable = true;
+                } else if (frame != in) {
+                        writable = false;
+                }
         }
+        report_stats(s);
         return frame;
 }
 
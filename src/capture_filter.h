@@ -38,13 +38,21 @@
 #ifndef CAPTURE_FILTER_H_
 #define CAPTURE_FILTER_H_
 
-#define CAPTURE_FILTER_ABI_VERSION 3
+#define CAPTURE_FILTER_ABI_VERSION 4
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct capture_filter;
+struct capture_filter_pool;
 struct module;
+struct video_desc;
+struct video_frame;
 
 struct capture_filter_info {
         /// @brief Initializes capture filter
@@ -67,11 +75,17 @@ struct capture_filter_info {
         /// This behavior may change towards use of shared_ptr<video_frame>
         /// in future.
         struct video_frame *(*filter)(void *state, struct video_frame *f);
+        /// @brief Passes output frame pool owned by the filter chain (optional)
+        /// Not called if the filter runs outside the chain (vo_postprocess
+        /// wrapper), pool is then NULL. See capture_filter_get_out_frame().
+        void (*set_pool)(void *state, struct capture_filter_pool *pool);
+        /// @brief Performs filtering in place (optional)
+        /// Used instead of filter() if the frame is writable (is owned by
+        /// the chain, eg. output of a previous filter).
+        /// @retval false frame cannot be processed in place, filter() is used
+        bool (*filter_in_place)(void *state, struct video_frame *f);
 };
 
-struct capture_filter;
-struct module;
-struct video_frame;
 
 /**
  * @see display_init
@@ -80,6 +94,16 @@ int capture_filter_init(struct module *parent, const char *cfg, struct capture_f
 void capture_filter_destroy(struct capture_filter *state);
 struct video_frame *capture_filter(struct capture_filter *state, struct video_frame *frame);
 
+/**
+ * @brief Returns output frame for a filter
+ *
+ * Frame data are taken from out_buffer if not NULL (vo_postprocess wrapper),
+ * otherwise from the pool (reused across frames). If pool is NULL, the data
+ * are allocated. The frame must be disposed with VIDEO_FRAME_DISPOSE().
+ */
+struct video_frame *capture_filter_get_out_frame(struct capture_filter_pool *pool,
+                struct video_desc desc, char *out_buffer);
+
 #ifdef __cplusplus
 }
 #endif
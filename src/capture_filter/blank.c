@@ -46,6 +46,10 @@
 #include "libavcodec/utils.h"
 #include "messaging.h"
 #include "module.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/parallel_conv.h"
+#include "utils/worker.h"
 
 #include "video.h"
 #include "video_codec.h"
@@ -68,9 +72,25 @@ struct state_blank {
 
         bool in_relative_units;
         bool black;
+        int threads; ///< 0 - all logical cores
 
+        struct blank_band *bands;
+        int band_count;
+};
+
+/// horizontal band of the blanked area processed by one thread
+struct blank_band {
         struct SwsContext *ctx_downscale,
                           *ctx_upscale;
+        int y;      ///< offset from the top of the area
+        int height;
+
+        // per-frame data
+        codec_t codec;
+        bool black;
+        char *orig;
+        int orig_stride;
+        int width;
 };
 
 static bool parse(struct state_blank *s, char *cfg)
@@ -108,6 +128,13 @@ static bool parse(struct state_blank *s, char *cfg)
         while ((item = strtok_r(cfg, ":", &save_ptr))) {
                 if (strcmp(item, "black") == 0) {
                         black = true;
+                } else if (strncmp(item, "threads=", strlen("threads=")) == 0) {
+                        // also set by a message, keep the old value on error
+                        const int threads = parse_thread_count(item + strlen("threads="));
+                        if (threads < 0) {
+                                return false;
+                        }
+                        s->threads = threads;
                 } else {
                         fprintf(stderr, "[Blank] Unknown config value: %s\n",
                                         item);
@@ -141,10 +168,11 @@ static int init(struct module *parent, const char *cfg, void **state)
         if (cfg && strcasecmp(cfg, "help") == 0) {
                 printf("Blanks specified rectangular area:\n\n");
                 printf("blank usage:\n");
-                printf("\tblank:x:y:widht:height[:black]\n");
+                printf("\tblank:x:y:widht:height[:black][:threads=<n>]\n");
                 printf("\t\tor\n");
-                printf("\tblank:x%%:y%%:widht%%:height%%[:black]\n");
+                printf("\tblank:x%%:y%%:widht%%:height%%[:black][:threads=<n>]\n");
                 printf("\t(all values in pixels)\n");
+                printf("\tthreads - number of threads (default 0 - all cores)\n");
                 return 1;
         }
 
@@ -169,13 +197,78 @@ static int init(struct module *parent, const char *cfg, void **state)
         return 0;
 }
 
+static void free_bands(struct state_blank *s)
+{
+        for (int i = 0; i < s->band_count; ++i) {
+                sws_freeContext(s->bands[i].ctx_downscale);
+                sws_freeContext(s->bands[i].ctx_upscale);
+        }
+        free(s->bands);
+        s->bands = NULL;
+        s->band_count = 0;
+}
+
+/**
+ * Splits the area to bands with height aligned to FACTOR, each having its
+ * own scaling contexts (those cannot be shared between threads).
+ */
+static bool create_bands(struct state_blank *s, enum AVPixelFormat av_pixfmt, int width, int height)
+{
+        free_bands(s);
+        int count = s->threads > 0 ? s->threads : get_cpu_core_count();
+        count = MAX(MIN(count, height / FACTOR), 1);
+        const int band_height = height / count / FACTOR * FACTOR;
+
+        s->bands = calloc(count, sizeof s->bands[0]);
+        s->band_count = count;
+        for (int i = 0; i < count; ++i) {
+                struct blank_band *b = &s->bands[i];
+                b->y = i * band_height;
+                b->height = i == count - 1 ? height - b->y : band_height;
+                b->ctx_downscale = sws_getContext(width, b->height, av_pixfmt,
+                                width / FACTOR, b->height / FACTOR, av_pixfmt, SWS_FAST_BILINEAR,0,0,0);
+                b->ctx_upscale = sws_getContext(width / FACTOR, b->height / FACTOR, av_pixfmt,
+                                width, b->height, av_pixfmt, SWS_FAST_BILINEAR,0,0,0);
+                if (b->ctx_downscale == NULL || b->ctx_upscale == NULL) {
+                        free_bands(s);
+                        return false;
+                }
+        }
+        return true;
+}
+
+static void *blank_band(void *arg)
+{
+        struct blank_band *b = arg;
+        char *orig = b->orig + b->y * b->orig_stride;
+        int tmp_stride = vc_get_linesize(b->width / FACTOR, b->codec);
+        size_t tmp_len = tmp_stride * (b->height / FACTOR);
+        uint8_t *tmp = (uint8_t *) malloc(tmp_len);
+        if (b->black) {
+                if (b->codec == UYVY) {
+                        unsigned char pattern[] = { 127, 0 };
+
+                        for (size_t i = 0; i < tmp_len; i += get_bpp(b->codec)) {
+                                memcpy(tmp + i, pattern, get_bpp(b->codec));
+                        }
+                } else {
+                        memset(tmp, 0, tmp_len);
+                }
+        } else {
+                sws_scale(b->ctx_downscale, (const uint8_t * const *) &orig, &b->orig_stride, 0, b->height, &tmp, &tmp_stride);
+        }
+        sws_scale(b->ctx_upscale, (const uint8_t * const *) &tmp, &tmp_stride, 0, b->height / FACTOR, (uint8_t **) &orig, &b->orig_stride);
+
+        free(tmp);
+        return NULL;
+}
+
 static void done(void *state)
 {
         struct state_blank *s = state;
         module_done(&s->mod);
 
-        sws_freeContext(s->ctx_downscale);
-        sws_freeContext(s->ctx_upscale);
+        free_bands(s);
         free(s);
 }
 
@@ -243,15 +336,7 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                         return in;
                 }
 
-                sws_freeContext(s->ctx_downscale);
-                sws_freeContext(s->ctx_upscale);
-
-                s->ctx_downscale = sws_getContext(width, height, av_pixfmt,
-                                width / FACTOR, height / FACTOR, av_pixfmt, SWS_FAST_BILINEAR,0,0,0);
-                s->ctx_upscale = sws_getContext(width / FACTOR, height / FACTOR, av_pixfmt,
-                                width, height, av_pixfmt, SWS_FAST_BILINEAR,0,0,0);
-
-                if (s->ctx_downscale == NULL || s->ctx_upscale == NULL) {
+                if (!create_bands(s, av_pixfmt, width, height)) {
                         fprintf(stderr, "Unable to initialize scaling context!");
                         return in;
                 }
@@ -269,26 +354,15 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 return in;
 
         int orig_stride = vc_get_linesize(in->tiles[0].width, in->color_spec);
-        char *orig = in->tiles[0].data + x * bpp + y * orig_stride;
-        int tmp_stride = vc_get_linesize(width / FACTOR, in->color_spec);
-        size_t tmp_len = tmp_stride * (height / FACTOR);
-        uint8_t *tmp = (uint8_t *) malloc(tmp_len);
-        if (s->black) {
-                if (codec == UYVY) {
-                        unsigned char pattern[] = { 127, 0 };
-
-                        for (size_t i = 0; i < tmp_len; i += get_bpp(codec)) {
-                                memcpy(tmp + i, pattern, get_bpp(codec));
-                        }
-                } else {
-                        memset(tmp, 0, tmp_len);
-                }
-        } else {
-                sws_scale(s->ctx_downscale, (const uint8_t * const *) &orig, &orig_stride, 0, height, &tmp, &tmp_stride);
+        for (int i = 0; i < s->band_count; ++i) {
+                struct blank_band *b = &s->bands[i];
+                b->codec = codec;
+                b->black = s->black;
+                b->orig = in->tiles[0].data + x * bpp + y * orig_stride;
+                b->orig_stride = orig_stride;
+                b->width = width;
         }
-        sws_scale(s->ctx_upscale, (const uint8_t * const *) &tmp, &tmp_stride, 0, height / FACTOR, (uint8_t **) &orig, &orig_stride);
-
-        free(tmp);
+        task_run_parallel(blank_band, s->band_count, s->bands, sizeof s->bands[0], NULL);
 
         return in;
 }
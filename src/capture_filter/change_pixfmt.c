@@ -61,6 +61,7 @@ struct state_capture_filter_change_pixfmt {
         uint32_t magic;
         codec_t to_codec;
         void *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        struct capture_filter_pool *pool;
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
@@ -103,14 +104,7 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to find decoder!\n");
                 return NULL;
         }
-        struct video_frame *out = vf_alloc_desc(desc);
-        if (s->vo_pp_out_buffer) {
-                out->tiles[0].data = s->vo_pp_out_buffer;
-        } else {
-                out->tiles[0].data = malloc(out->tiles[0].data_len + MAX_PADDING);
-                out->callbacks.data_deleter = vf_data_deleter;
-        }
-        out->callbacks.dispose = vf_free;
+        struct video_frame *out = capture_filter_get_out_frame(s->pool, desc, s->vo_pp_out_buffer);
 
         unsigned char *in_data = (unsigned char *) in->tiles[0].data;
         unsigned char *out_data = (unsigned char *) out->tiles[0].data;
@@ -129,6 +123,12 @@ static struct video_frame *filter(void *state, struct video_frame *in)
 }
 
 
+static void set_pool(void *state, struct capture_filter_pool *pool)
+{
+        struct state_capture_filter_change_pixfmt *s = state;
+        s->pool = pool;
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         struct state_capture_filter_change_pixfmt *s = state;
@@ -139,6 +139,7 @@ static const struct capture_filter_info capture_filter_change_pixfmt = {
         .init = init,
         .done = done,
         .filter = filter,
+        .set_pool = set_pool,
 };
 
 static bool
@@ -45,6 +45,8 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/parallel_conv.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -55,16 +57,35 @@ static struct video_frame *filter(void *state, struct video_frame *in);
 
 struct state_flip {
         char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        struct capture_filter_pool *pool;
+        int threads; ///< 0 - all logical cores
+};
+
+struct flip_data {
+        char *out; ///< NULL if flipping in place
+        char *in;
+        int linesize;
+        int height;
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
 {
         UNUSED(parent);
-        if (strlen(cfg) > 0) {
-                color_printf(TRED(TBOLD("flip")) " capture filter flips the video vertically (across horizontal axis), takes no arguments\n");
+        int threads = 0;
+        if (strncmp(cfg, "threads=", strlen("threads=")) == 0) {
+                threads = parse_thread_count(cfg + strlen("threads="));
+                if (threads < 0) {
+                        return -1;
+                }
+        } else if (strlen(cfg) > 0) {
+                color_printf(TRED(TBOLD("flip")) " capture filter flips the video vertically (across horizontal axis)\n\n");
+                color_printf("usage:\n\t" TBOLD("flip[:threads=<n>]") "\n");
+                color_printf("where " TBOLD("threads") " is number of threads (default 0 - all cores)\n");
                 return strcmp(cfg, "help") == 0 ? 1 : -1;
         }
-        *state = calloc(1, sizeof(struct state_flip));
+        struct state_flip *s = calloc(1, sizeof(struct state_flip));
+        s->threads = threads;
+        *state = s;
         return 0;
 }
 
@@ -73,31 +94,68 @@ static void done(void *state)
         free(state);
 }
 
+/**
+ * If flipping in place, rows are the upper half rows that are swapped with
+ * the bottom ones.
+ */
+static void flip_rows(int start_row, int end_row, void *udata)
+{
+        struct flip_data *d = udata;
+        for (int y = start_row; y < end_row; ++y) {
+                char *src = d->in + (size_t) y * d->linesize;
+                char *dst = (d->out ? d->out : d->in) + (size_t) (d->height - y - 1) * d->linesize;
+                if (d->out) {
+                        memcpy(dst, src, d->linesize);
+                        continue;
+                }
+                char tmp[1024];
+                for (int x = 0; x < d->linesize; x += sizeof tmp) {
+                        size_t len = MIN((size_t) (d->linesize - x), sizeof tmp);
+                        memcpy(tmp, src + x, len);
+                        memcpy(src + x, dst + x, len);
+                        memcpy(dst + x, tmp, len);
+                }
+        }
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_flip *s = state;
-        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
-        if (s->vo_pp_out_buffer) {
-                out->tiles[0].data = s->vo_pp_out_buffer;
-        } else {
-                out->tiles[0].data = (char *) (malloc(out->tiles[0].data_len));
-                out->callbacks.data_deleter = vf_data_deleter;
-        }
-        out->callbacks.dispose = vf_free;
+        struct video_frame *out = capture_filter_get_out_frame(s->pool,
+                        video_desc_from_frame(in), s->vo_pp_out_buffer);
 
-        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
-        unsigned char *out_data = (unsigned char *) out->tiles[0].data;
-
-        int linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
-        for (unsigned int y = 0; y < in->tiles[0].height; ++y) {
-                memcpy(out_data + (in->tiles[0].height - y - 1) * linesize, in_data + y * linesize, linesize);
-        }
+        struct flip_data data = {
+                out->tiles[0].data,
+                in->tiles[0].data,
+                vc_get_linesize(in->tiles[0].width, in->color_spec),
+                in->tiles[0].height
+        };
+        parallel_rows(in->tiles[0].height, 1, flip_rows, &data, s->threads);
 
         VIDEO_FRAME_DISPOSE(in);
 
         return out;
 }
 
+static bool filter_in_place(void *state, struct video_frame *f)
+{
+        struct state_flip *s = state;
+        struct flip_data data = {
+                NULL,
+                f->tiles[0].data,
+                vc_get_linesize(f->tiles[0].width, f->color_spec),
+                f->tiles[0].height
+        };
+        parallel_rows(f->tiles[0].height / 2, 1, flip_rows, &data, s->threads);
+        return true;
+}
+
+static void set_pool(void *state, struct capture_filter_pool *pool)
+{
+        struct state_flip *s = state;
+        s->pool = pool;
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         struct state_flip *s = state;
@@ -108,6 +166,8 @@ static const struct capture_filter_info capture_filter_flip = {
         .init = init,
         .done = done,
         .filter = filter,
+        .set_pool = set_pool,
+        .filter_in_place = filter_in_place,
 };
 
 REGISTER_MODULE(flip, &capture_filter_flip, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -41,6 +41,7 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <climits>
 #include <iostream>
 #include <stdexcept>
 #include <thread>
@@ -50,7 +51,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
-#include "utils/worker.h"
+#include "utils/parallel_conv.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -61,14 +62,14 @@ using std::cout;
 using std::exception;
 using std::numeric_limits;
 using std::vector;
-using std::thread;
 
 struct state_capture_filter_gamma {
 public:
         int out_depth; ///< 0, 8 or 16 (0 menas keep)
+        int threads; ///< 0 - all logical cores
         void *vo_pp_out_buffer{}; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
 
-        explicit state_capture_filter_gamma(double gamma, int out_depth) : out_depth(out_depth) {
+        explicit state_capture_filter_gamma(double gamma, int out_depth, int threads) : out_depth(out_depth), threads(threads) {
                 for (int i = 0; i <= numeric_limits<uint8_t>::max(); ++i) { // 8->8
                         lut8.push_back(pow(static_cast<double>(i)
                                         / numeric_limits<uint8_t>::max(), gamma)
@@ -91,15 +92,16 @@ public:
                 }
         }
 
-        void apply_gamma(int in_depth, int out_depth, size_t in_len, void const * __restrict in, void * __restrict out) {
+        /// @param samples_per_line  number of components in a line (width * 3)
+        void apply_gamma(int in_depth, int out_depth, int height, size_t samples_per_line, void const * __restrict in, void * __restrict out) {
                 if (in_depth == CHAR_BIT && out_depth == CHAR_BIT) {
-                        apply_lut<uint8_t, uint8_t>(in_len, lut8, in, out);
+                        apply_lut<uint8_t, uint8_t>(height, samples_per_line, lut8, in, out);
                 } else if (in_depth == 2 * CHAR_BIT && out_depth == 2 * CHAR_BIT) {
-                        apply_lut<uint16_t, uint16_t>(in_len, lut16, in, out);
+                        apply_lut<uint16_t, uint16_t>(height, samples_per_line, lut16, in, out);
                 } else if (in_depth == CHAR_BIT && out_depth == 2 * CHAR_BIT) {
-                        apply_lut<uint8_t, uint16_t>(in_len, lut8_16, in, out);
+                        apply_lut<uint8_t, uint16_t>(height, samples_per_line, lut8_16, in, out);
                 } else if (in_depth == 2 * CHAR_BIT && out_depth == CHAR_BIT) {
-                        apply_lut<uint16_t, uint8_t>(in_len, lut16_8, in, out);
+                        apply_lut<uint16_t, uint8_t>(height, samples_per_line, lut16_8, in, out);
                 } else {
                         throw exception();
                 }
@@ -108,38 +110,24 @@ public:
 private:
         template<typename inT, typename outT>
         struct data {
-                size_t len;
+                size_t samples_per_line;
                 const vector<outT> &lut;
                 const inT *in;
                 outT *out;
         };
 
         template<typename inT, typename outT>
-        static void *compute(void *arg) {
+        static void compute(int start_row, int end_row, void *arg) {
                 auto *d = static_cast<struct data<inT, outT> *>(arg);
-                for (size_t i = 0; i < d->len; ++i) {
+                for (size_t i = start_row * d->samples_per_line; i < end_row * d->samples_per_line; ++i) {
                         d->out[i] = d->lut[d->in[i]];
                 }
-                return nullptr;
         }
 
-        template<typename inT, typename outT> void apply_lut(size_t in_len, const vector<outT> &lut, void const *in, void *out)
+        template<typename inT, typename outT> void apply_lut(int height, size_t samples_per_line, const vector<outT> &lut, void const *in, void *out)
         {
-                auto *in_data = static_cast<const inT*>(in);
-                auto *out_data = static_cast<outT*>(out);
-                unsigned int cpus = thread::hardware_concurrency();
-                in_len /= sizeof(inT);
-                vector<data<inT, outT>> d;
-                vector<task_result_handle_t> handles(cpus);
-                for (unsigned int i = 0; i < cpus; i++) {
-                        d.push_back({in_len / cpus, lut, in_data + i * (in_len / cpus), out_data + i * (in_len / cpus)});
-                }
-                for (unsigned int i = 0; i < cpus; i++) {
-                        handles[i] = task_run_async(state_capture_filter_gamma::compute<inT, outT>, static_cast<void *>(&(d[i])));
-                }
-                for (unsigned int i = 0; i < cpus; i++) {
-                        wait_task(handles[i]);
-                }
+                data<inT, outT> d{samples_per_line, lut, static_cast<const inT*>(in), static_cast<outT*>(out)};
+                parallel_rows(height, 1, state_capture_filter_gamma::compute<inT, outT>, &d, threads);
         }
 
         vector<uint8_t>  lut8;
@@ -155,10 +143,12 @@ static auto init(struct module *parent, const char *cfg, void **state)
         if (strlen(cfg) == 0 || strcmp(cfg, "help") == 0) {
                 col() << "Performs gamma transformation.\n\n"
                        "usage:\n";
-                col() << "\t" << SBOLD("-F gamma:value[:8|:16]") << "\n";
+                col() << "\t" << SBOLD("-F gamma:value[:8|:16][:threads=<n>]") << "\n";
                 col() << "where:\n";
                 col() << SBOLD("8|16")
                      << " - force output to 8 (16) bits regardless the input\n";
+                col() << SBOLD("threads")
+                     << " - number of threads (default 0 - all cores)\n";
                 return 1;
         }
         char *endptr = nullptr;
@@ -170,17 +160,31 @@ static auto init(struct module *parent, const char *cfg, void **state)
         }
 
         long int bits = 0;
-        if (*endptr != '\0') {
+        int threads = 0;
+        while (*endptr != '\0') {
                 endptr += 1;
-                errno = 0;
-                bits = strtol(endptr, &endptr, 0);
-                if ((bits != 8 && bits != 16) || *endptr != '\0') {
-                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong number of bits (only 8 or 16)!\n";
+                if (strncmp(endptr, "threads=", strlen("threads=")) == 0) {
+                        const char *val = endptr + strlen("threads=");
+                        const long count = strtol(val, &endptr, 10);
+                        if (endptr == val || count < 0 || count > INT_MAX) {
+                                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong thread count: " << val << "\n";
+                                return -1;
+                        }
+                        threads = (int) count;
+                } else {
+                        bits = strtol(endptr, &endptr, 0);
+                        if (bits != 8 && bits != 16) {
+                                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong number of bits (only 8 or 16)!\n";
+                                return -1;
+                        }
+                }
+                if (*endptr != '\0' && *endptr != ':') {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong option: " << endptr << "\n";
                         return -1;
                 }
         }
 
-        auto *s = new state_capture_filter_gamma(gamma, bits);
+        auto *s = new state_capture_filter_gamma(gamma, bits, threads);
 
         *state = s;
         return 0;
@@ -214,7 +218,8 @@ static auto filter(void *state, struct video_frame *in) -> video_frame *
         out->callbacks.dispose = vf_free;
 
         try {
-                s->apply_gamma(get_bits_per_component(in->color_spec), get_bits_per_component(out_desc.color_spec), in->tiles[0].data_len, in->tiles[0].data, out->tiles[0].data);
+                s->apply_gamma(get_bits_per_component(in->color_spec), get_bits_per_component(out_desc.color_spec),
+                                in->tiles[0].height, 3 * static_cast<size_t>(in->tiles[0].width), in->tiles[0].data, out->tiles[0].data);
         } catch(...) {
                 LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Only 8-bit and 16-bit codecs are currently supported!\n";
                 vf_free(out);
@@ -236,6 +241,8 @@ static const struct capture_filter_info capture_filter_gamma = {
         .init = init,
         .done = done,
         .filter = filter,
+        .set_pool = nullptr,
+        .filter_in_place = nullptr,
 };
 
 REGISTER_MODULE(gamma, &capture_filter_gamma, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -45,6 +45,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/parallel_conv.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -55,16 +56,34 @@ static struct video_frame *filter(void *state, struct video_frame *in);
 
 struct state_grayscale {
         char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        struct capture_filter_pool *pool;
+        int threads; ///< 0 - all logical cores
+};
+
+struct grayscale_data {
+        unsigned char *out;
+        const unsigned char *in;
+        int linesize;
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
 {
         UNUSED(parent);
-        if (strlen(cfg) > 0) {
-                color_printf(TRED(TBOLD("grayscale")) " converts image to grayscale, takes no arguments\n");
+        int threads = 0;
+        if (strncmp(cfg, "threads=", strlen("threads=")) == 0) {
+                threads = parse_thread_count(cfg + strlen("threads="));
+                if (threads < 0) {
+                        return -1;
+                }
+        } else if (strlen(cfg) > 0) {
+                color_printf(TRED(TBOLD("grayscale")) " converts image to grayscale\n\n");
+                color_printf("usage:\n\t" TBOLD("grayscale[:threads=<n>]") "\n");
+                color_printf("where " TBOLD("threads") " is number of threads (default 0 - all cores)\n");
                 return strcmp(cfg, "help") == 0 ? 1 : -1;
         }
-        *state = calloc(1, sizeof(struct state_grayscale));
+        struct state_grayscale *s = calloc(1, sizeof(struct state_grayscale));
+        s->threads = threads;
+        *state = s;
         return 0;
 }
 
@@ -73,6 +92,18 @@ static void done(void *state)
         free(state);
 }
 
+/// also works in place (out == in)
+static void grayscale_rows(int start_row, int end_row, void *udata)
+{
+        struct grayscale_data *d = udata;
+        const unsigned char *in = d->in + (size_t) start_row * d->linesize;
+        unsigned char *out = d->out + (size_t) start_row * d->linesize;
+        for (int i = 0; i < (end_row - start_row) * d->linesize; i += 2) {
+                out[i] = 127;
+                out[i + 1] = in[i + 1];
+        }
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_grayscale *s = state;
@@ -81,29 +112,42 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 log_msg(LOG_LEVEL_WARNING, "Cannot create grayscale from other codec than UYVY!\n");
                 return in;
         }
-        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
-        if (s->vo_pp_out_buffer) {
-                out->tiles[0].data = s->vo_pp_out_buffer;
-        } else {
-                out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
-        }
-        out->callbacks.dispose = vf_free;
+        struct video_frame *out = capture_filter_get_out_frame(s->pool,
+                        video_desc_from_frame(in), s->vo_pp_out_buffer);
 
-        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
-        unsigned char *out_data = (unsigned char *) out->tiles[0].data;
-
-        for (unsigned int i = 0; i < in->tiles[0].width * in->tiles[0].height; ++i) {
-                *out_data++ = 127;
-                in_data++;
-                *out_data++ = *in_data++;
-        }
+        struct grayscale_data data = {
+                (unsigned char *) out->tiles[0].data,
+                (const unsigned char *) in->tiles[0].data,
+                vc_get_linesize(in->tiles[0].width, in->color_spec)
+        };
+        parallel_rows(in->tiles[0].height, 1, grayscale_rows, &data, s->threads);
 
         VIDEO_FRAME_DISPOSE(in);
 
         return out;
 }
 
+static bool filter_in_place(void *state, struct video_frame *f)
+{
+        struct state_grayscale *s = state;
+        if (f->color_spec != UYVY) {
+                return false;
+        }
+        struct grayscale_data data = {
+                (unsigned char *) f->tiles[0].data,
+                (const unsigned char *) f->tiles[0].data,
+                vc_get_linesize(f->tiles[0].width, f->color_spec)
+        };
+        parallel_rows(f->tiles[0].height, 1, grayscale_rows, &data, s->threads);
+        return true;
+}
+
+static void set_pool(void *state, struct capture_filter_pool *pool)
+{
+        struct state_grayscale *s = state;
+        s->pool = pool;
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         struct state_grayscale *s = state;
@@ -115,6 +159,8 @@ static const struct capture_filter_info capture_filter_grayscale = {
         .init = init,
         .done = done,
         .filter = filter,
+        .set_pool = set_pool,
+        .filter_in_place = filter_in_place,
 };
 
 REGISTER_MODULE(grayscale, &capture_filter_grayscale, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -233,6 +233,8 @@ static const struct capture_filter_info capture_filter_logo = {
         init,
         done,
         filter,
+        NULL,
+        NULL,
 };
 
 REGISTER_MODULE(logo, &capture_filter_logo, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -60,6 +60,7 @@ struct state_capture_filter_matrix {
         double transform_matrix[9];
         bool check_bounds;
         void *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        struct capture_filter_pool *pool;
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
@@ -130,14 +131,7 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         if (in->color_spec == UYVY) {
                 desc.color_spec = RGB;
         }
-        struct video_frame *out = vf_alloc_desc(desc);
-        if (s->vo_pp_out_buffer) {
-                out->tiles[0].data = s->vo_pp_out_buffer;
-        } else {
-                out->tiles[0].data = malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
-        }
-        out->callbacks.dispose = vf_free;
+        struct video_frame *out = capture_filter_get_out_frame(s->pool, desc, s->vo_pp_out_buffer);
 
         if (s->check_bounds) {
                 if (in->color_spec == UYVY) {
@@ -223,7 +217,7 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 } else {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Only UYVY, RGB or RG48 is currently supported!\n");
                         VIDEO_FRAME_DISPOSE(in);
-                        vf_free(out);
+                        VIDEO_FRAME_DISPOSE(out);
                         return NULL;
                 }
         } else {
@@ -298,7 +292,7 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 } else {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Only UYVY, RGB or RG48 is currently supported!\n");
                         VIDEO_FRAME_DISPOSE(in);
-                        vf_free(out);
+                        VIDEO_FRAME_DISPOSE(out);
                         return NULL;
                 }
         }
@@ -308,6 +302,12 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         return out;
 }
 
+static void set_pool(void *state, struct capture_filter_pool *pool)
+{
+        struct state_capture_filter_matrix *s = state;
+        s->pool = pool;
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         struct state_capture_filter_matrix *s = state;
@@ -318,6 +318,7 @@ static const struct capture_filter_info capture_filter_matrix = {
         .init = init,
         .done = done,
         .filter = filter,
+        .set_pool = set_pool,
 };
 
 REGISTER_MODULE(matrix, &capture_filter_matrix, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -53,6 +53,7 @@
 #include "types.h"                                  // for tile, video_frame
 #include "utils/color_out.h"                        // for color_printf, TBOLD
 #include "utils/macros.h"                           // for STR_LEN, snprintf_ch
+#include "utils/parallel_conv.h"                    // for parallel_rows
 #include "video_codec.h"                            // for vc_get_linesize
 #include "video_frame.h"                            // for vf_alloc_desc
 #include "vo_postprocess/capture_filter_wrapper.h"  // for ADD_VO_PP_CAPTURE...
@@ -75,6 +76,8 @@ struct state_capture_filter_matrix2 {
         double transform_matrix[MATRIX_VOL];
         void  *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper
                                  ///< (otherwise unused)
+        struct capture_filter_pool *pool;
+        int    threads; ///< 0 - all logical cores
         void  *y416_tmp_buffer;
         size_t y416_tmp_buffer_sz;
 };
@@ -86,13 +89,15 @@ usage(void)
             "matrix2") " performs matrix transformation on input "
                        "pixels.\n\n"
                        "usage:\n");
-        color_printf(TBOLD("\t-F/-p matrix2:a:b:c:d:e:f:g:h:i\n"));
+        color_printf(TBOLD("\t-F/-p matrix2:a:b:c:d:e:f:g:h:i[:threads=<n>]\n"));
         color_printf("or\n\t");
-        color_printf(TBOLD("-F/-p matrix2:y601_to_y709") "\n");
+        color_printf(TBOLD("-F/-p matrix2:y601_to_y709[:threads=<n>]") "\n");
         color_printf("\nwhere numbers a-i are members of 3x3 transformation "
                      "matrix [a b c; d e f; g h i], decimals.\n"
                      "Coefficients are applied to unpacked pixels (eg. on Y Cb "
                      "and Cr channels of UYVY).\n");
+        color_printf(TBOLD("threads") " is number of threads (default 0 - all "
+                                      "cores).\n");
         color_printf("\n" TBOLD("Note: ") "Currently only " TBOLD(
             "YCbCr") " codecs are supported. "
                      "Let us know if interested in " TBOLD("RGB") " ones.\n");
@@ -109,11 +114,23 @@ parse_fmt(struct state_capture_filter_matrix2 *s, char *cfg)
         char *tmp      = cfg;
         int   i        = 0;
         while ((item = strtok_r(tmp, ":", &save_ptr)) != NULL) {
+                tmp = NULL;
+                if (strncmp(item, "threads=", strlen("threads=")) == 0) {
+                        s->threads = parse_thread_count(item + strlen("threads="));
+                        if (s->threads < 0) {
+                                return false;
+                        }
+                        continue;
+                }
                 if (i == 0 && strcmp(item, "y601_to_y709") == 0) {
                         memcpy(s->transform_matrix, y601_y709_matrix,
                                sizeof y601_y709_matrix);
                         i = MATRIX_VOL;
-                        break;
+                        continue;
+                }
+                if (i == MATRIX_VOL) {
+                        MSG(ERROR, "Excess initializer given: %s\n", item);
+                        return false;
                 }
                 char *endptr             = NULL;
                 errno                    = 0;
@@ -121,7 +138,6 @@ parse_fmt(struct state_capture_filter_matrix2 *s, char *cfg)
                 if (errno != 0 || *endptr != '\0') {
                         MSG(WARNING, "Problem converting number %s\n", item);
                 }
-                tmp = NULL;
         }
 
         if (i != MATRIX_VOL) {
@@ -163,14 +179,27 @@ done(void *state)
         free(state);
 }
 
+struct matrix2_data {
+        struct state_capture_filter_matrix2 *s;
+        struct video_frame *in;
+        struct video_frame *out;
+        decoder_t from; ///< to Y416 (convert_apply_y416 only)
+        decoder_t to;   ///< from Y416 (convert_apply_y416 only)
+};
+
 static void
-apply_to_uyvy(struct state_capture_filter_matrix2 *s, struct video_frame *in,
-             struct video_frame *out)
+apply_to_uyvy(int start_row, int end_row, void *udata)
 {
-        unsigned char *in_data  = (unsigned char *) in->tiles[0].data;
-        unsigned char *out_data = (unsigned char *) out->tiles[0].data;
+        struct matrix2_data                 *d = udata;
+        struct state_capture_filter_matrix2 *s = d->s;
+        const size_t                         linesize =
+            vc_get_linesize(d->in->tiles[0].width, d->in->color_spec);
+        unsigned char *in_data =
+            (unsigned char *) d->in->tiles[0].data + start_row * linesize;
+        unsigned char *out_data =
+            (unsigned char *) d->out->tiles[0].data + start_row * linesize;
 
-        for (unsigned int i = 0; i < in->tiles[0].data_len; i += 4) {
+        for (size_t i = 0; i < (end_row - start_row) * linesize; i += 4) {
                 double u  = *in_data++ - 128;
                 double y1 = *in_data++ - 16;
                 double v  = *in_data++ - 128;
@@ -195,27 +224,25 @@ apply_to_uyvy(struct state_capture_filter_matrix2 *s, struct video_frame *in,
         }
 }
 
-static bool
-convert_apply_y416(struct state_capture_filter_matrix2 *s,
-                   struct video_frame *in, struct video_frame *out)
+static void
+apply_y416(int start_row, int end_row, void *udata)
 {
-        decoder_t from = get_decoder_from_to(in->color_spec, Y416);
-        decoder_t to   = get_decoder_from_to(Y416, in->color_spec);
-        if (from == NULL || to == NULL) {
-                return false;
-        }
+        struct matrix2_data                 *d = udata;
+        struct state_capture_filter_matrix2 *s = d->s;
+        const size_t in_linesize =
+            vc_get_linesize(d->in->tiles[0].width, d->in->color_spec);
+        const size_t y416_linesize =
+            vc_get_linesize(d->in->tiles[0].width, Y416);
+        const size_t rows = end_row - start_row;
+        unsigned char *tmp =
+            (unsigned char *) s->y416_tmp_buffer + start_row * y416_linesize;
 
-        const size_t tmp_len =
-            vc_get_datalen(in->tiles[0].width, in->tiles[0].height, Y416);
-        if (s->y416_tmp_buffer_sz <= tmp_len) {
-                free(s->y416_tmp_buffer);
-                s->y416_tmp_buffer    = malloc(tmp_len);
-                s->y416_tmp_buffer_sz = tmp_len;
-        }
-        from((unsigned char *) s->y416_tmp_buffer,
-             (unsigned char *) in->tiles[0].data, (int) tmp_len, 0, 0, 0);
-        uint16_t *data = s->y416_tmp_buffer;
-        for (unsigned int i = 0; i < tmp_len; i += 8) {
+        d->from(tmp,
+                (unsigned char *) d->in->tiles[0].data +
+                    start_row * in_linesize,
+                (int) (rows * y416_linesize), 0, 0, 0);
+        uint16_t *data = (uint16_t *) (void *) tmp;
+        for (size_t i = 0; i < rows * y416_linesize; i += 8) {
                 double u = data[0] - (1 << 15);
                 double y = data[1] - (1 << 12);
                 double v = data[2] - (1 << 15);
@@ -235,9 +262,32 @@ convert_apply_y416(struct state_capture_filter_matrix2 *s,
                 *data++ = 0xFFFF;
         }
 
-        to((unsigned char *) out->tiles[0].data,
-           (unsigned char *) s->y416_tmp_buffer, (int) tmp_len, DEFAULT_R_SHIFT,
-           DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+        d->to((unsigned char *) d->out->tiles[0].data +
+                  start_row * in_linesize,
+              tmp, (int) (rows * in_linesize), DEFAULT_R_SHIFT,
+              DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+}
+
+static bool
+convert_apply_y416(struct state_capture_filter_matrix2 *s,
+                   struct video_frame *in, struct video_frame *out)
+{
+        struct matrix2_data d = { s, in, out,
+                                  get_decoder_from_to(in->color_spec, Y416),
+                                  get_decoder_from_to(Y416, in->color_spec) };
+        if (d.from == NULL || d.to == NULL) {
+                return false;
+        }
+
+        const size_t tmp_len =
+            vc_get_datalen(in->tiles[0].width, in->tiles[0].height, Y416);
+        if (s->y416_tmp_buffer_sz <= tmp_len) {
+                free(s->y416_tmp_buffer);
+                s->y416_tmp_buffer    = malloc(tmp_len);
+                s->y416_tmp_buffer_sz = tmp_len;
+        }
+        parallel_rows((int) in->tiles[0].height, 1, apply_y416, &d,
+                      s->threads);
         return true;
 }
 
@@ -246,17 +296,13 @@ filter(void *state, struct video_frame *in)
 {
         struct state_capture_filter_matrix2 *s = state;
         struct video_desc desc = video_desc_from_frame(in);
-        struct video_frame *out = vf_alloc_desc(desc);
-        if (s->vo_pp_out_buffer) {
-                out->tiles[0].data = s->vo_pp_out_buffer;
-        } else {
-                out->tiles[0].data = malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
-        }
-        out->callbacks.dispose = vf_free;
+        struct video_frame *out =
+            capture_filter_get_out_frame(s->pool, desc, s->vo_pp_out_buffer);
 
         if (in->color_spec == UYVY) {
-                apply_to_uyvy(s, in, out);
+                struct matrix2_data d = { s, in, out, NULL, NULL };
+                parallel_rows((int) in->tiles[0].height, 1, apply_to_uyvy,
+                              &d, s->threads);
         } else {
                 if (codec_is_a_rgb(in->color_spec) ||
                     !convert_apply_y416(s, in, out)) {
@@ -273,6 +319,13 @@ filter(void *state, struct video_frame *in)
         return out;
 }
 
+static void
+set_pool(void *state, struct capture_filter_pool *pool)
+{
+        struct state_capture_filter_matrix2 *s = state;
+        s->pool                                = pool;
+}
+
 static void
 vo_pp_set_out_buffer(void *state, char *buffer)
 {
@@ -281,9 +334,10 @@ vo_pp_set_out_buffer(void *state, char *buffer)
 }
 
 static const struct capture_filter_info capture_filter_matrix2 = {
-        .init   = init,
-        .done   = done,
-        .filter = filter,
+        .init     = init,
+        .done     = done,
+        .filter   = filter,
+        .set_pool = set_pool,
 };
 
 REGISTER_MODULE(matrix2, &capture_filter_matrix2, LIBRARY_CLASS_CAPTURE_FILTER,
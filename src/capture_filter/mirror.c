@@ -45,6 +45,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/parallel_conv.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -55,16 +56,34 @@ static struct video_frame *filter(void *state, struct video_frame *in);
 
 struct state_mirror {
         char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        struct capture_filter_pool *pool;
+        int threads; ///< 0 - all logical cores
+};
+
+struct mirror_data {
+        unsigned char *out; ///< NULL if mirroring in place
+        unsigned char *in;
+        int linesize;
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
 {
         UNUSED(parent);
-        if (strlen(cfg) > 0) {
-                color_printf(TRED(TBOLD("mirror")) " capture filter flips the video horizontally (across vertical axis), takes no arguments\n");
+        int threads = 0;
+        if (strncmp(cfg, "threads=", strlen("threads=")) == 0) {
+                threads = parse_thread_count(cfg + strlen("threads="));
+                if (threads < 0) {
+                        return -1;
+                }
+        } else if (strlen(cfg) > 0) {
+                color_printf(TRED(TBOLD("mirror")) " capture filter flips the video horizontally (across vertical axis)\n\n");
+                color_printf("usage:\n\t" TBOLD("mirror[:threads=<n>]") "\n");
+                color_printf("where " TBOLD("threads") " is number of threads (default 0 - all cores)\n");
                 return strcmp(cfg, "help") == 0 ? 1 : -1;
         }
-        *state = calloc(1, sizeof(struct state_mirror));
+        struct state_mirror *s = calloc(1, sizeof(struct state_mirror));
+        s->threads = threads;
+        *state = s;
         return 0;
 }
 
@@ -92,6 +111,44 @@ static void mirror_line_UYVY(unsigned char *dst, const unsigned char *src, int l
         }
 }
 
+/// swaps UYVY macropixels from both ends of the line (including Y order)
+static void mirror_line_UYVY_in_place(unsigned char *line, int linesize)
+{
+        unsigned char *left = line;
+        unsigned char *right = line + linesize - 4;
+        while (left < right) {
+                unsigned char l[4] = { left[0], left[1], left[2], left[3] };
+                left[0] = right[0];
+                left[1] = right[3];
+                left[2] = right[2];
+                left[3] = right[1];
+                right[0] = l[0];
+                right[1] = l[3];
+                right[2] = l[2];
+                right[3] = l[1];
+                left += 4;
+                right -= 4;
+        }
+        if (left == right) { // middle macropixel
+                unsigned char y1 = left[1];
+                left[1] = left[3];
+                left[3] = y1;
+        }
+}
+
+static void mirror_rows(int start_row, int end_row, void *udata)
+{
+        struct mirror_data *d = udata;
+        for (int y = start_row; y < end_row; ++y) {
+                if (d->out == NULL) {
+                        mirror_line_UYVY_in_place(d->in + (size_t) y * d->linesize, d->linesize);
+                } else {
+                        mirror_line_UYVY(d->out + (size_t) y * d->linesize,
+                                        d->in + (size_t) y * d->linesize, d->linesize);
+                }
+        }
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_mirror *s = state;
@@ -101,28 +158,42 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 return in;
         }
 
-        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
-        if (s->vo_pp_out_buffer) {
-                out->tiles[0].data = s->vo_pp_out_buffer;
-        } else {
-                out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
-        }
-        out->callbacks.dispose = vf_free;
+        struct video_frame *out = capture_filter_get_out_frame(s->pool,
+                        video_desc_from_frame(in), s->vo_pp_out_buffer);
 
-        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
-        unsigned char *out_data = (unsigned char *) out->tiles[0].data;
-
-        int linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
-        for (unsigned int y = 0; y < in->tiles[0].height; ++y) {
-                mirror_line_UYVY(out_data + y * linesize, in_data + y * linesize, linesize);
-        }
+        struct mirror_data data = {
+                (unsigned char *) out->tiles[0].data,
+                (unsigned char *) in->tiles[0].data,
+                vc_get_linesize(in->tiles[0].width, in->color_spec)
+        };
+        parallel_rows(in->tiles[0].height, 1, mirror_rows, &data, s->threads);
 
         VIDEO_FRAME_DISPOSE(in);
 
         return out;
 }
 
+static bool filter_in_place(void *state, struct video_frame *f)
+{
+        struct state_mirror *s = state;
+        if (f->color_spec != UYVY) {
+                return false;
+        }
+        struct mirror_data data = {
+                NULL,
+                (unsigned char *) f->tiles[0].data,
+                vc_get_linesize(f->tiles[0].width, f->color_spec)
+        };
+        parallel_rows(f->tiles[0].height, 1, mirror_rows, &data, s->threads);
+        return true;
+}
+
+static void set_pool(void *state, struct capture_filter_pool *pool)
+{
+        struct state_mirror *s = state;
+        s->pool = pool;
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         struct state_mirror *s = state;
@@ -133,6 +204,8 @@ static const struct capture_filter_info capture_filter_mirror = {
         .init = init,
         .done = done,
         .filter = filter,
+        .set_pool = set_pool,
+        .filter_in_place = filter_in_place,
 };
 
 REGISTER_MODULE(mirror, &capture_filter_mirror, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
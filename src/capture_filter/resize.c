@@ -73,6 +73,7 @@ struct state_resize {
     struct video_desc saved_desc;
     struct video_desc out_desc;
     char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+    struct capture_filter_pool *pool;
     decoder_t decoder;
     struct video_frame *dec_frame;
 };
@@ -237,13 +238,8 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         return NULL;
     }
 
-    struct video_frame *out_frame = vf_alloc_desc(s->out_desc);
-    if (s->vo_pp_out_buffer) {
-        out_frame->tiles[0].data = s->vo_pp_out_buffer;
-    } else {
-        out_frame->tiles[0].data = (char *) malloc(out_frame->tiles[0].data_len);
-        out_frame->callbacks.data_deleter = vf_data_deleter;
-    }
+    struct video_frame *out_frame = capture_filter_get_out_frame(
+        s->pool, s->out_desc, s->vo_pp_out_buffer);
 
     for (unsigned int i = 0; i < out_frame->tile_count; i++) {
         if (s->decoder != vc_memcpy) {
@@ -264,11 +260,15 @@ static struct video_frame *filter(void *state, struct video_frame *in)
 
     VIDEO_FRAME_DISPOSE(in);
 
-    out_frame->callbacks.dispose = vf_free;
-
     return out_frame;
 }
 
+static void set_pool(void *state, struct capture_filter_pool *pool)
+{
+        struct state_resize *s = state;
+        s->pool = pool;
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         struct state_resize *s = state;
@@ -279,6 +279,8 @@ static const struct capture_filter_info capture_filter_resize = {
     init,
     done,
     filter,
+    set_pool,
+    NULL,
 };
 
 REGISTER_MODULE(resize, &capture_filter_resize, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
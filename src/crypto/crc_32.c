@@ -6,6 +6,7 @@
 #endif // HAVE_CONFIG_H
 
 #include <stdio.h>
+#include <string.h>
 #include "crc.h"
 
 #ifdef __TURBOC__
@@ -159,12 +160,49 @@ bool crc32file(char *name, uint32_t *crc, long *charcnt)
       return true;
 }
 
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/* Slicing-by-8 - crc_32_tab_sliced[k][i] is CRC of byte i followed by k zero */
+/* bytes, so that 8 input bytes are processed with independent lookups.      */
+static uint32_t crc_32_tab_sliced[8][256];
+
+static void crc_32_tab_sliced_init(void) __attribute__((constructor));
+static void crc_32_tab_sliced_init(void)
+{
+      for (int i = 0; i < 256; ++i) {
+            crc_32_tab_sliced[0][i] = crc_32_tab[i];
+      }
+      for (int k = 1; k < 8; ++k) {
+            for (int i = 0; i < 256; ++i) {
+                  uint32_t prev = crc_32_tab_sliced[k - 1][i];
+                  crc_32_tab_sliced[k][i] = crc_32_tab[prev & 0xff] ^ (prev >> 8);
+            }
+      }
+}
+#endif
+
 uint32_t crc32buf_with_oldcrc(const char *buf, size_t len, uint32_t old_crc)
 {
       register uint32_t oldcrc32;
 
       oldcrc32 = ~old_crc;
 
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      for ( ; len >= 8; len -= 8, buf += 8)
+      {
+            uint32_t lo, hi;
+            memcpy(&lo, buf, sizeof lo);
+            memcpy(&hi, buf + 4, sizeof hi);
+            lo ^= oldcrc32;
+            oldcrc32 = crc_32_tab_sliced[7][lo & 0xff] ^
+                       crc_32_tab_sliced[6][(lo >> 8) & 0xff] ^
+                       crc_32_tab_sliced[5][(lo >> 16) & 0xff] ^
+                       crc_32_tab_sliced[4][lo >> 24] ^
+                       crc_32_tab_sliced[3][hi & 0xff] ^
+                       crc_32_tab_sliced[2][(hi >> 8) & 0xff] ^
+                       crc_32_tab_sliced[1][(hi >> 16) & 0xff] ^
+                       crc_32_tab_sliced[0][hi >> 24];
+      }
+#endif
       for ( ; len; --len, ++buf)
       {
             oldcrc32 = UPDC32(*buf, oldcrc32);
@@ -38,6 +38,7 @@
 #include "crypto/openssl_decrypt.h"
 
 #include <assert.h>                  // for assert
+#include <pthread.h>
 #include <stdint.h>                  // for uint32_t
 #include <stdlib.h>                  // for calloc, free
 #include <string.h>                  // for NULL, memcpy, size_t, strstr
@@ -65,17 +66,23 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/macros.h"            // for STR_LEN, snprintf_ch
+#include "utils/worker.h"            // for task_parallel_for
 
 #define GCM_TAG_LEN 16
 #define MOD_NAME "[decrypt] "
+#define BATCH_GRAIN 16 ///< packets decrypted by a worker at once
+
+/// cipher contexts keyed on first use of the mode, used by one thread at a time
+struct decrypt_ctx {
+        EVP_CIPHER_CTX *ctx[MODE_AES128_MAX + 1];
+        struct decrypt_ctx *next;
+};
 
 struct openssl_decrypt {
-        EVP_CIPHER_CTX *ctx;
         unsigned char key_hash[16];
 
-        unsigned char ivec[AES_BLOCK_SIZE];
-        unsigned char ecount[AES_BLOCK_SIZE];
-        unsigned int num;
+        pthread_mutex_t lock;
+        struct decrypt_ctx *free_ctx;
 };
 
 static int openssl_decrypt_init(struct openssl_decrypt **state,
@@ -98,34 +105,92 @@ static int openssl_decrypt_init(struct openssl_decrypt **state,
                         strlen(pass));
         MD5Final(s->key_hash, &context);
 
-        s->ctx = EVP_CIPHER_CTX_new();
+        pthread_mutex_init(&s->lock, NULL);
         log_msg(LOG_LEVEL_INFO, MOD_NAME "Enabled stream decryption.\n");
 
         *state = s;
         return 0;
 }
 
+static void decrypt_ctx_free(struct decrypt_ctx *c)
+{
+        for (int i = 0; i <= MODE_AES128_MAX; ++i) {
+                EVP_CIPHER_CTX_free(c->ctx[i]);
+        }
+        free(c);
+}
+
 static void openssl_decrypt_destroy(struct openssl_decrypt *s)
 {
         if(!s) {
                 return;
         }
-        EVP_CIPHER_CTX_free(s->ctx);
+        while (s->free_ctx != NULL) {
+                struct decrypt_ctx *next = s->free_ctx->next;
+                decrypt_ctx_free(s->free_ctx);
+                s->free_ctx = next;
+        }
+        pthread_mutex_destroy(&s->lock);
         free(s);
 }
 
+static struct decrypt_ctx *decrypt_ctx_get(struct openssl_decrypt *s)
+{
+        pthread_mutex_lock(&s->lock);
+        struct decrypt_ctx *c = s->free_ctx;
+        if (c != NULL) {
+                s->free_ctx = c->next;
+        }
+        pthread_mutex_unlock(&s->lock);
+        return c != NULL ? c : calloc(1, sizeof *c);
+}
+
+static void decrypt_ctx_put(struct openssl_decrypt *s, struct decrypt_ctx *c)
+{
+        pthread_mutex_lock(&s->lock);
+        c->next = s->free_ctx;
+        s->free_ctx = c;
+        pthread_mutex_unlock(&s->lock);
+}
+
 #define CHECK(action, errmsg) do { int rc = action; if (rc != 1) { log_msg(LOG_LEVEL_ERROR, MOD_NAME errmsg ": %s\n", ERR_error_string(ERR_get_error(), NULL)); return 0; } } while(0)
+
+/// @returns context for mode keyed with the passphrase
+static EVP_CIPHER_CTX *get_keyed_ctx(struct openssl_decrypt *s, struct decrypt_ctx *c, enum openssl_mode mode)
+{
+        if (c->ctx[mode] != NULL) {
+                return c->ctx[mode];
+        }
+        const EVP_CIPHER *cipher = get_cipher(mode);
+        if (cipher == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cipher %d not available!\n", (int) mode);
+                return NULL;
+        }
+        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+        if (EVP_CipherInit_ex(ctx, cipher, NULL, s->key_hash, NULL, 0) != 1 ||
+                        (mode == MODE_AES128_GCM && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, 16, NULL) != 1)) { // default IV len is presumably 12 bytes
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to initialize cipher: %s\n", ERR_error_string(ERR_get_error(), NULL));
+                EVP_CIPHER_CTX_free(ctx);
+                return NULL;
+        }
+        c->ctx[mode] = ctx;
+        return ctx;
+}
+
 #pragma GCC diagnostic ignored "-Wcast-qual"
-static int openssl_decrypt(struct openssl_decrypt *decrypt,
+static int decrypt_packet(struct openssl_decrypt *decrypt, struct decrypt_ctx *c,
                 const char *ciphertext, int ciphertext_len,
                 const char *aad, int aad_len,
                 char *plaintext, enum openssl_mode mode)
 {
-        const EVP_CIPHER *cipher = get_cipher(mode);
-        if (cipher == NULL) {
+        if (mode <= MODE_AES128_NONE || mode > MODE_AES128_MAX) {
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cipher %d not available!\n", (int) mode);
                 return 0;
         }
+        EVP_CIPHER_CTX *ctx = get_keyed_ctx(decrypt, c, mode);
+        if (ctx == NULL) {
+                return 0;
+        }
         uint32_t data_len;
         memcpy(&data_len, ciphertext, sizeof(uint32_t));
         assert ((size_t) ciphertext_len >= data_len + sizeof(uint32_t) + 16 + sizeof(uint32_t));
@@ -134,24 +199,23 @@ static int openssl_decrypt(struct openssl_decrypt *decrypt,
         ciphertext += 16;
         ciphertext_len -= 20;
 
-        CHECK(EVP_CipherInit(decrypt->ctx, cipher, decrypt->key_hash, iv, 0), "Unable to initialize cipher");
-        CHECK(EVP_CIPHER_CTX_ctrl(decrypt->ctx, EVP_CTRL_GCM_SET_IVLEN, 16, NULL), "set IV len"); // default IV len is presumably 12 bytes
+        CHECK(EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, 0), "Unable to set IV");
 
         int out_len = 0;
         if (mode == MODE_AES128_GCM) {
                 ciphertext_len -= GCM_TAG_LEN;
                 if (aad && aad_len > 0) {
-                        if (!EVP_DecryptUpdate(decrypt->ctx, NULL, &out_len, (void *) aad, aad_len)) {
+                        if (!EVP_DecryptUpdate(ctx, NULL, &out_len, (void *) aad, aad_len)) {
                                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "AAD processing: %s\n", ERR_error_string(ERR_get_error(), NULL));
                         }
                 }
         }
-        CHECK(EVP_CipherUpdate(decrypt->ctx, (unsigned char *) plaintext, &out_len, (const unsigned char *) ciphertext, ciphertext_len), "EVP_CipherUpdate");
+        CHECK(EVP_CipherUpdate(ctx, (unsigned char *) plaintext, &out_len, (const unsigned char *) ciphertext, ciphertext_len), "EVP_CipherUpdate");
         int total_len = out_len;
         if (mode == MODE_AES128_GCM) {
-                CHECK(EVP_CIPHER_CTX_ctrl(decrypt->ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_LEN, (void *) (ciphertext + ciphertext_len)), "GCM set tag");
+                CHECK(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_LEN, (void *) (ciphertext + ciphertext_len)), "GCM set tag");
         }
-        CHECK(EVP_CipherFinal(decrypt->ctx, (unsigned char *) plaintext + out_len, &out_len), "EVP_CipherFinal");
+        CHECK(EVP_CipherFinal_ex(ctx, (unsigned char *) plaintext + out_len, &out_len), "EVP_CipherFinal");
         total_len += out_len;
 
         if (mode != MODE_AES128_GCM) {
@@ -169,10 +233,46 @@ static int openssl_decrypt(struct openssl_decrypt *decrypt,
         return data_len;
 }
 
+static int openssl_decrypt(struct openssl_decrypt *decrypt,
+                const char *ciphertext, int ciphertext_len,
+                const char *aad, int aad_len,
+                char *plaintext, enum openssl_mode mode)
+{
+        struct decrypt_ctx *c = decrypt_ctx_get(decrypt);
+        int ret = decrypt_packet(decrypt, c, ciphertext, ciphertext_len, aad, aad_len, plaintext, mode);
+        decrypt_ctx_put(decrypt, c);
+        return ret;
+}
+
+struct decrypt_batch_data {
+        struct openssl_decrypt *decrypt;
+        struct openssl_crypt_pkt *pkts;
+};
+
+static void decrypt_batch_range(size_t start, size_t end, void *udata)
+{
+        struct decrypt_batch_data *d = udata;
+        struct decrypt_ctx *c = decrypt_ctx_get(d->decrypt);
+        for (size_t i = start; i < end; ++i) {
+                struct openssl_crypt_pkt *p = &d->pkts[i];
+                p->out_len = p->in == NULL ? 0 // not encrypted/malformed
+                        : decrypt_packet(d->decrypt, c, p->in, p->in_len, p->aad, p->aad_len, p->out, p->mode);
+        }
+        decrypt_ctx_put(d->decrypt, c);
+}
+
+static void openssl_decrypt_batch(struct openssl_decrypt *decrypt,
+                struct openssl_crypt_pkt *pkts, int count)
+{
+        struct decrypt_batch_data d = { decrypt, pkts };
+        task_parallel_for(count, BATCH_GRAIN, decrypt_batch_range, &d);
+}
+
 static const struct openssl_decrypt_info functions = {
         openssl_decrypt_init,
         openssl_decrypt_destroy,
         openssl_decrypt,
+        openssl_decrypt_batch,
 };
 
 REGISTER_MODULE(openssl_decrypt, &functions, LIBRARY_CLASS_UNDEFINED, OPENSSL_DECRYPT_ABI_VERSION);
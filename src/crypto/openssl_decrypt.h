@@ -40,7 +40,7 @@
 
 #include "crypto/openssl_encrypt.h" // enum openssl_mode
 
-#define OPENSSL_DECRYPT_ABI_VERSION 1
+#define OPENSSL_DECRYPT_ABI_VERSION 2
 
 struct openssl_decrypt;
 
@@ -77,6 +77,14 @@ struct openssl_decrypt_info {
                         const char *ciphertext, int ciphertext_len,
                         const char *aad, int aad_len,
                         char *plaintext, enum openssl_mode mode);
+        /**
+         * Decrypts packets in parallel (see decrypt() for the semantics)
+         *
+         * @param[in,out] pkts  out must hold at least in_len bytes, out_len
+         *                      is set to 0 for packets failing verification
+         */
+        void (*decrypt_batch)(struct openssl_decrypt *decrypt,
+                        struct openssl_crypt_pkt *pkts, int count);
 };
 
 #endif //  OPENSSL_DECRYPT_H_
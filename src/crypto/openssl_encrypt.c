@@ -45,12 +45,19 @@
  *
  * Encryption algorithm is set in transmit.cpp, detected on receiver. Required
  * algorightms are currently GCM (default) and CBC.
+ *
+ * The IV consists of 64-bit nonce (random per-session salt + packet counter,
+ * big endian) followed by 8 zero bytes (block counter for CTR). CBC and CFB
+ * require unpredictable IVs so the nonce block is additionally encrypted with
+ * the key (IV = E_k(nonce)). Cipher contexts are keyed once and only the IV
+ * is set per packet.
  */
 
 #include "crypto/openssl_encrypt.h"
 
 #include <assert.h>           // for assert
-#include <stdint.h>           // for uint32_t
+#include <pthread.h>
+#include <stdint.h>           // for uint32_t, uint64_t
 #include <stdlib.h>           // for free, abort, calloc
 #include <string.h>           // for NULL, memcpy, strcmp, strlen
 
@@ -80,16 +87,30 @@
 #include "lib_common.h"
 #include "utils/color_out.h"  // for color_printf, TBOLD
 #include "utils/macros.h"     // for STR_LEN, snprintf_ch
+#include "utils/worker.h"     // for task_parallel_for
 
 #define DEFAULT_CIPHER_MODE MODE_AES128_GCM
 #define GCM_TAG_LEN 16
 #define MOD_NAME "[encrypt] "
+#define BATCH_GRAIN 16 ///< packets encrypted by a worker at once
 
-struct openssl_encrypt {
+/// pre-keyed cipher contexts, one is used by a thread at a time
+struct encrypt_ctx {
         EVP_CIPHER_CTX *ctx;
+        EVP_CIPHER_CTX *iv_ctx; ///< ECB context for IV derivation (CBC, CFB)
+        struct encrypt_ctx *next;
+};
+
+struct openssl_encrypt {
         const EVP_CIPHER *cipher;
         enum openssl_mode mode;
         unsigned char key_hash[16];
+
+        uint64_t salt;
+        uint64_t counter; ///< packets encrypted so far
+
+        pthread_mutex_t lock;
+        struct encrypt_ctx *free_ctx;
 };
 
 const struct {
@@ -181,7 +202,12 @@ openssl_encrypt_init(struct openssl_encrypt **state, const char *passphrase)
                 return -1;
         }
 
-        s->ctx = EVP_CIPHER_CTX_new();
+        if (RAND_bytes((unsigned char *) &s->salt, sizeof s->salt) != 1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot generate random bytes!\n");
+                free(s);
+                return -1;
+        }
+        pthread_mutex_init(&s->lock, NULL);
         s->mode = mode;
         log_msg(LOG_LEVEL_INFO, MOD_NAME "Encryption set to mode %d\n", (int) mode);
 
@@ -189,55 +215,175 @@ openssl_encrypt_init(struct openssl_encrypt **state, const char *passphrase)
         return 0;
 }
 
+static void encrypt_ctx_free(struct encrypt_ctx *c)
+{
+        EVP_CIPHER_CTX_free(c->ctx);
+        EVP_CIPHER_CTX_free(c->iv_ctx);
+        free(c);
+}
+
 static void openssl_encrypt_destroy(struct openssl_encrypt *s)
 {
-        EVP_CIPHER_CTX_free(s->ctx);
+        while (s->free_ctx != NULL) {
+                struct encrypt_ctx *next = s->free_ctx->next;
+                encrypt_ctx_free(s->free_ctx);
+                s->free_ctx = next;
+        }
+        pthread_mutex_destroy(&s->lock);
         free(s);
 }
 
 #define CHECK(action, errmsg) do { int rc = action; if (rc != 1) { log_msg(LOG_LEVEL_ERROR, MOD_NAME errmsg ": %s\n", ERR_error_string(ERR_get_error(), NULL)); return 0; } } while(0)
 
-static int openssl_encrypt(struct openssl_encrypt *encryption,
-                char *plaintext, int data_len, char *aad, int aad_len, char *ciphertext)
+static bool encrypt_ctx_init(struct openssl_encrypt *s, struct encrypt_ctx *c)
+{
+        c->ctx = EVP_CIPHER_CTX_new();
+        CHECK(EVP_CipherInit_ex(c->ctx, s->cipher, NULL, s->key_hash, NULL, 1), "Cannot initialize cipher");
+        if (s->mode == MODE_AES128_GCM) {
+                /* Set IV length if default 12 bytes (96 bits) is not appropriate */
+                CHECK(EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_SET_IVLEN, 16, NULL), "set IV len");
+        }
+#ifdef HAVE_EVP_AES_128_ECB
+        if (s->mode == MODE_AES128_CBC || s->mode == MODE_AES128_CFB) {
+                c->iv_ctx = EVP_CIPHER_CTX_new();
+                CHECK(EVP_CipherInit_ex(c->iv_ctx, EVP_aes_128_ecb(), NULL, s->key_hash, NULL, 1), "Cannot initialize IV cipher");
+                EVP_CIPHER_CTX_set_padding(c->iv_ctx, 0);
+        }
+#endif
+        return true;
+}
+
+static struct encrypt_ctx *encrypt_ctx_get(struct openssl_encrypt *s)
+{
+        pthread_mutex_lock(&s->lock);
+        struct encrypt_ctx *c = s->free_ctx;
+        if (c != NULL) {
+                s->free_ctx = c->next;
+        }
+        pthread_mutex_unlock(&s->lock);
+        if (c != NULL) {
+                return c;
+        }
+        c = calloc(1, sizeof *c);
+        if (!encrypt_ctx_init(s, c)) {
+                encrypt_ctx_free(c);
+                return NULL;
+        }
+        return c;
+}
+
+static void encrypt_ctx_put(struct openssl_encrypt *s, struct encrypt_ctx *c)
+{
+        pthread_mutex_lock(&s->lock);
+        c->next = s->free_ctx;
+        s->free_ctx = c;
+        pthread_mutex_unlock(&s->lock);
+}
+
+static bool derive_iv(struct openssl_encrypt *s, struct encrypt_ctx *c,
+                      uint64_t counter, unsigned char *ivec)
+{
+        const uint64_t nonce = s->salt + counter;
+        for (int i = 0; i < 8; ++i) {
+                ivec[i] = nonce >> (56 - 8 * i);
+        }
+        memset(ivec + 8, 0, 8);
+        if (s->mode != MODE_AES128_CBC && s->mode != MODE_AES128_CFB) {
+                return true;
+        }
+        if (c->iv_ctx == NULL) { // ECB not available
+                CHECK(RAND_bytes(ivec, 16), "Cannot generate random bytes");
+                return true;
+        }
+        int out_len = 0;
+        CHECK(EVP_EncryptUpdate(c->iv_ctx, ivec, &out_len, ivec, 16), "IV encryption");
+        return true;
+}
+
+static int encrypt_packet(struct openssl_encrypt *encryption, struct encrypt_ctx *c, uint64_t counter,
+                const char *plaintext, int data_len, const char *aad, int aad_len, char *ciphertext)
 {
         memcpy(ciphertext, &data_len, sizeof(uint32_t));
         int total_len = sizeof(uint32_t);
 
         unsigned char ivec[16];
-        if (RAND_bytes(ivec, 8) < 0) {
-                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot generate random bytes!\n");
+        if (!derive_iv(encryption, c, counter, ivec)) {
                 return 0;
         }
         memcpy(ciphertext + total_len, ivec, sizeof ivec);
         total_len += sizeof ivec;
 
-        CHECK(EVP_CipherInit(encryption->ctx, encryption->cipher, encryption->key_hash, ivec, 1), "Cannot initialize cipher");
-        /* Set IV length if default 12 bytes (96 bits) is not appropriate */
-        CHECK(EVP_CIPHER_CTX_ctrl(encryption->ctx, EVP_CTRL_GCM_SET_IVLEN, sizeof ivec, NULL), "set IV len");
+        CHECK(EVP_CipherInit_ex(c->ctx, NULL, NULL, NULL, ivec, 1), "Cannot set IV");
         int out_len = 0;
         if (encryption->mode == MODE_AES128_GCM) {
                 if (aad_len > 0) {
-                        EVP_EncryptUpdate(encryption->ctx, NULL, &out_len, (unsigned char *) aad, aad_len);
+                        EVP_EncryptUpdate(c->ctx, NULL, &out_len, (const unsigned char *) aad, aad_len);
                 }
         }
-        CHECK(EVP_CipherUpdate(encryption->ctx, (unsigned char *) ciphertext + total_len, &out_len, (unsigned char *) plaintext, data_len), "EVP_CipherUpdate");
+        CHECK(EVP_CipherUpdate(c->ctx, (unsigned char *) ciphertext + total_len, &out_len, (const unsigned char *) plaintext, data_len), "EVP_CipherUpdate");
         total_len += out_len;
         if (encryption->mode != MODE_AES128_GCM) {
                 uint32_t crc = crc32buf(aad, aad_len);
                 crc = crc32buf_with_oldcrc(plaintext, data_len, crc);
-                CHECK(EVP_CipherUpdate(encryption->ctx, (unsigned char *) ciphertext + total_len, &out_len, (unsigned char *) &crc, sizeof crc), "EVP_CipherUpdate CRC");
+                CHECK(EVP_CipherUpdate(c->ctx, (unsigned char *) ciphertext + total_len, &out_len, (unsigned char *) &crc, sizeof crc), "EVP_CipherUpdate CRC");
                 total_len += out_len;
         }
-        CHECK(EVP_CipherFinal(encryption->ctx, (unsigned char *) ciphertext + total_len, &out_len), "EVP_CipherFinal");
+        CHECK(EVP_CipherFinal_ex(c->ctx, (unsigned char *) ciphertext + total_len, &out_len), "EVP_CipherFinal");
         total_len += out_len;
         if (encryption->mode == MODE_AES128_GCM) {
-                CHECK(EVP_CIPHER_CTX_ctrl(encryption->ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_LEN, ciphertext + total_len), "GCM get tag");
+                CHECK(EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_LEN, ciphertext + total_len), "GCM get tag");
                 total_len += GCM_TAG_LEN;
         }
 
         return total_len;
 }
 
+static int openssl_encrypt(struct openssl_encrypt *encryption,
+                char *plaintext, int data_len, char *aad, int aad_len, char *ciphertext)
+{
+        struct encrypt_ctx *c = encrypt_ctx_get(encryption);
+        if (c == NULL) {
+                return 0;
+        }
+        int ret = encrypt_packet(encryption, c, encryption->counter++, plaintext, data_len, aad, aad_len, ciphertext);
+        encrypt_ctx_put(encryption, c);
+        return ret;
+}
+
+struct encrypt_batch_data {
+        struct openssl_encrypt *encryption;
+        struct openssl_crypt_pkt *pkts;
+        uint64_t first_counter;
+};
+
+static void encrypt_batch_range(size_t start, size_t end, void *udata)
+{
+        struct encrypt_batch_data *d = udata;
+        struct encrypt_ctx *c = encrypt_ctx_get(d->encryption);
+        for (size_t i = start; i < end; ++i) {
+                struct openssl_crypt_pkt *p = &d->pkts[i];
+                p->out_len = c == NULL ? 0 : encrypt_packet(d->encryption, c, d->first_counter + i,
+                                p->in, p->in_len, p->aad, p->aad_len, p->out);
+        }
+        if (c != NULL) {
+                encrypt_ctx_put(d->encryption, c);
+        }
+}
+
+static bool openssl_encrypt_batch(struct openssl_encrypt *encryption,
+                struct openssl_crypt_pkt *pkts, int count)
+{
+        struct encrypt_batch_data d = { encryption, pkts, encryption->counter };
+        encryption->counter += count;
+        task_parallel_for(count, BATCH_GRAIN, encrypt_batch_range, &d);
+        for (int i = 0; i < count; ++i) {
+                if (pkts[i].out_len == 0) {
+                        return false;
+                }
+        }
+        return true;
+}
+
 static int openssl_get_overhead(struct openssl_encrypt *s)
 {
         return sizeof(uint32_t) /* data_len */ +
@@ -255,6 +401,7 @@ static const struct openssl_encrypt_info functions = {
         openssl_encrypt_init,
         openssl_encrypt_destroy,
         openssl_encrypt,
+        openssl_encrypt_batch,
         openssl_get_overhead,
         openssl_get_cipher,
 };
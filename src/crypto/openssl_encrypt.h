@@ -38,6 +38,10 @@
 #ifndef OPENSSL_ENCRYPT_H_
 #define OPENSSL_ENCRYPT_H_
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
 struct openssl_encrypt;
 
 /// only GCM provides autenticity, other modes only check integrity (CRC)
@@ -57,7 +61,18 @@ const void *get_cipher(enum openssl_mode mode);
 #define MAX_CRYPTO_PAD 15 // ECB needs to be padded
 #define MAX_CRYPTO_EXCEED (MAX_CRYPTO_EXTRA_DATA + MAX_CRYPTO_PAD)
 
-#define OPENSSL_ENCRYPT_ABI_VERSION 1
+#define OPENSSL_ENCRYPT_ABI_VERSION 2
+
+/// packet of a batch passed to encrypt_batch()/decrypt_batch()
+struct openssl_crypt_pkt {
+        const char *in;          ///< plaintext (encryption) or ciphertext
+        int in_len;
+        const char *aad;         ///< Additional Authenticated Data (see encrypt())
+        int aad_len;
+        enum openssl_mode mode;  ///< cipher of the packet (decryption only)
+        char *out;               ///< output buffer, in_len + MAX_CRYPTO_EXCEED for encryption
+        int out_len;             ///< [out] length of the output, 0 on error
+};
 
 struct openssl_encrypt_info {
         /**
@@ -91,6 +106,16 @@ struct openssl_encrypt_info {
          */
         int (*encrypt)(struct openssl_encrypt *encryption,
                         char *plaintext, int plaintext_len, char *aad, int aad_len, char *ciphertext);
+        /**
+         * Encrypts packets in parallel. Result is equivalent to calling
+         * encrypt() for the packets in order (IVs are taken from the same
+         * counter).
+         *
+         * @param[in,out] pkts  packets, out_len is set for each of them
+         * @retval false        some of the packets failed (out_len == 0)
+         */
+        bool (*encrypt_batch)(struct openssl_encrypt *encryption,
+                        struct openssl_crypt_pkt *pkts, int count);
         /**
          * Returns maximal number of bytest that the ciphertext length may exceed plaintext for selected
          * encryption.
@@ -48,9 +48,13 @@
 #include "config_unix.h"
 #include "config_win32.h"
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <chrono>
+#include <cinttypes>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -59,6 +63,7 @@
 #include "utils/color_out.h"
 #include "utils/string_view_utils.hpp"
 #include "utils/misc.h" // ug_strerror
+#include "utils/thread.h"
 
 using std::atomic;
 using std::string;
@@ -126,7 +131,7 @@ log_vprintf(int level, const char *format, va_list ap)
                         buf.append(TERM_RESET);
                 }
         }
-        buf.submit();
+        buf.submit(level <= LOG_LEVEL_FATAL);
 }
 
 void log_msg(int level, const char *format, ...) {
@@ -167,6 +172,50 @@ void log_msg_once(int level, uint32_t id, const char *msg, ...) {
         }
 }
 
+/**
+ * Checks (and updates) the rate limit of a call site. If some messages were
+ * suppressed since the last passed one, their count is printed first.
+ *
+ * @returns whether the message should be printed
+ */
+bool log_rate_limit_pass(int level, struct log_rate_limit *rl, int interval_ms)
+{
+        const time_ns_t now = get_time_in_ns();
+        time_ns_t next = __atomic_load_n(&rl->next, __ATOMIC_RELAXED);
+        if (now < next ||
+            !__atomic_compare_exchange_n(&rl->next, &next,
+                                         now + (time_ns_t) interval_ms * MS_IN_NS, false,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                __atomic_fetch_add(&rl->suppressed, 1, __ATOMIC_RELAXED);
+                return false;
+        }
+        const uint32_t suppressed =
+            __atomic_exchange_n(&rl->suppressed, 0, __ATOMIC_RELAXED);
+        if (suppressed > 0) {
+                log_msg(level, "(%" PRIu32 " similar messages suppressed)\n",
+                        suppressed);
+        }
+        return true;
+}
+
+/**
+ * Like log_msg() but the message is printed at most once per interval_ms,
+ * the call site is identified by rl (zero-initialized). Intended for
+ * messages that may be repeated per frame or packet. Usually used with the
+ * log_msg_limited() or MSG_LIMITED() macros.
+ */
+void log_msg_rate_limited(int level, struct log_rate_limit *rl,
+                          int interval_ms, const char *format, ...)
+{
+        if (log_level < level || !log_rate_limit_pass(level, rl, interval_ms)) {
+                return;
+        }
+        va_list ap;
+        va_start(ap, format);
+        log_vprintf(level, format, ap);
+        va_end(ap);
+}
+
 /**
  * This function is analogous to perror(). The message is printed using the logger.
  */
@@ -405,3 +454,294 @@ Log_output::Log_output(){
         last_msg.reserve(initial_buf_size);
         interactive = color_output_init();
 }
+
+Log_output::~Log_output(){
+        stop_async();
+}
+
+namespace {
+/**
+ * Single-producer single-consumer ring of log records owned by one thread.
+ *
+ * Records are a header (struct log_record) followed by the message, both
+ * may wrap around the end of the buffer. The producer never waits - if the
+ * record doesn't fit, it is dropped and counted. Rings are never freed,
+ * when the owning thread exits, the ring is left to be drained and reused
+ * by another thread.
+ */
+struct log_ring {
+        static constexpr size_t size = 64 * 1024; // power of 2
+
+        alignas(64) atomic<size_t> head{0}; ///< written by producer
+        alignas(64) atomic<size_t> tail{0}; ///< written by consumer
+        atomic<unsigned long> dropped{0};
+        atomic<bool> in_use{true};
+        log_ring *next = nullptr;
+        char data[size];
+
+        void copy_in(size_t pos, const void *src, size_t len) {
+                pos &= size - 1;
+                const size_t first = std::min(len, size - pos);
+                memcpy(data + pos, src, first);
+                memcpy(data, (const char *) src + first, len - first);
+        }
+        void copy_out(size_t pos, void *dst, size_t len) const {
+                pos &= size - 1;
+                const size_t first = std::min(len, size - pos);
+                memcpy(dst, data + pos, first);
+                memcpy((char *) dst + first, data, len - first);
+        }
+};
+
+struct log_record {
+        time_ns_t timestamp;
+        size_t len;
+};
+
+atomic<log_ring *> log_rings{nullptr};
+
+struct log_ring_holder {
+        log_ring *ring = nullptr;
+        ~log_ring_holder() {
+                if (ring != nullptr) {
+                        ring->in_use.store(false, std::memory_order_release);
+                }
+        }
+};
+
+log_ring *
+get_thread_ring()
+{
+        thread_local log_ring_holder holder;
+        if (holder.ring != nullptr) {
+                return holder.ring;
+        }
+        // reuse ring of an exited thread
+        for (log_ring *r = log_rings.load(std::memory_order_acquire);
+             r != nullptr; r = r->next) {
+                bool expected = false;
+                if (r->in_use.compare_exchange_strong(expected, true)) {
+                        return holder.ring = r;
+                }
+        }
+        auto *r = new log_ring;
+        r->next = log_rings.load(std::memory_order_relaxed);
+        while (!log_rings.compare_exchange_weak(r->next, r,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed)) {
+        }
+        return holder.ring = r;
+}
+
+/// @retval false  message doesn't fit the ring at all (never will)
+bool
+log_ring_push(time_ns_t timestamp, const string &msg)
+{
+        const log_record rec{ timestamp, msg.size() };
+        const size_t needed = sizeof rec + rec.len;
+        if (needed > log_ring::size / 2) {
+                return false;
+        }
+        log_ring *r = get_thread_ring();
+        const size_t head = r->head.load(std::memory_order_relaxed);
+        const size_t tail = r->tail.load(std::memory_order_acquire);
+        if (log_ring::size - (head - tail) < needed) {
+                r->dropped.fetch_add(1, std::memory_order_relaxed);
+                return true;
+        }
+        r->copy_in(head, &rec, sizeof rec);
+        r->copy_in(head + sizeof rec, msg.data(), rec.len);
+        r->head.store(head + needed, std::memory_order_release);
+        return true;
+}
+} // end of anonymous namespace
+
+ADD_TO_PARAM("log-sync", "* log-sync\n"
+                "  Write log messages synchronously from the logging thread "
+                "instead of the background one.\n");
+
+/**
+ * Starts the background log thread. Until called (and after stop_async()),
+ * messages are written synchronously, which keeps the order with output
+ * printed directly to stdout (eg. help) during initialization.
+ */
+void Log_output::start_async() {
+        if (async || get_commandline_param("log-sync") != nullptr) {
+                return;
+        }
+        async = true;
+        flusher_thread = std::thread(&Log_output::flusher, this);
+}
+
+void Log_output::stop_async() {
+        if (!async.exchange(false)) {
+                return;
+        }
+        {
+                std::lock_guard<std::mutex> lk(flusher_mut);
+                flusher_sleeping = false;
+        }
+        flusher_cv.notify_one();
+        flusher_thread.join();
+        flush(); // messages enqueued concurrently with the stop
+}
+
+/// writes all enqueued messages
+void Log_output::flush() {
+        drain();
+}
+
+/**
+ * Collects records from all rings, orders them by the timestamp and writes
+ * them.
+ *
+ * @returns if there were any records
+ */
+bool Log_output::drain() {
+        if (log_rings.load(std::memory_order_acquire) == nullptr) {
+                return false;
+        }
+        std::lock_guard<std::mutex> drain_lk(drain_mut);
+        unsigned long dropped = 0;
+        pending.clear();
+        for (log_ring *r = log_rings.load(std::memory_order_acquire);
+             r != nullptr; r = r->next) {
+                dropped += r->dropped.exchange(0, std::memory_order_relaxed);
+                size_t       tail = r->tail.load(std::memory_order_relaxed);
+                const size_t head = r->head.load(std::memory_order_acquire);
+                while (tail != head) {
+                        log_record rec;
+                        r->copy_out(tail, &rec, sizeof rec);
+                        string msg(rec.len, '\0');
+                        r->copy_out(tail + sizeof rec, msg.data(), rec.len);
+                        pending.emplace_back(rec.timestamp, std::move(msg));
+                        tail += sizeof rec + rec.len;
+                }
+                r->tail.store(tail, std::memory_order_release);
+        }
+        if (pending.empty() && dropped == 0) {
+                return false;
+        }
+        std::stable_sort(pending.begin(), pending.end(),
+                         [](const auto &a, const auto &b) {
+                                 return a.first < b.first;
+                         });
+        std::lock_guard<std::mutex> lk(mut);
+        for (const auto &m : pending) {
+                write_locked(m.first, m.second);
+        }
+        if (dropped > 0) {
+                string msg = get_level_style(LOG_LEVEL_WARNING) + "Log: " +
+                             std::to_string(dropped) +
+                             " messages dropped (output too slow)" +
+                             (is_interactive() ? TERM_RESET "\n" : "\n");
+                write_locked(get_time_in_ns(), msg);
+        }
+        fflush(stdout);
+        return true;
+}
+
+void Log_output::flusher() {
+        set_thread_name("log_flusher");
+        while (async) {
+                if (drain()) {
+                        continue;
+                }
+                std::unique_lock<std::mutex> lk(flusher_mut);
+                flusher_sleeping = true;
+                // recheck - a producer might have enqueued before seeing
+                // flusher_sleeping set
+                lk.unlock();
+                if (drain()) {
+                        flusher_sleeping = false;
+                        continue;
+                }
+                lk.lock();
+                flusher_cv.wait_for(lk, std::chrono::seconds(1),
+                                    [this] { return !flusher_sleeping; });
+                flusher_sleeping = false;
+        }
+}
+
+void Log_output::submit(bool sync){
+        const time_ns_t timestamp = get_time_in_ns();
+        if (async && !sync) {
+                if (log_ring_push(timestamp, get_internal_buffer())) {
+                        // pairs with flusher_sleeping store + drain
+                        std::atomic_thread_fence(std::memory_order_seq_cst);
+                        if (flusher_sleeping.load(std::memory_order_relaxed)) {
+                                {
+                                        std::lock_guard<std::mutex> lk(
+                                            flusher_mut);
+                                        flusher_sleeping = false;
+                                }
+                                flusher_cv.notify_one();
+                        }
+                        return;
+                }
+        }
+        flush();
+        std::lock_guard<std::mutex> lock(mut);
+        write_locked(timestamp, get_internal_buffer());
+}
+
+void Log_output::write_locked(time_ns_t timestamp, const string &msg){
+        static constexpr int ts_bufsize = 32; //log10(2^64) is 19.3, so should be enough
+        char ts_str[ts_bufsize];
+        ts_str[0] = '\0';
+
+        if (show_timestamps == LOG_TIMESTAMP_ENABLED
+                || (show_timestamps == LOG_TIMESTAMP_AUTO && log_level >= LOG_LEVEL_VERBOSE))
+        {
+                snprintf(ts_str, ts_bufsize, "[%.3f] ",
+                         (double) timestamp / NS_IN_SEC_DBL);
+        }
+
+        const char *start_newline = "";
+        if (skip_repeated && interactive) {
+                if (msg == last_msg) {
+                        last_msg_repeats++;
+                        printf("    Last message repeated %d times\r", last_msg_repeats);
+                        fflush(stdout);
+                        return;
+                }
+
+                if (last_msg_repeats > 0) {
+                        start_newline = "\n";
+                }
+                last_msg_repeats = 0;
+        }
+
+        printf("%s%s%s", start_newline, ts_str, msg.c_str());
+
+        last_msg = msg;
+}
+
+void Log_output::submit_raw(){
+        flush();
+        std::lock_guard<std::mutex> lock(mut);
+        if(last_msg_repeats > 0)
+                fputc('\n', stdout);
+        fputs(get_internal_buffer().c_str(), stdout);
+        std::swap(last_msg, get_internal_buffer());
+        last_msg_repeats = 0;
+}
+
+/**
+ * Starts writing log messages from a background thread. Should be called
+ * when the initialization is done (with possible help printed), the
+ * messages are then only enqueued to per-thread ring and the threads don't
+ * wait for the output.
+ */
+void log_async_start(void) {
+        get_log_output().start_async();
+}
+
+/// Writes all pending messages and switches back to synchronous logging.
+void log_async_stop(void) {
+        get_log_output().stop_async();
+}
+
+void log_flush(void) {
+        get_log_output().flush();
+}
@@ -95,6 +95,35 @@ void log_perror(int log_level, const char *msg);
                                  0x7FFFFFFF)) +  __COUNTER__, \
                              "%s" fmt, MOD_NAME, ##__VA_ARGS__)
 
+/**
+ * Per-call-site state for rate-limited messages, zero-initialize (use as a
+ * static variable, see log_msg_limited()).
+ */
+struct log_rate_limit {
+        time_ns_t next;      ///< earliest time of next printed message
+        uint32_t suppressed; ///< messages suppressed since the last printed
+};
+void log_msg_rate_limited(int log_level, struct log_rate_limit *rl,
+                          int interval_ms, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+bool log_rate_limit_pass(int log_level, struct log_rate_limit *rl,
+                         int interval_ms);
+/// prints the message at most once per interval_ms from given call site
+#define log_msg_limited(l, interval_ms, ...) \
+        do { \
+                static struct log_rate_limit log_rl_; \
+                if (log_level >= (l)) \
+                        log_msg_rate_limited((l), &log_rl_, (interval_ms), \
+                                             __VA_ARGS__); \
+        } while (0)
+#define MSG_LIMITED(l, interval_ms, fmt, ...) \
+        log_msg_limited(LOG_LEVEL_##l, interval_ms, "%s" fmt, MOD_NAME, \
+                        ##__VA_ARGS__)
+
+void log_async_start(void);
+void log_async_stop(void);
+void log_flush(void);
+
 bool parse_log_cfg(const char *conf_str,
 		int *log_lvl,
 		bool *logger_skip_repeats,
@@ -110,6 +139,7 @@ void bug_msg(int level, const char *format, ...) __attribute__((format (printf,
 
 #ifdef __cplusplus
 #include <atomic>
+#include <condition_variable>
 #include <iomanip>
 #include <iostream>
 #include <stdio.h>
@@ -118,6 +148,9 @@ void bug_msg(int level, const char *format, ...) __attribute__((format (printf,
 #include <string>
 #include <string_view>
 #include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 #include "tv.h"
 #include "utils/color_out.h"
 
@@ -135,7 +168,9 @@ class Log_output{
                 std::string& get() { return lo.get_internal_buffer(); }
                 char *data() { return get().data(); }
 
-                void submit() { lo.submit(); }
+                /// @param sync  write the message (and everything queued
+                ///              before) from the calling thread
+                void submit(bool sync = false) { lo.submit(sync); }
                 void submit_raw() { lo.submit_raw(); }
 
                 Buffer(const Buffer&) = delete;
@@ -148,6 +183,7 @@ class Log_output{
         };
 public:
         Log_output();
+        ~Log_output();
         
         Buffer get_buffer() { return Buffer(*this); }
 
@@ -165,9 +201,16 @@ public:
         Log_output& operator=(const Log_output&) = delete;
         Log_output& operator=(Log_output&&) = delete;
 
+        void start_async();
+        void stop_async();
+        void flush();
+
 private:
-        void submit();
+        void submit(bool sync);
         void submit_raw(); //just pass to output as is, no styles, timestamps, etc.
+        void write_locked(time_ns_t timestamp, const std::string &msg);
+        bool drain();
+        void flusher();
 
         constexpr static int initial_buf_size = 256;
         std::string& get_internal_buffer(){
@@ -180,13 +223,22 @@ private:
 
         bool interactive = false;
 
-        /* Since writing to stdout uses locks internally anyway (C11 standard
-         * 7.21.2 sections 7&8), using a mutex here does not cause any significant
-         * overhead, we just wait for the lock a bit earlier. */
+        /* Only the output (either the flusher thread or synchronous
+         * writers) holds this lock, producers in asynchronous mode just
+         * enqueue the message to a per-thread ring (see debug.cpp) so that
+         * a blocked terminal doesn't stall eg. the receiver thread. */
         std::mutex mut;
         std::string last_msg;
         int last_msg_repeats = 0;
 
+        std::atomic<bool> async = false;
+        std::atomic<bool> flusher_sleeping = false;
+        std::mutex drain_mut; ///< serializes ring consumers
+        std::mutex flusher_mut;
+        std::condition_variable flusher_cv;
+        std::thread flusher_thread;
+        std::vector<std::pair<time_ns_t, std::string>> pending;
+
         friend class Buffer;
 };
 
@@ -219,49 +271,6 @@ inline const std::string& Log_output::get_level_style(int lvl){
         }
 }
 
-inline void Log_output::submit(){
-        static constexpr int ts_bufsize = 32; //log10(2^64) is 19.3, so should be enough
-        char ts_str[ts_bufsize];
-        ts_str[0] = '\0';
-                                              
-        if (show_timestamps == LOG_TIMESTAMP_ENABLED
-                || (show_timestamps == LOG_TIMESTAMP_AUTO && log_level >= LOG_LEVEL_VERBOSE))
-        {
-                const time_ns_t time_ns = get_time_in_ns();
-                snprintf(ts_str, ts_bufsize, "[%.3f] ",
-                         (double) time_ns / NS_IN_SEC_DBL);
-        }
-
-        const char *start_newline = "";
-        std::lock_guard<std::mutex> lock(mut);
-        if (skip_repeated && interactive) {
-                if (get_internal_buffer() == last_msg) {
-                        last_msg_repeats++;
-                        printf("    Last message repeated %d times\r", last_msg_repeats);
-                        fflush(stdout);
-                        return;
-                }
-
-                if (last_msg_repeats > 0) {
-                        start_newline = "\n";
-                }
-                last_msg_repeats = 0;
-        }
-
-        printf("%s%s%s", start_newline, ts_str, get_internal_buffer().c_str());
-
-        std::swap(last_msg, get_internal_buffer());
-}
-
-inline void Log_output::submit_raw(){
-        std::lock_guard<std::mutex> lock(mut);
-        if(last_msg_repeats > 0)
-                fputc('\n', stdout);
-        fputs(get_internal_buffer().c_str(), stdout);
-        std::swap(last_msg, get_internal_buffer());
-        last_msg_repeats = 0;
-}
-
 inline Log_output& get_log_output(){
         static Log_output out;
         return out;
@@ -295,7 +304,7 @@ public:
 
                 auto buf = get_log_output().get_buffer();
                 buf.append(msg);
-                buf.submit();
+                buf.submit(level <= LOG_LEVEL_FATAL);
         }
 
         inline std::ostream& Get() {
@@ -311,6 +320,12 @@ private:
 
 #define LOG(level) \
 if ((level) <= log_level) Logger(level).Get()
+/// stream version of log_msg_limited()
+#define LOG_LIMITED(level, interval_ms) \
+if (static struct log_rate_limit log_rl_; \
+    (level) <= log_level && \
+    log_rate_limit_pass((level), &log_rl_, (interval_ms))) \
+        Logger(level).Get()
 
 
 #endif
@@ -74,6 +74,7 @@ struct exporter {
         pthread_mutex_t lock;
 
         long long int limit; ///< number of video frames to record, -1 == unlimited (default)
+        size_t segment_size; ///< 0 - file per frame
         bool exit_on_limit;
 };
 
@@ -90,7 +91,7 @@ static void usage() {
         color_printf("Usage:\n");
         color_printf("\t" TBOLD(
             TRED("--record") "[=<dir>[:limit=<n>[:exit_on_limit]][:noaudio]"
-            "[:novideo][:override][:paused]] ") "\n" "\t" TBOLD(TRED("-E")
+            "[:novideo][:override][:paused][:segmented[=<MiB>]]] ") "\n" "\t" TBOLD(TRED("-E")
             "[<dir>[:<opts>]]") "\n\t" TBOLD("--record=help | -Ehelp") "\n");
         color_printf("where\n");
         color_printf(TERM_BOLD "\tlimit=<n>" TERM_RESET "         - write at "
@@ -100,6 +101,7 @@ static void usage() {
                                "existing files in the given directory\n");
         color_printf(TERM_BOLD "\tnoaudio | novideo" TERM_RESET " - do not export audio/video\n");
         color_printf(TERM_BOLD "\tpaused" TERM_RESET "            - use specified directory but do not export immediately (can be started with a key or through control socket)\n");
+        color_printf(TERM_BOLD "\tsegmented" TERM_RESET "         - append video frames to preallocated segment files of given size (default %d MiB) instead of a file per frame\n", VIDEO_EXPORT_DEFAULT_SEGMENT_SIZE / 1024 / 1024);
 }
 
 static bool
@@ -133,6 +135,16 @@ parse_options(struct exporter *s, const char *ccfg, bool *should_export)
                         }
                 } else if (strcmp(item, "exit_on_limit") == 0) {
                         s->exit_on_limit = true;
+                } else if (strstr(item, "segmented") == item) {
+                        s->segment_size = VIDEO_EXPORT_DEFAULT_SEGMENT_SIZE;
+                        if (strchr(item, '=') != NULL) {
+                                long long mib = strtoll(strchr(item, '=') + 1, NULL, 0);
+                                if (mib <= 0) {
+                                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong segment size: %s!\n", strchr(item, '=') + 1);
+                                        return false;
+                                }
+                                s->segment_size = (size_t) mib * 1024 * 1024;
+                        }
                 } else if (s->dir == NULL && cfg != NULL) {
                         s->dir = strdup(item);
                 } else {
@@ -181,7 +193,7 @@ static bool enable_export(struct exporter *s)
         }
 
         if (!s->novideo) {
-                s->video_export = video_export_init(s->dir);
+                s->video_export = video_export_init(s->dir, s->segment_size);
                 if (!s->video_export) {
                         goto error;
                 }
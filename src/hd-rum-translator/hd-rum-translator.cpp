@@ -79,6 +79,7 @@
 #include "utils/color_out.h"
 #include "utils/misc.h" // format_in_si_units, unit_evaluate
 #include "utils/net.h"
+#include "utils/worker.h"
 
 using std::invalid_argument;
 using std::stoi;
@@ -238,6 +239,13 @@ struct item {
     char *buf;
 };
 
+#define RECV_BATCH 64       ///< max datagrams received by one udp_recvfrom_batch()
+#define SEND_BATCH 64       ///< max datagrams fanned out to replicas at once
+#define REPLICAS_PER_SENDER 8 ///< min replicas to justify an additional sender thread
+
+ADD_TO_PARAM("hd-rum-send-threads", "* hd-rum-send-threads=<n>\n"
+                "  Max number of threads sending to output ports (default: number of cores).\n");
+
 static struct item *qinit(int qsize)
 {
     struct item *queue;
@@ -363,6 +371,52 @@ static int create_output_port(struct hd_rum_translator_state *s,
         return idx;
 }
 
+#ifndef _WIN32
+struct send_task_data {
+    struct hd_rum_translator_state *s;
+    char *const *bufs;
+    const int *lens;
+    int count;
+    unsigned first_replica;
+    unsigned stride;
+};
+
+static void *send_task(void *arg)
+{
+    auto *d = (struct send_task_data *) arg;
+    for (unsigned i = d->first_replica; i < d->s->replicas.size(); i += d->stride) {
+        replica *r = d->s->replicas[i];
+        if (r->type == replica::type_t::USE_SOCK) {
+            udp_sendto_batch(r->sock.get(), d->bufs, d->lens, d->count,
+                             (sockaddr *) &r->sockaddr, r->sockaddr_len);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Sends the batch to all output ports that don't need transcoding. The
+ * buffers are shared by all replicas (no copy), with many replicas these
+ * are distributed among multiple sender threads.
+ */
+static void send_to_replicas(struct hd_rum_translator_state *s,
+                             char *const *bufs, const int *lens, int count)
+{
+    unsigned max_threads = get_cpu_core_count();
+    if (const char *val = get_commandline_param("hd-rum-send-threads")) {
+        max_threads = MAX(atoi(val), 1);
+    }
+    unsigned threads = (s->replicas.size() + REPLICAS_PER_SENDER - 1) / REPLICAS_PER_SENDER;
+    threads = MAX(MIN(threads, max_threads), 1U);
+
+    vector<struct send_task_data> data(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        data[i] = { s, bufs, lens, count, i, threads };
+    }
+    task_run_parallel(send_task, threads, data.data(), sizeof data[0], nullptr);
+}
+#endif
+
 static void *writer(void *arg)
 {
     struct hd_rum_translator_state *s =
@@ -466,6 +520,7 @@ static void *writer(void *arg)
 
         // then process incoming packets
         while (s->qhead != s->qtail) {
+#ifdef _WIN32
             if(s->qhead->size == 0) { // poisoned pill
                 return NULL;
             }
@@ -479,7 +534,6 @@ static void *writer(void *arg)
             }
 
             // distribute it to output ports that don't need transcoding
-#ifdef _WIN32
             // send it asynchronously in MSW (performance optimalization)
             SleepEx(0, TRUE); // allow system to call our completion routines in APC
             int ref = 0;
@@ -506,17 +560,44 @@ static void *writer(void *arg)
             }
             // reallocate the buffer since the last one will be freeed automaticaly
             s->qhead->buf = (char *) malloc(SIZE);
+            s->qhead = s->qhead->next;
 #else
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    ssize_t ret = udp_sendto(s->replicas[i]->sock.get(), s->qhead->buf, s->qhead->size, (sockaddr *) &s->replicas[i]->sockaddr, s->replicas[i]->sockaddr_len);
+            // take all queued packets (up to SEND_BATCH) at once
+            char *bufs[SEND_BATCH];
+            int lens[SEND_BATCH];
+            int count = 0;
+            bool poisoned = false;
+            struct item *end = s->qhead;
+            while (end != s->qtail && count < SEND_BATCH) {
+                if (end->size == 0) {
+                    poisoned = true;
+                    break;
+                }
+                bufs[count] = end->buf;
+                lens[count] = (int) end->size;
+                count += 1;
+                end = end->next;
+            }
+
+            // pass it for transcoding if needed
+            if (recompress_get_num_active_ports(s->recompress) > 0) {
+                for (int i = 0; i < count; ++i) {
+                    ssize_t ret = hd_rum_decompress_write(s->decompress, bufs[i], lens[i]);
                     if (ret < 0) {
-                        perror("Hd-rum-translator send");
+                        perror("hd_rum_decompress_write");
                     }
                 }
             }
+
+            if (count > 0) {
+                send_to_replicas(s, bufs, lens, count);
+            }
+            // release the items only after sent, the buffers are referenced until then
+            s->qhead = end;
+            if (poisoned) {
+                return NULL;
+            }
 #endif
-            s->qhead = s->qhead->next;
 
             pthread_mutex_lock(&s->qfull_mtx);
             s->qfull = 0;
@@ -1124,6 +1205,7 @@ int main(int argc, char **argv)
         fprintf(stderr, "cannot create writer thread\n");
         EXIT(2);
     }
+    log_async_start();
 
     uint64_t received_data = 0;
     struct timeval t0;
@@ -1144,23 +1226,35 @@ int main(int argc, char **argv)
         while (state.qtail->next != state.qhead && !should_exit) {
             struct timeval timeout = { 1, 0 };
 
-            struct sockaddr_storage sin = {};
-            socklen_t addrlen = sizeof(sin);
-            state.qtail->size = udp_recvfrom_timeout(sock_in, state.qtail->buf, SIZE, &timeout, (sockaddr *) &sin, &addrlen);
-            if(state.qtail->size <= 0)
+            // receive into all free items at once (one is always kept empty)
+            char *bufs[RECV_BATCH];
+            int lens[RECV_BATCH];
+            struct sockaddr_storage sin[RECV_BATCH];
+            socklen_t addrlen[RECV_BATCH];
+            int free_items = 0;
+            for (struct item *it = state.qtail; it->next != state.qhead && free_items < RECV_BATCH; it = it->next) {
+                bufs[free_items++] = it->buf;
+            }
+            const bool conference = params.out_conf.mode == CONFERENCE;
+            int count = udp_recvfrom_batch(sock_in, bufs, MAX_PKT_SIZE, lens, free_items, &timeout,
+                    conference ? sin : nullptr, conference ? addrlen : nullptr);
+            if (count <= 0) {
+                state.qtail->size = 0;
                 break;
+            }
 
             struct timeval t;
             gettimeofday(&t, NULL);
 
-            if(params.out_conf.mode == CONFERENCE){
-                    participant_mgr.tick(sin, addrlen);
+            for (int i = 0; i < count; ++i) {
+                if (conference) {
+                    participant_mgr.tick(sin[i], addrlen[i]);
+                }
+                received_data += lens[i];
+                state.qtail->size = lens[i];
+                state.qtail = state.qtail->next;
             }
 
-            received_data += state.qtail->size;
-
-            state.qtail = state.qtail->next;
-
             pthread_mutex_lock(&state.qempty_mtx);
             state.qempty = 0;
             pthread_cond_signal(&state.qempty_cond);
@@ -202,6 +202,7 @@ static bool validate_param(const char *param);
 static bool unexpected_exit_called = true; // check for unexpected exit()
 void common_cleanup(struct init_data *init)
 {
+        log_async_stop();
         if (init) {
 #if defined BUILD_LIBRARIES
                 for (auto a : init->opened_libs) {
@@ -1493,6 +1493,7 @@ int main(int argc, char *argv[])
 
                 audio_start(uv.audio);
 
+                log_async_start();
                 control_start(control);
                 kc.start();
 
@@ -383,10 +383,11 @@ void pdb_destroy_item(struct pdb_e *item)
 		free(item->sdes_loc);
 		free(item->sdes_tool);
 		free(item->sdes_note);
+                // pbuf may hold a frame being assembled by the decoder
+                pbuf_destroy(item->playout_buffer);
                 if (item->decoder_state_deleter && item->decoder_state) {
                         item->decoder_state_deleter(item->decoder_state);
                 }
-                pbuf_destroy(item->playout_buffer);
                 tfrc_done(item->tfrc_state);
                 free(item);
         }
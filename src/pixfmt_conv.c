@@ -67,6 +67,10 @@
 #ifdef __SSSE3__
 #include "tmmintrin.h"
 #endif
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define PIXFMT_CONV_X86_DISPATCH 1
+#endif
 
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 #define BYTE_SWAP(x) (3 - x)
@@ -1119,25 +1123,27 @@ static void vc_copylineUYVYtoRG48(unsigned char * __restrict dst, const unsigned
  */
 static void vc_copylineUYVYtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift) {
+        enum { DEPTH = DEPTH8 };
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
+        const struct color_coeffs cfs = *get_color_coeffs(CS_DFL, DEPTH);
         uint32_t *dst32 = (uint32_t *)(void *) dst;
         uint32_t alpha_mask = 0xFFFFFFFFU ^ (0xFFU << rshift) ^ (0xFFU << gshift) ^ (0xFFU << bshift);
         OPTIMIZED_FOR (int x = 0; x <= dst_len - 8; x += 8) {
-                register int y1, y2, u ,v;
-                u = *src++;
-                y1 = *src++;
-                v = *src++;
-                y2 = *src++;
-                int r = 1.164 * (y1 - 16) + 1.793 * (v - 128);
-                int g = 1.164 * (y1 - 16) - 0.534 * (v - 128) - 0.213 * (u - 128);
-                int b = 1.164 * (y1 - 16) + 2.115 * (u - 128);
+                int u = src[0] - 128;
+                int y1 = cfs.y_scale * (src[1] - 16);
+                int v = src[2] - 128;
+                int y2 = cfs.y_scale * (src[3] - 16);
+                src += 4;
+                int r = YCBCR_TO_R(cfs, y1, u, v) >> COMP_BASE;
+                int g = YCBCR_TO_G(cfs, y1, u, v) >> COMP_BASE;
+                int b = YCBCR_TO_B(cfs, y1, u, v) >> COMP_BASE;
                 r = CLAMP(r, 0, 255);
                 g = CLAMP(g, 0, 255);
                 b = CLAMP(b, 0, 255);
                 *dst32++ = alpha_mask | r << rshift | g << gshift | b << bshift;
-                r = 1.164 * (y2 - 16) + 1.793 * (v - 128);
-                g = 1.164 * (y2 - 16) - 0.534 * (v - 128) - 0.213 * (u - 128);
-                b = 1.164 * (y2 - 16) + 2.115 * (u - 128);
+                r = YCBCR_TO_R(cfs, y2, u, v) >> COMP_BASE;
+                g = YCBCR_TO_G(cfs, y2, u, v) >> COMP_BASE;
+                b = YCBCR_TO_B(cfs, y2, u, v) >> COMP_BASE;
                 r = CLAMP(r, 0, 255);
                 g = CLAMP(g, 0, 255);
                 b = CLAMP(b, 0, 255);
@@ -2929,6 +2935,628 @@ static void vc_copylineY416toV210(unsigned char * __restrict dst, const unsigned
         }
 }
 
+#ifdef PIXFMT_CONV_X86_DISPATCH
+/*
+ * AVX2 and AVX-512 variants of the most used line decoders. Each kernel
+ * converts as many whole vector blocks as fits in dst_len (always a multiple
+ * of the scalar block) and passes the rest to the scalar version, so that
+ * the output is bit-exact and no byte outside the scalar footprint is read
+ * or written.
+ */
+#define AVX2 __attribute__((target("avx2")))
+#define AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+
+/// packs the low 3 bytes of every 32-bit word to the first 24 bytes
+static inline AVX2 __m256i pack_24_of_32_avx2(__m256i x)
+{
+        const __m256i compact = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2,
+            4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        x = _mm256_shuffle_epi8(x, compact);
+        return _mm256_permutevar8x32_epi32(
+            x, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+}
+
+static inline AVX2 void store_24_avx2(unsigned char *dst, __m256i x)
+{
+        _mm_storeu_si128((__m128i *)(void *) dst, _mm256_castsi256_si128(x));
+        _mm_storel_epi64((__m128i *)(void *) (dst + 16),
+                         _mm256_extracti128_si256(x, 1));
+}
+
+/// spreads 24 bytes to the low 3 bytes of 8 32-bit words (upper is zeroed)
+static inline AVX2 __m256i load_24_to_32_avx2(const unsigned char *src)
+{
+        const __m256i spread = _mm256_setr_epi8(
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 4, 5, 6, -1,
+            7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+        __m256i x = _mm256_loadu2_m128i((const __m128i *)(const void *) (src + 8),
+                                        (const __m128i *)(const void *) src);
+        return _mm256_shuffle_epi8(x, spread);
+}
+
+static AVX2 void
+vc_copylinev210_avx2(unsigned char *__restrict dst,
+                     const unsigned char *__restrict src, int dst_len,
+                     int rshift, int gshift, int bshift)
+{
+        const __m256i mask8 = _mm256_set1_epi32(0xFF);
+        while (dst_len >= 24) {
+                __m256i w = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i x = _mm256_or_si256(
+                    _mm256_and_si256(_mm256_srli_epi32(w, 2), mask8),
+                    _mm256_or_si256(
+                        _mm256_and_si256(_mm256_srli_epi32(w, 4),
+                                         _mm256_slli_epi32(mask8, 8)),
+                        _mm256_and_si256(_mm256_srli_epi32(w, 6),
+                                         _mm256_slli_epi32(mask8, 16))));
+                store_24_avx2(dst, pack_24_of_32_avx2(x));
+                src += 32;
+                dst += 24;
+                dst_len -= 24;
+        }
+        vc_copylinev210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX512 void
+vc_copylinev210_avx512(unsigned char *__restrict dst,
+                       const unsigned char *__restrict src, int dst_len,
+                       int rshift, int gshift, int bshift)
+{
+        const __m512i mask8 = _mm512_set1_epi32(0xFF);
+        const __m512i compact = _mm512_broadcast_i32x4(_mm_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+        const __m512i perm = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12,
+                                               13, 14, 3, 7, 11, 15);
+        while (dst_len >= 48) {
+                __m512i w = _mm512_loadu_si512(src);
+                __m512i x = _mm512_ternarylogic_epi32(
+                    _mm512_and_si512(_mm512_srli_epi32(w, 2), mask8),
+                    _mm512_and_si512(_mm512_srli_epi32(w, 4),
+                                     _mm512_slli_epi32(mask8, 8)),
+                    _mm512_and_si512(_mm512_srli_epi32(w, 6),
+                                     _mm512_slli_epi32(mask8, 16)),
+                    0xFE); // a | b | c
+                x = _mm512_permutexvar_epi32(perm,
+                                             _mm512_shuffle_epi8(x, compact));
+                _mm512_mask_storeu_epi8(dst, 0xFFFFFFFFFFFFULL, x);
+                src += 64;
+                dst += 48;
+                dst_len -= 48;
+        }
+        vc_copylinev210_avx2(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static inline AVX2 __m256i uyvy_to_v210_word_avx2(__m256i x)
+{
+        const __m256i mask8 = _mm256_set1_epi32(0xFF);
+        return _mm256_or_si256(
+            _mm256_slli_epi32(_mm256_and_si256(x, mask8), 2),
+            _mm256_or_si256(
+                _mm256_slli_epi32(
+                    _mm256_and_si256(x, _mm256_slli_epi32(mask8, 8)), 4),
+                _mm256_slli_epi32(
+                    _mm256_and_si256(x, _mm256_slli_epi32(mask8, 16)), 6)));
+}
+
+static AVX2 void
+vc_copylineUYVYtoV210_avx2(unsigned char *__restrict dst,
+                           const unsigned char *__restrict src, int dst_len,
+                           int rshift, int gshift, int bshift)
+{
+        while (dst_len >= 32) {
+                __m256i w = uyvy_to_v210_word_avx2(load_24_to_32_avx2(src));
+                _mm256_storeu_si256((__m256i *)(void *) dst, w);
+                src += 24;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineUYVYtoV210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX512 void
+vc_copylineUYVYtoV210_avx512(unsigned char *__restrict dst,
+                             const unsigned char *__restrict src, int dst_len,
+                             int rshift, int gshift, int bshift)
+{
+        const __m512i mask8 = _mm512_set1_epi32(0xFF);
+        const __m512i perm = _mm512_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6, 6, 7,
+                                               8, 9, 9, 10, 11, 12);
+        const __m512i spread = _mm512_broadcast_i32x4(_mm_setr_epi8(
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+        while (dst_len >= 64) {
+                __m512i x = _mm512_maskz_loadu_epi8(0xFFFFFFFFFFFFULL, src);
+                x = _mm512_shuffle_epi8(_mm512_permutexvar_epi32(perm, x),
+                                        spread);
+                __m512i w = _mm512_ternarylogic_epi32(
+                    _mm512_slli_epi32(_mm512_and_si512(x, mask8), 2),
+                    _mm512_slli_epi32(
+                        _mm512_and_si512(x, _mm512_slli_epi32(mask8, 8)), 4),
+                    _mm512_slli_epi32(
+                        _mm512_and_si512(x, _mm512_slli_epi32(mask8, 16)), 6),
+                    0xFE); // a | b | c
+                _mm512_storeu_si512(dst, w);
+                src += 48;
+                dst += 64;
+                dst_len -= 64;
+        }
+        vc_copylineUYVYtoV210_avx2(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * v210 samples are extracted from 16-bit windows: a sample at bit offset
+ * 0/2/4 of the window is moved to the top 10 bits by multiplying with
+ * 64/16/4 and masking.
+ */
+static AVX2 void
+vc_copylineV210toY216_avx2(unsigned char *__restrict dst,
+                           const unsigned char *__restrict src, int dst_len,
+                           int rshift, int gshift, int bshift)
+{
+        const __m256i m0 = _mm256_setr_epi8(
+            1, 2, 0, 1, 4, 5, 2, 3, 6, 7, 5, 6, 9, 10, 8, 9, 1, 2, 0, 1, 4, 5,
+            2, 3, 6, 7, 5, 6, 9, 10, 8, 9);
+        const __m256i m1 = _mm256_setr_epi8(
+            12, 13, 10, 11, 14, 15, 13, 14, -1, -1, -1, -1, -1, -1, -1, -1, 12,
+            13, 10, 11, 14, 15, 13, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i mul0 = _mm256_setr_epi16(16, 64, 64, 4, 4, 16, 16, 64,
+                                               16, 64, 64, 4, 4, 16, 16, 64);
+        const __m256i mul1 = _mm256_setr_epi16(64, 4, 4, 16, 0, 0, 0, 0, 64,
+                                               4, 4, 16, 0, 0, 0, 0);
+        const __m256i mask = _mm256_set1_epi16((short) 0xFFC0);
+        while (dst_len >= 48) {
+                __m256i x = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i r0 = _mm256_and_si256(
+                    _mm256_mullo_epi16(_mm256_shuffle_epi8(x, m0), mul0), mask);
+                __m256i r1 = _mm256_and_si256(
+                    _mm256_mullo_epi16(_mm256_shuffle_epi8(x, m1), mul1), mask);
+                _mm_storeu_si128((__m128i *)(void *) dst,
+                                 _mm256_castsi256_si128(r0));
+                _mm_storel_epi64((__m128i *)(void *) (dst + 16),
+                                 _mm256_castsi256_si128(r1));
+                _mm_storeu_si128((__m128i *)(void *) (dst + 24),
+                                 _mm256_extracti128_si256(r0, 1));
+                _mm_storel_epi64((__m128i *)(void *) (dst + 40),
+                                 _mm256_extracti128_si256(r1, 1));
+                src += 32;
+                dst += 48;
+                dst_len -= 48;
+        }
+        vc_copylineV210toY216(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// @copydetails vc_copylineV210toY216_avx2
+static AVX2 void
+vc_copylineV210toY416_avx2(unsigned char *__restrict dst,
+                           const unsigned char *__restrict src, int dst_len,
+                           int rshift, int gshift, int bshift)
+{
+        const __m256i m0 = _mm256_setr_epi8(
+            0, 1, 1, 2, 2, 3, -1, -1, 0, 1, 4, 5, 2, 3, -1, -1, 0, 1, 1, 2, 2,
+            3, -1, -1, 0, 1, 4, 5, 2, 3, -1, -1);
+        const __m256i m1 = _mm256_setr_epi8(
+            5, 6, 6, 7, 8, 9, -1, -1, 5, 6, 9, 10, 8, 9, -1, -1, 5, 6, 6, 7, 8,
+            9, -1, -1, 5, 6, 9, 10, 8, 9, -1, -1);
+        const __m256i m2 = _mm256_setr_epi8(
+            10, 11, 12, 13, 13, 14, -1, -1, 10, 11, 14, 15, 13, 14, -1, -1, 10,
+            11, 12, 13, 13, 14, -1, -1, 10, 11, 14, 15, 13, 14, -1, -1);
+        const __m256i mul0 = _mm256_setr_epi16(64, 16, 4, 0, 64, 64, 4, 0, 64,
+                                               16, 4, 0, 64, 64, 4, 0);
+        const __m256i mul1 = _mm256_setr_epi16(16, 4, 64, 0, 16, 16, 64, 0, 16,
+                                               4, 64, 0, 16, 16, 64, 0);
+        const __m256i mul2 = _mm256_setr_epi16(4, 64, 16, 0, 4, 4, 16, 0, 4,
+                                               64, 16, 0, 4, 4, 16, 0);
+        const __m256i mask = _mm256_set1_epi16((short) 0xFFC0);
+        const __m256i alpha = _mm256_set1_epi64x((long long) 0xFFFF000000000000ULL);
+        while (dst_len >= 96) {
+                __m256i x = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i o[3];
+                o[0] = _mm256_mullo_epi16(_mm256_shuffle_epi8(x, m0), mul0);
+                o[1] = _mm256_mullo_epi16(_mm256_shuffle_epi8(x, m1), mul1);
+                o[2] = _mm256_mullo_epi16(_mm256_shuffle_epi8(x, m2), mul2);
+                for (int i = 0; i < 3; ++i) {
+                        o[i] = _mm256_or_si256(_mm256_and_si256(o[i], mask),
+                                               alpha);
+                        _mm_storeu_si128((__m128i *)(void *) (dst + 16 * i),
+                                         _mm256_castsi256_si128(o[i]));
+                        _mm_storeu_si128(
+                            (__m128i *)(void *) (dst + 48 + 16 * i),
+                            _mm256_extracti128_si256(o[i], 1));
+                }
+                src += 32;
+                dst += 96;
+                dst_len -= 96;
+        }
+        vc_copylineV210toY416(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static inline AVX2 __m256i pack_v210_avx2(__m256i a, __m256i b, __m256i c)
+{
+        return _mm256_or_si256(
+            a, _mm256_or_si256(_mm256_slli_epi32(b, 10),
+                               _mm256_slli_epi32(c, 20)));
+}
+
+static AVX2 void
+vc_copylineY216toV210_avx2(unsigned char *__restrict dst,
+                           const unsigned char *__restrict src, int dst_len,
+                           int rshift, int gshift, int bshift)
+{
+        // x holds samples 0-7 of a block, y samples 4-11
+        const __m256i a_x = _mm256_setr_epi8(
+            2, 3, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3,
+            -1, -1, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i a_y = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, 6, 7, -1, -1, 8, 9, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, 6, 7, -1, -1, 8, 9, -1, -1);
+        const __m256i b_x = _mm256_setr_epi8(
+            0, 1, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1,
+            -1, -1, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i b_y = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, 4, 5, -1, -1, 14, 15, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, 4, 5, -1, -1, 14, 15, -1, -1);
+        const __m256i c_x = _mm256_setr_epi8(
+            6, 7, -1, -1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 6, 7,
+            -1, -1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i c_y = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1, 12, 13, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1, 12, 13, -1, -1);
+        while (dst_len >= 32) {
+                __m256i x = _mm256_srli_epi16(
+                    _mm256_loadu2_m128i(
+                        (const __m128i *)(const void *) (src + 24),
+                        (const __m128i *)(const void *) src),
+                    6);
+                __m256i y = _mm256_srli_epi16(
+                    _mm256_loadu2_m128i(
+                        (const __m128i *)(const void *) (src + 32),
+                        (const __m128i *)(const void *) (src + 8)),
+                    6);
+                __m256i a = _mm256_or_si256(_mm256_shuffle_epi8(x, a_x),
+                                            _mm256_shuffle_epi8(y, a_y));
+                __m256i b = _mm256_or_si256(_mm256_shuffle_epi8(x, b_x),
+                                            _mm256_shuffle_epi8(y, b_y));
+                __m256i c = _mm256_or_si256(_mm256_shuffle_epi8(x, c_x),
+                                            _mm256_shuffle_epi8(y, c_y));
+                _mm256_storeu_si256((__m256i *)(void *) dst,
+                                    pack_v210_avx2(a, b, c));
+                src += 48;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineY216toV210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * Returns U avg, Y0, V avg, Y1 (shifted to 10 bits) in the low 4 words for
+ * 2 Y416 pixels in every 128-bit lane.
+ */
+static inline AVX2 __m256i y416_pair_to_422_avx2(__m256i c)
+{
+        const __m256i one = _mm256_set1_epi16(1);
+        __m256i c2 = _mm256_srli_si256(c, 8);
+        // floor((c + c2) / 2) without overflow
+        __m256i avg = _mm256_add_epi16(
+            _mm256_add_epi16(_mm256_srli_epi16(c, 1), _mm256_srli_epi16(c2, 1)),
+            _mm256_and_si256(_mm256_and_si256(c, c2), one));
+        __m256i t = _mm256_blend_epi16(avg, c, 0x02);
+        t = _mm256_blend_epi16(t, _mm256_slli_si256(c2, 4), 0x08);
+        return _mm256_srli_epi16(t, 6);
+}
+
+static AVX2 void
+vc_copylineY416toV210_avx2(unsigned char *__restrict dst,
+                           const unsigned char *__restrict src, int dst_len,
+                           int rshift, int gshift, int bshift)
+{
+        // a holds samples 0-7 of a block, b samples 8-11
+        const __m256i a_a = _mm256_setr_epi8(
+            0, 1, -1, -1, 6, 7, -1, -1, 12, 13, -1, -1, -1, -1, -1, -1, 0, 1,
+            -1, -1, 6, 7, -1, -1, 12, 13, -1, -1, -1, -1, -1, -1);
+        const __m256i a_b = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, -1, -1);
+        const __m256i b_a = _mm256_setr_epi8(
+            2, 3, -1, -1, 8, 9, -1, -1, 14, 15, -1, -1, -1, -1, -1, -1, 2, 3,
+            -1, -1, 8, 9, -1, -1, 14, 15, -1, -1, -1, -1, -1, -1);
+        const __m256i b_b = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 4, 5, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 4, 5, -1, -1);
+        const __m256i c_a = _mm256_setr_epi8(
+            4, 5, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 4, 5,
+            -1, -1, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i c_b = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, -1, -1, 6, 7, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, 0, 1, -1, -1, 6, 7, -1, -1);
+        while (dst_len >= 32) {
+                __m256i t[3];
+                for (int i = 0; i < 3; ++i) {
+                        t[i] = y416_pair_to_422_avx2(_mm256_loadu2_m128i(
+                            (const __m128i *)(const void *) (src + 48 + 16 * i),
+                            (const __m128i *)(const void *) (src + 16 * i)));
+                }
+                __m256i a = _mm256_unpacklo_epi64(t[0], t[1]);
+                __m256i b = t[2];
+                __m256i va = _mm256_or_si256(_mm256_shuffle_epi8(a, a_a),
+                                             _mm256_shuffle_epi8(b, a_b));
+                __m256i vb = _mm256_or_si256(_mm256_shuffle_epi8(a, b_a),
+                                             _mm256_shuffle_epi8(b, b_b));
+                __m256i vc = _mm256_or_si256(_mm256_shuffle_epi8(a, c_a),
+                                             _mm256_shuffle_epi8(b, c_b));
+                _mm256_storeu_si256((__m256i *)(void *) dst,
+                                    pack_v210_avx2(va, vb, vc));
+                src += 96;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineY416toV210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// returns R10k words byte-swapped to native (big-endian) bit order
+static inline AVX2 __m256i load_r10k_avx2(const unsigned char *src)
+{
+        const __m256i bswap = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7,
+            6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        return _mm256_shuffle_epi8(
+            _mm256_loadu_si256((const __m256i *)(const void *) src), bswap);
+}
+
+static AVX2 void
+vc_copyliner10k_avx2(unsigned char *__restrict dst,
+                     const unsigned char *__restrict src, int dst_len,
+                     int rshift, int gshift, int bshift)
+{
+        const uint32_t alpha_mask = 0xFFFFFFFFU ^ (0xFFU << rshift) ^
+                                    (0xFFU << gshift) ^ (0xFFU << bshift);
+        const __m256i alpha = _mm256_set1_epi32((int) alpha_mask);
+        const __m256i mask8 = _mm256_set1_epi32(0xFF);
+        const __m128i rs = _mm_cvtsi32_si128(rshift);
+        const __m128i gs = _mm_cvtsi32_si128(gshift);
+        const __m128i bs = _mm_cvtsi32_si128(bshift);
+        while (dst_len >= 32) {
+                __m256i be = load_r10k_avx2(src);
+                __m256i r = _mm256_srli_epi32(be, 24);
+                __m256i g = _mm256_and_si256(_mm256_srli_epi32(be, 14), mask8);
+                __m256i b = _mm256_and_si256(_mm256_srli_epi32(be, 4), mask8);
+                __m256i out = _mm256_or_si256(
+                    _mm256_or_si256(alpha, _mm256_sll_epi32(r, rs)),
+                    _mm256_or_si256(_mm256_sll_epi32(g, gs),
+                                    _mm256_sll_epi32(b, bs)));
+                _mm256_storeu_si256((__m256i *)(void *) dst, out);
+                src += 32;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copyliner10k(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2 void
+vc_copyliner10ktoRGB_avx2(unsigned char *__restrict dst,
+                          const unsigned char *__restrict src, int dst_len,
+                          int rshift, int gshift, int bshift)
+{
+        const __m256i mask8 = _mm256_set1_epi32(0xFF);
+        while (dst_len >= 24) {
+                __m256i be = load_r10k_avx2(src);
+                __m256i rgb = _mm256_or_si256(
+                    _mm256_srli_epi32(be, 24),
+                    _mm256_or_si256(
+                        _mm256_slli_epi32(
+                            _mm256_and_si256(_mm256_srli_epi32(be, 14), mask8),
+                            8),
+                        _mm256_slli_epi32(
+                            _mm256_and_si256(_mm256_srli_epi32(be, 4), mask8),
+                            16)));
+                store_24_avx2(dst, pack_24_of_32_avx2(rgb));
+                src += 32;
+                dst += 24;
+                dst_len -= 24;
+        }
+        vc_copyliner10ktoRGB(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2 void
+vc_copylineRGBAtoR10k_avx2(unsigned char *__restrict dst,
+                           const unsigned char *__restrict src, int dst_len,
+                           int rshift, int gshift, int bshift)
+{
+        const __m256i bswap = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7,
+            6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        const __m256i mask8 = _mm256_set1_epi32(0xFF);
+        const __m256i padding = _mm256_set1_epi32(0x3);
+        while (dst_len >= 32) {
+                __m256i x = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i g = _mm256_and_si256(_mm256_srli_epi32(x, 8), mask8);
+                __m256i b = _mm256_and_si256(_mm256_srli_epi32(x, 16), mask8);
+                __m256i be = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_slli_epi32(x, 24), padding),
+                    _mm256_or_si256(_mm256_slli_epi32(g, 14),
+                                    _mm256_slli_epi32(b, 4)));
+                _mm256_storeu_si256((__m256i *)(void *) dst,
+                                    _mm256_shuffle_epi8(be, bswap));
+                src += 32;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineRGBAtoR10k(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2 void
+vc_copylineRG48toR12L_avx2(unsigned char *__restrict dst,
+                           const unsigned char *__restrict src, int dst_len,
+                           int rshift, int gshift, int bshift)
+{
+        const __m256i lo = _mm256_set1_epi32(0xFFF);
+        const __m256i hi = _mm256_set1_epi32(0xFFF000);
+        // 3 iterations make 2 whole R12L blocks (16 pixels)
+        while (dst_len >= 72) {
+                for (int i = 0; i < 3; ++i) {
+                        __m256i x = _mm256_loadu_si256(
+                            (const __m256i *)(const void *) src);
+                        __m256i w = _mm256_or_si256(
+                            _mm256_and_si256(_mm256_srli_epi32(x, 4), lo),
+                            _mm256_and_si256(_mm256_srli_epi32(x, 8), hi));
+                        store_24_avx2(dst, pack_24_of_32_avx2(w));
+                        src += 32;
+                        dst += 24;
+                }
+                dst_len -= 72;
+        }
+        vc_copylineRG48toR12L(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2 void
+vc_copylineR12LtoRG48_avx2(unsigned char *__restrict dst,
+                           const unsigned char *__restrict src, int dst_len,
+                           int rshift, int gshift, int bshift)
+{
+        const __m256i lo = _mm256_set1_epi32(0xFFF0);
+        const __m256i hi = _mm256_set1_epi32((int) 0xFFF00000U);
+        // 3 iterations make 2 whole R12L blocks (16 pixels)
+        while (dst_len >= 96) {
+                for (int i = 0; i < 3; ++i) {
+                        __m256i w = load_24_to_32_avx2(src);
+                        __m256i x = _mm256_or_si256(
+                            _mm256_and_si256(_mm256_slli_epi32(w, 4), lo),
+                            _mm256_and_si256(_mm256_slli_epi32(w, 8), hi));
+                        _mm256_storeu_si256((__m256i *)(void *) dst, x);
+                        src += 24;
+                        dst += 32;
+                }
+                dst_len -= 96;
+        }
+        vc_copylineR12LtoRG48(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2 void
+vc_copylineUYVYtoRGBA_avx2(unsigned char *__restrict dst,
+                           const unsigned char *__restrict src, int dst_len,
+                           int rshift, int gshift, int bshift)
+{
+        const struct color_coeffs cfs = *get_color_coeffs(CS_DFL, DEPTH8);
+        const uint32_t alpha_mask = 0xFFFFFFFFU ^ (0xFFU << rshift) ^
+                                    (0xFFU << gshift) ^ (0xFFU << bshift);
+        const __m256i alpha = _mm256_set1_epi32((int) alpha_mask);
+        const __m128i y_idx = _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, -1, -1,
+                                            -1, -1, -1, -1, -1, -1);
+        const __m128i u_idx = _mm_setr_epi8(0, 0, 4, 4, 8, 8, 12, 12, -1, -1,
+                                            -1, -1, -1, -1, -1, -1);
+        const __m128i v_idx = _mm_setr_epi8(2, 2, 6, 6, 10, 10, 14, 14, -1,
+                                            -1, -1, -1, -1, -1, -1, -1);
+        const __m256i y_scale = _mm256_set1_epi32(cfs.y_scale);
+        const __m256i r_cr = _mm256_set1_epi32(cfs.r_cr);
+        const __m256i g_cb = _mm256_set1_epi32(cfs.g_cb);
+        const __m256i g_cr = _mm256_set1_epi32(cfs.g_cr);
+        const __m256i b_cb = _mm256_set1_epi32(cfs.b_cb);
+        const __m128i rs = _mm_cvtsi32_si128(rshift);
+        const __m128i gs = _mm_cvtsi32_si128(gshift);
+        const __m128i bs = _mm_cvtsi32_si128(bshift);
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i max = _mm256_set1_epi32(255);
+        while (dst_len >= 32) {
+                __m128i x = _mm_loadu_si128((const __m128i *)(const void *) src);
+                __m256i y = _mm256_mullo_epi32(
+                    _mm256_sub_epi32(
+                        _mm256_cvtepu8_epi32(_mm_shuffle_epi8(x, y_idx)),
+                        _mm256_set1_epi32(16)),
+                    y_scale);
+                __m256i u = _mm256_sub_epi32(
+                    _mm256_cvtepu8_epi32(_mm_shuffle_epi8(x, u_idx)),
+                    _mm256_set1_epi32(128));
+                __m256i v = _mm256_sub_epi32(
+                    _mm256_cvtepu8_epi32(_mm_shuffle_epi8(x, v_idx)),
+                    _mm256_set1_epi32(128));
+                __m256i r = _mm256_add_epi32(y, _mm256_mullo_epi32(v, r_cr));
+                __m256i g = _mm256_add_epi32(
+                    y, _mm256_add_epi32(_mm256_mullo_epi32(u, g_cb),
+                                        _mm256_mullo_epi32(v, g_cr)));
+                __m256i b = _mm256_add_epi32(y, _mm256_mullo_epi32(u, b_cb));
+                r = _mm256_min_epi32(
+                    _mm256_max_epi32(_mm256_srai_epi32(r, COMP_BASE), zero), max);
+                g = _mm256_min_epi32(
+                    _mm256_max_epi32(_mm256_srai_epi32(g, COMP_BASE), zero), max);
+                b = _mm256_min_epi32(
+                    _mm256_max_epi32(_mm256_srai_epi32(b, COMP_BASE), zero), max);
+                __m256i out = _mm256_or_si256(
+                    _mm256_or_si256(alpha, _mm256_sll_epi32(r, rs)),
+                    _mm256_or_si256(_mm256_sll_epi32(g, gs),
+                                    _mm256_sll_epi32(b, bs)));
+                _mm256_storeu_si256((__m256i *)(void *) dst, out);
+                src += 16;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineUYVYtoRGBA(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+static AVX2 void
+vc_copylineRGBAtoUYVY_avx2(unsigned char *__restrict dst,
+                           const unsigned char *__restrict src, int dst_len,
+                           int rshift, int gshift, int bshift)
+{
+        const struct color_coeffs cfs = *get_color_coeffs(CS_DFL, DEPTH8);
+        const __m256i mask8 = _mm256_set1_epi32(0xFF);
+        const __m256i y_r = _mm256_set1_epi32(cfs.y_r);
+        const __m256i y_g = _mm256_set1_epi32(cfs.y_g);
+        const __m256i y_b = _mm256_set1_epi32(cfs.y_b);
+        const __m256i cb_r = _mm256_set1_epi32(cfs.cb_r);
+        const __m256i cb_g = _mm256_set1_epi32(cfs.cb_g);
+        const __m256i cb_b = _mm256_set1_epi32(cfs.cb_b);
+        const __m256i cr_r = _mm256_set1_epi32(cfs.cr_r);
+        const __m256i cr_g = _mm256_set1_epi32(cfs.cr_g);
+        const __m256i cr_b = _mm256_set1_epi32(cfs.cr_b);
+        // every lane gives 8 bytes: u0 y0 v0 y1 u1 y2 v1 y3
+        const __m256i y_pos = _mm256_setr_epi8(
+            -1, 0, -1, 4, -1, 8, -1, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0,
+            -1, 4, -1, 8, -1, 12, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i uv_pos = _mm256_setr_epi8(
+            0, -1, 8, -1, 4, -1, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, -1,
+            8, -1, 4, -1, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        // the scalar version writes whole UYVY words, (dst_len + 3) / 4
+        while (dst_len > 12) {
+                __m256i x = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i r = _mm256_and_si256(x, mask8);
+                __m256i g = _mm256_and_si256(_mm256_srli_epi32(x, 8), mask8);
+                __m256i b = _mm256_and_si256(_mm256_srli_epi32(x, 16), mask8);
+                __m256i y = _mm256_add_epi32(
+                    _mm256_mullo_epi32(r, y_r),
+                    _mm256_add_epi32(_mm256_mullo_epi32(g, y_g),
+                                     _mm256_mullo_epi32(b, y_b)));
+                __m256i cb = _mm256_add_epi32(
+                    _mm256_mullo_epi32(r, cb_r),
+                    _mm256_add_epi32(_mm256_mullo_epi32(g, cb_g),
+                                     _mm256_mullo_epi32(b, cb_b)));
+                __m256i cr = _mm256_add_epi32(
+                    _mm256_mullo_epi32(r, cr_r),
+                    _mm256_add_epi32(_mm256_mullo_epi32(g, cr_g),
+                                     _mm256_mullo_epi32(b, cr_b)));
+                y = _mm256_add_epi32(_mm256_srai_epi32(y, COMP_BASE),
+                                     _mm256_set1_epi32(16));
+                // pair sums [u0 u1 v0 v1 | u2 u3 v2 v3], then
+                // ((sum / 2) >> COMP_BASE) + 128 (division rounds to zero)
+                __m256i uv = _mm256_hadd_epi32(cb, cr);
+                uv = _mm256_srai_epi32(
+                    _mm256_add_epi32(uv, _mm256_srli_epi32(uv, 31)), 1);
+                uv = _mm256_add_epi32(_mm256_srai_epi32(uv, COMP_BASE),
+                                      _mm256_set1_epi32(128));
+                __m256i out = _mm256_or_si256(_mm256_shuffle_epi8(y, y_pos),
+                                              _mm256_shuffle_epi8(uv, uv_pos));
+                out = _mm256_permute4x64_epi64(out, 0x8);
+                _mm_storeu_si128((__m128i *)(void *) dst,
+                                 _mm256_castsi256_si128(out));
+                src += 32;
+                dst += 16;
+                dst_len -= 16;
+        }
+        vc_copylineRGBAtoUYVY(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+#undef AVX2
+#undef AVX512
+#endif // defined PIXFMT_CONV_X86_DISPATCH
+
 struct decoder_item {
         decoder_t decoder;
         codec_t in;
@@ -2995,17 +3623,114 @@ static const struct decoder_item decoders[] = {
         { vc_copylineV210toRG48,  v210,  RG48 },
 };
 
+#ifdef PIXFMT_CONV_X86_DISPATCH
+/// SIMD variants of decoders[], faster first
+static const struct {
+        decoder_t decoder;
+        codec_t in;
+        codec_t out;
+        enum pixfmt_conv_isa isa;
+} simd_decoders[] = {
+        { vc_copylinev210_avx512,       v210,  UYVY, PIXFMT_CONV_ISA_AVX512 },
+        { vc_copylineUYVYtoV210_avx512, UYVY,  v210, PIXFMT_CONV_ISA_AVX512 },
+        { vc_copylinev210_avx2,         v210,  UYVY, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copylineUYVYtoV210_avx2,   UYVY,  v210, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copylineV210toY216_avx2,   v210,  Y216, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copylineV210toY416_avx2,   v210,  Y416, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copylineY216toV210_avx2,   Y216,  v210, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copylineY416toV210_avx2,   Y416,  v210, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copyliner10k_avx2,         R10k,  RGBA, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copyliner10ktoRGB_avx2,    R10k,  RGB,  PIXFMT_CONV_ISA_AVX2 },
+        { vc_copylineRGBAtoR10k_avx2,   RGBA,  R10k, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copylineRG48toR12L_avx2,   RG48,  R12L, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copylineR12LtoRG48_avx2,   R12L,  RG48, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copylineUYVYtoRGBA_avx2,   UYVY,  RGBA, PIXFMT_CONV_ISA_AVX2 },
+        { vc_copylineRGBAtoUYVY_avx2,   RGBA,  UYVY, PIXFMT_CONV_ISA_AVX2 },
+};
+#endif
+
+bool pixfmt_conv_isa_supported(enum pixfmt_conv_isa isa)
+{
+        switch (isa) {
+        case PIXFMT_CONV_ISA_AUTO:
+        case PIXFMT_CONV_ISA_SCALAR:
+                return true;
+#ifdef PIXFMT_CONV_X86_DISPATCH
+        case PIXFMT_CONV_ISA_AVX2:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2");
+        case PIXFMT_CONV_ISA_AVX512:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2") &&
+                       __builtin_cpu_supports("avx512f") &&
+                       __builtin_cpu_supports("avx512bw");
+#else
+        case PIXFMT_CONV_ISA_AVX2:
+        case PIXFMT_CONV_ISA_AVX512:
+                return false;
+#endif
+        }
+        return false;
+}
+
+const char *pixfmt_conv_isa_name(enum pixfmt_conv_isa isa)
+{
+        switch (isa) {
+        case PIXFMT_CONV_ISA_AUTO:
+                return "auto";
+        case PIXFMT_CONV_ISA_SCALAR:
+                return "scalar";
+        case PIXFMT_CONV_ISA_AVX2:
+                return "AVX2";
+        case PIXFMT_CONV_ISA_AVX512:
+                return "AVX-512";
+        }
+        return "(unknown)";
+}
+
 /**
  * Returns line decoder for specifiedn input and output codec.
  *
- * If in == out, vc_memcpy is returned.
+ * If in == out, vc_memcpy is returned. The fastest variant supported by
+ * the running CPU is selected.
  */
 decoder_t get_decoder_from_to(codec_t in, codec_t out) {
+        return get_decoder_from_to_isa(in, out, PIXFMT_CONV_ISA_AUTO);
+}
+
+/**
+ * Returns line decoder for specified codecs using at most given instruction
+ * set. Intended for tests and benchmarks, otherwise use get_decoder_from_to().
+ *
+ * @retval NULL  conversion doesn't exist or isa is not supported by the CPU
+ */
+decoder_t
+get_decoder_from_to_isa(codec_t in, codec_t out, enum pixfmt_conv_isa isa)
+{
+        if (isa == PIXFMT_CONV_ISA_AUTO) {
+                isa = pixfmt_conv_isa_supported(PIXFMT_CONV_ISA_AVX512)
+                          ? PIXFMT_CONV_ISA_AVX512
+                      : pixfmt_conv_isa_supported(PIXFMT_CONV_ISA_AVX2)
+                          ? PIXFMT_CONV_ISA_AVX2
+                          : PIXFMT_CONV_ISA_SCALAR;
+        } else if (!pixfmt_conv_isa_supported(isa)) {
+                return NULL;
+        }
+
         if (in == out &&
                         (out != RGBA && out != RGB)) { // vc_copylineRGB[A] may change shift
                 return vc_memcpy;
         }
 
+#ifdef PIXFMT_CONV_X86_DISPATCH
+        for (unsigned int i = 0; i < sizeof simd_decoders / sizeof simd_decoders[0]; ++i) {
+                if (simd_decoders[i].in == in && simd_decoders[i].out == out &&
+                    simd_decoders[i].isa <= isa) {
+                        return simd_decoders[i].decoder;
+                }
+        }
+#endif
+
         for (unsigned int i = 0; i < sizeof(decoders)/sizeof(struct decoder_item); ++i) {
                 if (decoders[i].in == in && decoders[i].out == out) {
                         return decoders[i].decoder;
@@ -91,7 +91,18 @@ extern "C" {
 typedef void decoder_func_t(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift);
 typedef decoder_func_t *decoder_t;
 
+/// instruction set of line decoders
+enum pixfmt_conv_isa {
+        PIXFMT_CONV_ISA_AUTO,   ///< best supported by the running CPU
+        PIXFMT_CONV_ISA_SCALAR,
+        PIXFMT_CONV_ISA_AVX2,
+        PIXFMT_CONV_ISA_AVX512, ///< AVX-512F + AVX-512BW
+};
+
 decoder_t        get_decoder_from_to(codec_t in, codec_t out) __attribute__((const));
+decoder_t        get_decoder_from_to_isa(codec_t in, codec_t out, enum pixfmt_conv_isa isa) __attribute__((const));
+bool             pixfmt_conv_isa_supported(enum pixfmt_conv_isa isa);
+const char      *pixfmt_conv_isa_name(enum pixfmt_conv_isa isa);
 decoder_t        get_best_decoder_from(codec_t in, const codec_t *out_candidates, codec_t *out);
 
 decoder_func_t vc_copylineRGBA;
@@ -54,6 +54,12 @@
 #ifndef _WIN32
 #include <ifaddrs.h>
 #endif
+#ifdef HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#endif
 
 #include "debug.h"
 #include "host.h"
@@ -62,10 +68,11 @@
 #include "compat/vsnprintf.h"
 #include "net_udp.h"
 #include "rtp.h"
-#include "utils/list.h"
+#include "tv.h"
 #include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/net.h"
+#include "utils/packet_pool.h"
 #include "utils/thread.h"
 #include "utils/windows.h"
 
@@ -74,10 +81,26 @@
 #endif
 
 #define DEFAULT_MAX_UDP_READER_QUEUE_LEN (1920/3*8*1080/1152) //< 10-bit FullHD frame divided by 1280 MTU packets (minus headers)
+#ifdef HAVE_RECVMMSG
+#define DEFAULT_UDP_READER_BATCH 64 ///< max datagrams fetched by reader with one recvmmsg()
+#else
+#define DEFAULT_UDP_READER_BATCH 1
+#endif
+#define DEFAULT_UDP_PACKET_POOL_LEN 16384 ///< max received packets kept for reuse (grows on demand)
+#define UDP_SEND_BATCH_MAX 1024     ///< max datagrams submitted by one sendmmsg() (UIO_MAXIOV)
+#define UDP_SEND_BATCH_MAX_IOV 3    ///< max iovec elements per batched datagram
+#define UDP_SEND_BATCH_HDR_LEN 64   ///< max length of copied 1st iovec element (RTP header)
+#define UDP_GSO_MAX_SEGMENTS 64     ///< UDP_MAX_SEGMENTS of older kernels
+#define UDP_GSO_MAX_BYTES 65000     ///< max payload of one GSO super-datagram
+#if defined HAVE_SENDMMSG && defined SO_TXTIME
+#define UDP_HAVE_TXTIME 1
+#endif
 
 static unsigned get_ifindex(const char *iface);
 static int resolve_address(socket_udp *s, const char *addr, uint16_t tx_port);
 static void *udp_reader(void *arg);
+static void udp_reader_alloc(struct socket_udp_local *l);
+static void udp_reader_free(struct socket_udp_local *l);
 static void     udp_leave_mcast_grp4(unsigned long addr, int fd,
                                      const char iface[]);
 
@@ -158,8 +181,17 @@ struct socket_udp_local {
 
         // for multithreaded receiving
         pthread_t thread_id;
-        struct simple_linked_list *packets;
+        struct item **packets;   ///< ring buffer of received packets
+        unsigned int packets_head;
+        unsigned int packets_count;
         unsigned int max_packets;
+        int batch;               ///< number of slots in reader slab
+        uint8_t **slab;          ///< reader-owned preallocated packet buffers
+        struct packet_pool *pool; ///< received packet buffers
+#ifdef HAVE_RECVMMSG
+        struct mmsghdr *msgs;
+        struct iovec *iovs;
+#endif
         pthread_mutex_t lock;
         pthread_cond_t boss_cv;
         pthread_cond_t reader_cv;
@@ -168,6 +200,36 @@ struct socket_udp_local {
         fd_t should_exit_fd[2];
 };
 
+#ifdef HAVE_SENDMMSG
+/**
+ * Datagrams queued between udp_async_start() and udp_async_wait(). First
+ * iovec element of each datagram (RTP header) is copied to hdrs, the rest is
+ * referenced and must not be altered until flushed.
+ */
+struct udp_send_batch {
+        bool active;
+        bool gso;               ///< coalesce equally sized datagrams with UDP_SEGMENT
+        int count;              ///< queued datagrams
+        int iov_count;
+        struct mmsghdr *msgs;   ///< [UDP_SEND_BATCH_MAX]
+        struct iovec *iovs;     ///< [UDP_SEND_BATCH_MAX * UDP_SEND_BATCH_MAX_IOV], packed
+        int *lens;              ///< [UDP_SEND_BATCH_MAX] datagram lengths
+        char (*hdrs)[UDP_SEND_BATCH_HDR_LEN];
+        // GSO super-datagrams
+        struct mmsghdr *gso_msgs;
+        char (*gso_cmsgs)[CMSG_SPACE(sizeof(uint16_t))];
+        int *gso_first;         ///< index of first datagram in super-datagram
+#ifdef UDP_HAVE_TXTIME
+        // SO_TXTIME pacing
+        bool txtime;            ///< SO_TXTIME enabled on tx socket
+        clockid_t txtime_clock;
+        long pacing_interval;   ///< ns between datagrams, 0 - pacing disabled
+        uint64_t pacing_next;   ///< departure time of next queued datagram
+        char (*txtime_cmsgs)[CMSG_SPACE(sizeof(uint64_t))];
+#endif
+};
+#endif
+
 /*
  * Complete socket including remote host
  */
@@ -187,9 +249,17 @@ struct _socket_udp {
         int overlapped_max;
         int overlapped_count;
 #endif
+#ifdef HAVE_SENDMMSG
+        struct udp_send_batch batch;
+#endif
+        uint64_t max_pacing_rate; ///< last value set with SO_MAX_PACING_RATE, 0 - not set
 };
 
 static void udp_clean_async_state(socket_udp *s);
+#ifdef HAVE_SENDMMSG
+static void udp_batch_add(socket_udp *s, const struct iovec *vector, int count);
+static void udp_batch_flush(socket_udp *s);
+#endif
 
 #ifdef _WIN32
 /* Want to use both Winsock 1 and 2 socket options, but since
@@ -954,6 +1024,19 @@ get_ifindex(const char *iface)
 ADD_TO_PARAM("udp-queue-len",
                 "* udp-queue-len=<l>\n"
                 "  Use different queue size than default DEFAULT_MAX_UDP_READER_QUEUE_LEN\n");
+#ifdef HAVE_SENDMMSG
+ADD_TO_PARAM("udp-gso",
+                "* udp-gso\n"
+                "  Send equally sized packets of a frame as UDP GSO (UDP_SEGMENT) super-datagrams\n");
+#endif
+ADD_TO_PARAM("udp-pool-len",
+                "* udp-pool-len=<n>\n"
+                "  Max number of received packet buffers kept for reuse (default DEFAULT_UDP_PACKET_POOL_LEN)\n");
+#ifdef HAVE_RECVMMSG
+ADD_TO_PARAM("udp-batch",
+                "* udp-batch=<n>\n"
+                "  Max number of datagrams received by one recvmmsg() call (default DEFAULT_UDP_READER_BATCH, 1 disables batching)\n");
+#endif
 #ifdef _WIN32
 ADD_TO_PARAM("udp-disable-multi-socket",
                 "* udp-disable-multi-socket\n"
@@ -982,7 +1065,6 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
         int ret;
         socket_udp *s = (socket_udp *) calloc(1, sizeof *s);
         s->local = (struct socket_udp_local*) calloc(1, sizeof(*s->local));
-        s->local->packets = simple_linked_list_init();
         s->local->rx_fd =
                 s->local->tx_fd = INVALID_SOCKET;
         pthread_mutex_init(&s->local->lock, NULL);
@@ -1079,6 +1161,13 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 } else {
                         s->local->max_packets = atoi(get_commandline_param("udp-queue-len"));
                 }
+                s->local->batch = DEFAULT_UDP_READER_BATCH;
+#ifdef HAVE_RECVMMSG
+                if (get_commandline_param("udp-batch")) {
+                        s->local->batch = MAX(atoi(get_commandline_param("udp-batch")), 1);
+                }
+#endif
+                udp_reader_alloc(s->local);
                 platform_pipe_init(s->local->should_exit_fd);
                 pthread_create(&s->local->thread_id, NULL, udp_reader, s);
         }
@@ -1182,17 +1271,13 @@ void udp_exit(socket_udp * s)
                         s->local->should_exit = true;
                         pthread_cond_signal(&s->local->reader_cv);
                         pthread_join(s->local->thread_id, NULL);
-                        while (simple_linked_list_size(s->local->packets) > 0) {
-                                struct item *item = (struct item *) simple_linked_list_pop(s->local->packets);
-                                free(item->buf);
-                        }
                         platform_pipe_close(s->local->should_exit_fd[1]);
+                        udp_reader_free(s->local);
                 }
                 CLOSESOCKET(s->local->rx_fd);
                 if (s->local->tx_fd != s->local->rx_fd) {
                         CLOSESOCKET(s->local->tx_fd);
                 }
-                simple_linked_list_destroy(s->local->packets);
                 pthread_mutex_destroy(&s->local->lock);
                 pthread_cond_destroy(&s->local->boss_cv);
                 pthread_cond_destroy(&s->local->reader_cv);
@@ -1229,6 +1314,63 @@ int udp_sendto(socket_udp * s, char *buffer, int buflen, struct sockaddr *dst_ad
         return sendto(s->local->tx_fd, buffer, buflen, 0, dst_addr, addrlen);
 }
 
+#define UDP_SENDTO_BATCH_CHUNK 128 ///< datagrams passed to one sendmmsg() by udp_sendto_batch()
+
+/**
+ * Sends multiple datagrams to a single destination. The buffers are passed
+ * to the kernel by reference (one sendmmsg() per UDP_SENDTO_BATCH_CHUNK
+ * datagrams if available) so the same buffers may be sent to multiple
+ * destinations without copying.
+ *
+ * @returns number of datagrams sent, datagrams that failed are skipped
+ */
+int udp_sendto_batch(socket_udp *s, char *const *buffers, const int *lens,
+                     int count, struct sockaddr *dst_addr, socklen_t addrlen)
+{
+#ifdef HAVE_SENDMMSG
+        struct mmsghdr msgs[UDP_SENDTO_BATCH_CHUNK];
+        struct iovec iovs[UDP_SENDTO_BATCH_CHUNK];
+        int sent = 0;
+        for (int first = 0; first < count; first += UDP_SENDTO_BATCH_CHUNK) {
+                const int n = MIN(count - first, UDP_SENDTO_BATCH_CHUNK);
+                memset(msgs, 0, n * sizeof msgs[0]);
+                for (int i = 0; i < n; ++i) {
+                        iovs[i].iov_base = buffers[first + i];
+                        iovs[i].iov_len = lens[first + i];
+                        msgs[i].msg_hdr.msg_name = dst_addr;
+                        msgs[i].msg_hdr.msg_namelen = addrlen;
+                        msgs[i].msg_hdr.msg_iov = &iovs[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                int done = 0;
+                while (done < n) {
+                        int ret = sendmmsg(s->local->tx_fd, msgs + done, n - done, 0);
+                        if (ret < 0) {
+                                if (errno == EINTR) {
+                                        continue;
+                                }
+                                socket_error("sendmmsg");
+                                done += 1; // skip the failed datagram
+                                continue;
+                        }
+                        done += ret;
+                        sent += ret;
+                }
+        }
+        return sent;
+#else
+        int sent = 0;
+        for (int i = 0; i < count; ++i) {
+                if (udp_sendto(s, buffers[i], lens[i], dst_addr, addrlen) >= 0) {
+                        sent += 1;
+                } else {
+                        socket_error("sendto");
+                }
+        }
+        return sent;
+#endif
+}
+
 #ifdef _WIN32
 int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
 {
@@ -1259,6 +1401,19 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 
         assert(s != NULL);
 
+#ifdef HAVE_SENDMMSG
+        if (s->batch.active && count <= UDP_SEND_BATCH_MAX_IOV &&
+                        vector[0].iov_len <= UDP_SEND_BATCH_HDR_LEN) {
+                udp_batch_add(s, vector, count);
+                free(d);
+                return 0;
+        }
+        if (s->batch.active && s->batch.count > 0) {
+                // not batchable - send queued datagrams first to keep order
+                udp_batch_flush(s);
+        }
+#endif
+
         msg.msg_name = (void *) & s->sock;
         msg.msg_namelen = s->sock_len;
         msg.msg_iov = vector;
@@ -1274,67 +1429,177 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 }
 #endif // _WIN32
 
+static uint8_t *udp_reader_alloc_packet(struct socket_udp_local *l)
+{
+        return (uint8_t *) packet_pool_alloc(l->pool);
+}
+
+/**
+ * Allocates reader slab and the queue of received packets.
+ */
+static void udp_reader_alloc(struct socket_udp_local *l)
+{
+        unsigned int pool_len = DEFAULT_UDP_PACKET_POOL_LEN;
+        if (get_commandline_param("udp-pool-len")) {
+                pool_len = atoi(get_commandline_param("udp-pool-len"));
+        }
+        l->pool = packet_pool_create(ALIGNED_ITEM_OFF + sizeof(struct item), pool_len);
+        l->packets = (struct item **) calloc(l->max_packets, sizeof l->packets[0]);
+        l->slab = (uint8_t **) calloc(l->batch, sizeof l->slab[0]);
+        for (int i = 0; i < l->batch; ++i) {
+                l->slab[i] = udp_reader_alloc_packet(l);
+        }
+#ifdef HAVE_RECVMMSG
+        l->msgs = (struct mmsghdr *) calloc(l->batch, sizeof l->msgs[0]);
+        l->iovs = (struct iovec *) calloc(l->batch, sizeof l->iovs[0]);
+        for (int i = 0; i < l->batch; ++i) {
+                l->msgs[i].msg_hdr.msg_iov = &l->iovs[i];
+                l->msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+}
+
+static void udp_reader_free(struct socket_udp_local *l)
+{
+        while (l->packets_count > 0) {
+                packet_pool_free(l->packets[l->packets_head]->buf);
+                l->packets_head = (l->packets_head + 1) % l->max_packets;
+                l->packets_count -= 1;
+        }
+        free(l->packets);
+        for (int i = 0; i < l->batch; ++i) {
+                packet_pool_free(l->slab[i]);
+        }
+        free(l->slab);
+        // released when the last packet handed to consumers is freed
+        packet_pool_destroy(l->pool);
+#ifdef HAVE_RECVMMSG
+        free(l->msgs);
+        free(l->iovs);
+#endif
+}
+
+/**
+ * Receives up to l->batch datagrams into the reader slab.
+ *
+ * @param nonblock do not block if there is no datagram ready
+ * @returns        number of received datagrams (stored in l->slab[0..ret-1]),
+ *                 0 if none was ready (nonblock) or -1 on error
+ */
+static int udp_reader_recv(struct socket_udp_local *l, bool nonblock, int *sizes, socklen_t *addrlens)
+{
+#ifdef HAVE_RECVMMSG
+        for (int i = 0; i < l->batch; ++i) {
+                l->iovs[i].iov_base = l->slab[i] + RTP_PACKET_HEADER_SIZE;
+                l->iovs[i].iov_len = RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE;
+                l->msgs[i].msg_hdr.msg_name = l->slab[i] + ALIGNED_SOCKADDR_STORAGE_OFF;
+                l->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        }
+        int ret = recvmmsg(l->rx_fd, l->msgs, l->batch, nonblock ? MSG_DONTWAIT : MSG_WAITFORONE, NULL);
+        if (ret < 0) {
+                if (nonblock && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        return 0;
+                }
+                socket_error("recvmmsg");
+                return -1;
+        }
+        for (int i = 0; i < ret; ++i) {
+                sizes[i] = (int) l->msgs[i].msg_len;
+                addrlens[i] = l->msgs[i].msg_hdr.msg_namelen;
+        }
+        return ret;
+#else
+        assert(!nonblock);
+        UNUSED(nonblock);
+        addrlens[0] = sizeof(struct sockaddr_storage);
+        sizes[0] = recvfrom(l->rx_fd, (char *) l->slab[0] + RTP_PACKET_HEADER_SIZE,
+                        RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
+                        0, (struct sockaddr *)(void *)(l->slab[0] + ALIGNED_SOCKADDR_STORAGE_OFF), &addrlens[0]);
+        if (sizes[0] <= 0) {
+                /// @todo
+                /// In MSW, this block is called as often as packet is sent if
+                /// we got WSAECONNRESET error (noone is listening). This can have
+                /// negative performance impact.
+                socket_error("recvfrom");
+                return -1;
+        }
+        return 1;
+#endif
+}
+
 /**
  * When receiving data in separate thread, this function fetches data
  * from socket and puts it in queue.
+ *
+ * If recvmmsg() is available, up to socket_udp_local::batch datagrams are
+ * received by one call to a preallocated slab and enqueued under single lock.
+ * Socket is not polled with select() again until it is drained.
  */
 static void *udp_reader(void *arg)
 {
         set_thread_name(__func__);
         socket_udp *s = (socket_udp *) arg;
+        struct socket_udp_local *l = s->local;
+        int *sizes = (int *) malloc(l->batch * sizeof sizes[0]);
+        socklen_t *addrlens = (socklen_t *) malloc(l->batch * sizeof addrlens[0]);
+        bool drained = true;
 
         while (1) {
-                fd_set fds;
-                FD_ZERO(&fds);
-                FD_SET(s->local->rx_fd, &fds);
-                FD_SET(s->local->should_exit_fd[0], &fds);
-                int nfds = MAX(s->local->rx_fd, s->local->should_exit_fd[0]) + 1;
-
-                int rc = select(nfds, &fds, NULL, NULL, NULL);
-                if (rc <= 0) {
-                        socket_error("select");
-                        continue;
-                }
-                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
-                        break;
+                if (drained) {
+                        fd_set fds;
+                        FD_ZERO(&fds);
+                        FD_SET(l->rx_fd, &fds);
+                        FD_SET(l->should_exit_fd[0], &fds);
+                        int nfds = MAX(l->rx_fd, l->should_exit_fd[0]) + 1;
+
+                        int rc = select(nfds, &fds, NULL, NULL, NULL);
+                        if (rc <= 0) {
+                                socket_error("select");
+                                continue;
+                        }
+                        if (FD_ISSET(l->should_exit_fd[0], &fds)) {
+                                break;
+                        }
                 }
-                uint8_t *packet = (uint8_t *) malloc(ALIGNED_ITEM_OFF + sizeof(struct item));
-                uint8_t *buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
-                struct sockaddr *src_addr = (struct sockaddr *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF);
-                socklen_t addrlen = sizeof(struct sockaddr_storage);
-                int size = recvfrom(s->local->rx_fd, (char *) buffer,
-                                RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
-                                0, src_addr, &addrlen);
-
-                if (size <= 0) {
-                        /// @todo
-                        /// In MSW, this block is called as often as packet is sent if
-                        /// we got WSAECONNRESET error (noone is listening). This can have
-                        /// negative performance impact.
-                        socket_error("recvfrom");
-                        free(packet);
+                int count = udp_reader_recv(l, !drained, sizes, addrlens);
+                // with batch == 1 keep the legacy select()+recvfrom() per packet
+                drained = l->batch == 1 || count < l->batch;
+                if (count <= 0) {
+                        drained = true;
                         continue;
                 }
 
-                pthread_mutex_lock(&s->local->lock);
-                while (simple_linked_list_size(s->local->packets) >= (int) s->local->max_packets && !s->local->should_exit) {
-                        pthread_cond_wait(&s->local->reader_cv, &s->local->lock);
+                pthread_mutex_lock(&l->lock);
+                for (int i = 0; i < count; ++i) {
+                        while (l->packets_count >= l->max_packets && !l->should_exit) {
+                                pthread_cond_signal(&l->boss_cv);
+                                pthread_cond_wait(&l->reader_cv, &l->lock);
+                        }
+                        if (l->should_exit) {
+                                break;
+                        }
+                        uint8_t *packet = l->slab[i];
+                        struct item *it = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
+                        *it = (struct item){packet, sizes[i], (struct sockaddr *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF), addrlens[i]};
+                        l->packets[(l->packets_head + l->packets_count) % l->max_packets] = it;
+                        l->packets_count += 1;
+                        l->slab[i] = NULL;
                 }
-                if (s->local->should_exit) {
-                        free(packet);
-                        pthread_mutex_unlock(&s->local->lock);
+                const bool should_exit = l->should_exit;
+                pthread_mutex_unlock(&l->lock);
+                pthread_cond_signal(&l->boss_cv);
+                if (should_exit) {
                         break;
                 }
-
-                struct item *i = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
-                *i = (struct item){packet, size, src_addr, addrlen};
-                simple_linked_list_append(s->local->packets, i);
-
-                pthread_mutex_unlock(&s->local->lock);
-                pthread_cond_signal(&s->local->boss_cv);
+                // replace slots handed over to the consumer (it frees the packets)
+                for (int i = 0; i < count; ++i) {
+                        l->slab[i] = udp_reader_alloc_packet(l);
+                }
         }
 
-        platform_pipe_close(s->local->should_exit_fd[0]);
+        free(sizes);
+        free(addrlens);
+        platform_pipe_close(l->should_exit_fd[0]);
 
         return NULL;
 }
@@ -1399,15 +1664,15 @@ bool udp_not_empty(socket_udp * s, struct timeval *timeout)
                 }
                 struct timespec tmout_ts = { tv.tv_sec, tv.tv_usec * 1000 };
                 int rc = 0;
-                while (rc != ETIMEDOUT && simple_linked_list_size(s->local->packets) == 0) {
+                while (rc != ETIMEDOUT && s->local->packets_count == 0) {
                         rc = pthread_cond_timedwait(&s->local->boss_cv, &s->local->lock, &tmout_ts);
                 }
         } else {
-                while (simple_linked_list_size(s->local->packets) == 0) {
+                while (s->local->packets_count == 0) {
                         pthread_cond_wait(&s->local->boss_cv, &s->local->lock);
                 }
         }
-        bool ret = simple_linked_list_size(s->local->packets) > 0;
+        bool ret = s->local->packets_count > 0;
         pthread_mutex_unlock(&s->local->lock);
         return ret;
 }
@@ -1436,11 +1701,21 @@ int udp_recvfrom(socket_udp *s, char *buffer, int buflen, struct sockaddr *src_a
         return udp_do_recv(s, buffer, buflen, 0, src_addr, addrlen);
 }
 
+static struct item *udp_pop_item(struct socket_udp_local *l)
+{
+        assert(l->packets_count > 0);
+        struct item *it = l->packets[l->packets_head];
+        l->packets_head = (l->packets_head + 1) % l->max_packets;
+        l->packets_count -= 1;
+        return it;
+}
+
 /**
  * Receives data from multithreaded socket.
  *
  * @param[in] s       UDP socket state
- * @param[out] buffer data received from socket. Must be freed by caller!
+ * @param[out] buffer data received from socket. Must be freed by caller with
+ *                    packet_pool_free()!
  * @returns           length of the received datagram
  */
 int udp_recvfrom_data(socket_udp * s, char **buffer,
@@ -1450,7 +1725,7 @@ int udp_recvfrom_data(socket_udp * s, char **buffer,
         int ret;
 
         pthread_mutex_lock(&s->local->lock);
-        struct item *it = (struct item *)(simple_linked_list_pop(s->local->packets));
+        struct item *it = udp_pop_item(s->local);
         *buffer = (char *) it->buf;
         if(src_addr){
                 if(it->src_addr){
@@ -1467,6 +1742,37 @@ int udp_recvfrom_data(socket_udp * s, char **buffer,
 
         return ret;
 }
+
+/**
+ * Receives multiple datagrams from multithreaded socket at once.
+ *
+ * Pops all queued packets up to max_count while holding the queue lock only
+ * once. Does not block - use udp_not_empty() to wait for data.
+ *
+ * @param[in]  s         UDP socket state
+ * @param[out] buffers   received data, each must be freed by caller with
+ *                       packet_pool_free()!
+ * @param[out] lens      lengths of the received datagrams
+ * @param      max_count capacity of buffers and lens
+ * @returns              number of received datagrams
+ */
+int udp_recv_data_batch(socket_udp *s, char **buffers, int *lens, int max_count)
+{
+        assert(s->local->multithreaded);
+
+        pthread_mutex_lock(&s->local->lock);
+        int count = MIN((int) s->local->packets_count, max_count);
+        for (int i = 0; i < count; ++i) {
+                struct item *it = udp_pop_item(s->local);
+                buffers[i] = (char *) it->buf;
+                lens[i] = it->size;
+        }
+        pthread_mutex_unlock(&s->local->lock);
+        pthread_cond_signal(&s->local->reader_cv);
+
+        return count;
+}
+
 int udp_recv_data(socket_udp * s, char **buffer){
         return udp_recvfrom_data(s, buffer, NULL, NULL);
 }
@@ -1744,12 +2050,57 @@ void udp_async_start(socket_udp *s, int nr_packets)
 
         s->overlapped_count = 0;
         s->overlapping_active = true;
+#elif defined HAVE_SENDMMSG
+        UNUSED(nr_packets);
+        struct udp_send_batch *b = &s->batch;
+        if (b->msgs == NULL) {
+                b->msgs = (struct mmsghdr *) calloc(UDP_SEND_BATCH_MAX, sizeof b->msgs[0]);
+                b->iovs = (struct iovec *) calloc(UDP_SEND_BATCH_MAX * UDP_SEND_BATCH_MAX_IOV, sizeof b->iovs[0]);
+                b->lens = (int *) calloc(UDP_SEND_BATCH_MAX, sizeof b->lens[0]);
+                b->hdrs = calloc(UDP_SEND_BATCH_MAX, sizeof b->hdrs[0]);
+                b->gso = get_commandline_param("udp-gso") != NULL;
+                if (b->gso) {
+                        b->gso_msgs = (struct mmsghdr *) calloc(UDP_SEND_BATCH_MAX, sizeof b->gso_msgs[0]);
+                        b->gso_cmsgs = calloc(UDP_SEND_BATCH_MAX, sizeof b->gso_cmsgs[0]);
+                        b->gso_first = (int *) calloc(UDP_SEND_BATCH_MAX, sizeof b->gso_first[0]);
+                }
+        }
+        b->active = true;
 #else
         UNUSED(nr_packets);
         UNUSED(s);
 #endif
 }
 
+/**
+ * Submits datagrams queued since udp_async_start() (or last flush) without
+ * ending the async block. Used by traffic shaper to send one burst at once.
+ */
+void udp_async_flush(socket_udp *s)
+{
+#ifdef HAVE_SENDMMSG
+        if (s->batch.active) {
+                udp_batch_flush(s);
+        }
+#else
+        UNUSED(s);
+#endif
+}
+
+/**
+ * @retval true if datagrams sent in async block are queued and submitted in
+ *              batches (so that it makes sense to call udp_async_flush())
+ */
+bool udp_async_is_batching(socket_udp *s)
+{
+#ifdef HAVE_SENDMMSG
+        return s->batch.active;
+#else
+        UNUSED(s);
+        return false;
+#endif
+}
+
 void udp_async_wait(socket_udp *s)
 {
 #ifdef _WIN32
@@ -1772,6 +2123,14 @@ void udp_async_wait(socket_udp *s)
                 free(s->dispose_udata[i]);
         }
         s->overlapping_active = false;
+#elif defined HAVE_SENDMMSG
+        if (s->batch.active) {
+                udp_batch_flush(s);
+                s->batch.active = false;
+        }
+#ifdef UDP_HAVE_TXTIME
+        s->batch.pacing_interval = 0;
+#endif
 #else
         UNUSED(s);
 #endif
@@ -1786,11 +2145,251 @@ static void udp_clean_async_state(socket_udp *s)
         free(s->overlapped);
         free(s->overlapped_events);
         free(s->dispose_udata);
+#elif defined HAVE_SENDMMSG
+        free(s->batch.msgs);
+        free(s->batch.iovs);
+        free(s->batch.lens);
+        free(s->batch.hdrs);
+        free(s->batch.gso_msgs);
+        free(s->batch.gso_cmsgs);
+        free(s->batch.gso_first);
+#ifdef UDP_HAVE_TXTIME
+        free(s->batch.txtime_cmsgs);
+#endif
 #else
         UNUSED(s);
 #endif
 }
 
+/**
+ * Enables SO_TXTIME on the socket so that datagrams sent in async block can
+ * carry their departure time, see udp_async_set_pacing(). Pacing itself is
+ * performed by the qdisc - fq (CLOCK_MONOTONIC) or etf (CLOCK_TAI, tai=true).
+ * Without such qdisc the timestamps are ignored.
+ *
+ * @retval false if SO_TXTIME or async batching is not supported
+ */
+bool udp_set_txtime(socket_udp *s, bool tai)
+{
+#ifdef UDP_HAVE_TXTIME
+        struct udp_send_batch *b = &s->batch;
+        const clockid_t clock = tai ? CLOCK_TAI : CLOCK_MONOTONIC;
+        if (b->txtime && b->txtime_clock == clock) {
+                return true;
+        }
+        struct sock_txtime cfg = { .clockid = clock, .flags = 0 };
+        if (SETSOCKOPT(s->local->tx_fd, SOL_SOCKET, SO_TXTIME, (sockopt_t) &cfg, sizeof cfg) != 0) {
+                socket_error("setsockopt SO_TXTIME");
+                return false;
+        }
+        if (b->txtime_cmsgs == NULL) {
+                b->txtime_cmsgs = calloc(UDP_SEND_BATCH_MAX, sizeof b->txtime_cmsgs[0]);
+        }
+        b->txtime = true;
+        b->txtime_clock = clock;
+        return true;
+#else
+        UNUSED(s), UNUSED(tai);
+        return false;
+#endif
+}
+
+/**
+ * Assigns departure times spaced by interval_ns to datagrams sent in current
+ * async block (from now on). Requires prior successful udp_set_txtime() and
+ * is reset by udp_async_wait().
+ */
+void udp_async_set_pacing(socket_udp *s, long interval_ns)
+{
+#ifdef UDP_HAVE_TXTIME
+        struct udp_send_batch *b = &s->batch;
+        if (!b->txtime || !b->active) {
+                return;
+        }
+        struct timespec now;
+        clock_gettime(b->txtime_clock, &now);
+        b->pacing_interval = interval_ns;
+        b->pacing_next = (uint64_t) now.tv_sec * NS_IN_SEC + now.tv_nsec;
+#else
+        UNUSED(s), UNUSED(interval_ns);
+#endif
+}
+
+/**
+ * Sets SO_MAX_PACING_RATE (enforced by fq qdisc) of the sending socket.
+ *
+ * @param bytes_per_sec  rate limit, UINT64_MAX for unlimited
+ * @retval false if not supported
+ */
+bool udp_set_max_pacing_rate(socket_udp *s, uint64_t bytes_per_sec)
+{
+#ifdef SO_MAX_PACING_RATE
+        if (s->max_pacing_rate == bytes_per_sec) {
+                return true;
+        }
+        if (SETSOCKOPT(s->local->tx_fd, SOL_SOCKET, SO_MAX_PACING_RATE, (sockopt_t) &bytes_per_sec, sizeof bytes_per_sec) != 0) {
+                // older kernels accept only 32-bit value
+                uint32_t rate32 = MIN(bytes_per_sec, UINT32_MAX);
+                if (SETSOCKOPT(s->local->tx_fd, SOL_SOCKET, SO_MAX_PACING_RATE, (sockopt_t) &rate32, sizeof rate32) != 0) {
+                        socket_error("setsockopt SO_MAX_PACING_RATE");
+                        return false;
+                }
+        }
+        s->max_pacing_rate = bytes_per_sec;
+        return true;
+#else
+        UNUSED(s), UNUSED(bytes_per_sec);
+        return false;
+#endif
+}
+
+#ifdef HAVE_SENDMMSG
+static void udp_batch_add(socket_udp *s, const struct iovec *vector, int count)
+{
+        struct udp_send_batch *b = &s->batch;
+        if (b->count == UDP_SEND_BATCH_MAX) {
+                udp_batch_flush(s);
+        }
+        struct iovec *iov = b->iovs + b->iov_count;
+        memcpy(b->hdrs[b->count], vector[0].iov_base, vector[0].iov_len);
+        iov[0].iov_base = b->hdrs[b->count];
+        iov[0].iov_len = vector[0].iov_len;
+        int len = (int) vector[0].iov_len;
+        for (int i = 1; i < count; ++i) {
+                iov[i] = vector[i];
+                len += (int) vector[i].iov_len;
+        }
+        struct msghdr *mh = &b->msgs[b->count].msg_hdr;
+        mh->msg_name = &s->sock;
+        mh->msg_namelen = s->sock_len;
+        mh->msg_iov = iov;
+        mh->msg_iovlen = count;
+        mh->msg_control = NULL;
+        mh->msg_controllen = 0;
+        mh->msg_flags = 0;
+#ifdef UDP_HAVE_TXTIME
+        if (b->pacing_interval > 0) {
+                mh->msg_control = b->txtime_cmsgs[b->count];
+                mh->msg_controllen = sizeof b->txtime_cmsgs[b->count];
+                struct cmsghdr *cm = CMSG_FIRSTHDR(mh);
+                cm->cmsg_level = SOL_SOCKET;
+                cm->cmsg_type = SCM_TXTIME;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+                memcpy(CMSG_DATA(cm), &b->pacing_next, sizeof b->pacing_next);
+                b->pacing_next += b->pacing_interval;
+        }
+#endif
+        b->lens[b->count] = len;
+        b->iov_count += count;
+        b->count += 1;
+}
+
+static void udp_send_mmsgs(fd_t fd, struct mmsghdr *msgs, int count)
+{
+        int sent = 0;
+        while (sent < count) {
+                int ret = sendmmsg(fd, msgs + sent, count - sent, 0);
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        socket_error("sendmmsg");
+                        ret = 1; // skip the failed datagram
+                }
+                sent += ret;
+        }
+}
+
+/**
+ * Groups consecutive datagrams of equal length (last one of a group may be
+ * shorter) to super-datagrams segmented by kernel (UDP_SEGMENT).
+ *
+ * @returns number of super-datagrams in b->gso_msgs
+ */
+static int udp_batch_build_gso(struct udp_send_batch *b)
+{
+        int groups = 0;
+        for (int i = 0; i < b->count; ) {
+                const int seg_len = b->lens[i];
+                int total = seg_len;
+                size_t iovlen = b->msgs[i].msg_hdr.msg_iovlen;
+                int n = 1;
+                while (i + n < b->count && n < UDP_GSO_MAX_SEGMENTS &&
+                                b->lens[i + n] <= seg_len &&
+                                total + b->lens[i + n] <= UDP_GSO_MAX_BYTES) {
+                        total += b->lens[i + n];
+                        iovlen += b->msgs[i + n].msg_hdr.msg_iovlen;
+                        n += 1;
+                        if (b->lens[i + n - 1] < seg_len) {
+                                break;
+                        }
+                }
+                struct msghdr *mh = &b->gso_msgs[groups].msg_hdr;
+                *mh = b->msgs[i].msg_hdr;
+                mh->msg_iovlen = iovlen; // iovecs of consecutive datagrams are packed
+                if (n > 1) {
+                        mh->msg_control = b->gso_cmsgs[groups];
+                        mh->msg_controllen = sizeof b->gso_cmsgs[groups];
+                        struct cmsghdr *cm = CMSG_FIRSTHDR(mh);
+                        cm->cmsg_level = SOL_UDP;
+                        cm->cmsg_type = UDP_SEGMENT;
+                        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                        const uint16_t gso_size = seg_len;
+                        memcpy(CMSG_DATA(cm), &gso_size, sizeof gso_size);
+                }
+                b->gso_first[groups] = i;
+                groups += 1;
+                i += n;
+        }
+        return groups;
+}
+
+/**
+ * @returns index of first datagram that was not sent (b->count if all were)
+ */
+static int udp_batch_send_gso(socket_udp *s)
+{
+        struct udp_send_batch *b = &s->batch;
+        const int groups = udp_batch_build_gso(b);
+        int sent = 0;
+        while (sent < groups) {
+                int ret = sendmmsg(s->local->tx_fd, b->gso_msgs + sent, groups - sent, 0);
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        if (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP || errno == ENOPROTOOPT) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "UDP GSO not usable (%s), disabling.\n",
+                                                ug_strerror(errno));
+                                b->gso = false;
+                                return b->gso_first[sent];
+                        }
+                        socket_error("sendmmsg");
+                        ret = 1;
+                }
+                sent += ret;
+        }
+        return b->count;
+}
+
+static void udp_batch_flush(socket_udp *s)
+{
+        struct udp_send_batch *b = &s->batch;
+        int first = 0;
+        bool gso = b->gso;
+#ifdef UDP_HAVE_TXTIME
+        gso = gso && b->pacing_interval == 0; // departure time is per datagram
+#endif
+        if (gso) {
+                first = udp_batch_send_gso(s);
+        }
+        udp_send_mmsgs(s->local->tx_fd, b->msgs + first, b->count - first);
+        b->count = 0;
+        b->iov_count = 0;
+}
+#endif // defined HAVE_SENDMMSG
+
+
 bool udp_is_ipv6(socket_udp *s)
 {
         return s->local->mode == IPv6 && !IN6_IS_ADDR_V4MAPPED(&((struct sockaddr_in6 *) &s->sock)->sin6_addr);
@@ -1922,7 +2521,7 @@ int udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
                         if (len > 0) {
                                 memcpy(buffer, data, len);
                         }
-                        free(data);
+                        packet_pool_free(data);
                 }
         } else {
                 udp_fd_zero_r(&fd);
@@ -1939,6 +2538,66 @@ int udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
         return len;
 }
 
+/**
+ * Receives up to max_count datagrams from a socket that is not multithreaded,
+ * waiting at most timeout for the first one. Datagrams that are already
+ * queued are received with single recvmmsg() call if available.
+ *
+ * @param[out] lens       lengths of the received datagrams
+ * @param[out] src_addrs  (optional) source addresses, addrlens must be given as well
+ * @returns    number of received datagrams, 0 if none was received until timeout
+ */
+int udp_recvfrom_batch(socket_udp *s, char **buffers, int buflen, int *lens,
+                       int max_count, struct timeval *timeout,
+                       struct sockaddr_storage *src_addrs, socklen_t *addrlens)
+{
+        assert(!s->local->multithreaded);
+        assert(max_count > 0);
+
+        struct udp_fd_r fd;
+        udp_fd_zero_r(&fd);
+        udp_fd_set_r(s, &fd);
+        if (udp_select_r(timeout, &fd) <= 0 || !udp_fd_isset_r(s, &fd)) {
+                return 0;
+        }
+#ifdef HAVE_RECVMMSG
+        struct mmsghdr msgs[max_count];
+        struct iovec iovs[max_count];
+        memset(msgs, 0, sizeof msgs);
+        for (int i = 0; i < max_count; ++i) {
+                iovs[i].iov_base = buffers[i];
+                iovs[i].iov_len = buflen;
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                if (src_addrs != NULL) {
+                        msgs[i].msg_hdr.msg_name = &src_addrs[i];
+                        msgs[i].msg_hdr.msg_namelen = sizeof src_addrs[i];
+                }
+        }
+        int ret = recvmmsg(s->local->rx_fd, msgs, max_count, MSG_DONTWAIT, NULL);
+        if (ret < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+                        socket_error("recvmmsg");
+                }
+                return 0;
+        }
+        for (int i = 0; i < ret; ++i) {
+                lens[i] = (int) msgs[i].msg_len;
+                if (src_addrs != NULL) {
+                        addrlens[i] = msgs[i].msg_hdr.msg_namelen;
+                }
+        }
+        return ret;
+#else
+        if (src_addrs != NULL) {
+                addrlens[0] = sizeof src_addrs[0];
+        }
+        lens[0] = udp_recvfrom(s, buffers[0], buflen,
+                               (struct sockaddr *) src_addrs, addrlens);
+        return lens[0] > 0 ? 1 : 0;
+#endif
+}
+
 int udp_recv_timeout(socket_udp *s, char *buffer, int buflen, struct timeval *timeout)
 {
         return udp_recvfrom_timeout(s, buffer, buflen, timeout, NULL, NULL);
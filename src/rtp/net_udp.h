@@ -74,10 +74,20 @@ int         udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
 int         udp_recvfrom(socket_udp *s, char *buffer, int buflen, struct sockaddr *src_addr, socklen_t *addrlen);
 int         udp_send(socket_udp *s, char *buffer, int buflen);
 int         udp_sendto(socket_udp *s, char *buffer, int buflen, struct sockaddr *dst_addr, socklen_t addrlen);
+int         udp_recvfrom_batch(socket_udp *s, char **buffers, int buflen, int *lens,
+                int max_count, struct timeval *timeout,
+                struct sockaddr_storage *src_addrs, socklen_t *addrlens);
+int         udp_sendto_batch(socket_udp *s, char *const *buffers, const int *lens,
+                int count, struct sockaddr *dst_addr, socklen_t addrlen);
 
 int         udp_recvv(socket_udp *s, struct msghdr *m);
 void        udp_async_start(socket_udp *s, int nr_packets);
 void        udp_async_wait(socket_udp *s);
+void        udp_async_flush(socket_udp *s);
+bool        udp_async_is_batching(socket_udp *s);
+void        udp_async_set_pacing(socket_udp *s, long interval_ns);
+bool        udp_set_txtime(socket_udp *s, bool tai);
+bool        udp_set_max_pacing_rate(socket_udp *s, uint64_t bytes_per_sec);
 #ifdef _WIN32
 int         udp_sendv(socket_udp *s, LPWSABUF vector, int count, void *d);
 #else
@@ -110,6 +120,7 @@ int         udp_fd_isset_r(socket_udp *s, struct udp_fd_r *);
 int         udp_recv_data(socket_udp * s, char **buffer);
 int         udp_recvfrom_data(socket_udp * s, char **buffer,
                 struct sockaddr *src_addr, socklen_t *addrlen);
+int         udp_recv_data_batch(socket_udp *s, char **buffers, int *lens, int max_count);
 bool        udp_not_empty(socket_udp *s, struct timeval *timeout);
 int         udp_port_pair_is_free(int force_ip_version, int even_port);
 bool        udp_is_ipv6(socket_udp *s);
@@ -70,6 +70,7 @@
 #include "tv.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/packet_pool.h"
 
 #define PBUF_MAGIC	0xcafebabe
 
@@ -77,23 +78,35 @@ enum {
         DEFAULT_STATS_INTERVAL = 128,
         STAT_INT_MIN_DIVISOR   = sizeof(unsigned long long) * CHAR_BIT,
         WRAPAROUND_THRESHOLD   = 900000, // 10 sec with 90 kHz clock
+        NODE_CACHE_LEN         = 64, ///< max unused frame nodes kept for reuse
+        TS_HASH_BITS           = 6,
 };
 static_assert(DEFAULT_STATS_INTERVAL % STAT_INT_MIN_DIVISOR == 0,
                 "STATS_INTERVAL must be divisible by (sizeof(ull) * CHAR_BIT)");
+// coded_data is stored in the scratch area of the (pooled) packet itself
+static_assert(sizeof(struct coded_data) <= PACKET_POOL_SCRATCH_LEN,
+              "coded_data doesn't fit packet pool scratch space");
 #define MOD_NAME "[Pbuf] "
 
 struct pbuf_node {
         struct pbuf_node *nxt;
         struct pbuf_node *prv;
+        struct pbuf_node *hnxt;         /* next node in timestamp hash bucket */
         uint32_t rtp_timestamp; /* RTP timestamp for the frame           */
         time_ns_t arrival_time;    /* Arrival time of first packet in frame */
         time_ns_t playout_time;    /* Playout time for the frame            */
         time_ns_t deletion_time;   /* Deletion time for the frame            */
-        struct coded_data *cdata;       /*                                       */
+        struct coded_data *cdata;       /* linked lazily by link_coded_units()  */
+        rtp_packet **pkts;              /* packets indexed by seq - base_seq    */
+        int pkts_alloc;
+        int pkts_span;                  /* highest used index + 1               */
+        int pkt_count;
+        uint16_t base_seq;
         int decoded;            /* Non-zero if we've decoded this frame  */
         int mbit;               /* determines if mbit of frame had been seen */
         uint32_t magic;         /* For debugging                         */
         bool completed;
+        bool cut_through;       /* assembled incrementally by pbuf_decode_cut_through() */
 };
 
 struct pbuf {
@@ -115,10 +128,26 @@ struct pbuf {
         int max_out_of_order_dist;
         int dups; // duplicite packets
         char stream_identifier[STR_LEN];
+
+        struct pbuf_node *ts_hash[1 << TS_HASH_BITS];
+
+        // unused frame nodes, to avoid allocation per frame
+        struct pbuf_node *free_nodes;
+        int free_node_count;
+        long long int node_heap_allocs;
+
+        // incremental (cut-through) assembly
+        const struct pbuf_frame_decoder *ct_dec;
+        struct pbuf_node *ct_node;      // frame currently being assembled
+        void *ct_ctx;
+        rtp_packet **ct_pending;        // packets not yet passed to ct_dec
+        int ct_pending_count;
+        int ct_pending_alloc;
 };
 
-static void free_cdata(struct coded_data *head);
 static int frame_complete(struct pbuf_node *frame);
+static void remove_pnode(struct pbuf *playout_buf, struct pbuf_node *node);
+static void cut_through_abort(struct pbuf *playout_buf);
 
 /*********************************************************************************/
 
@@ -211,104 +240,228 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                                         playout_buf->expected_pkts_cum * 100.0);
                 }
 
-                struct pbuf_node *curr = playout_buf->frst;
-                while (curr != NULL) {
-                        struct pbuf_node *temp = curr->nxt;
-                        if (curr == playout_buf->frst) {
-                                playout_buf->frst = curr->nxt;
-                        }
-                        if (curr == playout_buf->last) {
-                                playout_buf->last = curr->prv;
-                        }
-                        if (curr->nxt != NULL) {
-                                curr->nxt->prv = curr->prv;
-                        }
-                        if (curr->prv != NULL) {
-                                curr->prv->nxt = curr->nxt;
-                        }
-                        free_cdata(curr->cdata);
-                        free(curr);
-                        curr = temp;
+                while (playout_buf->frst != NULL) {
+                        remove_pnode(playout_buf, playout_buf->frst);
+                }
+                while (playout_buf->free_nodes != NULL) {
+                        struct pbuf_node *next = playout_buf->free_nodes->nxt;
+                        free(playout_buf->free_nodes->pkts);
+                        free(playout_buf->free_nodes);
+                        playout_buf->free_nodes = next;
                 }
+                free(playout_buf->ct_pending);
                 free(playout_buf);
         }
 }
 
-/** Add "pkt" to the frame represented by "node". The "node" has
- * previously been created, and has some coded data already...
+/**
+ * Stores "pkt" to the frame represented by "node" at index given by its
+ * sequence number relative to node->base_seq. Packet array grows in both
+ * directions as needed so that both in-order and out-of-order arrival is
+ * O(1) (amortized).
  *
- * New arrivals are filed to the list in descending sequence number order
+ * @retval false packet was not stored (duplicate or out of memory) and freed
  */
-static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
+static bool add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
 {
         assert(node->rtp_timestamp == pkt->ts);
-        assert(node->cdata != NULL);
 
-        struct coded_data *tmp = (struct coded_data *) malloc(sizeof(struct coded_data));
-        if (tmp == NULL) {
-                /* this is bad, out of memory, drop the packet... */
-                free(pkt);
-                return;
+        int idx = (int16_t) (pkt->seq - node->base_seq);
+        if (node->pkt_count == 0) {
+                node->base_seq = pkt->seq;
+                idx = 0;
+        } else if (idx < 0) { // reordered before first received packet
+                const int shift = -idx;
+                if (node->pkts_span + shift > node->pkts_alloc) {
+                        const int new_alloc = MAX(node->pkts_span + shift, 2 * node->pkts_alloc);
+                        rtp_packet **pkts = realloc(node->pkts, new_alloc * sizeof pkts[0]);
+                        if (pkts == NULL) {
+                                packet_pool_free(pkt);
+                                return false;
+                        }
+                        memset(pkts + node->pkts_alloc, 0, (new_alloc - node->pkts_alloc) * sizeof pkts[0]);
+                        node->pkts = pkts;
+                        node->pkts_alloc = new_alloc;
+                }
+                memmove(node->pkts + shift, node->pkts, node->pkts_span * sizeof node->pkts[0]);
+                memset(node->pkts, 0, shift * sizeof node->pkts[0]);
+                node->pkts_span += shift;
+                node->base_seq = pkt->seq;
+                idx = 0;
         }
-
-        tmp->seqno = pkt->seq;
-        tmp->data = pkt;
+        if (idx >= node->pkts_alloc) {
+                const int new_alloc = MAX(idx + 1, 2 * node->pkts_alloc);
+                rtp_packet **pkts = realloc(node->pkts, new_alloc * sizeof pkts[0]);
+                if (pkts == NULL) {
+                        packet_pool_free(pkt);
+                        return false;
+                }
+                memset(pkts + node->pkts_alloc, 0, (new_alloc - node->pkts_alloc) * sizeof pkts[0]);
+                node->pkts = pkts;
+                node->pkts_alloc = new_alloc;
+        }
+        if (node->pkts[idx] != NULL) { // duplicate
+                packet_pool_free(pkt);
+                return false;
+        }
+        node->pkts[idx] = pkt;
+        node->pkts_span = MAX(node->pkts_span, idx + 1);
+        node->pkt_count += 1;
         node->mbit |= pkt->m;
-        if((int16_t)(tmp->seqno - node->cdata->seqno) > 0){
-                tmp->prv = NULL;
-                tmp->nxt = node->cdata;
-                node->cdata->prv = tmp;
-                node->cdata = tmp;
-        } else {
-                struct coded_data *curr = node->cdata;
-                struct coded_data *prv = NULL;
-                while (curr != NULL &&  ((int16_t)(tmp->seqno - curr->seqno) < 0)){
-                        prv = curr;
-                        curr = curr->nxt;
+        node->cdata = NULL; // links need to be rebuilt
+        return true;
+}
+
+/**
+ * Links packets of the frame to the coded_data list passed to decoders
+ * (descending sequence number order, coded_data structs are stored inside
+ * the packets themselves).
+ */
+static struct coded_data *link_coded_units(struct pbuf_node *node)
+{
+        if (node->cdata != NULL) {
+                return node->cdata;
+        }
+        struct coded_data *prv = NULL;
+        for (int i = node->pkts_span - 1; i >= 0; --i) {
+                rtp_packet *pkt = node->pkts[i];
+                if (pkt == NULL) {
+                        continue;
                 }
-                if (curr == NULL) {
-                        tmp->nxt = NULL;
-                        tmp->prv = prv;
-                        prv->nxt = tmp;
-                }else if ((int16_t)(tmp->seqno - curr->seqno) > 0){
-                        tmp->nxt = curr;
-                        tmp->prv = curr->prv;
-                        tmp->prv->nxt = tmp;
-                        curr->prv = tmp;
+                struct coded_data *cd = (struct coded_data *) packet_pool_scratch(pkt);
+                cd->seqno = pkt->seq;
+                cd->data = pkt;
+                cd->prv = prv;
+                cd->nxt = NULL;
+                if (prv != NULL) {
+                        prv->nxt = cd;
                 } else {
-                        /* this is bad, something went terribly wrong... */
-                        free(pkt);
-                        free(tmp);
+                        node->cdata = cd;
                 }
+                prv = cd;
         }
+        return node->cdata;
 }
 
-static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_delay_us)
+static void free_coded_units(struct pbuf_node *node)
 {
-        struct pbuf_node *tmp = calloc(1, sizeof(struct pbuf_node));
-        if (tmp != NULL) {
-                tmp->magic = PBUF_MAGIC;
-                tmp->rtp_timestamp = pkt->ts;
-                tmp->mbit = pkt->m;
-                tmp->playout_time =
-                        tmp->arrival_time = get_time_in_ns();
-                tmp->playout_time += playout_delay_us * 1000;
-                tmp->deletion_time = tmp->playout_time + playout_delay_us * 1000;
-
-                tmp->cdata = (struct coded_data *) malloc(sizeof(struct coded_data));
-                if (tmp->cdata != NULL) {
-                        tmp->cdata->nxt = NULL;
-                        tmp->cdata->prv = NULL;
-                        tmp->cdata->seqno = pkt->seq;
-                        tmp->cdata->data = pkt;
-                } else {
-                        free(pkt);
-                        free(tmp);
-                        return NULL;
+        for (int i = 0; i < node->pkts_span; ++i) {
+                packet_pool_free(node->pkts[i]);
+                node->pkts[i] = NULL;
+        }
+        node->pkts_span = node->pkt_count = 0;
+        node->cdata = NULL;
+}
+
+static unsigned int ts_hash(uint32_t rtp_timestamp)
+{
+        return (rtp_timestamp * 2654435761U) >> (32 - TS_HASH_BITS);
+}
+
+static struct pbuf_node *ts_hash_find(struct pbuf *playout_buf, uint32_t rtp_timestamp)
+{
+        struct pbuf_node *node = playout_buf->ts_hash[ts_hash(rtp_timestamp)];
+        while (node != NULL && node->rtp_timestamp != rtp_timestamp) {
+                node = node->hnxt;
+        }
+        return node;
+}
+
+static void ts_hash_insert(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        struct pbuf_node **bucket = &playout_buf->ts_hash[ts_hash(node->rtp_timestamp)];
+        node->hnxt = *bucket;
+        *bucket = node;
+}
+
+static void ts_hash_remove(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        struct pbuf_node **it = &playout_buf->ts_hash[ts_hash(node->rtp_timestamp)];
+        while (*it != node) {
+                it = &(*it)->hnxt;
+        }
+        *it = node->hnxt;
+}
+
+static struct pbuf_node *alloc_pnode(struct pbuf *playout_buf)
+{
+        struct pbuf_node *node = playout_buf->free_nodes;
+        if (node == NULL) {
+                playout_buf->node_heap_allocs += 1;
+                return calloc(1, sizeof(struct pbuf_node));
+        }
+        playout_buf->free_nodes = node->nxt;
+        playout_buf->free_node_count -= 1;
+        // keep the (cleared) packet array for reuse
+        rtp_packet **pkts = node->pkts;
+        const int pkts_alloc = node->pkts_alloc;
+        memset(node, 0, sizeof *node);
+        node->pkts = pkts;
+        node->pkts_alloc = pkts_alloc;
+        return node;
+}
+
+/// unlinks node from the playout buffer, frees its packets and recycles it
+static void remove_pnode(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        if (node == playout_buf->frst) {
+                playout_buf->frst = node->nxt;
+        }
+        if (node == playout_buf->last) {
+                playout_buf->last = node->prv;
+        }
+        if (node->nxt != NULL) {
+                node->nxt->prv = node->prv;
+        }
+        if (node->prv != NULL) {
+                node->prv->nxt = node->nxt;
+        }
+        ts_hash_remove(playout_buf, node);
+        if (node == playout_buf->ct_node) {
+                cut_through_abort(playout_buf);
+        }
+        if (node->cut_through) { // drop its packets waiting for assembly
+                int count = 0;
+                for (int i = 0; i < playout_buf->ct_pending_count; ++i) {
+                        if (playout_buf->ct_pending[i]->ts != node->rtp_timestamp) {
+                                playout_buf->ct_pending[count++] = playout_buf->ct_pending[i];
+                        }
                 }
-        } else {
-                free(pkt);
+                playout_buf->ct_pending_count = count;
         }
+        free_coded_units(node);
+
+        if (playout_buf->free_node_count >= NODE_CACHE_LEN) {
+                free(node->pkts);
+                free(node);
+                return;
+        }
+        node->nxt = playout_buf->free_nodes;
+        playout_buf->free_nodes = node;
+        playout_buf->free_node_count += 1;
+}
+
+static struct pbuf_node *create_new_pnode(struct pbuf *playout_buf, rtp_packet * pkt, long long playout_delay_us)
+{
+        struct pbuf_node *tmp = alloc_pnode(playout_buf);
+        if (tmp == NULL) {
+                packet_pool_free(pkt);
+                return NULL;
+        }
+        tmp->magic = PBUF_MAGIC;
+        tmp->rtp_timestamp = pkt->ts;
+        tmp->playout_time =
+                tmp->arrival_time = get_time_in_ns();
+        tmp->playout_time += playout_delay_us * 1000;
+        tmp->deletion_time = tmp->playout_time + playout_delay_us * 1000;
+        tmp->cut_through = playout_buf->ct_dec != NULL;
+
+        if (!add_coded_unit(tmp, pkt)) {
+                free(tmp->pkts);
+                free(tmp);
+                return NULL;
+        }
+        ts_hash_insert(playout_buf, tmp);
         return tmp;
 }
 
@@ -418,6 +571,17 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                     (recv_pct < 100.0 ? TERM_FG_RED : ""), recv_pct,
                     playout_buf->expected_pkts - playout_buf->received_pkts,
                     playout_buf->longest_gap, oo_dups_str);
+                if (log_level >= LOG_LEVEL_VERBOSE) {
+                        struct packet_pool_stats pool_stats;
+                        packet_pool_get_stats(pkt, &pool_stats);
+                        MSG(VERBOSE,
+                            "[%s] allocated %llu packets (%llu heap "
+                            "allocations, pool capacity %u), %lld frame "
+                            "nodes from heap\n",
+                            playout_buf->stream_identifier, pool_stats.allocs,
+                            pool_stats.heap_allocs, pool_stats.capacity,
+                            playout_buf->node_heap_allocs);
+                }
 
                 if (playout_buf->max_out_of_order_dist >= playout_buf->stats_interval) {
                         size_t new_val = (playout_buf->max_out_of_order_dist + STAT_INT_MIN_DIVISOR - 1) / STAT_INT_MIN_DIVISOR * STAT_INT_MIN_DIVISOR;
@@ -435,6 +599,24 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
         }
 }
 
+/// queues stored packet for incremental assembly
+static void cut_through_enqueue(struct pbuf *playout_buf, struct pbuf_node *node, rtp_packet *pkt)
+{
+        if (!node->cut_through || node->decoded) {
+                return;
+        }
+        if (playout_buf->ct_pending_count == playout_buf->ct_pending_alloc) {
+                const int new_alloc = MAX(2 * playout_buf->ct_pending_alloc, 256);
+                rtp_packet **pending = realloc(playout_buf->ct_pending, new_alloc * sizeof pending[0]);
+                if (pending == NULL) {
+                        return; // the frame will miss the packet
+                }
+                playout_buf->ct_pending = pending;
+                playout_buf->ct_pending_alloc = new_alloc;
+        }
+        playout_buf->ct_pending[playout_buf->ct_pending_count++] = pkt;
+}
+
 void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
 {
         struct pbuf_node *tmp;
@@ -444,75 +626,52 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
 
         if (playout_buf->frst == NULL && playout_buf->last == NULL) {
                 /* playout buffer is empty - add new frame */
-                playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                playout_buf->frst = create_new_pnode(playout_buf, pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
                 playout_buf->last = playout_buf->frst;
+                if (playout_buf->frst != NULL) {
+                        cut_through_enqueue(playout_buf, playout_buf->frst, pkt);
+                }
                 return;
         }
 
-        if (playout_buf->last->rtp_timestamp == pkt->ts) {
-                if (playout_buf->last->decoded) {
-                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Late data for already decoded frame!\n");
+        struct pbuf_node *node = ts_hash_find(playout_buf, pkt->ts);
+        if (node != NULL) {
+                /* Packet belongs to an existing frame, most likely the last one */
+                if (node->decoded) {
+                        MSG_LIMITED(VERBOSE, 1000, "Late data for already decoded frame!\n");
                 }
-                /* Packet belongs to last frame in playout_buf this is the */
-                /* most likely scenario - although...                      */
-                add_coded_unit(playout_buf->last, pkt);
-        } else {
-                if (playout_buf->last->rtp_timestamp < pkt->ts ||
-                    playout_buf->last->rtp_timestamp - pkt->ts >
-                        UINT32_MAX - WRAPAROUND_THRESHOLD) {
-                        /* Packet belongs to a new frame... */
-                        tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                if (add_coded_unit(node, pkt)) {
+                        cut_through_enqueue(playout_buf, node, pkt);
+                }
+        } else if (playout_buf->last->rtp_timestamp < pkt->ts ||
+                   playout_buf->last->rtp_timestamp - pkt->ts >
+                       UINT32_MAX - WRAPAROUND_THRESHOLD) {
+                /* Packet belongs to a new frame... */
+                tmp = create_new_pnode(playout_buf, pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                if (tmp != NULL) {
                         playout_buf->last->nxt = tmp;
                         playout_buf->last->completed = true;
                         tmp->prv = playout_buf->last;
                         playout_buf->last = tmp;
+                        cut_through_enqueue(playout_buf, tmp, pkt);
+                }
+        } else {
+                /* Packet belongs to a previous frame that is not present */
+                if (playout_buf->frst->rtp_timestamp > pkt->ts ||
+                    pkt->ts - playout_buf->frst->rtp_timestamp >
+                        UINT32_MAX - WRAPAROUND_THRESHOLD) {
+                        debug_msg("A very old packet - discarded\n");
                 } else {
-                        bool discard_pkt = false;
-                        /* Packet belongs to a previous frame... */
-                        if (playout_buf->frst->rtp_timestamp > pkt->ts ||
-                            pkt->ts - playout_buf->frst->rtp_timestamp >
-                                UINT32_MAX - WRAPAROUND_THRESHOLD) {
-                                debug_msg("A very old packet - discarded\n");
-                                discard_pkt = true;
-                        } else {
-                                debug_msg
-                                    ("A packet for a previous frame, but might still be useful\n");
-                                struct pbuf_node *curr = playout_buf->last;
-                                while(curr != playout_buf->frst && curr->rtp_timestamp > pkt->ts){
-                                        curr = curr->prv;
-                                }
-                                if (curr->rtp_timestamp == pkt->ts) {
-                                        /* Packet belongs to a previous existing frame... */
-                                        add_coded_unit(curr, pkt);
-                                } else {
-                                        /* Packet belongs to a frame that is not present */
-                                        discard_pkt = true;
-                                }
-                        }
-                        if (discard_pkt) {
-                                if (pkt->m) {
-                                        debug_msg
-                                                ("Oops... dropped packet with M bit set\n");
-                                }
-                                free(pkt);
-                        }
+                        debug_msg("A packet for a previous, already removed frame - discarded\n");
                 }
+                if (pkt->m) {
+                        debug_msg("Oops... dropped packet with M bit set\n");
+                }
+                packet_pool_free(pkt);
         }
         pbuf_validate(playout_buf);
 }
 
-static void free_cdata(struct coded_data *head)
-{
-        struct coded_data *tmp;
-
-        while (head != NULL) {
-                free(head->data);
-                tmp = head;
-                head = head->nxt;
-                free(tmp);
-        }
-}
-
 void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
 {
         /* Remove previously decoded frames that have passed their playout  */
@@ -527,20 +686,7 @@ void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
         while (curr != NULL) {
                 temp = curr->nxt;
                 if (curr_time > curr->deletion_time && frame_complete(curr)) {
-                        if (curr == playout_buf->frst) {
-                                playout_buf->frst = curr->nxt;
-                        }
-                        if (curr == playout_buf->last) {
-                                playout_buf->last = curr->prv;
-                        }
-                        if (curr->nxt != NULL) {
-                                curr->nxt->prv = curr->prv;
-                        }
-                        if (curr->prv != NULL) {
-                                curr->prv->nxt = curr->nxt;
-                        }
-                        free_cdata(curr->cdata);
-                        free(curr);
+                        remove_pnode(playout_buf, curr);
                 } else {
                         /* The playout buffer is stored in order, so once  */
                         /* we see one packet that has not yet reached it's */
@@ -573,6 +719,17 @@ int pbuf_is_empty(struct pbuf *playout_buf)
         return playout_buf->frst == NULL;
 }
 
+static void fill_stats(struct pbuf *playout_buf, const rtp_packet *pkt,
+                       time_ns_t arrival_time, struct pbuf_stats *stats)
+{
+        struct packet_pool_stats pool_stats;
+        packet_pool_get_stats(pkt, &pool_stats);
+        *stats = (struct pbuf_stats){ playout_buf->received_pkts_cum,
+                playout_buf->expected_pkts_cum, pool_stats.allocs,
+                pool_stats.heap_allocs, playout_buf->node_heap_allocs,
+                arrival_time };
+}
+
 int
 pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
                              decode_frame_t decode_func, void *data)
@@ -586,13 +743,15 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
 
         curr = playout_buf->frst;
         while (curr != NULL) {
-                if (!curr->decoded 
+                if (!curr->decoded && !curr->cut_through
                                 && curr_time > curr->playout_time
                    ) {
                         if (frame_complete(curr)) {
-                                struct pbuf_stats stats = { playout_buf->received_pkts_cum,
-                                        playout_buf->expected_pkts_cum };
-                                int ret = decode_func(curr->cdata, data, &stats);
+                                struct coded_data *cdata = link_coded_units(curr);
+                                struct pbuf_stats stats;
+                                fill_stats(playout_buf, cdata->data,
+                                           curr->arrival_time, &stats);
+                                int ret = decode_func(cdata, data, &stats);
                                 curr->decoded = 1;
                                 return ret;
                         } else {
@@ -609,6 +768,93 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
         return 0;
 }
 
+static int cut_through_finish(struct pbuf *playout_buf)
+{
+        struct pbuf_node *node = playout_buf->ct_node;
+        struct pbuf_stats stats;
+        fill_stats(playout_buf, node->pkts[0], node->arrival_time, &stats);
+        int ret = playout_buf->ct_dec->frame_finish(playout_buf->ct_ctx, &stats);
+        node->decoded = 1;
+        playout_buf->ct_node = NULL;
+        playout_buf->ct_ctx = NULL;
+        return ret;
+}
+
+static void cut_through_abort(struct pbuf *playout_buf)
+{
+        playout_buf->ct_dec->frame_abort(playout_buf->ct_ctx);
+        playout_buf->ct_node->decoded = 1;
+        playout_buf->ct_node = NULL;
+        playout_buf->ct_ctx = NULL;
+}
+
+/**
+ * Frame is known to be complete if M-bit packet was received and there is
+ * no gap in sequence numbers since the end of the previous frame.
+ */
+static bool cut_through_frame_ready(struct pbuf_node *node)
+{
+        return node->mbit && node->pkt_count == node->pkts_span &&
+               node->prv != NULL &&
+               (uint16_t) (node->prv->base_seq + node->prv->pkts_span) ==
+                   node->base_seq;
+}
+
+/**
+ * Incremental variant of pbuf_decode() - packets received since the last
+ * call are passed to dec->frame_add() immediately and the frame is finished
+ * as soon as it is complete, regardless of the playout delay. Incomplete
+ * frames are finished when they reach the playout time (as in pbuf_decode())
+ * or when the next frame starts - packets reordered across a frame boundary
+ * are thus dropped.
+ *
+ * Frames received before incremental decoding was enabled or for which
+ * dec->frame_begin() failed are decoded by dec->decode in pbuf_decode().
+ */
+int pbuf_decode_cut_through(struct pbuf *playout_buf, time_ns_t curr_time,
+                            const struct pbuf_frame_decoder *dec, void *data)
+{
+        int ret = 0;
+
+        pbuf_validate(playout_buf);
+        playout_buf->ct_dec = dec;
+
+        for (int i = 0; i < playout_buf->ct_pending_count; ++i) {
+                rtp_packet *pkt = playout_buf->ct_pending[i];
+                struct pbuf_node *node = ts_hash_find(playout_buf, pkt->ts);
+                assert(node != NULL);
+                if (node->decoded || !node->cut_through) {
+                        continue;
+                }
+                if (node != playout_buf->ct_node) {
+                        if (playout_buf->ct_node != NULL) {
+                                ret |= cut_through_finish(playout_buf);
+                        }
+                        playout_buf->ct_ctx = dec->frame_begin(data, pkt);
+                        if (playout_buf->ct_ctx == NULL) {
+                                node->cut_through = false;
+                                continue;
+                        }
+                        playout_buf->ct_node = node;
+                }
+                if (!dec->frame_add(playout_buf->ct_ctx, pkt)) {
+                        cut_through_abort(playout_buf);
+                }
+        }
+        playout_buf->ct_pending_count = 0;
+
+        struct pbuf_node *node = playout_buf->ct_node;
+        if (node != NULL && curr_time > node->playout_time + 1 * NS_IN_SEC) {
+                node->completed = true;
+        }
+        if (node != NULL && (cut_through_frame_ready(node) ||
+                             (curr_time > node->playout_time && frame_complete(node)))) {
+                ret |= cut_through_finish(playout_buf);
+        }
+
+        return ret | pbuf_decode(playout_buf, curr_time, dec->decode, data);
+}
+
 void pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay)
 {
         playout_buf->playout_delay_us = playout_delay * 1000 * 1000;
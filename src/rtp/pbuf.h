@@ -77,7 +77,8 @@
 extern "C" {
 #endif
 
-/* The coded representation of a single frame */
+/* The coded representation of a single frame. Stored intrusively in the packet */
+/* pool scratch area of data (see packet_pool_scratch()).                      */
 struct coded_data {
         struct coded_data       *nxt;
         struct coded_data       *prv;
@@ -88,6 +89,11 @@ struct coded_data {
 struct pbuf_stats {
         long long int received_pkts_cum;
         long long int expected_pkts_cum;
+        // allocation counters (cumulative)
+        unsigned long long pkt_allocs;      ///< packets allocated by receiver
+        unsigned long long pkt_heap_allocs; ///< packet allocations that needed malloc
+        long long int node_heap_allocs;     ///< frame nodes allocated with malloc
+        time_ns_t arrival_time;             ///< arrival of 1st packet of the frame
 };
 
 /* The playout buffer */
@@ -117,6 +123,23 @@ struct pbuf_audio_data {
  */
 typedef int decode_frame_t(struct coded_data *cdata, void *decode_data, struct pbuf_stats *stats);
 
+/**
+ * Callbacks for incremental (cut-through) frame assembly - packets are
+ * passed to the decoder as soon as they are received instead of processing
+ * the whole frame in one burst when it reaches its playout time.
+ */
+struct pbuf_frame_decoder {
+        /// @returns frame context or NULL if the frame cannot be assembled incrementally
+        void *(*frame_begin)(void *decode_data, rtp_packet *first_pkt);
+        /// @retval false frame cannot be decoded, it will be aborted
+        bool (*frame_add)(void *frame_ctx, rtp_packet *pkt);
+        /// completes the frame and releases frame_ctx, returns the same as decode_frame_t
+        int (*frame_finish)(void *frame_ctx, struct pbuf_stats *stats);
+        /// drops the frame and releases frame_ctx
+        void (*frame_abort)(void *frame_ctx);
+        decode_frame_t *decode; ///< used for frames not assembled incrementally
+};
+
 /* 
  * External interface:
  */
@@ -127,6 +150,8 @@ int 	 	 pbuf_is_empty(struct pbuf *playout_buf);
 int 	 	 pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
                              decode_frame_t decode_func, void *data);
                              //struct video_frame *framebuffer, int i, struct state_decoder *decoder);
+int              pbuf_decode_cut_through(struct pbuf *playout_buf, time_ns_t curr_time,
+                                         const struct pbuf_frame_decoder *dec, void *data);
 void		 pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time);
 void		 pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay);
 
@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2013-2023 CESNET, z. s. p. o.
+ * Copyright (c) 2013-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -36,25 +36,33 @@
  */
 
 
+#include <algorithm>
 #include <bitset>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <utility>
 
 #include "config.h"
 #include "debug.h"
+#include "host.h"
 #include "rtp/rs.h"
 #include "rtp/rtp_types.h"
 #include "transmit.h"
 #include "ug_runtime_error.hpp"
 #include "utils/color_out.h"
+#include "utils/gf256.h"
+#include "utils/misc.h"
 #include "utils/text.h"
+#include "utils/worker.h"
 #include "video.h"
 
 enum {
         DEFAULT_K_AUDIO = 160,
         DEFAULT_K_VIDEO = 200,
         DEFAULT_N       = 240,
+        DEFAULT_MAX_BLOCK_LEN = 512 * 1024,
 };
 
 #define MAX_K 255
@@ -73,21 +81,90 @@ extern "C" {
 
 static void usage();
 
+using std::lock_guard;
+using std::map;
+using std::min;
+using std::mutex;
+using std::pair;
 using std::shared_ptr;
+using std::vector;
+using std::weak_ptr;
+
+ADD_TO_PARAM("rs-block-size",
+                "* rs-block-size=<bytes>\n"
+                "  Split video frames larger than <bytes> to multiple Reed-Solomon blocks encoded and decoded\n"
+                "  in parallel (default 512k, 0 - single block as understood by older receivers)\n");
+
+/*
+ * Frame buffer layout
+ * -------------------
+ * The buffer consists of (k + m) * blocks symbols of equal size. Symbol j of
+ * block b is stored at index j * blocks + b, so that the data symbols form
+ * a contiguous prefix of the buffer and a burst loss is spread evenly among
+ * the blocks. Block count is sent in the seed field of the FEC header (0
+ * means single block, which is the original layout).
+ */
+#ifdef HAVE_ZFEC
+static char *get_symbol(char *buf, unsigned int ss, unsigned int blocks,
+                        unsigned int block, unsigned int idx)
+{
+        return buf + ((size_t) idx * blocks + block) * ss;
+}
+
+/// zfec code and parity rows of its encoding matrix prepared for gf256_mul_matrix()
+struct rs::code {
+        fec_t *fec = nullptr;
+        vector<gf256_coef> parity_coefs;
+        ~code() {
+                if (fec != nullptr) {
+                        fec_free(fec);
+                }
+        }
+};
+
+/**
+ * Creating the code involves a matrix inversion so the immutable code is
+ * shared by all instances with the same parameters (the decoder recreates
+ * the state whenever the block count changes).
+ */
+shared_ptr<const rs::code> rs::get_code(unsigned int k, unsigned int n)
+{
+        static mutex lock;
+        static map<pair<unsigned int, unsigned int>, weak_ptr<const code>> cache;
+
+        lock_guard<mutex> lk(lock);
+        weak_ptr<const code> &cached = cache[{ k, n }];
+        if (shared_ptr<const code> ret = cached.lock()) {
+                return ret;
+        }
+        auto ret = std::make_shared<code>();
+        ret->fec = fec_new(k, n);
+        assert(ret->fec != NULL);
+        ret->parity_coefs.resize((n - k) * k);
+        for (unsigned int i = 0; i < (n - k) * k; ++i) {
+                gf256_coef_init(&ret->parity_coefs[i],
+                                ret->fec->enc_matrix[k * k + i]);
+        }
+        cached = ret;
+        return ret;
+}
+#endif
 
 /**
  * Constructs RS state. Since this constructor is currently used only for the decoder,
  * it allows creation of dummy state even if zfec was not compiled in.
+ *
+ * @param blocks  block count of the received frames (the seed field of
+ *                the FEC header), 0 is equivalent to 1
  */
-rs::rs(unsigned int k, unsigned int n)
-        : m_k(k), m_n(n)
+rs::rs(unsigned int k, unsigned int n, unsigned int blocks)
+        : m_k(k), m_n(n), m_blocks(std::max(blocks, 1U))
 {
         assert (k <= MAX_K);
         assert (n <= MAX_N);
         assert (m_k <= m_n);
 #ifdef HAVE_ZFEC
-        state = fec_new(m_k, m_n);
-        assert(state != NULL);
+        m_code = get_code(m_k, m_n);
 #else
         LOG(LOG_LEVEL_ERROR) << "zfec support is not compiled in, error correction is disabled\n";
 #endif
@@ -116,29 +193,73 @@ rs::rs(const char *c_cfg, bool is_audio)
                 usage();
                 throw 1;
         }
+        m_max_block_len = DEFAULT_MAX_BLOCK_LEN;
+        if (const char *val = get_commandline_param("rs-block-size")) {
+                m_max_block_len = unit_evaluate(val, nullptr);
+        }
 
 #ifdef HAVE_ZFEC
-        state = fec_new(m_k, m_n);
-        assert(state != NULL);
-        MSG(INFO, "Using Reed-Solomon with k=%u n=%u\n", m_k, m_n);
+        m_code = get_code(m_k, m_n);
+        MSG(INFO, "Using Reed-Solomon with k=%u n=%u (%s)\n", m_k, m_n,
+            gf256_get_kernel_name());
 #else
         throw ug_runtime_error("zfec support is not compiled in");
 #endif
 }
 
-rs::~rs()
+rs::~rs() = default;
+
+/**
+ * Computes parity symbols of all blocks in buf, multiple blocks are
+ * encoded in parallel.
+ */
+void rs::encode_blocks(char *buf, unsigned int ss, unsigned int blocks)
 {
 #ifdef HAVE_ZFEC
-        if (state != nullptr) {
-                fec_free((fec_t *) state);
+        struct encode_task_data {
+                rs *s;
+                char *buf;
+                unsigned int ss, blocks;
+                unsigned int first, step; ///< blocks processed by the task
+                enum gf256_kernel kernel; ///< kernel selected by the caller
+        };
+        auto encode_task = [](void *arg) -> void * {
+                auto *d = (encode_task_data *) arg;
+                const rs *s = d->s;
+                // the kernel selection is per thread
+                const enum gf256_kernel saved_kernel = gf256_get_kernel();
+                gf256_set_kernel(d->kernel);
+                for (unsigned int b = d->first; b < d->blocks; b += d->step) {
+                        const uint8_t *src[MAX_K];
+                        uint8_t *dst[MAX_N];
+                        for (unsigned int k = 0; k < s->m_k; ++k) {
+                                src[k] = (uint8_t *) get_symbol(d->buf, d->ss, d->blocks, b, k);
+                        }
+                        for (unsigned int m = 0; m < s->m_n - s->m_k; ++m) {
+                                dst[m] = (uint8_t *) get_symbol(d->buf, d->ss, d->blocks, b, s->m_k + m);
+                        }
+                        gf256_mul_matrix(dst, s->m_n - s->m_k, src, s->m_k,
+                                         s->m_code->parity_coefs.data(), d->ss);
+                }
+                gf256_set_kernel(saved_kernel);
+                return nullptr;
+        };
+
+        const unsigned int workers = min<unsigned>(blocks, get_cpu_core_count());
+        vector<encode_task_data> data(workers);
+        for (unsigned int i = 0; i < workers; ++i) {
+                data[i] = { this, buf, ss, blocks, i, workers, gf256_get_kernel() };
         }
+        task_run_parallel(encode_task, workers, data.data(), sizeof data[0], nullptr);
+#else
+        (void) buf, (void) ss, (void) blocks;
 #endif
 }
 
 shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
 {
 #ifdef HAVE_ZFEC
-        assert(state != nullptr);
+        assert(m_code != nullptr);
 
         video_payload_hdr_t hdr;
         format_video_header(in.get(), 0, 0, hdr);
@@ -146,47 +267,36 @@ shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
 
         struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in.get()));
 
+        // block count is common for the whole frame (FEC header)
+        size_t max_len = 0;
+        for (unsigned i = 0; i < in->tile_count; ++i) {
+                max_len = std::max<size_t>(max_len, in->tiles[i].data_len);
+        }
+        unsigned int blocks = 1;
+        if (m_max_block_len > 0) {
+                blocks = std::max<size_t>((sizeof(uint32_t) + hdr_len + max_len +
+                                           m_max_block_len - 1) / m_max_block_len, 1);
+        }
+
         for (unsigned i = 0; i < in->tile_count; ++i) {
                 size_t len = in->tiles[i].data_len;
                 char *data = in->tiles[i].data;
-                //int encode(char *hdr, int hdr_len, char *in, int len, char **out) {
-                int ss = get_ss(hdr_len, len);
-                int buffer_len = ss * m_n;
+                int ss = get_ss(hdr_len, len, blocks);
+                size_t buffer_len = (size_t) ss * m_n * blocks;
                 char *out_data;
                 out_data = out->tiles[i].data = (char *) malloc(buffer_len);
                 uint32_t len32 = len + hdr_len;
                 memcpy(out_data, &len32, sizeof(len32));
                 memcpy(out_data + sizeof(len32), hdr, hdr_len);
                 memcpy(out_data + sizeof(len32) + hdr_len, data, len);
-                memset(out_data + sizeof(len32) + hdr_len + len, 0, ss * m_k - (sizeof(len32) + hdr_len + len));
-
-#if 0
-                void *src[MAX_K];
-                for (int k = 0; k < m_k; ++k) {
-                        src[k] = *out + ss * k;
-                }
-
-                for (int m = 0; m < m_n - m_k; ++m) {
-                        fec_encode(state, src, *out + ss * (m_k + m), m, ss);
-                }
-#else
-                void *src[MAX_K];
-                for (unsigned int k = 0; k < m_k; ++k) {
-                        src[k] = out_data + ss * k;
-                }
-                void *dst[MAX_N];
-                unsigned int dst_idx[MAX_N];
-                for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                        dst[m] = out_data + ss * (m_k + m);
-                        dst_idx[m] = m_k + m;
-                }
+                memset(out_data + sizeof(len32) + hdr_len + len, 0,
+                       (size_t) ss * m_k * blocks - (sizeof(len32) + hdr_len + len));
 
-                fec_encode((const fec_t *)state, (gf **) src,
-                                (gf **) dst, dst_idx, m_n-m_k, ss);
-#endif
+                encode_blocks(out_data, ss, blocks);
 
                 out->tiles[i].data_len = buffer_len;
-                out->fec_params = fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss);
+                out->fec_params = fec_desc(FEC_RS, m_k, m_n - m_k, 0,
+                                           blocks > 1 ? blocks : 0, ss);
         }
 
         static auto deleter = [](video_frame *frame) {
@@ -227,20 +337,7 @@ audio_frame2 rs::encode(const audio_frame2 &in)
 
                 out.set_fec_params(i, fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss));
 
-                void *src[MAX_K];
-                for (unsigned int k = 0; k < m_k; ++k) {
-                        src[k] = out.get_data(i) + ss * k;
-                }
-
-                void *dst[MAX_N];
-                unsigned int dst_idx[MAX_N];
-                for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                        dst[m] = out.get_data(i) + ss * (m_k + m);
-                        dst_idx[m] = m_k + m;
-                }
-
-                fec_encode((const fec_t *)state, (gf **) src,
-                                (gf **) dst, dst_idx, m_n-m_k, ss);
+                encode_blocks(out.get_data(i), ss, 1);
         }
 
         return out;
@@ -253,8 +350,9 @@ audio_frame2 rs::encode(const audio_frame2 &in)
 /**
  * Returns symbol size (?) for given headers len and with configured m_k
  */
-int rs::get_ss(int hdr_len, int len) {
-        return ((sizeof(uint32_t) + hdr_len + len) + m_k - 1) / m_k;
+int rs::get_ss(int hdr_len, int len, unsigned int blocks) {
+        const unsigned int data_symbols = m_k * blocks;
+        return ((sizeof(uint32_t) + hdr_len + len) + data_symbols - 1) / data_symbols;
 }
 
 /**
@@ -270,11 +368,69 @@ uint32_t rs::get_buf_len(const char *buf, std::map<int, int> const & c_m)
         return 0U;
 }
 
+/**
+ * Reconstructs missing data symbols of one block in place.
+ *
+ * @param received  flags of fully received symbols indexed by the position
+ *                  in buffer
+ * @retval false    less than k symbols of the block were received
+ */
+bool rs::decode_block(char *buf, unsigned int ss, unsigned int blocks,
+                      unsigned int block, const vector<bool> &received)
+{
+#ifdef HAVE_ZFEC
+        // zfec requires received data symbols at their index, missing
+        // ones are substituted by parity symbols
+        const gf *pkt[MAX_K];
+        unsigned int index[MAX_K];
+        std::bitset<MAX_K> repaired_slots;
+        unsigned int parity = m_k;
+        for (unsigned int j = 0; j < m_k; ++j) {
+                if (received[j * blocks + block]) {
+                        pkt[j] = (gf *) get_symbol(buf, ss, blocks, block, j);
+                        index[j] = j;
+                        continue;
+                }
+                while (parity < m_n && !received[parity * blocks + block]) {
+                        parity++;
+                }
+                if (parity == m_n) {
+                        return false;
+                }
+                pkt[j] = (gf *) get_symbol(buf, ss, blocks, block, parity);
+                index[j] = parity++;
+                repaired_slots.set(j);
+        }
+        if (repaired_slots.none()) {
+                return true;
+        }
+
+        vector<char> output(repaired_slots.count() * ss);
+        gf *out_pkts[MAX_K];
+        for (unsigned int i = 0; i < repaired_slots.count(); ++i) {
+                out_pkts[i] = (gf *) output.data() + i * ss;
+        }
+        fec_decode(m_code->fec, pkt, out_pkts, index, ss);
+
+        unsigned int i = 0;
+        for (unsigned int j = 0; j < m_k; ++j) {
+                if (repaired_slots.test(j)) {
+                        memcpy(get_symbol(buf, ss, blocks, block, j), out_pkts[i++], ss);
+                }
+        }
+        return true;
+#else
+        (void) buf, (void) ss, (void) blocks, (void) block, (void) received;
+        return false;
+#endif
+}
+
 bool rs::decode(char *in, int in_len, char **out, int *len,
                 std::map<int, int> const & c_m)
 {
         std::map<int, int> m = c_m; // make private copy
-        unsigned int ss = in_len / m_n;
+        const unsigned int blocks = m_blocks;
+        unsigned int ss = in_len / (m_n * blocks);
 
         // compact neighbouring segments
         for (auto it = m.begin(); it != m.end(); ++it) {
@@ -289,131 +445,57 @@ bool rs::decode(char *in, int in_len, char **out, int *len,
                 }
         }
 
-        if (state == nullptr) { // zfec was not compiled in - dummy mode
+        if (m_code == nullptr || ss == 0) { // zfec was not compiled in - dummy mode
                 *len = get_buf_len(in, c_m);
                 *out = (char *) in + sizeof(uint32_t);
                 auto fst_sgmt = m.find(0);
-                return fst_sgmt != m.end() && (unsigned) fst_sgmt->second >= ss * m_k;
+                return fst_sgmt != m.end() && (unsigned) fst_sgmt->second >= ss * m_k * blocks;
         }
 
-#ifdef HAVE_ZFEC
-        assert(m_n <= MAX_N);
-        void *pkt[MAX_N];
-        unsigned int index[MAX_N];
-        unsigned int i = 0;
-#if 0
-
-        ///fprintf(stderr, "%d\n\n%d\n%d\n", in_len, malloc_usable_size((void *)in), sizeof(short));
-
-
-        for (auto it = m.begin(); it != m.end(); ++it) {
-                int start = it->first;
-                int offset = it->second;
-
-                int first_symbol_start = (start + ss - 1) / ss * ss;
-                int last_symbol_end = (start + offset) / ss * ss;
-                //fprintf(stderr, "%d %d %d\n", first_symbol_start, last_symbol_end, start);
-                for (int j = first_symbol_start; j < last_symbol_end; j += ss) {
-                        //fprintf(stderr, "%d\n", j);
-                        pkt[i] = (void *) (in + j);
-                        index[i] = j / ss;
-                        i++;
-                        if (i == m_k) break;
-                }
-                if (i == m_k) break;
-        }
-
-        if (i != m_k) {
-                *len = 0;
-                return;
-        }
-
-        assert (i == m_k);
-
-        int ret = fec_decode(state, pkt, index, ss);
-        if (ret != 0) {
-                *len = 0;
-                return;
-        }
-        uint32_t out_sz;
-        memcpy(&out_sz,  pkt[0], sizeof(out_sz));
-        fprintf(stderr, "%d %d\n\n", out_sz, index[0]);
-        *len = out_sz;
-        *out = (char *) in + 4;
-#else
-        //const unsigned int bitset_size = m_k;
-
-        std::bitset<MAX_K> empty_slots;
-        std::bitset<MAX_K> repaired_slots;
-
+        vector<bool> received(m_n * blocks);
         for (auto it = m.begin(); it != m.end(); ++it) {
                 int start = it->first;
                 int size = it->second;
 
                 unsigned int first_symbol_start = (start + ss - 1) / ss * ss;
                 unsigned int last_symbol_end = (start + size) / ss * ss;
-                for (unsigned int j = first_symbol_start; j < last_symbol_end; j += ss) {
-                        if (j/ss < m_k) {
-                                pkt[j/ss] = in + j;
-                                index[j/ss] = j/ss;
-                                empty_slots.set(j/ss);
-                                //fprintf(stderr, "%d\n", j/ss);
-                        } else {
-                                for (unsigned int k = 0; k < m_k; ++k) {
-                                        if (!empty_slots.test(k)) {
-                                                pkt[k] = in + j;
-                                                index[k] = j/ss;
-                                                //fprintf(stderr, "%d\n", j/ss);
-                                                empty_slots.set(k);
-                                                repaired_slots.set(k);
-                                                break;
-                                        }
-                                        //fprintf(stderr, "what???\n", j/ss);
-                                }
-                        }
-                        i++;
-                        //fprintf(stderr, " %d\n", i);
-                        if (i == m_k) break;
+                for (unsigned int j = first_symbol_start; j < last_symbol_end && j / ss < received.size(); j += ss) {
+                        received[j / ss] = true;
                 }
-                if (i == m_k) break;
-        }
-
-        //fprintf(stderr, "       %d\n", i);
-
-        if (i != m_k) {
-                *len = get_buf_len(in, c_m);
-                *out = (char *) in + sizeof(uint32_t);
-                return false;
-        }
-
-        char **output = (char **) malloc(m_k * sizeof(char *));
-        for (unsigned int i = 0; i < m_k; ++i) {
-                output[i] = (char *) malloc(ss);
         }
 
-        fec_decode((const fec_t *) state, (const gf *const *) pkt,
-                        (gf *const *) output, index, ss);
-
-        i = 0;
-        for (unsigned int j = 0; j < m_k; ++j) {
-                if (repaired_slots.test(j)) {
-                        memcpy((void *) (in + j * ss), output[i], ss);
-                        i++;
+        struct decode_task_data {
+                rs *s;
+                char *buf;
+                unsigned int ss, blocks;
+                unsigned int first, step; ///< blocks processed by the task
+                const vector<bool> *received;
+                bool ret;
+        };
+        auto decode_task = [](void *arg) -> void * {
+                auto *d = (decode_task_data *) arg;
+                for (unsigned int b = d->first; b < d->blocks; b += d->step) {
+                        d->ret = d->s->decode_block(d->buf, d->ss, d->blocks, b, *d->received) && d->ret;
                 }
+                return nullptr;
+        };
+        const unsigned int workers = min<unsigned>(blocks, get_cpu_core_count());
+        vector<decode_task_data> data(workers);
+        for (unsigned int i = 0; i < workers; ++i) {
+                data[i] = { this, in, ss, blocks, i, workers, &received, true };
         }
+        task_run_parallel(decode_task, workers, data.data(), sizeof data[0], nullptr);
 
-        for (unsigned int i = 0; i < m_k; ++i) {
-                free(output[i]);
+        *out = (char *) in + sizeof(uint32_t);
+        for (const auto &d : data) {
+                if (!d.ret) {
+                        *len = get_buf_len(in, c_m);
+                        return false;
+                }
         }
-        free(output);
-
         uint32_t out_sz;
         memcpy(&out_sz, in, sizeof(out_sz));
-        //fprintf(stderr, "       %d\n", out_sz);
         *len = out_sz;
-        *out = (char *) in + sizeof(uint32_t);
-#endif
-#endif // defined HAVE_ZFEC
 
         return true;
 }
@@ -433,6 +515,9 @@ static void usage() {
             "The n/k ratio determines the redundancy that the FEC provides. "
             "But please note that the " TUNDERLINE("strength")
             " of the FEC applies " TBOLD ("per frame") " basis, so 20%"
-            " redundancy will cover 20% loss in a signle frame only.\n";
+            " redundancy will cover 20% loss in a signle frame only. Large video"
+            " frames are split into multiple independent blocks (see "
+            TBOLD("--param rs-block-size") "), symbols of the blocks are"
+            " interleaved so that the loss is spread among them.\n";
         color_printf("%s\n", wrap_paragraph(desc));
 }
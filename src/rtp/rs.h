@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2013-2021 CESNET, z. s. p. o.
+ * Copyright (c) 2013-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -41,13 +41,14 @@
 #include <cstdint>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include "fec.h"
 
 struct video_frame;
 
 struct rs : public fec {
-        rs(unsigned int k, unsigned int n);
+        rs(unsigned int k, unsigned int n, unsigned int blocks = 1);
         rs(const char *cfg, bool is_audio);
         virtual ~rs();
         std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame> frame) override;
@@ -56,10 +57,17 @@ struct rs : public fec {
                 const std::map<int, int> &) override;
 
 private:
-        int get_ss(int hdr_len, int len);
+        struct code;
+        static std::shared_ptr<const code> get_code(unsigned int k, unsigned int n);
+        int get_ss(int hdr_len, int len, unsigned int blocks = 1);
         uint32_t get_buf_len(const char *buf, std::map<int, int> const & c_m);
-        void *state = nullptr;
+        void encode_blocks(char *buf, unsigned int ss, unsigned int blocks);
+        bool decode_block(char *buf, unsigned int ss, unsigned int blocks,
+                          unsigned int block, const std::vector<bool> &received);
+        std::shared_ptr<const code> m_code;
         unsigned int m_k, m_n;
+        unsigned int m_blocks = 1; ///< block count of decoded frames
+        size_t m_max_block_len = 0; ///< encoder only, 0 - do not split frames
 };
 
 #endif /* __RS_H__ */
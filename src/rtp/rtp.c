@@ -78,6 +78,7 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <stdalign.h>
 #include <stdatomic.h>
 
 #include "memory.h"
@@ -91,6 +92,7 @@
 #include "rtp.h"
 #include "utils/misc.h"
 #include "utils/net.h"
+#include "utils/packet_pool.h"
 #include "utils/random.h"
 
 #undef max
@@ -126,6 +128,9 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
 #define MAX_MISORDER   100
 #define MIN_SEQUENTIAL 2
 
+#define RTP_RECV_BATCH 64 ///< max packets processed per rtp_recv_data() call (multithreaded rx)
+#define RTP_RECV_POOL_LEN 4096 ///< max received packets kept for reuse (single-threaded rx)
+
 /*
  * Definitions for the RTP/RTCP packets on the wire...
  */
@@ -332,6 +337,7 @@ struct rtp {
         rtp_callback callback;
         struct msghdr *mhdr;
         bool mt_recv; /* whether the receiver uses separate thread for receiving */
+        struct packet_pool *rx_pool; /* received packets if !mt_recv, otherwise net_udp owns the pool */
         uint32_t magic;         /* For debugging...  */
 };
 
@@ -1505,8 +1511,10 @@ process_rtp(struct rtp *session, uint32_t curr_rtp_ts, rtp_packet * packet,
                 event.type = RX_RTP;
 
                 //              printf("This packet is going to have size %d\n",sizeof(packet));
-                event.data = (void *)packet;    /* The callback function MUST free this! */
+                event.data = (void *)packet;    /* The callback function MUST free this with packet_pool_free()! */
                 session->callback(session, &event);
+        } else {
+                packet_pool_free(packet);
         }
 }
 
@@ -1527,11 +1535,23 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
         uint8_t *buffer = NULL;
 
         if (session->mt_recv) {
-                buflen = udp_recv_data(session->rtp_socket, (char **) &packet);
-                buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
+                // process everything the reader thread has queued at once
+                char *packets[RTP_RECV_BATCH];
+                int lens[RTP_RECV_BATCH];
+                int count = udp_recv_data_batch(session->rtp_socket, packets, lens, RTP_RECV_BATCH);
+                for (int i = 0; i < count; ++i) {
+                        packet = (rtp_packet *)(void *) packets[i];
+                        buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
+                        rtp_process_data(session, curr_rtp_ts, buffer, packet, lens[i]);
+                        buflen += max(lens[i], 0);
+                }
+                return buflen;
         } else {
+                if (session->rx_pool == NULL) {
+                        session->rx_pool = packet_pool_create(RTP_MAX_PACKET_LEN + sizeof(struct sockaddr_storage), RTP_RECV_POOL_LEN);
+                }
                 if (!session->opt->reuse_bufs || (packet == NULL)) {
-                        packet = (rtp_packet *) malloc(RTP_MAX_PACKET_LEN + (session->opt->record_source ? sizeof(struct sockaddr_storage) : 0));
+                        packet = (rtp_packet *) packet_pool_alloc(session->rx_pool);
                         buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
                 }
                 struct sockaddr_storage *sin = NULL;
@@ -1545,7 +1565,7 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
                                         RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
                                         (struct sockaddr *) sin, sin ? &addrlen : 0);
                 if (buflen <= 0) {
-                        free(packet);
+                        packet_pool_free(packet);
                 }
         }
 
@@ -1666,7 +1686,7 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
         }
 
         if (!session->opt->reuse_bufs) {
-                free(packet);
+                packet_pool_free(packet);
         }
 }
 
@@ -2767,6 +2787,9 @@ rtp_send_data_hdr(struct rtp *session,
         WSABUF *send_vector = NULL;
 #else
         struct iovec send_vector[3];
+        // header is sent (or copied to a send batch) synchronously
+        alignas(rtp_packet) uint8_t hdr_buf[20 + RTP_PACKET_HEADER_SIZE +
+                                            RTP_MAX_EXTN_LEN];
 #endif
         int send_vector_len;
 
@@ -2786,6 +2809,7 @@ rtp_send_data_hdr(struct rtp *session,
         buffer_len = vlen + (4 * cc);
 
         if (extn != NULL) {
+                assert((extn_len + 1) * 4 <= RTP_MAX_EXTN_LEN);
                 buffer_len += (extn_len + 1) * 4;
         }
 
@@ -2816,11 +2840,13 @@ rtp_send_data_hdr(struct rtp *session,
         assert(buffer_len < RTP_MAX_PACKET_LEN);
         /* we dont always need 20 (12|16) but this seems to work. LG */
 #ifdef _WIN32
-        d = (uint8_t *) malloc(3 * sizeof(WSABUF) + 20 + RTP_PACKET_HEADER_SIZE);
+        d = (uint8_t *) malloc(3 * sizeof(WSABUF) + 20 + RTP_PACKET_HEADER_SIZE +
+                               RTP_MAX_EXTN_LEN);
         send_vector = d;
         buffer = (uint8_t *) d + 3 * sizeof(WSABUF);
 #else
-        d = buffer = (uint8_t *) malloc(20 + RTP_PACKET_HEADER_SIZE);
+        d = NULL;
+        buffer = hdr_buf;
 #endif
         packet = (rtp_packet *)(void *) buffer;
 
@@ -2873,10 +2899,10 @@ rtp_send_data_hdr(struct rtp *session,
         /* ...a header extension? */
         if (extn != NULL) {
                 /* We don't use the packet->extn_type field here, that's for receive only... */
-                uint16_t *base = (uint16_t *)(void *) packet->extn;
-                base[0] = htons(extn_type);
-                base[1] = htons(extn_len);
-                memcpy(packet->extn + 4, extn, extn_len * 4);
+                uint8_t *extn_hdr = buffer + RTP_PACKET_HEADER_SIZE + vlen + 4 * cc;
+                const uint16_t base[2] = { htons(extn_type), htons(extn_len) };
+                memcpy(extn_hdr, base, sizeof base);
+                memcpy(extn_hdr + sizeof base, extn, extn_len * 4);
         }
         /* ...the payload header... */
         if (phdr != NULL) {
@@ -3707,6 +3733,7 @@ void rtp_done(struct rtp *session)
 
         udp_exit(session->rtp_socket);
         udp_exit(session->rtcp_socket);
+        packet_pool_destroy(session->rx_pool);
         free(session->opt);
         free(session);
 }
@@ -4037,6 +4064,31 @@ void rtp_async_wait(struct rtp *session)
        udp_async_wait(session->rtp_socket);
 }
 
+void rtp_async_flush(struct rtp *session)
+{
+       udp_async_flush(session->rtp_socket);
+}
+
+bool rtp_async_is_batching(struct rtp *session)
+{
+       return udp_async_is_batching(session->rtp_socket);
+}
+
+void rtp_async_set_pacing(struct rtp *session, long interval_ns)
+{
+       udp_async_set_pacing(session->rtp_socket, interval_ns);
+}
+
+bool rtp_set_txtime(struct rtp *session, bool tai)
+{
+       return udp_set_txtime(session->rtp_socket, tai);
+}
+
+bool rtp_set_max_pacing_rate(struct rtp *session, uint64_t bytes_per_sec)
+{
+       return udp_set_max_pacing_rate(session->rtp_socket, bytes_per_sec);
+}
+
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session)
 {
         return udp_get_local(session->rtp_socket);
@@ -126,6 +126,8 @@ typedef struct __attribute__((packed)) {
 } rtp_packet;
 
 #define RTP_PACKET_HEADER_SIZE ((int) (offsetof(rtp_packet, extn_type) - offsetof(rtp_packet, csrc) + sizeof ((rtp_packet *) 0)->extn_type))
+/// max size of header extension (incl. 4 B ext header) accepted by rtp_send_data_hdr()
+#define RTP_MAX_EXTN_LEN 64
 
 typedef struct {
 	uint32_t         ssrc;
@@ -177,7 +179,7 @@ typedef struct {
 
 /* rtp_event type values. */
 typedef enum {
-        RX_RTP,
+        RX_RTP,         /* e->data is rtp_packet that callback must release with packet_pool_free() */
 	RX_RTP_IOV,
         RX_SR,
         RX_RR,
@@ -317,7 +319,7 @@ bool             rtp_is_ipv6(struct rtp *session);
 bool             rtp_has_receiver(struct rtp *session);
 
 /*
- * Async API - MSW specific
+ * Async API - MSW overlapped I/O, sendmmsg() batching elsewhere
  *
  * Using async API hugely improves performance.
  * Usage is simple - prior to sending a bulk of packets (eg. video frame), rtp_async_start()
@@ -325,9 +327,20 @@ bool             rtp_has_receiver(struct rtp *session);
  * be altered up to rtp_async_wait() call, which waits upon completition of async operations
  * started after rtp_async_start(). Caller is responsible that rtp_send_data_hdr() is not called
  * more than nr_packet times.
+ *
+ * If rtp_async_is_batching() returns true, packets are only queued and submitted
+ * together by rtp_async_flush() or rtp_async_wait(). With rtp_set_txtime()
+ * enabled, rtp_async_set_pacing() lets the kernel (fq/etf qdisc) space the
+ * queued packets.
  */
 void             rtp_async_start(struct rtp *session, int nr_packets);
 void             rtp_async_wait(struct rtp *session);
+void             rtp_async_flush(struct rtp *session);
+bool             rtp_async_is_batching(struct rtp *session);
+void             rtp_async_set_pacing(struct rtp *session, long interval_ns);
+
+bool             rtp_set_txtime(struct rtp *session, bool tai);
+bool             rtp_set_max_pacing_rate(struct rtp *session, uint64_t bytes_per_sec);
 
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session);
 
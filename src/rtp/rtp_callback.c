@@ -70,6 +70,7 @@
 #include "rtp/rtp.h"     // for rtp_my_ssrc, rtcp_rr, rtcp_app, rtcp_sdes_item
 #include "tfrc.h"        // for tfrc_recv_data
 #include "tv.h"          // for get_time_in_ns
+#include "utils/packet_pool.h" // for packet_pool_free
 
 struct pdb;
 struct rtp;
@@ -222,6 +223,8 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
                                pckt_rtp->data_len + 40);
                 if (pckt_rtp->data_len > 0) {   /* Only process packets that contain data... */
                         pbuf_insert(state->playout_buffer, pckt_rtp);
+                } else {
+                        packet_pool_free(pckt_rtp);
                 }
                 break;
         case RX_TFRC_RX:
@@ -147,7 +147,7 @@ typedef uint32_t audio_payload_hdr_t[5];
  * bits 26-31 C
  *
  * 5th word
- * bits 0 - 31 LDGM random generator seed
+ * bits 0 - 31 LDGM random generator seed or RS block count (0 - single block)
  */
 typedef uint32_t fec_payload_hdr_t[5];
 
@@ -42,6 +42,7 @@
  */
 
 #include <assert.h>             // for assert
+#include <pthread.h>
 #include <stdbool.h>            // for false, true
 #include <stdint.h>             // for uint8_t, uint32_t, uint16_t
 #include <stdlib.h>             // for free, malloc, NULL
@@ -57,6 +58,7 @@
 #include "types.h"              // for tile, video_frame, frame_type
 #include "utils/h264_stream.h"
 #include "utils/bs.h"
+#include "utils/macros.h"       // for MAX
 #include "video_frame.h"
 
 /// type was 1-23 representing H.264 NAL type
@@ -68,14 +70,121 @@ static const uint8_t start_sequence[] = { 0, 0, 0, 1 };
 
 int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data, int data_len);
 
+/**
+ * Pool of growable frame buffers. Buffers are returned to the pool by the
+ * frame data deleter, the pool is freed when both the decoder and all
+ * frames have released it.
+ */
+struct rtpdec_buf_pool {
+        pthread_mutex_t lock;
+        struct rtpdec_buf *free_list;
+        int refcount; ///< decoder + buffers taken from the pool
+};
+
+struct rtpdec_buf {
+        struct rtpdec_buf_pool *pool;
+        struct rtpdec_buf *next;
+        size_t capacity;
+        size_t len;
+        _Alignas(16) unsigned char data[];
+};
+
+enum {
+        RTPDEC_BUF_INIT_SIZE = 1024 * 1024,
+        /// space for a back-pointer to the buffer preceding frame data
+        RTPDEC_BUF_PTR = sizeof(struct rtpdec_buf *),
+};
+
+static struct rtpdec_buf_pool *rtpdec_buf_pool_create(void)
+{
+        struct rtpdec_buf_pool *pool = calloc(1, sizeof *pool);
+        pthread_mutex_init(&pool->lock, NULL);
+        pool->refcount = 1;
+        return pool;
+}
+
+static void rtpdec_buf_pool_unref(struct rtpdec_buf_pool *pool)
+{
+        pthread_mutex_lock(&pool->lock);
+        const bool last = --pool->refcount == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (!last) {
+                return;
+        }
+        while (pool->free_list != NULL) {
+                struct rtpdec_buf *next = pool->free_list->next;
+                free(pool->free_list);
+                pool->free_list = next;
+        }
+        pthread_mutex_destroy(&pool->lock);
+        free(pool);
+}
+
+static struct rtpdec_buf *rtpdec_buf_get(struct rtpdec_buf_pool *pool)
+{
+        pthread_mutex_lock(&pool->lock);
+        struct rtpdec_buf *buf = pool->free_list;
+        if (buf != NULL) {
+                pool->free_list = buf->next;
+        }
+        pool->refcount += 1;
+        pthread_mutex_unlock(&pool->lock);
+        if (buf == NULL) {
+                buf = malloc(sizeof *buf + RTPDEC_BUF_INIT_SIZE);
+                buf->pool = pool;
+                buf->capacity = RTPDEC_BUF_INIT_SIZE;
+        }
+        buf->len = 0;
+        return buf;
+}
+
+static void rtpdec_buf_put(struct rtpdec_buf *buf)
+{
+        struct rtpdec_buf_pool *pool = buf->pool;
+        pthread_mutex_lock(&pool->lock);
+        buf->next = pool->free_list;
+        pool->free_list = buf;
+        pthread_mutex_unlock(&pool->lock);
+        rtpdec_buf_pool_unref(pool);
+}
+
+static void rtpdec_buf_data_deleter(struct video_frame *frame)
+{
+        struct rtpdec_buf *buf = NULL;
+        memcpy(&buf, frame->tiles[0].data - RTPDEC_BUF_PTR, sizeof buf);
+        rtpdec_buf_put(buf);
+}
+
+/// @returns pointer to len bytes appended to the buffer (may be reallocated)
+static unsigned char *rtpdec_buf_append(struct rtpdec_buf **buf, size_t len)
+{
+        if ((*buf)->len + len > (*buf)->capacity) {
+                size_t capacity = MAX((*buf)->capacity * 2, (*buf)->len + len);
+                *buf = realloc(*buf, sizeof **buf + capacity);
+                (*buf)->capacity = capacity;
+        }
+        unsigned char *ret = (*buf)->data + (*buf)->len;
+        (*buf)->len += len;
+        return ret;
+}
+
+static void rtpdec_buf_append_nal(struct rtpdec_buf **buf, const uint8_t *hdr,
+                                  int hdr_len, const uint8_t *data, int data_len)
+{
+        unsigned char *dst = rtpdec_buf_append(buf, sizeof start_sequence + hdr_len + data_len);
+        memcpy(dst, start_sequence, sizeof start_sequence);
+        if (hdr_len > 0) {
+                memcpy(dst + sizeof start_sequence, hdr, hdr_len);
+        }
+        memcpy(dst + sizeof start_sequence + hdr_len, data, data_len);
+}
+
 /**
  * This function extracts important data for futher processing of the stream,
  * eg. frame type - for prepending RTSP/SDP sprop-parameter-sets to I-frame and
  * parsing dimensions from SPS NAL.
  *
- * Should be run in 1st pass - it sets frame_type according to which does the
- * decoder deduce offset in 2nd pass.
- *
+ * @param data  NAL unit, NULL to process only the header
  * @retval H.264 or RTP NAL type
  */
 static uint8_t process_nal(uint8_t nal, struct video_frame *frame, uint8_t *data, int data_len) {
@@ -84,7 +193,7 @@ static uint8_t process_nal(uint8_t nal, struct video_frame *frame, uint8_t *data
     log_msg(LOG_LEVEL_DEBUG2, "NAL type %s (%d; nri: %d)\n",
             get_nalu_name(type), (int) type, (int) nri);
 
-    if (type == NAL_H264_SPS) {
+    if (type == NAL_H264_SPS && data != NULL) {
         fill_coded_frame_from_sps(frame, data, data_len);
     }
 
@@ -99,33 +208,25 @@ static uint8_t process_nal(uint8_t nal, struct video_frame *frame, uint8_t *data
 }
 
 /**
- * @param pass  0 - extracts frame metadata (type; width height if SPS present)
- * and computes required out buffer length;
- *              1 - copy NAL units to output buffer separated by start codes
- * ([0,]0,0,1i; Annex-B)
+ * Extracts frame metadata (type; width height if SPS present) and appends
+ * NAL units to the buffer separated by start codes ([0,]0,0,1; Annex-B).
+ *
+ * @param fu_start  offset of the FU-A NAL unit being reassembled in buf
  */
-static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int pass, unsigned char **dst, uint8_t *data, int data_len) {
-    int fu_length = 0;
+static _Bool decode_nal_unit(struct video_frame *frame, struct rtpdec_buf **buf, size_t *fu_start, uint8_t *data, int data_len) {
     uint8_t nal = data[0];
-    uint8_t type = pass == 0 ? process_nal(nal, frame, data, data_len) : H264_NALU_HDR_GET_TYPE(nal);
+    uint8_t type = H264_NALU_HDR_GET_TYPE(nal);
     if (type >= NAL_H264_MIN && type <= NAL_H264_MAX) {
         type = H264_NAL;
     }
 
     switch (type) {
         case H264_NAL:
-            if (pass == 0) {
-                *total_length += sizeof(start_sequence) + data_len;
-            } else {
-                *dst -= data_len + sizeof(start_sequence);
-                memcpy(*dst, start_sequence, sizeof(start_sequence));
-                memcpy(*dst + sizeof(start_sequence), data, data_len);
-            }
+            process_nal(nal, frame, data, data_len);
+            rtpdec_buf_append_nal(buf, NULL, 0, data, data_len);
             break;
         case RTP_STAP_A:
         {
-            int nal_sizes[100];
-            unsigned nal_count = 0;
             data++;
             data_len--;
 
@@ -142,36 +243,14 @@ static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int p
                         (int) H264_NALU_HDR_GET_TYPE(data[0]),
                         (int) H264_NALU_HDR_GET_NRI(nal));
 
-                if (nal_size <= data_len) {
-                    if (pass == 0) {
-                        *total_length += sizeof(start_sequence) + nal_size;
-                        process_nal(data[0], frame, data, data_len);
-                    } else {
-                        assert(nal_count < sizeof nal_sizes / sizeof nal_sizes[0] - 1);
-                        nal_sizes[nal_count++] = nal_size;
-                    }
-                } else {
+                if (nal_size > data_len) {
                     error_msg("NAL size exceeds length: %u %d\n", nal_size, data_len);
                     return false;
                 }
+                process_nal(data[0], frame, data, nal_size);
+                rtpdec_buf_append_nal(buf, NULL, 0, data, nal_size);
                 data += nal_size;
                 data_len -= nal_size;
-
-                if (data_len < 0) {
-                    error_msg("Consumed more bytes than we got! (%d)\n", data_len);
-                    return false;
-                }
-
-            }
-            if (pass > 0) {
-                for (int i = nal_count - 1; i >= 0; i--) {
-                    int nal_size = nal_sizes[i];
-                    data -= nal_size;
-                    *dst -= nal_size + sizeof(start_sequence);
-                    memcpy(*dst, start_sequence, sizeof(start_sequence));
-                    memcpy(*dst + sizeof(start_sequence), data, nal_size);
-                    data -= 2;
-                }
             }
             break;
         }
@@ -202,28 +281,19 @@ static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int p
                 data++;
                 data_len--;
 
-                if (pass == 0) {
-                    if (end_bit) {
-                        fu_length = data_len;
-                    } else {
-                        fu_length += data_len;
-                    }
-                    if (start_bit) {
-                        *total_length += sizeof(start_sequence) + sizeof(reconstructed_nal) + data_len;
-                        process_nal(reconstructed_nal, frame, data, fu_length);
-                    } else {
-                        *total_length += data_len;
-                    }
+                if (start_bit) {
+                    process_nal(reconstructed_nal, frame, NULL, 0);
+                    *fu_start = (*buf)->len + sizeof start_sequence;
+                    rtpdec_buf_append_nal(buf, &reconstructed_nal, sizeof reconstructed_nal, data, data_len);
                 } else {
-                    if (start_bit) {
-                        *dst -= sizeof(start_sequence) + sizeof(reconstructed_nal) + data_len;
-                        memcpy(*dst, start_sequence, sizeof(start_sequence));
-                        memcpy(*dst + sizeof(start_sequence), &reconstructed_nal, sizeof(reconstructed_nal));
-                        memcpy(*dst + sizeof(start_sequence) + sizeof(reconstructed_nal), data, data_len);
-                    } else {
-                        *dst -= data_len;
-                        memcpy(*dst, data, data_len);
-                    }
+                    memcpy(rtpdec_buf_append(buf, data_len), data, data_len);
+                }
+                // SPS is parsed when reassembled
+                if (end_bit && nal_type == NAL_H264_SPS && *fu_start <= (*buf)->len) {
+                    fill_coded_frame_from_sps(frame, (*buf)->data + *fu_start, (int) ((*buf)->len - *fu_start));
+                }
+                if (end_bit) {
+                    *fu_start = SIZE_MAX;
                 }
             } else {
                 error_msg("Too short data for FU-A H264 RTP packet\n");
@@ -264,48 +334,63 @@ get_sps_pps_frame(const struct video_desc *desc,
         return frame;
 }
 
+/**
+ * Depacketizes the frame in a single pass to a pooled buffer. Coded data are
+ * linked in descending order, so the list is traversed from the tail.
+ *
+ * Buffer layout is: [back-pointer][SPS/PPS space][NAL units]. The SPS/PPS
+ * space (offset_len) is filled only for I-frames, otherwise the frame data
+ * start after it and the back-pointer is stored just before them.
+ */
 int decode_frame_h264(struct coded_data *cdata, void *decode_data) {
-    struct coded_data *orig = cdata;
-
-    int total_length = 0;
-
     struct decode_data_rtsp *data = decode_data;
     struct video_frame *frame = data->frame;
     frame->frame_type = BFRAME;
 
-    for (int pass = 0; pass < 2; pass++) {
-        unsigned char *dst = NULL;
-
-        if (pass > 0) {
-            cdata = orig;
-            if(frame->frame_type == INTRA){
-                total_length+=data->offset_len;
-            }
-            frame->tiles[0].data_len = total_length;
-            assert(frame->tiles[0].data == NULL);
-            frame->tiles[0].data = malloc(total_length);
-            frame->callbacks.data_deleter = vf_data_deleter;
-            dst = (unsigned char *) frame->tiles[0].data + total_length;
-        }
-
-        while (cdata != NULL) {
-            rtp_packet *pckt = cdata->data;
+    if (data->h264.buf_pool == NULL) {
+        data->h264.buf_pool = rtpdec_buf_pool_create();
+    }
+    struct rtpdec_buf *buf = rtpdec_buf_get(data->h264.buf_pool);
+    const size_t nal_start = RTPDEC_BUF_PTR + data->offset_len;
+    rtpdec_buf_append(&buf, nal_start);
+    size_t fu_start = SIZE_MAX;
 
-            if (!decode_nal_unit(frame, &total_length, pass, &dst, (uint8_t *) pckt->data, pckt->data_len)) {
-                return false;
-            }
+    while (cdata->nxt != NULL) {
+        cdata = cdata->nxt;
+    }
+    for ( ; cdata != NULL; cdata = cdata->prv) {
+        rtp_packet *pckt = cdata->data;
 
-            cdata = cdata->nxt;
+        if (!decode_nal_unit(frame, &buf, &fu_start, (uint8_t *) pckt->data, pckt->data_len)) {
+            rtpdec_buf_put(buf);
+            return false;
         }
     }
 
+    size_t start = nal_start;
     if (frame->frame_type == INTRA) {
-        write_sps_pps(frame, data);
+        start = RTPDEC_BUF_PTR;
+        memcpy(buf->data + start, data->h264.offset_buffer, data->offset_len);
     }
+    memcpy(buf->data + start - RTPDEC_BUF_PTR, &buf, sizeof buf);
+
+    assert(frame->tiles[0].data == NULL);
+    frame->tiles[0].data = (char *) buf->data + start;
+    frame->tiles[0].data_len = buf->len - start;
+    frame->callbacks.data_deleter = rtpdec_buf_data_deleter;
 
     return true;
 }
 
+/// releases decoder resources, frames may be still in use
+void decode_frame_h264_done(struct decode_data_rtsp *decode_data)
+{
+    if (decode_data->h264.buf_pool != NULL) {
+        rtpdec_buf_pool_unref(decode_data->h264.buf_pool);
+        decode_data->h264.buf_pool = NULL;
+    }
+}
+
 int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data, int data_len){
     uint32_t width, height;
     sps_t* sps = (sps_t*)malloc(sizeof(sps_t));
@@ -89,6 +89,7 @@ struct video_desc;
         ((is_hevc) ? (nal) >> 1 : H264_NALU_HDR_GET_TYPE((nal)))
 
 int decode_frame_h264(struct coded_data *cdata, void *decode_data);
+void decode_frame_h264_done(struct decode_data_rtsp *decode_data);
 struct video_frame *get_sps_pps_frame(const struct video_desc *desc,
                                       struct decode_data_rtsp *decode_data);
 int width_height_from_SDP(int *widthOut, int *heightOut , unsigned char *data, int data_len);
@@ -51,6 +51,7 @@
 #include "utils/jpeg_writer.h"  // for JPEG_QUANT_SIZE
 
 struct coded_data;
+struct rtpdec_buf_pool;
 struct video_frame;
 
 enum {
@@ -69,6 +70,7 @@ struct decode_data_rtsp {
                 struct {
                         /// SPS/PPS headers extracted from RTSP
                         unsigned char offset_buffer[2048];
+                        struct rtpdec_buf_pool *buf_pool; ///< output frame buffers
                 } h264;
                 struct {
                         uint8_t quantization_tables[JPEG_QUANT_TAB_COUNT]
@@ -54,8 +54,96 @@
 #include "debug.h"            // for debug_msg
 #include "rtp/rtpdec_h264.h"  // for nal_type, aux_nal_types, NALU_HDR_GET_TYPE
 
-static uint32_t get4Bytes(const unsigned char *ptr) {
-        return (ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3];
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define RTPENC_X86_DISPATCH 1
+#endif
+
+/// @returns position of 3-byte start code followed by at least one byte
+static const unsigned char *find_start_code_c(const unsigned char *p,
+                                              const unsigned char *stop)
+{
+        for ( ; stop - p >= 4; ++p) {
+                if (p[2] > 1) { // cannot be part of start code at p or p+1
+                        p += 2;
+                } else if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
+                        return p;
+                }
+        }
+        return NULL;
+}
+
+#ifdef RTPENC_X86_DISPATCH
+/*
+ * Vectorized variants compare 3 shifted loads - zero, zero, one - so that
+ * a block is rejected with one branch unless it contains a start code.
+ */
+__attribute__((target("sse2"))) static const unsigned char *
+find_start_code_sse2(const unsigned char *p, const unsigned char *stop)
+{
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one  = _mm_set1_epi8(1);
+        for ( ; stop - p >= 16 + 3; p += 16) {
+                __m128i b0 = _mm_loadu_si128((const __m128i *)(const void *) p);
+                __m128i b1 = _mm_loadu_si128((const __m128i *)(const void *) (p + 1));
+                __m128i b2 = _mm_loadu_si128((const __m128i *)(const void *) (p + 2));
+                __m128i m = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero),
+                                                        _mm_cmpeq_epi8(b1, zero)),
+                                          _mm_cmpeq_epi8(b2, one));
+                unsigned mask = _mm_movemask_epi8(m);
+                if (mask != 0) {
+                        return p + __builtin_ctz(mask);
+                }
+        }
+        return find_start_code_c(p, stop);
+}
+
+__attribute__((target("avx2"))) static const unsigned char *
+find_start_code_avx2(const unsigned char *p, const unsigned char *stop)
+{
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one  = _mm256_set1_epi8(1);
+        for ( ; stop - p >= 32 + 3; p += 32) {
+                __m256i b0 = _mm256_loadu_si256((const __m256i *)(const void *) p);
+                __m256i b1 = _mm256_loadu_si256((const __m256i *)(const void *) (p + 1));
+                __m256i b2 = _mm256_loadu_si256((const __m256i *)(const void *) (p + 2));
+                __m256i m = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero),
+                                                              _mm256_cmpeq_epi8(b1, zero)),
+                                             _mm256_cmpeq_epi8(b2, one));
+                unsigned mask = _mm256_movemask_epi8(m);
+                if (mask != 0) {
+                        return p + __builtin_ctz(mask);
+                }
+        }
+        return find_start_code_sse2(p, stop);
+}
+#endif // defined RTPENC_X86_DISPATCH
+
+typedef const unsigned char *(*find_start_code_t)(const unsigned char *p,
+                                                 const unsigned char *stop);
+
+static find_start_code_t get_find_start_code(void)
+{
+#ifdef RTPENC_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+                return find_start_code_avx2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+                return find_start_code_sse2;
+        }
+#endif
+        return find_start_code_c;
+}
+
+static const unsigned char *find_start_code(const unsigned char *p,
+                                            const unsigned char *stop)
+{
+        static _Thread_local find_start_code_t find;
+        if (find == NULL) {
+                find = get_find_start_code();
+        }
+        return find(p, stop);
 }
 
 /**
@@ -65,25 +153,14 @@ static uint32_t get4Bytes(const unsigned char *ptr) {
  *                        to NAL unit beginning (skipping the start code)
  */
 static const unsigned char *get_next_nal(const unsigned char *start, long len, _Bool with_start_code) {
-        const unsigned char * const stop = start + len;
-        while (stop - start >= 4) {
-                uint32_t next4Bytes = get4Bytes(start);
-                if (next4Bytes == 0x00000001) {
-                        return start + (with_start_code ? 0 : 4);
-                }
-                if ((next4Bytes & 0xFFFFFF00) == 0x00000100) {
-                        return start + (with_start_code ? 0 : 3);
-                }
-                // We save at least some of "next4Bytes".
-                if ((unsigned) (next4Bytes & 0xFF) > 1) {
-                        // Common case: 0x00000001 or 0x000001 definitely doesn't begin anywhere in "next4Bytes", so we save all of it:
-                        start += 4;
-                } else {
-                        // Save the first byte, and continue testing the rest:
-                        start += 1;
-                }
+        const unsigned char *sc = find_start_code(start, start + len);
+        if (sc == NULL) {
+                return NULL;
         }
-        return NULL;
+        if (sc > start && sc[-1] == 0) { // 4-byte start code
+                return with_start_code ? sc - 1 : sc + 3;
+        }
+        return with_start_code ? sc : sc + 3;
 }
 
 /**
@@ -130,6 +130,7 @@
 #include "rtp/rtp_types.h"             // for video_payload_hdr_t, PT_ENCRYP...
 #include "tv.h"                        // for NS_IN_SEC
 #include "utils/color_out.h"
+#include "utils/latency_trace.h"
 #include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/synchronized_queue.h"
@@ -311,6 +312,7 @@ struct frame_msg {
         struct reported_statistics_cumul &stats;
         bool is_corrupted = false;
         bool is_displayed = false;
+        time_ns_t capture_time = 0; ///< sender capture time (latency trace)
 };
 
 struct main_msg_reconfigure {
@@ -395,6 +397,8 @@ struct state_video_decoder
 
         const struct openssl_decrypt_info *dec_funcs = NULL; ///< decrypt state
         struct openssl_decrypt      *decrypt = NULL; ///< decrypt state
+        vector<struct openssl_crypt_pkt> decrypt_pkts; ///< packets of a frame decrypted at once
+        vector<char>                 decrypt_arena;
 
         struct reported_statistics_cumul stats = {}; ///< stats to be reported through control socket
 };
@@ -429,6 +433,7 @@ static void *fec_thread(void *args) {
                         decoder->decompress_queue.push(std::move(data));
                         break; // exit from loop
                 }
+                const time_ns_t fec_start = get_time_in_ns();
 
                 struct video_frame *frame = decoder->frame;
                 struct tile *tile = NULL;
@@ -439,9 +444,12 @@ static void *fec_thread(void *args) {
                                         desc.c != data->recv_frame->fec_params.c ||
                                         desc.seed != data->recv_frame->fec_params.seed
                           ) {
-                                delete fec_state;
                                 desc = data->recv_frame->fec_params;
-                                fec_state = fec::create_from_desc(desc);
+                                // the old state is deleted after the new one is
+                                // created so that RS can reuse its code matrix
+                                fec *new_state = fec::create_from_desc(desc);
+                                delete fec_state;
+                                fec_state = new_state;
                                 if(fec_state == NULL) {
                                         log_msg(LOG_LEVEL_FATAL, "[decoder] Unable to initialize FEC.\n");
                                         exit_uv(1);
@@ -558,6 +566,8 @@ static void *fec_thread(void *args) {
                         }
                 }
 
+                latency_trace_record(LATENCY_STAGE_FEC,
+                                     get_time_in_ns() - fec_start);
                 decoder->decompress_queue.push(std::move(data));
 cleanup:
                 ;
@@ -644,6 +654,7 @@ static void *decompress_thread(void *args) {
                 }
 
                 auto t0 = std::chrono::high_resolution_clock::now();
+                const time_ns_t decompress_start = get_time_in_ns();
                 unique_ptr<char[]> tmp;
 
                 if (decoder->out_codec == VIDEO_CODEC_END) {
@@ -720,9 +731,21 @@ static void *decompress_thread(void *args) {
 
                         decoder->frame->ssrc = msg->nofec_frame->ssrc;
                         decoder->frame->timestamp = msg->nofec_frame->timestamp;
+                        const time_ns_t put_start = get_time_in_ns();
+                        latency_trace_record(LATENCY_STAGE_DECOMPRESS,
+                                             put_start - decompress_start);
                         const bool ret = display_put_frame(
                             decoder->display, decoder->frame, putf_timeout);
                         msg->is_displayed = ret;
+                        const time_ns_t put_end = get_time_in_ns();
+                        latency_trace_record(LATENCY_STAGE_DISPLAY,
+                                             put_end - put_start);
+                        if (ret) {
+                                latency_trace_record_interval(
+                                    LATENCY_STAGE_E2E, msg->capture_time,
+                                    put_end);
+                        }
+                        latency_trace_report(decoder->control);
                         decoder->frame = display_get_frame(decoder->display);
                         assert(decoder->frame != nullptr);
                 }
@@ -1493,42 +1516,39 @@ static void check_for_mode_change(struct state_video_decoder *decoder,
         reconfigure_helper(decoder, network_desc, {});
 }
 
-#define ERROR_GOTO_CLEANUP ret = false; goto cleanup;
 #define max(a, b)       (((a) > (b))? (a): (b))
 
 /**
- * @brief Decodes a participant buffer representing one video frame.
- * @param cdata        PBUF buffer
- * @param decoder_data @ref vcodec_state containing decoder state and some additional data
- * @retval true        if decoding was successful.
- *                     It stil doesn't mean that the frame will be correctly displayed,
- *                     decoding may fail in some subsequent (asynchronous) steps.
- * @retval false       if decoding failed
+ * State of a video frame being assembled from received packets.
  */
-int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf_stats *stats)
+struct video_frame_assembly {
+        struct vcodec_state *pbuf_data;
+        struct state_video_decoder *decoder;
+        struct video_frame *frame;
+        vector<uint32_t> buffer_num;
+        unique_ptr<map<int, int>[]> pckt_list;
+        int buffer_number = 0;
+        bool buffer_swapped = false;
+        bool framebuffer_not_ready = false;
+        int prints = 0;
+        int pt = 0;
+        struct latency_trace_ext trace{};
+        bool has_trace = false;
+};
+
+/**
+ * Starts assembly of a new frame.
+ * @param first_pkt any packet of the frame
+ * @returns frame context or NULL if there is no display to decode to
+ */
+static void *video_frame_assembly_begin(void *decoder_data, rtp_packet *first_pkt)
 {
         struct vcodec_state *pbuf_data = (struct vcodec_state *) decoder_data;
         struct state_video_decoder *decoder = pbuf_data->decoder;
 
-        bool ret = true;
-        int prints=0;
-        int max_substreams = decoder->max_substreams;
-
-        vector<uint32_t> buffer_num(max_substreams);
-        // the following is just FEC related optimalization - normally we fill up
-        // allocated buffers when we have compressed data. But in case of FEC, there
-        // is just the FEC buffer present, so we point to it instead to copying
-        struct video_frame *frame = vf_alloc(max_substreams);
-        frame->callbacks.data_deleter = vf_data_deleter;
-        unique_ptr<map<int, int>[]> pckt_list(new map<int, int>[max_substreams]);
-
-        int buffer_number = 0;
-        bool buffer_swapped = false;
-
         // We have no framebuffer assigned, exitting
         if(!decoder->display) {
-                vf_free(frame);
-                return false;
+                return NULL;
         }
 
         main_msg_reconfigure *msg_reconf;
@@ -1548,255 +1568,316 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 delete msg_reconf;
         }
 
-        frame->ssrc = cdata->data->ssrc;
-        frame->timestamp = cdata->data->ts;
-        int pt = cdata->data->pt;
-        if (PT_VIDEO_HAS_FEC(pt)) {
-                const uint32_t *hdr = (uint32_t *)(void *)cdata->data->data;
+        auto *s = new video_frame_assembly();
+        s->pbuf_data = pbuf_data;
+        s->decoder = decoder;
+        const int max_substreams = decoder->max_substreams;
+        s->buffer_num.resize(max_substreams);
+        // the following is just FEC related optimalization - normally we fill up
+        // allocated buffers when we have compressed data. But in case of FEC, there
+        // is just the FEC buffer present, so we point to it instead to copying
+        s->frame = vf_alloc(max_substreams);
+        s->frame->callbacks.data_deleter = vf_data_deleter;
+        s->pckt_list.reset(new map<int, int>[max_substreams]);
+
+        s->frame->ssrc = first_pkt->ssrc;
+        s->frame->timestamp = first_pkt->ts;
+        s->pt = first_pkt->pt;
+        if (PT_VIDEO_HAS_FEC(s->pt)) {
+                const uint32_t *hdr = (uint32_t *)(void *)first_pkt->data;
                 const uint32_t tmp = ntohl(hdr[3]);
                 const int k = tmp >> 19;
                 const int m = 0x1fff & (tmp >> 6);
                 const int c = 0x3f & tmp;
                 const int seed = ntohl(hdr[4]);
-                frame->fec_params =
-                    fec_desc(fec::fec_type_from_pt(pt), k, m, c, seed);
+                s->frame->fec_params =
+                    fec_desc(fec::fec_type_from_pt(s->pt), k, m, c, seed);
         }
+        return s;
+}
 
-        while (cdata != NULL) {
-                int len;
-                const char *data;
-                rtp_packet *pckt = cdata->data;
-                enum openssl_mode crypto_mode = MODE_AES128_NONE;
-
-                pt = pckt->pt;
-                const uint32_t *hdr = (uint32_t *)(void *) pckt->data;
-                const uint32_t data_pos = ntohl(hdr[1]);
-                uint32_t tmp = ntohl(hdr[0]);
-                const uint32_t substream = tmp >> 22;
-                buffer_number = tmp & 0x3fffff;
-                const int buffer_length = ntohl(hdr[2]);
-
-                if (PT_VIDEO_IS_ENCRYPTED(pt)) {
-                        if(!decoder->decrypt) {
-                                log_msg(LOG_LEVEL_ERROR, ENCRYPTED_ERR);
-                                ERROR_GOTO_CLEANUP
-                        }
-                } else {
-                        if(decoder->decrypt) {
-                                log_msg(LOG_LEVEL_ERROR, NOT_ENCRYPTED_ERR);
-                                ERROR_GOTO_CLEANUP
-                        }
+/**
+ * Places packet payload to the frame - decodes lines directly to the display
+ * framebuffer (uncompressed video) or copies it to the received buffer.
+ * @param decrypted  packet already decrypted by decrypt_frame(), NULL to
+ *                   decrypt here if encrypted
+ * @retval false frame cannot be decoded, must be aborted
+ */
+static bool video_frame_assembly_add_pkt(void *state, rtp_packet *pckt,
+                                         const struct openssl_crypt_pkt *decrypted)
+{
+        auto *s = (struct video_frame_assembly *) state;
+        struct state_video_decoder *decoder = s->decoder;
+        struct video_frame *frame = s->frame;
+        const int max_substreams = decoder->max_substreams;
+        int len;
+        const char *data;
+        enum openssl_mode crypto_mode = MODE_AES128_NONE;
+
+        const int pt = s->pt = pckt->pt;
+        const uint32_t *hdr = (uint32_t *)(void *) pckt->data;
+        const uint32_t data_pos = ntohl(hdr[1]);
+        uint32_t tmp = ntohl(hdr[0]);
+        const uint32_t substream = tmp >> 22;
+        s->buffer_number = tmp & 0x3fffff;
+        const int buffer_length = ntohl(hdr[2]);
+
+        if (pckt->extn != nullptr &&
+            latency_trace_ext_parse(pckt->extn, pckt->extn_len,
+                                    pckt->extn_type, &s->trace)) {
+                s->has_trace = true;
+        }
+
+        if (PT_VIDEO_IS_ENCRYPTED(pt)) {
+                if(!decoder->decrypt) {
+                        log_msg_limited(LOG_LEVEL_ERROR, 1000, ENCRYPTED_ERR);
+                        return false;
                 }
+        } else {
+                if(decoder->decrypt) {
+                        log_msg_limited(LOG_LEVEL_ERROR, 1000, NOT_ENCRYPTED_ERR);
+                        return false;
+                }
+        }
 
-                switch (pt) {
-                case PT_VIDEO:
-                        len = pckt->data_len - sizeof(video_payload_hdr_t);
-                        data = (const char *) hdr + sizeof(video_payload_hdr_t);
-                        break;
-                case PT_VIDEO_RS:
-                case PT_VIDEO_LDGM:
-                        len = pckt->data_len - sizeof(fec_payload_hdr_t);
-                        data = (const char *) hdr + sizeof(fec_payload_hdr_t);
-                        break;
-                case PT_ENCRYPT_VIDEO:
-                case PT_ENCRYPT_VIDEO_LDGM:
-                case PT_ENCRYPT_VIDEO_RS:
-                        {
-				size_t media_hdr_len = pt == PT_ENCRYPT_VIDEO ? sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t);
-                                len = pckt->data_len - sizeof(crypto_payload_hdr_t) - media_hdr_len;
-                                data = (const char *)hdr + sizeof(crypto_payload_hdr_t) + media_hdr_len;
-                                uint32_t crypto_hdr = ntohl(*(const uint32_t *)(const void *)((const char *)hdr + media_hdr_len));
-                                crypto_mode = (enum openssl_mode) (crypto_hdr >> 24);
-				if (crypto_mode == MODE_AES128_NONE || crypto_mode > MODE_AES128_MAX) {
-					log_msg(LOG_LEVEL_WARNING, "Unknown cipher mode: %d\n", (int) crypto_mode);
-					ret = false;
-					goto cleanup;
-				}
-                        }
-                        break;
-                default:
-                        if (pt == PT_Unassign_Type95) {
-                                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('U', 'V', 'P', 'T'), MOD_NAME "Unassigned PT 95 received, ignoring.\n");
-                        } else {
-                                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Unknown packet type: " << pckt->pt << ".\n";
+        switch (pt) {
+        case PT_VIDEO:
+                len = pckt->data_len - sizeof(video_payload_hdr_t);
+                data = (const char *) hdr + sizeof(video_payload_hdr_t);
+                break;
+        case PT_VIDEO_RS:
+        case PT_VIDEO_LDGM:
+                len = pckt->data_len - sizeof(fec_payload_hdr_t);
+                data = (const char *) hdr + sizeof(fec_payload_hdr_t);
+                break;
+        case PT_ENCRYPT_VIDEO:
+        case PT_ENCRYPT_VIDEO_LDGM:
+        case PT_ENCRYPT_VIDEO_RS:
+                {
+                        size_t media_hdr_len = pt == PT_ENCRYPT_VIDEO ? sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t);
+                        len = pckt->data_len - sizeof(crypto_payload_hdr_t) - media_hdr_len;
+                        data = (const char *)hdr + sizeof(crypto_payload_hdr_t) + media_hdr_len;
+                        uint32_t crypto_hdr = ntohl(*(const uint32_t *)(const void *)((const char *)hdr + media_hdr_len));
+                        crypto_mode = (enum openssl_mode) (crypto_hdr >> 24);
+                        if (crypto_mode == MODE_AES128_NONE || crypto_mode > MODE_AES128_MAX) {
+                                log_msg_limited(LOG_LEVEL_WARNING, 1000, "Unknown cipher mode: %d\n", (int) crypto_mode);
+                                return false;
                         }
-                        ret = false;
-                        goto cleanup;
                 }
+                break;
+        default:
+                if (pt == PT_Unassign_Type95) {
+                        log_msg_once(LOG_LEVEL_WARNING, to_fourcc('U', 'V', 'P', 'T'), MOD_NAME "Unassigned PT 95 received, ignoring.\n");
+                } else {
+                        LOG_LIMITED(LOG_LEVEL_WARNING, 1000) << MOD_NAME "Unknown packet type: " << pckt->pt << ".\n";
+                }
+                return false;
+        }
 
-                if ((int) substream >= max_substreams) {
-                        log_msg(LOG_LEVEL_WARNING, "[decoder] received substream ID %d. Expecting at most %d substreams. Did you set -M option?\n",
-                                        substream, max_substreams);
-                        // the guess is valid - we start with highest substream number (anytime - since it holds a m-bit)
-                        // in next iterations, index is valid
-                        enum video_mode video_mode =
-                                guess_video_mode(substream + 1);
-                        if (video_mode != VIDEO_UNKNOWN) {
-                                log_msg(LOG_LEVEL_NOTICE, "[decoder] Guessing mode: ");
-                                decoder_set_video_mode(decoder, video_mode);
-                                decoder->received_vid_desc.width = 0; // just for sure, that we reconfigure in next iteration
-                                log_msg(LOG_LEVEL_NOTICE, "%s. Check if it is correct.\n", get_video_mode_description(decoder->video_mode));
-                        } else {
-                                log_msg(LOG_LEVEL_FATAL, "[decoder] Unknown video mode!\n");
-                                handle_error(1);
-                        }
-                        // we need skip this frame (variables are illegal in this iteration
-                        // and in case that we got unrecognized number of substreams - exit
-                        ret = false;
-                        goto cleanup;
+        if ((int) substream >= max_substreams) {
+                log_msg_limited(LOG_LEVEL_WARNING, 1000, "[decoder] received substream ID %d. Expecting at most %d substreams. Did you set -M option?\n",
+                                substream, max_substreams);
+                // the guess is valid - we start with highest substream number (anytime - since it holds a m-bit)
+                // in next iterations, index is valid
+                enum video_mode video_mode =
+                        guess_video_mode(substream + 1);
+                if (video_mode != VIDEO_UNKNOWN) {
+                        log_msg(LOG_LEVEL_NOTICE, "[decoder] Guessing mode: ");
+                        decoder_set_video_mode(decoder, video_mode);
+                        decoder->received_vid_desc.width = 0; // just for sure, that we reconfigure in next iteration
+                        log_msg(LOG_LEVEL_NOTICE, "%s. Check if it is correct.\n", get_video_mode_description(decoder->video_mode));
+                } else {
+                        log_msg(LOG_LEVEL_FATAL, "[decoder] Unknown video mode!\n");
+                        handle_error(1);
                 }
+                // we need skip this frame (variables are illegal in this iteration
+                // and in case that we got unrecognized number of substreams - exit
+                return false;
+        }
 
-                char plaintext[RTP_MAX_PACKET_LEN]; // will be actually shorter
-                if (PT_VIDEO_IS_ENCRYPTED(pt)) {
-                        int data_len;
+        char plaintext[RTP_MAX_PACKET_LEN]; // will be actually shorter
+        if (decrypted != nullptr) {
+                if (decrypted->out_len == 0) {
+                        return true; // skip the packet
+                }
+                data = decrypted->out;
+                len = decrypted->out_len;
+        } else if (PT_VIDEO_IS_ENCRYPTED(pt)) {
+                int data_len;
+
+                if((data_len = decoder->dec_funcs->decrypt(decoder->decrypt,
+                                data, len,
+                                (const char *) hdr, pt == PT_ENCRYPT_VIDEO ?
+                                sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t),
+                                plaintext, crypto_mode)) == 0) {
+                        return true; // skip the packet
+                }
+                data = (char *) plaintext;
+                len = data_len;
+        }
 
-                        if((data_len = decoder->dec_funcs->decrypt(decoder->decrypt,
-                                        data, len,
-                                        (const char *) hdr, pt == PT_ENCRYPT_VIDEO ?
-                                        sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t),
-                                        plaintext, crypto_mode)) == 0) {
-                                goto next_packet;
-                        }
-                        data = (char *) plaintext;
-                        len = data_len;
+        if (!PT_VIDEO_HAS_FEC(pt))
+        {
+                /* Critical section
+                 * each thread *MUST* wait here if this condition is true
+                 */
+                check_for_mode_change(decoder, hdr);
+
+                // hereafter, display framebuffer can be used, so we
+                // check if we got it
+                if (FRAMEBUFFER_NOT_READY(decoder)) {
+                        s->framebuffer_not_ready = true;
+                        return false;
                 }
+        }
 
-                if (!PT_VIDEO_HAS_FEC(pt))
-                {
-                        /* Critical section
-                         * each thread *MUST* wait here if this condition is true
-                         */
-                        check_for_mode_change(decoder, hdr);
+        s->buffer_num[substream] = s->buffer_number;
+        frame->tiles[substream].data_len = buffer_length;
+        s->pckt_list[substream][data_pos] = len;
 
-                        // hereafter, display framebuffer can be used, so we
-                        // check if we got it
-                        if (FRAMEBUFFER_NOT_READY(decoder)) {
-                                vf_free(frame);
-                                return false;
-                        }
+        if ((pt == PT_VIDEO || pt == PT_ENCRYPT_VIDEO) && decoder->decoder_type == LINE_DECODER) {
+                struct tile *tile = NULL;
+                if(!s->buffer_swapped) {
+                        wait_for_framebuffer_swap(decoder);
+                        s->buffer_swapped = true;
+                        unique_lock<mutex> lk(decoder->lock);
+                        decoder->buffer_swapped = false;
                 }
 
-                buffer_num[substream] = buffer_number;
-                frame->tiles[substream].data_len = buffer_length;
-                pckt_list[substream][data_pos] = len;
-
-                if ((pt == PT_VIDEO || pt == PT_ENCRYPT_VIDEO) && decoder->decoder_type == LINE_DECODER) {
-                        struct tile *tile = NULL;
-                        if(!buffer_swapped) {
-                                wait_for_framebuffer_swap(decoder);
-                                buffer_swapped = true;
-                                unique_lock<mutex> lk(decoder->lock);
-                                decoder->buffer_swapped = false;
-                        }
-
-                        if (!decoder->merged_fb) {
-                                tile = vf_get_tile(decoder->frame, substream);
-                        } else {
-                                tile = vf_get_tile(decoder->frame, 0);
-                        }
+                if (!decoder->merged_fb) {
+                        tile = vf_get_tile(decoder->frame, substream);
+                } else {
+                        tile = vf_get_tile(decoder->frame, 0);
+                }
 
-                        struct line_decoder *line_decoder =
-                                &decoder->line_decoder[substream];
+                struct line_decoder *line_decoder =
+                        &decoder->line_decoder[substream];
 
-                        /* End of critical section */
+                /* End of critical section */
 
-                        /* MAGIC, don't touch it, you definitely break it
-                         *  *source* is data from network, *destination* is frame buffer
-                         */
+                /* MAGIC, don't touch it, you definitely break it
+                 *  *source* is data from network, *destination* is frame buffer
+                 */
 
-                        /* compute Y pos in source frame and convert it to
-                         * byte offset in the destination frame
-                         */
-                        int y = (data_pos / line_decoder->src_linesize) * line_decoder->dst_pitch;
+                /* compute Y pos in source frame and convert it to
+                 * byte offset in the destination frame
+                 */
+                int y = (data_pos / line_decoder->src_linesize) * line_decoder->dst_pitch;
 
-                        /* compute X pos in source frame */
-                        int s_x = data_pos % line_decoder->src_linesize;
+                /* compute X pos in source frame */
+                int s_x = data_pos % line_decoder->src_linesize;
 
-                        /* convert X pos from source frame into the destination frame.
-                         * it is byte offset from the beginning of a line.
-                         */
-                        int d_x = s_x * line_decoder->conv_num / line_decoder->conv_den;
+                /* convert X pos from source frame into the destination frame.
+                 * it is byte offset from the beginning of a line.
+                 */
+                int d_x = s_x * line_decoder->conv_num / line_decoder->conv_den;
 
-                        /* pointer to data payload in packet */
-                        auto *source = (const unsigned char *)(data);
+                /* pointer to data payload in packet */
+                auto *source = (const unsigned char *)(data);
 
-                        /* copy whole packet that can span several lines.
-                         * we need to clip data (v210 case) or center data (RGBA, R10k cases)
+                /* copy whole packet that can span several lines.
+                 * we need to clip data (v210 case) or center data (RGBA, R10k cases)
+                 */
+                while (len > 0) {
+                        /* len id payload length in source BPP
+                         * decoder needs len in destination BPP, so convert it
                          */
-                        while (len > 0) {
-                                /* len id payload length in source BPP
-                                 * decoder needs len in destination BPP, so convert it
-                                 */
-                                int l = len * line_decoder->conv_num / line_decoder->conv_den;
+                        int l = len * line_decoder->conv_num / line_decoder->conv_den;
 
-                                /* do not copy multiple lines, we need to
-                                 * copy (& clip, center) line by line
-                                 */
-                                if (l + d_x > (int) line_decoder->dst_linesize) {
-                                        l = line_decoder->dst_linesize - d_x;
-                                }
-
-                                /* compute byte offset in destination frame */
-                                const uint32_t offset = y + d_x;
-
-                                /* watch the SEGV */
-                                if (l + line_decoder->base_offset + offset <= tile->data_len) {
-                                        /*decode frame:
-                                         * we have offset for destination
-                                         * we update source contiguously
-                                         * we pass {r,g,b}shifts */
-                                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
-                                                        line_decoder->shifts[0], line_decoder->shifts[1],
-                                                        line_decoder->shifts[2]);
-                                        /* we decoded one line (or a part of one line) to the end of the line
-                                         * so decrease *source* len by 1 line (or that part of the line */
-                                        len -= line_decoder->src_linesize - s_x;
-                                        /* jump in source by the same amount */
-                                        source += line_decoder->src_linesize - s_x;
-                                } else {
-                                        /* this should not ever happen as we call reconfigure before each packet
-                                         * iff reconfigure is needed. But if it still happens, something is terribly wrong
-                                         * say it loudly
-                                         */
-                                        if((prints % 100) == 0) {
-                                                log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
-                                                                "Well this should not happened. Expect troubles pretty soon.\n");
-                                        }
-                                        prints++;
-                                        len = 0;
-                                }
-                                /* each new line continues from the beginning */
-                                d_x = 0;        /* next line from beginning */
-                                s_x = 0;
-                                y += line_decoder->dst_pitch;  /* next line */
-                        }
-                } else { /* PT_VIDEO_LDGM or external decoder */
-                        if(!frame->tiles[substream].data) {
-                                frame->tiles[substream].data = (char *) malloc(buffer_length + PADDING);
+                        /* do not copy multiple lines, we need to
+                         * copy (& clip, center) line by line
+                         */
+                        if (l + d_x > (int) line_decoder->dst_linesize) {
+                                l = line_decoder->dst_linesize - d_x;
                         }
 
-                        if (data_pos + len > (unsigned) buffer_length) {
-                                if((prints % 100) == 0) {
+                        /* compute byte offset in destination frame */
+                        const uint32_t offset = y + d_x;
+
+                        /* watch the SEGV */
+                        if (l + line_decoder->base_offset + offset <= tile->data_len) {
+                                /*decode frame:
+                                 * we have offset for destination
+                                 * we update source contiguously
+                                 * we pass {r,g,b}shifts */
+                                line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
+                                                line_decoder->shifts[0], line_decoder->shifts[1],
+                                                line_decoder->shifts[2]);
+                                /* we decoded one line (or a part of one line) to the end of the line
+                                 * so decrease *source* len by 1 line (or that part of the line */
+                                len -= line_decoder->src_linesize - s_x;
+                                /* jump in source by the same amount */
+                                source += line_decoder->src_linesize - s_x;
+                        } else {
+                                /* this should not ever happen as we call reconfigure before each packet
+                                 * iff reconfigure is needed. But if it still happens, something is terribly wrong
+                                 * say it loudly
+                                 */
+                                if((s->prints % 100) == 0) {
                                         log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
                                                         "Well this should not happened. Expect troubles pretty soon.\n");
                                 }
-                                prints++;
-                                len = max<int>(0, buffer_length - data_pos);
+                                s->prints++;
+                                len = 0;
                         }
-                        memcpy(frame->tiles[substream].data + data_pos,
-                               (const unsigned char *)data, len);
+                        /* each new line continues from the beginning */
+                        d_x = 0;        /* next line from beginning */
+                        s_x = 0;
+                        y += line_decoder->dst_pitch;  /* next line */
+                }
+        } else { /* PT_VIDEO_LDGM or external decoder */
+                if(!frame->tiles[substream].data) {
+                        frame->tiles[substream].data = (char *) malloc(buffer_length + PADDING);
                 }
 
-next_packet:
-                cdata = cdata->nxt;
+                if (data_pos + len > (unsigned) buffer_length) {
+                        if((s->prints % 100) == 0) {
+                                log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
+                                                "Well this should not happened. Expect troubles pretty soon.\n");
+                        }
+                        s->prints++;
+                        len = max<int>(0, buffer_length - data_pos);
+                }
+                memcpy(frame->tiles[substream].data + data_pos,
+                       (const unsigned char *)data, len);
         }
 
-        if (FRAMEBUFFER_NOT_READY(decoder) && (pt == PT_VIDEO || pt == PT_ENCRYPT_VIDEO)) {
-                ret = false;
-                goto cleanup;
+        return true;
+}
+
+/// drops the frame being assembled
+static void video_frame_assembly_abort(void *state)
+{
+        auto *s = (struct video_frame_assembly *) state;
+        vf_free(s->frame);
+        if (s->buffer_swapped) { // framebuffer won't be displayed, give it back
+                unique_lock<mutex> lk(s->decoder->lock);
+                s->decoder->buffer_swapped = true;
+                lk.unlock();
+                s->decoder->buffer_swapped_cv.notify_one();
+        }
+        if (!s->framebuffer_not_ready) {
+                s->pbuf_data->decoded++;
+                s->decoder->stats.update(s->buffer_number);
         }
+        delete s;
+}
 
-        assert(ret);
+/**
+ * Passes the assembled frame to FEC/decompress thread.
+ * @retval true  if decoding was successful
+ */
+static int video_frame_assembly_finish(void *state, struct pbuf_stats *stats)
+{
+        auto *s = (struct video_frame_assembly *) state;
+        struct state_video_decoder *decoder = s->decoder;
+        struct video_frame *frame = s->frame;
+        const int max_substreams = decoder->max_substreams;
+
+        if (FRAMEBUFFER_NOT_READY(decoder) && (s->pt == PT_VIDEO || s->pt == PT_ENCRYPT_VIDEO)) {
+                video_frame_assembly_abort(s);
+                return false;
+        }
 
         /// Zero missing parts of framebuffer - this may be useful for compressed video
         /// (which may be also with FEC - but we use systematic codes therefore it may
@@ -1804,7 +1885,7 @@ next_packet:
         if (decoder->decoder_type != LINE_DECODER) {
                 for(int i = 0; i < max_substreams; ++i) {
                         unsigned int last_end = 0;
-                        for (auto const & packets : pckt_list[i]) {
+                        for (auto const & packets : s->pckt_list[i]) {
                                 unsigned int start = packets.first;
                                 unsigned int len = packets.second;
                                 if (last_end < start) {
@@ -1823,17 +1904,29 @@ next_packet:
                 for (int i = 0; i < max_substreams; ++i) {
                         frame_size += frame->tiles[i].data_len;
                 }
-                pbuf_data->max_frame_size =
-                    max(pbuf_data->max_frame_size, frame_size);
+                s->pbuf_data->max_frame_size =
+                    max(s->pbuf_data->max_frame_size, frame_size);
                 // format message
                 unique_ptr <frame_msg> fec_msg (new frame_msg(decoder->control, decoder->stats));
-                fec_msg->buffer_num = std::move(buffer_num);
+                fec_msg->buffer_num = std::move(s->buffer_num);
                 fec_msg->recv_frame = frame;
-                frame = NULL;
-                fec_msg->pckt_list = std::move(pckt_list);
+                fec_msg->pckt_list = std::move(s->pckt_list);
                 fec_msg->received_pkts_cum = stats->received_pkts_cum;
                 fec_msg->expected_pkts_cum = stats->expected_pkts_cum;
 
+                latency_trace_record_interval(LATENCY_STAGE_RECEIVE,
+                                              stats->arrival_time,
+                                              get_time_in_ns());
+                if (s->has_trace) {
+                        latency_trace_record_sender(&s->trace);
+                        latency_trace_record_interval(
+                            LATENCY_STAGE_NETWORK,
+                            s->trace.capture_time +
+                                (time_ns_t) s->trace.send_start_us * NS_IN_US,
+                            stats->arrival_time);
+                        fec_msg->capture_time = s->trace.capture_time;
+                }
+
                 auto t0 = std::chrono::high_resolution_clock::now();
                 decoder->fec_queue.push(std::move(fec_msg));
                 auto t1 = std::chrono::high_resolution_clock::now();
@@ -1843,16 +1936,94 @@ next_packet:
                 }
 
         }
-cleanup:
-        ;
-        if (ret) {
-                vf_free(frame);
-        }
-        pbuf_data->decoded++;
+        s->pbuf_data->decoded++;
 
-        decoder->stats.update(buffer_number);
+        decoder->stats.update(s->buffer_number);
 
-        return ret;
+        delete s;
+        return true;
+}
+
+static bool video_frame_assembly_add(void *state, rtp_packet *pckt)
+{
+        return video_frame_assembly_add_pkt(state, pckt, nullptr);
+}
+
+const struct pbuf_frame_decoder video_frame_cut_through_decoder = {
+        video_frame_assembly_begin,
+        video_frame_assembly_add,
+        video_frame_assembly_finish,
+        video_frame_assembly_abort,
+        decode_video_frame,
+};
+
+/**
+ * Decrypts all packets of the frame in parallel to decoder->decrypt_arena
+ * (decoder->decrypt_pkts are in the order of cdata).
+ */
+static void decrypt_frame(struct state_video_decoder *decoder, struct coded_data *cdata)
+{
+        // EVP_DecryptUpdate may need an extra block for padded modes
+        enum { PAD = 16 };
+        decoder->decrypt_pkts.clear();
+        size_t arena_len = 0;
+        for (struct coded_data *it = cdata; it != NULL; it = it->nxt) {
+                arena_len += it->data->data_len + PAD;
+        }
+        if (decoder->decrypt_arena.size() < arena_len) {
+                decoder->decrypt_arena.resize(arena_len);
+        }
+        char *out = decoder->decrypt_arena.data();
+        for ( ; cdata != NULL; cdata = cdata->nxt) {
+                rtp_packet *pckt = cdata->data;
+                struct openssl_crypt_pkt p{};
+                p.out = out;
+                out += pckt->data_len + PAD;
+                const size_t media_hdr_len = pckt->pt == PT_ENCRYPT_VIDEO ? sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t);
+                if (PT_VIDEO_IS_ENCRYPTED(pckt->pt) &&
+                    (size_t) pckt->data_len > media_hdr_len + sizeof(crypto_payload_hdr_t)) {
+                        uint32_t crypto_hdr = 0;
+                        memcpy(&crypto_hdr, pckt->data + media_hdr_len, sizeof crypto_hdr);
+                        p.mode = (enum openssl_mode) (ntohl(crypto_hdr) >> 24);
+                        p.in = pckt->data + media_hdr_len + sizeof(crypto_payload_hdr_t);
+                        p.in_len = pckt->data_len - media_hdr_len - sizeof(crypto_payload_hdr_t);
+                        p.aad = pckt->data;
+                        p.aad_len = media_hdr_len;
+                }
+                decoder->decrypt_pkts.push_back(p);
+        }
+        decoder->dec_funcs->decrypt_batch(decoder->decrypt, decoder->decrypt_pkts.data(),
+                                          (int) decoder->decrypt_pkts.size());
+}
+
+/**
+ * @brief Decodes a participant buffer representing one video frame.
+ * @param cdata        PBUF buffer
+ * @param decoder_data @ref vcodec_state containing decoder state and some additional data
+ * @retval true        if decoding was successful.
+ *                     It stil doesn't mean that the frame will be correctly displayed,
+ *                     decoding may fail in some subsequent (asynchronous) steps.
+ * @retval false       if decoding failed
+ */
+int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf_stats *stats)
+{
+        auto *decoder = ((struct vcodec_state *) decoder_data)->decoder;
+        const bool batch_decrypt = decoder->decrypt != nullptr && PT_VIDEO_IS_ENCRYPTED(cdata->data->pt);
+        void *frame = video_frame_assembly_begin(decoder_data, cdata->data);
+        if (frame == NULL) {
+                return false;
+        }
+        if (batch_decrypt) {
+                decrypt_frame(decoder, cdata);
+        }
+        for (size_t i = 0; cdata != NULL; cdata = cdata->nxt, ++i) {
+                if (!video_frame_assembly_add_pkt(frame, cdata->data,
+                                                  batch_decrypt ? &decoder->decrypt_pkts[i] : nullptr)) {
+                        video_frame_assembly_abort(frame);
+                        return false;
+                }
+        }
+        return video_frame_assembly_finish(frame, stats);
 }
 
 static void decoder_process_message(struct module *m)
@@ -54,6 +54,7 @@
 #include "types.h"
 
 struct coded_data;
+struct pbuf_frame_decoder;
 struct display;
 struct module;
 struct state_video_decoder;
@@ -67,6 +68,8 @@ extern "C" {
 #endif // __cplusplus
 
 int decode_video_frame(struct coded_data *received_data, void *decoder_data, struct pbuf_stats *stats);
+/// incremental variant of decode_video_frame() for pbuf_decode_cut_through()
+extern const struct pbuf_frame_decoder video_frame_cut_through_decoder;
 
 struct state_video_decoder *video_decoder_init(struct module *parent, enum video_mode,
                 struct display *display, const char *encryption);
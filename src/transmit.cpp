@@ -79,6 +79,7 @@
 #include "tv.h"
 #include "types.h"
 #include "utils/jpeg_reader.h"
+#include "utils/latency_trace.h"
 #include "utils/macros.h"
 #include "utils/misc.h" // unit_evaluate
 #include "utils/random.h"
@@ -91,6 +92,8 @@
 #define FEC_MAX_MULT 10
 
 #define CONTROL_PORT_BANDWIDTH_REPORT_INTERVAL_NS NS_IN_SEC
+/// if packets are sent in batches, traffic shaper waits after bursts of this duration
+#define TX_PACING_BURST_NS (100 * NS_IN_US)
 
 #ifdef __APPLE__
 #define GET_STARTTIME gettimeofday(&start, NULL)
@@ -129,6 +132,13 @@ struct rate_limit_dyn {
         static constexpr int EXCESS_GAP = 4; ///< minimal gap between excessive frames
 };
 
+enum tx_pacing {
+        TX_PACING_SW,           ///< busy-wait traffic shaper (default)
+        TX_PACING_TXTIME,       ///< SO_TXTIME departure times, fq qdisc
+        TX_PACING_ETF,          ///< SO_TXTIME departure times, etf qdisc
+        TX_PACING_MAX_RATE,     ///< SO_MAX_PACING_RATE, fq qdisc
+};
+
 struct tx {
         struct module mod;
 
@@ -154,13 +164,21 @@ struct tx {
         struct control_state *control = nullptr;
         size_t sent_since_report = 0;
         uint64_t last_stat_report = 0;
+        time_ns_t send_start = 0; ///< start of current tx_send()
 
         const struct openssl_encrypt_info *enc_funcs;
         struct openssl_encrypt *encryption;
         long long int bitrate;
         struct rate_limit_dyn dyn_rate_limit_state;
+        enum tx_pacing pacing;
 		
         char tmp_packet[RTP_MAX_MTU];
+
+        // encrypted packets of a tile (see tx_encrypt_packets())
+        struct openssl_crypt_pkt *crypt_pkts;
+        long crypt_pkts_count;
+        char *crypt_arena;
+        size_t crypt_arena_size;
 };
 
 static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
@@ -198,6 +216,32 @@ static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
         }
 }
 
+ADD_TO_PARAM("tx-pacing",
+                "* tx-pacing=sw|txtime|etf|max-rate\n"
+                "  Video packet pacing - sw (busy-wait, default), txtime (SO_TXTIME, needs fq qdisc),\n"
+                "  etf (SO_TXTIME, needs etf qdisc) or max-rate (SO_MAX_PACING_RATE, needs fq qdisc)\n"
+                "  Whole frame is queued at once so increase fq flow_limit accordingly.\n");
+static bool
+parse_tx_pacing(struct tx *tx)
+{
+        tx->pacing = TX_PACING_SW;
+        const char *cfg = get_commandline_param("tx-pacing");
+        if (cfg == nullptr || strcmp(cfg, "sw") == 0) {
+                return true;
+        }
+        if (strcmp(cfg, "txtime") == 0) {
+                tx->pacing = TX_PACING_TXTIME;
+        } else if (strcmp(cfg, "etf") == 0) {
+                tx->pacing = TX_PACING_ETF;
+        } else if (strcmp(cfg, "max-rate") == 0) {
+                tx->pacing = TX_PACING_MAX_RATE;
+        } else {
+                MSG(ERROR, "Unknown pacing mode: %s\n", cfg);
+                return false;
+        }
+        return true;
+}
+
 /**
  * @brief intitializes transmission
  *
@@ -259,6 +303,10 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
         }
 
         tx->bitrate = bitrate;
+        if (!parse_tx_pacing(tx)) {
+                module_done(&tx->mod);
+                return NULL;
+        }
 
         if(parent)
                 tx->control = (struct control_state *) get_module(get_root_module(parent), "control");
@@ -403,6 +451,8 @@ static void tx_done(struct module *mod)
 {
         struct tx *tx = (struct tx *) mod->priv_data;
         assert(tx->magic == TRANSMIT_MAGIC);
+        free(tx->crypt_pkts);
+        free(tx->crypt_arena);
         free(tx);
 }
 
@@ -417,6 +467,7 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
         fec_check_messages(tx);
+        tx->send_start = get_time_in_ns();
 
         uint32_t ts =
             (frame->flags & TIMESTAMP_VALID) == 0
@@ -446,6 +497,46 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
                                 i, fragment_offset);
         }
         tx->buffer++;
+
+        latency_trace_record_interval(LATENCY_STAGE_COMPRESS,
+                                      frame->compress_start,
+                                      frame->compress_end);
+        latency_trace_record_interval(
+            LATENCY_STAGE_SEND_QUEUE,
+            frame->compress_end != 0 ? frame->compress_end : frame->filter_end,
+            tx->send_start);
+        latency_trace_record(LATENCY_STAGE_SEND,
+                             get_time_in_ns() - tx->send_start);
+        latency_trace_report(tx->control);
+}
+
+/**
+ * Fills the latency trace RTP header extension with the sender stage times
+ * of the frame (sent with the last packet).
+ */
+static void
+format_latency_ext(const struct tx *tx, const struct video_frame *frame,
+                   uint32_t *out)
+{
+        // 0 means unset, so a valid interval is at least 1 us
+        auto us = [](time_ns_t start, time_ns_t end) -> uint32_t {
+                if (start == 0 || end < start) {
+                        return 0;
+                }
+                return (uint32_t) std::clamp<time_ns_t>((end - start) / NS_IN_US,
+                                                        1, UINT32_MAX);
+        };
+        const time_ns_t ready =
+            frame->compress_end != 0 ? frame->compress_end : frame->filter_end;
+        const struct latency_trace_ext ext = {
+                frame->capture_time,
+                us(frame->capture_time, frame->filter_end),
+                us(frame->compress_start, frame->compress_end),
+                us(ready, tx->send_start),
+                us(frame->capture_time, tx->send_start),
+                us(tx->send_start, get_time_in_ns()),
+        };
+        latency_trace_ext_format(&ext, out);
 }
 
 void format_video_header(struct video_frame *frame, int tile_idx, int buffer_idx, uint32_t *video_hdr)
@@ -654,6 +745,66 @@ get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long pa
         return packet_rate;
 }
 
+/**
+ * Delegates pacing of packets of current frame to kernel if requested by
+ * tx-pacing param. If kernel pacing cannot be set, falls back to traffic
+ * shaper permanently.
+ *
+ * @param packet_rate  inter-packet interval in ns as returned by get_packet_rate()
+ * @param avg_pkt_len  average packet length including headers
+ * @retval true  kernel paces the packets - do not use traffic shaper
+ */
+static bool
+set_kernel_pacing(struct tx *tx, struct rtp *rtp_session, long packet_rate,
+                  long avg_pkt_len)
+{
+        bool ret = false;
+        switch (tx->pacing) {
+        case TX_PACING_SW:
+                return false;
+        case TX_PACING_TXTIME:
+        case TX_PACING_ETF:
+                ret = rtp_async_is_batching(rtp_session) &&
+                      rtp_set_txtime(rtp_session, tx->pacing == TX_PACING_ETF);
+                if (ret) {
+                        rtp_async_set_pacing(rtp_session, packet_rate);
+                }
+                break;
+        case TX_PACING_MAX_RATE:
+                ret = rtp_set_max_pacing_rate(
+                    rtp_session, packet_rate == 0
+                                     ? UINT64_MAX
+                                     : avg_pkt_len * NS_IN_SEC / packet_rate);
+                break;
+        }
+        if (!ret) {
+                MSG(WARNING, "Kernel pacing not supported, using traffic "
+                             "shaper.\n");
+                tx->pacing = TX_PACING_SW;
+        }
+        return ret;
+}
+
+/**
+ * Returns number of packets sent at once between two traffic shaper waits.
+ *
+ * When RTP session batches async sends (sendmmsg), the whole frame is sent at
+ * once for unlimited rate, otherwise packets are grouped to bursts of
+ * approximately TX_PACING_BURST_NS. Without batching packets are paced
+ * individually.
+ */
+static long
+get_pacing_burst(struct rtp *rtp_session, long packet_rate, long packet_count)
+{
+        if (!rtp_async_is_batching(rtp_session)) {
+                return 1;
+        }
+        if (packet_rate == 0) {
+                return packet_count;
+        }
+        return std::clamp<long>(TX_PACING_BURST_NS / packet_rate, 1, packet_count);
+}
+
 static int
 get_tx_hdr_len(bool is_ipv6)
 {
@@ -661,6 +812,40 @@ get_tx_hdr_len(bool is_ipv6)
                RTP_HDR_LEN;
 }
 
+/**
+ * Encrypts all packets of the tile at once (in parallel) to tx->crypt_arena,
+ * that persists until the next call so the packets can be sent
+ * asynchronously.
+ */
+static bool
+tx_encrypt_packets(struct tx *tx, struct tile *tile, const uint32_t *rtp_headers,
+                   int rtp_hdr_len, int aad_len, const vector<int> &packet_sizes,
+                   long pkt_count)
+{
+        const int max_pkt_len = *std::max_element(packet_sizes.begin(), packet_sizes.end()) +
+                MAX_CRYPTO_EXCEED;
+        if (tx->crypt_pkts_count < pkt_count) {
+                free(tx->crypt_pkts);
+                tx->crypt_pkts = (struct openssl_crypt_pkt *) calloc(pkt_count, sizeof tx->crypt_pkts[0]);
+                tx->crypt_pkts_count = pkt_count;
+        }
+        if (tx->crypt_arena_size < (size_t) pkt_count * max_pkt_len) {
+                free(tx->crypt_arena);
+                tx->crypt_arena_size = (size_t) pkt_count * max_pkt_len;
+                tx->crypt_arena = (char *) malloc(tx->crypt_arena_size);
+        }
+        for (long i = 0; i < pkt_count; ++i) {
+                const uint32_t *hdr = rtp_headers + i * (rtp_hdr_len / sizeof(uint32_t));
+                struct openssl_crypt_pkt *p = &tx->crypt_pkts[i];
+                p->in = tile->data + ntohl(hdr[1]);
+                p->in_len = packet_sizes.at(i % packet_sizes.size());
+                p->aad = (const char *) hdr;
+                p->aad_len = aad_len;
+                p->out = tx->crypt_arena + i * max_pkt_len;
+        }
+        return tx->enc_funcs->encrypt_batch(tx->encryption, tx->crypt_pkts, (int) pkt_count);
+}
+
 static void
 tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 uint32_t ts, int send_m,
@@ -718,6 +903,12 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 rtp_hdr_len += sizeof(crypto_payload_hdr_t);
         }
 
+        const bool trace_ext =
+            latency_trace_ext_enabled() && frame->capture_time != 0;
+        if (trace_ext) {
+                hdrs_len += LATENCY_TRACE_EXT_SIZE;
+        }
+
         vector<int> packet_sizes = get_packet_sizes(frame, substream, tx->mtu - hdrs_len);
         long mult_pkt_cnt = (long) packet_sizes.size() * tx->mult_count;
         const long packet_rate =
@@ -742,44 +933,63 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 rtp_hdr_packet[1] = htonl(0);
         }
 
-        if (!tx->encryption) {
-                rtp_async_start(rtp_session, mult_pkt_cnt);
+        if (tx->encryption != nullptr &&
+            !tx_encrypt_packets(tx, tile, (uint32_t *) rtp_headers, rtp_hdr_len,
+                                frame->fec_params.type != FEC_NONE
+                                    ? sizeof(fec_payload_hdr_t)
+                                    : sizeof(video_payload_hdr_t),
+                                packet_sizes, mult_pkt_cnt)) {
+                free(rtp_headers);
+                return;
         }
 
+        rtp_async_start(rtp_session, mult_pkt_cnt);
+        const bool kernel_paced = set_kernel_pacing(
+            tx, rtp_session, packet_rate,
+            hdrs_len + tile->data_len / (long) packet_sizes.size());
+        const long burst =
+            kernel_paced ? mult_pkt_cnt
+                         : get_pacing_burst(rtp_session, packet_rate, mult_pkt_cnt);
+
         rtp_hdr_packet = (uint32_t *) rtp_headers;
         for (long i = 0; i < mult_pkt_cnt; ++i) {
-                GET_STARTTIME;
+                if (i % burst == 0) {
+                        GET_STARTTIME;
+                }
                 const int m        = i == mult_pkt_cnt - 1 ? send_m : 0;
                 char     *data     = tile->data + ntohl(rtp_hdr_packet[1]);
                 int       data_len = packet_sizes.at(i % packet_sizes.size());
 
-                char encrypted_data[RTP_MAX_PACKET_LEN + MAX_CRYPTO_EXCEED];
                 if (tx->encryption != nullptr) {
-                        data_len = tx->enc_funcs->encrypt(
-                            tx->encryption, data, data_len,
-                            (char *) rtp_hdr_packet,
-                            frame->fec_params.type != FEC_NONE
-                                ? sizeof(fec_payload_hdr_t)
-                                : sizeof(video_payload_hdr_t),
-                            encrypted_data);
-                        if (data_len <= 0) {
-                                return;
-                        }
-                        data = encrypted_data;
+                        data     = tx->crypt_pkts[i].out;
+                        data_len = tx->crypt_pkts[i].out_len;
                 }
 
+                uint32_t ext[LATENCY_TRACE_EXT_WORDS];
+                const bool with_ext = trace_ext && m == 1;
+                if (with_ext) {
+                        format_latency_ext(tx, frame, ext);
+                }
                 rtp_send_data_hdr(rtp_session, ts, pt, m, 0, nullptr,
                                   (char *) rtp_hdr_packet, rtp_hdr_len, data,
-                                  data_len, nullptr, 0, 0);
+                                  data_len, with_ext ? (char *) ext : nullptr,
+                                  with_ext ? LATENCY_TRACE_EXT_WORDS : 0,
+                                  with_ext ? LATENCY_TRACE_EXT_TYPE : 0);
                 rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
 
+                if ((i + 1) % burst != 0) {
+                        continue;
+                }
+                if (burst > 1) {
+                        rtp_async_flush(rtp_session);
+                }
                 // TRAFFIC SHAPER
-                if (m != 1) { // wait for all but last packet
+                if (m != 1 && !kernel_paced) { // wait for all but last packet (burst)
                         do {
                                 GET_STOPTIME;
                                 GET_DELTA;
-                        } while (packet_rate - delta - overslept > 0);
-                        overslept = -(packet_rate - delta - overslept);
+                        } while (packet_rate * burst - delta - overslept > 0);
+                        overslept = -(packet_rate * burst - delta - overslept);
                         //fprintf(stdout, "%ld ", overslept);
                 }
         }
@@ -787,9 +997,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         const long data_sent = tile->data_len + rtp_hdr_len * mult_pkt_cnt;
         report_stats(tx, rtp_session, data_sent);
 
-        if (!tx->encryption) {
-                rtp_async_wait(rtp_session);
-        }
+        rtp_async_wait(rtp_session);
         free(rtp_headers);
 }
 
@@ -219,6 +219,11 @@ enum frame_flags_common {
         TIMESTAMP_VALID = 1 << 0, ///< timestamp set by source (in 90 kHz clock)
 };
 
+/// flags specific to video frame (share the bit space with frame_flags_common)
+enum video_frame_flags {
+        DAMAGE_VALID = 1 << 8, ///< damaged_area set by source
+};
+
 struct video_frame;
 /**
  * @brief Struct containing callbacks of a @ref video_frame
@@ -331,8 +336,13 @@ struct video_frame {
                 uint32_t timecode; ///< BCD timecode (hrs, min, sec, frm num)
                 uint32_t duration; ///< used by file cap
         };
+        int64_t capture_time;   ///< in ns from epoch, set by vidcap_grab()
+        int64_t filter_end;     ///< in ns from epoch, capture filters done
         int64_t compress_start; ///< in ns from epoch
         int64_t compress_end;   ///< in ns from epoch
+        /// part of the frame (0-1) that changed since the previous frame of
+        /// the source, valid only if DAMAGE_VALID flag is set
+        float damaged_area;
 #define VF_METADATA_END tile_count
 
         /// tiles contain actual video frame data. A frame usually contains exactly one
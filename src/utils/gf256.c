@@ -0,0 +1,288 @@
+/**
+ * @file   utils/gf256.c
+ * @brief  vectorized GF(2^8) arithmetic for Reed-Solomon coding
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define GF256_X86_DISPATCH 1
+#endif
+
+#include "utils/gf256.h"
+#include "utils/macros.h"
+
+#define GF256_POLY 0x11D
+/// length of the segment of all sources that is processed at once
+#define GF256_BLOCK_LEN 1024
+
+/**
+ * Computes dst[off, off + len) of one matrix row, vectorized kernels may
+ * leave a tail shorter than their vector width unprocessed.
+ * @returns number of bytes processed
+ */
+typedef size_t gf256_row_t(uint8_t *dst, const uint8_t *const *src,
+                           const struct gf256_coef *coefs, int cols,
+                           size_t off, size_t len);
+
+uint8_t gf256_mul(uint8_t a, uint8_t b)
+{
+        unsigned int ret = 0;
+        unsigned int aa = a;
+        for ( ; b != 0; b >>= 1U) {
+                if (b & 1U) {
+                        ret ^= aa;
+                }
+                aa <<= 1U;
+                if (aa & 0x100U) {
+                        aa ^= GF256_POLY;
+                }
+        }
+        return ret;
+}
+
+void gf256_coef_init(struct gf256_coef *coef, uint8_t c)
+{
+        for (int i = 0; i < 16; ++i) {
+                coef->lo[i] = gf256_mul(c, i);
+                coef->hi[i] = gf256_mul(c, i << 4);
+        }
+        // row i of the matrix selects input bits contributing to output
+        // bit i, GF2P8AFFINEQB expects row for bit i in byte 7 - i
+        coef->affine = 0;
+        for (int i = 0; i < 8; ++i) {
+                uint64_t row = 0;
+                for (int k = 0; k < 8; ++k) {
+                        row |= (uint64_t) ((gf256_mul(c, 1U << k) >> i) & 1U) << k;
+                }
+                coef->affine |= row << (8 * (7 - i));
+        }
+}
+
+static size_t gf256_row_scalar(uint8_t *dst, const uint8_t *const *src,
+                               const struct gf256_coef *coefs, int cols,
+                               size_t off, size_t len)
+{
+        for (size_t i = off; i < off + len; ++i) {
+                uint8_t acc = 0;
+                for (int c = 0; c < cols; ++c) {
+                        const uint8_t x = src[c][i];
+                        acc ^= coefs[c].lo[x & 0xF] ^ coefs[c].hi[x >> 4];
+                }
+                dst[i] = acc;
+        }
+        return len;
+}
+
+#ifdef GF256_X86_DISPATCH
+__attribute__((target("ssse3"))) static size_t
+gf256_row_ssse3(uint8_t *dst, const uint8_t *const *src,
+                const struct gf256_coef *coefs, int cols, size_t off,
+                size_t len)
+{
+        const __m128i mask = _mm_set1_epi8(0xF);
+        size_t i = off;
+        for ( ; i + 16 <= off + len; i += 16) {
+                __m128i acc = _mm_setzero_si128();
+                for (int c = 0; c < cols; ++c) {
+                        const __m128i x = _mm_loadu_si128((const __m128i *)(const void *) (src[c] + i));
+                        const __m128i lo = _mm_loadu_si128((const __m128i *)(const void *) coefs[c].lo);
+                        const __m128i hi = _mm_loadu_si128((const __m128i *)(const void *) coefs[c].hi);
+                        acc = _mm_xor_si128(acc, _mm_shuffle_epi8(lo, _mm_and_si128(x, mask)));
+                        acc = _mm_xor_si128(acc, _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+                }
+                _mm_storeu_si128((__m128i *)(void *) (dst + i), acc);
+        }
+        return i - off;
+}
+
+__attribute__((target("avx2"))) static size_t
+gf256_row_avx2(uint8_t *dst, const uint8_t *const *src,
+               const struct gf256_coef *coefs, int cols, size_t off,
+               size_t len)
+{
+        const __m256i mask = _mm256_set1_epi8(0xF);
+        size_t i = off;
+        for ( ; i + 32 <= off + len; i += 32) {
+                __m256i acc = _mm256_setzero_si256();
+                for (int c = 0; c < cols; ++c) {
+                        const __m256i x = _mm256_loadu_si256((const __m256i *)(const void *) (src[c] + i));
+                        const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) coefs[c].lo));
+                        const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) coefs[c].hi));
+                        acc = _mm256_xor_si256(acc, _mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask)));
+                        acc = _mm256_xor_si256(acc, _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+                }
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i), acc);
+        }
+        return i - off;
+}
+
+__attribute__((target("avx512f,avx512bw"))) static size_t
+gf256_row_avx512(uint8_t *dst, const uint8_t *const *src,
+                 const struct gf256_coef *coefs, int cols, size_t off,
+                 size_t len)
+{
+        const __m512i mask = _mm512_set1_epi8(0xF);
+        size_t i = off;
+        for ( ; i + 64 <= off + len; i += 64) {
+                __m512i acc = _mm512_setzero_si512();
+                for (int c = 0; c < cols; ++c) {
+                        const __m512i x = _mm512_loadu_si512(src[c] + i);
+                        const __m512i lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(const void *) coefs[c].lo));
+                        const __m512i hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(const void *) coefs[c].hi));
+                        acc = _mm512_xor_si512(acc, _mm512_shuffle_epi8(lo, _mm512_and_si512(x, mask)));
+                        acc = _mm512_xor_si512(acc, _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi64(x, 4), mask)));
+                }
+                _mm512_storeu_si512(dst + i, acc);
+        }
+        return i - off;
+}
+
+__attribute__((target("gfni,avx2"))) static size_t
+gf256_row_gfni(uint8_t *dst, const uint8_t *const *src,
+               const struct gf256_coef *coefs, int cols, size_t off,
+               size_t len)
+{
+        size_t i = off;
+        for ( ; i + 64 <= off + len; i += 64) {
+                __m256i acc0 = _mm256_setzero_si256();
+                __m256i acc1 = _mm256_setzero_si256();
+                for (int c = 0; c < cols; ++c) {
+                        const __m256i a = _mm256_set1_epi64x((long long) coefs[c].affine);
+                        const __m256i x0 = _mm256_loadu_si256((const __m256i *)(const void *) (src[c] + i));
+                        const __m256i x1 = _mm256_loadu_si256((const __m256i *)(const void *) (src[c] + i + 32));
+                        acc0 = _mm256_xor_si256(acc0, _mm256_gf2p8affine_epi64_epi8(x0, a, 0));
+                        acc1 = _mm256_xor_si256(acc1, _mm256_gf2p8affine_epi64_epi8(x1, a, 0));
+                }
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i), acc0);
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i + 32), acc1);
+        }
+        return i - off;
+}
+#endif // defined GF256_X86_DISPATCH
+
+static const struct {
+        enum gf256_kernel kernel;
+        const char *name;
+        gf256_row_t *row;
+} gf256_kernels[] = {
+        { GF256_KERNEL_SCALAR, "scalar", gf256_row_scalar },
+#ifdef GF256_X86_DISPATCH
+        { GF256_KERNEL_SSSE3, "SSSE3", gf256_row_ssse3 },
+        { GF256_KERNEL_AVX2, "AVX2", gf256_row_avx2 },
+        { GF256_KERNEL_AVX512, "AVX-512", gf256_row_avx512 },
+        { GF256_KERNEL_GFNI, "GFNI", gf256_row_gfni },
+#endif
+};
+
+static bool gf256_kernel_supported(enum gf256_kernel kernel)
+{
+#ifdef GF256_X86_DISPATCH
+        __builtin_cpu_init();
+        switch (kernel) {
+        case GF256_KERNEL_SSSE3:
+                return __builtin_cpu_supports("ssse3");
+        case GF256_KERNEL_AVX2:
+                return __builtin_cpu_supports("avx2");
+        case GF256_KERNEL_AVX512:
+                return __builtin_cpu_supports("avx512bw");
+        case GF256_KERNEL_GFNI:
+                return __builtin_cpu_supports("gfni") &&
+                       __builtin_cpu_supports("avx2");
+        default:
+                break;
+        }
+#endif
+        return kernel == GF256_KERNEL_SCALAR;
+}
+
+static _Thread_local int gf256_kernel_idx = -1; ///< -1 - not yet selected
+
+bool gf256_set_kernel(enum gf256_kernel kernel)
+{
+        if (kernel == GF256_KERNEL_AUTO) {
+                // the kernels are listed in the order of preference
+                for (int i = 0; i < (int) ARR_COUNT(gf256_kernels); ++i) {
+                        if (gf256_kernel_supported(gf256_kernels[i].kernel)) {
+                                gf256_kernel_idx = i;
+                        }
+                }
+                return true;
+        }
+        for (int i = 0; i < (int) ARR_COUNT(gf256_kernels); ++i) {
+                if (gf256_kernels[i].kernel == kernel &&
+                    gf256_kernel_supported(kernel)) {
+                        gf256_kernel_idx = i;
+                        return true;
+                }
+        }
+        return false;
+}
+
+enum gf256_kernel gf256_get_kernel(void)
+{
+        if (gf256_kernel_idx == -1) {
+                gf256_set_kernel(GF256_KERNEL_AUTO);
+        }
+        return gf256_kernels[gf256_kernel_idx].kernel;
+}
+
+const char *gf256_get_kernel_name(void)
+{
+        if (gf256_kernel_idx == -1) {
+                gf256_set_kernel(GF256_KERNEL_AUTO);
+        }
+        return gf256_kernels[gf256_kernel_idx].name;
+}
+
+void gf256_mul_matrix(uint8_t *const *dst, int rows, const uint8_t *const *src,
+                      int cols, const struct gf256_coef *coefs, size_t len)
+{
+        if (gf256_kernel_idx == -1) {
+                gf256_set_kernel(GF256_KERNEL_AUTO);
+        }
+        gf256_row_t *const row = gf256_kernels[gf256_kernel_idx].row;
+        for (size_t off = 0; off < len; off += GF256_BLOCK_LEN) {
+                const size_t block_len = MIN(len - off, GF256_BLOCK_LEN);
+                for (int r = 0; r < rows; ++r) {
+                        const struct gf256_coef *row_coefs = coefs + (size_t) r * cols;
+                        const size_t done = row(dst[r], src, row_coefs, cols, off, block_len);
+                        gf256_row_scalar(dst[r], src, row_coefs, cols, off + done, block_len - done);
+                }
+        }
+}
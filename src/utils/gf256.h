@@ -0,0 +1,101 @@
+/**
+ * @file   utils/gf256.h
+ * @brief  vectorized GF(2^8) arithmetic for Reed-Solomon coding
+ *
+ * The field is generated by the polynomial x^8+x^4+x^3+x^2+1 (0x11D), the
+ * same as the one used by zfec, so that the products are interchangeable
+ * with zfec's ones.
+ *
+ * Multiplication by a constant is implemented either with nibble lookup
+ * tables (scalar, SSSE3/AVX2/AVX-512 PSHUFB) or as an affine transform
+ * (GFNI). The best available kernel is selected at runtime.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_GF256_H_8A1F4C2E_6B7D_4E39_B0C5_2D9E3F71A6B8
+#define UTILS_GF256_H_8A1F4C2E_6B7D_4E39_B0C5_2D9E3F71A6B8
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum gf256_kernel {
+        GF256_KERNEL_AUTO,
+        GF256_KERNEL_SCALAR,
+        GF256_KERNEL_SSSE3,
+        GF256_KERNEL_AVX2,
+        GF256_KERNEL_AVX512,
+        GF256_KERNEL_GFNI,
+};
+
+/// multiplication by a constant prepared for the kernels
+struct gf256_coef {
+        uint8_t lo[16];  ///< products of the constant with low nibbles
+        uint8_t hi[16];  ///< products of the constant with high nibbles
+        uint64_t affine; ///< bit matrix of the multiplication (GFNI)
+};
+
+uint8_t gf256_mul(uint8_t a, uint8_t b);
+void gf256_coef_init(struct gf256_coef *coef, uint8_t c);
+/**
+ * Computes dst[r] = sum over i of coefs[r * cols + i] * src[i] for every
+ * row r. Processing is blocked over len so that the source segments stay
+ * in cache while all rows are computed.
+ */
+void gf256_mul_matrix(uint8_t *const *dst, int rows, const uint8_t *const *src,
+                      int cols, const struct gf256_coef *coefs, size_t len);
+/**
+ * Overrides kernel selection for the calling thread, intended for tests
+ * and benchmarks.
+ * @retval false kernel is not supported by the CPU (or the build)
+ */
+bool gf256_set_kernel(enum gf256_kernel kernel);
+/// @returns kernel selected for the calling thread (never GF256_KERNEL_AUTO)
+enum gf256_kernel gf256_get_kernel(void);
+const char *gf256_get_kernel_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_GF256_H_8A1F4C2E_6B7D_4E39_B0C5_2D9E3F71A6B8
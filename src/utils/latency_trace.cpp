@@ -0,0 +1,306 @@
+/**
+ * @file   utils/latency_trace.cpp
+ * @brief  per-stage frame latency histograms
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // defined HAVE_CONFIG_H
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "control_socket.h"
+#include "debug.h"
+#include "host.h"
+#include "utils/latency_trace.h"
+
+#define MOD_NAME "[latency] "
+
+using std::atomic;
+using std::memory_order_relaxed;
+
+namespace {
+/**
+ * Log-linear histogram of microsecond values - values below 2^SUB_BITS are
+ * stored exactly, the others in 2^SUB_BITS sub-buckets per power of 2.
+ */
+struct latency_histogram {
+        enum {
+                SUB_BITS    = 5,
+                SUB_BUCKETS = 1 << SUB_BITS,
+                MAX_EXP     = 31, ///< max value ~2^32 us (> 1 hour)
+                BUCKETS     = (MAX_EXP - SUB_BITS + 2) * SUB_BUCKETS,
+        };
+        atomic<uint32_t> counts[BUCKETS];
+        atomic<uint32_t> max;
+
+        static unsigned index(uint32_t us) {
+                if (us < SUB_BUCKETS) {
+                        return us;
+                }
+                const unsigned exp = 31 - __builtin_clz(us);
+                return (exp - SUB_BITS + 1) * SUB_BUCKETS +
+                       ((us >> (exp - SUB_BITS)) - SUB_BUCKETS);
+        }
+        /// @returns highest value stored in the bucket
+        static uint32_t upper_bound(unsigned idx) {
+                if (idx < SUB_BUCKETS) {
+                        return idx;
+                }
+                const unsigned group = idx / SUB_BUCKETS;
+                const unsigned sub   = idx % SUB_BUCKETS;
+                return (uint32_t) ((((uint64_t) SUB_BUCKETS + sub + 1)
+                                    << (group - 1)) - 1);
+        }
+
+        void record(uint32_t us) {
+                counts[index(us)].fetch_add(1, memory_order_relaxed);
+                uint32_t old_max = max.load(memory_order_relaxed);
+                while (us > old_max &&
+                       !max.compare_exchange_weak(old_max, us,
+                                                  memory_order_relaxed)) {
+                }
+        }
+};
+
+latency_histogram histograms[LATENCY_STAGE_COUNT];
+atomic<time_ns_t> last_report{0};
+
+const char *const stage_names[LATENCY_STAGE_COUNT] = {
+        "capture_filter", "compress", "send_queue", "send",    "network",
+        "receive",        "fec",      "decompress", "display", "e2e",
+        "remote_capture_filter", "remote_compress", "remote_send_queue",
+        "remote_send",
+};
+
+uint32_t ns_to_us_sat(time_ns_t ns) {
+        const time_ns_t us = ns / NS_IN_US;
+        return us > UINT32_MAX ? UINT32_MAX : (uint32_t) us;
+}
+} // end of anonymous namespace
+
+ADD_TO_PARAM("latency-trace", "* latency-trace[=<interval_s>]\n"
+                "  Print per-stage frame latency percentiles every interval "
+                "(default 5 s) and send sender stage times to the receiver "
+                "(RTP header extension).\n");
+
+void latency_trace_record(enum latency_stage stage, time_ns_t duration_ns)
+{
+        if (duration_ns < 0) { // unsynchronized clocks or unset timestamp
+                return;
+        }
+        histograms[stage].record(ns_to_us_sat(duration_ns));
+}
+
+/// records end - start if both timestamps are set
+void latency_trace_record_interval(enum latency_stage stage, time_ns_t start,
+                                   time_ns_t end)
+{
+        if (start == 0 || end == 0) {
+                return;
+        }
+        latency_trace_record(stage, end - start);
+}
+
+void latency_trace_get(enum latency_stage stage, struct latency_stats *stats,
+                       bool reset)
+{
+        latency_histogram &h = histograms[stage];
+        uint32_t counts[latency_histogram::BUCKETS];
+        unsigned long long total = 0;
+        for (unsigned i = 0; i < latency_histogram::BUCKETS; ++i) {
+                counts[i] = reset ? h.counts[i].exchange(0, memory_order_relaxed)
+                                  : h.counts[i].load(memory_order_relaxed);
+                total += counts[i];
+        }
+        const uint32_t max = reset ? h.max.exchange(0, memory_order_relaxed)
+                                   : h.max.load(memory_order_relaxed);
+
+        *stats = {};
+        stats->count = total;
+        stats->max = (time_ns_t) max * NS_IN_US;
+        if (total == 0) {
+                return;
+        }
+        const unsigned long long p50_rank = (total * 50 + 99) / 100;
+        const unsigned long long p99_rank = (total * 99 + 99) / 100;
+        unsigned long long seen = 0;
+        bool have_p50 = false;
+        for (unsigned i = 0; i < latency_histogram::BUCKETS; ++i) {
+                if (counts[i] == 0) {
+                        continue;
+                }
+                seen += counts[i];
+                const uint32_t val =
+                    std::min(latency_histogram::upper_bound(i), max);
+                if (!have_p50 && seen >= p50_rank) {
+                        stats->p50 = (time_ns_t) val * NS_IN_US;
+                        have_p50 = true;
+                }
+                if (seen >= p99_rank) {
+                        stats->p99 = (time_ns_t) val * NS_IN_US;
+                        break;
+                }
+        }
+}
+
+const char *latency_stage_name(enum latency_stage stage)
+{
+        return stage_names[stage];
+}
+
+bool latency_trace_ext_enabled(void)
+{
+        static const bool enabled =
+            get_commandline_param("latency-trace") != nullptr;
+        return enabled;
+}
+
+/// serializes ext to network byte order
+void latency_trace_ext_format(const struct latency_trace_ext *ext,
+                              uint32_t out[LATENCY_TRACE_EXT_WORDS])
+{
+        out[0] = htonl((uint32_t) ((uint64_t) ext->capture_time >> 32));
+        out[1] = htonl((uint32_t) ext->capture_time);
+        out[2] = htonl(ext->filter_us);
+        out[3] = htonl(ext->compress_us);
+        out[4] = htonl(ext->send_queue_us);
+        out[5] = htonl(ext->send_start_us);
+        out[6] = htonl(ext->send_us);
+}
+
+/**
+ * @param extn  pointer to the RTP header extension (incl. the type/length
+ *              header) as in rtp_packet
+ * @returns     false if the extension is not a latency trace
+ */
+bool latency_trace_ext_parse(const unsigned char *extn, uint16_t extn_len,
+                             uint16_t extn_type, struct latency_trace_ext *ext)
+{
+        if (extn == nullptr || extn_type != LATENCY_TRACE_EXT_TYPE ||
+            extn_len < LATENCY_TRACE_EXT_WORDS) {
+                return false;
+        }
+        uint32_t w[LATENCY_TRACE_EXT_WORDS];
+        memcpy(w, extn + 4, sizeof w);
+        ext->capture_time = (time_ns_t) (((uint64_t) ntohl(w[0]) << 32) |
+                                         ntohl(w[1]));
+        ext->filter_us     = ntohl(w[2]);
+        ext->compress_us   = ntohl(w[3]);
+        ext->send_queue_us = ntohl(w[4]);
+        ext->send_start_us = ntohl(w[5]);
+        ext->send_us       = ntohl(w[6]);
+        return true;
+}
+
+/**
+ * Records sender stages received in the extension (on the receiver) as
+ * remote stages, zero values mean that the stage was not timed.
+ */
+void latency_trace_record_sender(const struct latency_trace_ext *ext)
+{
+        const struct {
+                enum latency_stage stage;
+                uint32_t           us;
+        } stages[] = {
+                { LATENCY_STAGE_REMOTE_CAPTURE_FILTER, ext->filter_us },
+                { LATENCY_STAGE_REMOTE_COMPRESS, ext->compress_us },
+                { LATENCY_STAGE_REMOTE_SEND_QUEUE, ext->send_queue_us },
+                { LATENCY_STAGE_REMOTE_SEND, ext->send_us },
+        };
+        for (const auto &s : stages) {
+                if (s.us != 0) {
+                        histograms[s.stage].record(s.us);
+                }
+        }
+}
+
+/**
+ * Reports (and resets) the histograms if the report interval has elapsed.
+ * Can be called from more threads (eg. sender and receiver in the same
+ * process), only one of them reports.
+ */
+void latency_trace_report(struct control_state *control)
+{
+        static const time_ns_t interval = [] {
+                const char *val = get_commandline_param("latency-trace");
+                const double sec = val != nullptr && strlen(val) > 0
+                                       ? atof(val)
+                                       : 5.0;
+                return (time_ns_t) (sec > 0.0 ? sec * NS_IN_SEC : 5 * NS_IN_SEC);
+        }();
+        const bool print = latency_trace_ext_enabled();
+        if (!print && !control_stats_enabled(control)) {
+                return;
+        }
+        const time_ns_t now = get_time_in_ns();
+        time_ns_t last = last_report.load(memory_order_relaxed);
+        if (last == 0) { // 1st call - start the interval
+                last_report.compare_exchange_strong(last, now);
+                return;
+        }
+        if (now - last < interval ||
+            !last_report.compare_exchange_strong(last, now)) {
+                return;
+        }
+
+        std::ostringstream summary;
+        for (int i = 0; i < LATENCY_STAGE_COUNT; ++i) {
+                struct latency_stats st;
+                latency_trace_get((enum latency_stage) i, &st, true);
+                if (st.count == 0) {
+                        continue;
+                }
+                std::ostringstream oss;
+                oss << "latency " << stage_names[i] << " count " << st.count
+                    << " p50 " << st.p50 / NS_IN_US << " p99 "
+                    << st.p99 / NS_IN_US << " max " << st.max / NS_IN_US;
+                control_report_stats(control, oss.str());
+                summary << " " << stage_names[i] << " "
+                        << st.p50 / MS_IN_NS_DBL << "/"
+                        << st.p99 / MS_IN_NS_DBL << "/"
+                        << st.max / MS_IN_NS_DBL;
+        }
+        if (print && !summary.str().empty()) {
+                MSG(INFO, "p50/p99/max [ms]:%s\n", summary.str().c_str());
+        }
+}
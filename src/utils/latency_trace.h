@@ -0,0 +1,133 @@
+/**
+ * @file   utils/latency_trace.h
+ * @brief  per-stage frame latency histograms
+ *
+ * Stage durations of the video pipeline are recorded into log-linear
+ * (HDR-style) histograms with 1 us resolution and ~3 % relative precision.
+ * The histograms are periodically reported over the control socket as
+ * "stats latency <stage> count <n> p50 <us> p99 <us> max <us>" (and printed
+ * if the latency-trace param is given) and then reset, so that every report
+ * covers just the last interval.
+ *
+ * Sender stages are timed with the timestamps in struct video_frame
+ * (capture_time, filter_end, compress_start, compress_end). With
+ * "--param latency-trace" the sender also puts them into an RTP header
+ * extension on the last packet of the frame so that the receiver can
+ * compute the network and glass-to-glass (e2e) latency. The receiver reports
+ * the sender stages as remote_<stage>, separately from the local ones (the
+ * process may be sending as well). These two are
+ * computed from the wall-clock times of the both peers and therefore need
+ * synchronized clocks (NTP, PTP).
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_LATENCY_TRACE_H_7A1C3E55_2B9D_4C61_8F0E_64D2A9B1C3F7
+#define UTILS_LATENCY_TRACE_H_7A1C3E55_2B9D_4C61_8F0E_64D2A9B1C3F7
+
+#ifdef __cplusplus
+#include <cstdint>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#include "tv.h"
+
+#define LATENCY_TRACE_EXT_TYPE  0x5547 ///< RTP header extension type ("UG")
+#define LATENCY_TRACE_EXT_WORDS 7      ///< extension length in 32-bit words
+/// bytes the extension adds to the RTP header (including ext header)
+#define LATENCY_TRACE_EXT_SIZE  (4 * (1 + LATENCY_TRACE_EXT_WORDS))
+
+enum latency_stage {
+        LATENCY_STAGE_CAPTURE_FILTER, ///< vidcap grab -> capture filters done
+        LATENCY_STAGE_COMPRESS,       ///< compress_start -> compress_end
+        LATENCY_STAGE_SEND_QUEUE,     ///< compressed -> tx_send() start
+        LATENCY_STAGE_SEND,           ///< tx_send() duration
+        LATENCY_STAGE_NETWORK,        ///< send start -> 1st packet arrival
+        LATENCY_STAGE_RECEIVE,        ///< 1st packet -> frame passed to decoder
+        LATENCY_STAGE_FEC,            ///< FEC decode (incl. line decode)
+        LATENCY_STAGE_DECOMPRESS,     ///< decompression
+        LATENCY_STAGE_DISPLAY,        ///< display_put_frame() duration
+        LATENCY_STAGE_E2E,            ///< sender capture -> frame displayed
+        // sender stages of the remote peer (from the RTP header extension)
+        LATENCY_STAGE_REMOTE_CAPTURE_FILTER,
+        LATENCY_STAGE_REMOTE_COMPRESS,
+        LATENCY_STAGE_REMOTE_SEND_QUEUE,
+        LATENCY_STAGE_REMOTE_SEND,
+        LATENCY_STAGE_COUNT
+};
+
+struct latency_stats {
+        unsigned long long count;
+        time_ns_t p50; ///< median (upper bound of the bucket) in ns
+        time_ns_t p99;
+        time_ns_t max;
+};
+
+/// sender stage times carried in the RTP header extension
+struct latency_trace_ext {
+        time_ns_t capture_time; ///< sender wall-clock time of grab in ns
+        uint32_t  filter_us;
+        uint32_t  compress_us;
+        uint32_t  send_queue_us;
+        uint32_t  send_start_us; ///< tx_send() start relative to capture_time
+        uint32_t  send_us;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void latency_trace_record(enum latency_stage stage, time_ns_t duration_ns);
+void latency_trace_record_interval(enum latency_stage stage, time_ns_t start,
+                                   time_ns_t end);
+void latency_trace_get(enum latency_stage stage, struct latency_stats *stats,
+                       bool reset);
+const char *latency_stage_name(enum latency_stage stage);
+
+bool latency_trace_ext_enabled(void);
+void latency_trace_ext_format(const struct latency_trace_ext *ext,
+                              uint32_t out[LATENCY_TRACE_EXT_WORDS]);
+bool latency_trace_ext_parse(const unsigned char *extn, uint16_t extn_len,
+                             uint16_t extn_type, struct latency_trace_ext *ext);
+void latency_trace_record_sender(const struct latency_trace_ext *ext);
+
+#ifdef __cplusplus
+}
+
+struct control_state;
+void latency_trace_report(struct control_state *control);
+#endif
+
+#endif // defined UTILS_LATENCY_TRACE_H_7A1C3E55_2B9D_4C61_8F0E_64D2A9B1C3F7
@@ -0,0 +1,248 @@
+/**
+ * @file   utils/packet_pool.c
+ * @brief  lock-free pool of fixed-size packet buffers
+ *
+ * Free items form a Treiber stack linked by 32-bit item indices. The head
+ * packs the index together with a 32-bit modification tag into one 64-bit
+ * word to avoid the ABA problem. Chunks are never released before the pool
+ * itself so a stale item pointer obtained during a failed pop still points
+ * to valid memory.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "utils/macros.h"
+#include "utils/packet_pool.h"
+
+enum {
+        CHUNK_ITEMS = 256,
+        MAX_CHUNKS  = 1024,
+        ITEM_ALIGN  = 64, ///< item stride alignment (cache line)
+};
+
+#define IDX_NONE UINT32_MAX        ///< empty free list
+#define IDX_HEAP (UINT32_MAX - 1)  ///< item malloc'ed outside of the pool
+
+struct item_hdr {
+        struct packet_pool *pool;
+        uint32_t idx;
+        _Atomic uint32_t next;   ///< free-list link, valid only while free
+        alignas(max_align_t) unsigned char scratch[PACKET_POOL_SCRATCH_LEN];
+};
+static_assert(sizeof(struct item_hdr) % alignof(max_align_t) == 0,
+              "item data must be aligned to max_align_t");
+
+struct packet_pool {
+        _Atomic uint64_t head;   ///< modification tag << 32 | item index
+        atomic_uint refs;        ///< owner + items in use
+        atomic_ullong allocs;
+        atomic_ullong heap_allocs;
+        atomic_uint capacity;
+
+        size_t item_size;
+        size_t stride;
+        unsigned int max_items;
+
+        pthread_mutex_t grow_lock;
+        int chunk_count;
+        unsigned char *chunks[MAX_CHUNKS];
+};
+
+static struct item_hdr *item_at(struct packet_pool *pool, uint32_t idx)
+{
+        return (struct item_hdr *)(void *) (pool->chunks[idx / CHUNK_ITEMS] +
+                                            (idx % CHUNK_ITEMS) * pool->stride);
+}
+
+static void pool_push(struct packet_pool *pool, struct item_hdr *hdr)
+{
+        uint64_t old = atomic_load_explicit(&pool->head, memory_order_relaxed);
+        uint64_t new_head = 0;
+        do {
+                atomic_store_explicit(&hdr->next, (uint32_t) old,
+                                      memory_order_relaxed);
+                new_head = (((old >> 32U) + 1) << 32U) | hdr->idx;
+        } while (!atomic_compare_exchange_weak_explicit(
+            &pool->head, &old, new_head, memory_order_release,
+            memory_order_relaxed));
+}
+
+static struct item_hdr *pool_pop(struct packet_pool *pool)
+{
+        uint64_t old = atomic_load_explicit(&pool->head, memory_order_acquire);
+        while ((uint32_t) old != IDX_NONE) {
+                struct item_hdr *hdr = item_at(pool, (uint32_t) old);
+                // may be stale if other thread popped the item meanwhile,
+                // the CAS then fails due to changed tag
+                const uint32_t next =
+                    atomic_load_explicit(&hdr->next, memory_order_relaxed);
+                const uint64_t new_head = (((old >> 32U) + 1) << 32U) | next;
+                if (atomic_compare_exchange_weak_explicit(
+                        &pool->head, &old, new_head, memory_order_acquire,
+                        memory_order_acquire)) {
+                        return hdr;
+                }
+        }
+        return NULL;
+}
+
+/**
+ * Adds a new chunk of items to the pool and returns one of them.
+ * @returns NULL if the pool has reached max_items
+ */
+static struct item_hdr *pool_grow(struct packet_pool *pool)
+{
+        pthread_mutex_lock(&pool->grow_lock);
+        // other allocating thread may have grown the pool meanwhile
+        struct item_hdr *ret = pool_pop(pool);
+        const unsigned int capacity = atomic_load_explicit(&pool->capacity, memory_order_relaxed);
+        if (ret != NULL || capacity >= pool->max_items ||
+            pool->chunk_count == MAX_CHUNKS) {
+                pthread_mutex_unlock(&pool->grow_lock);
+                return ret;
+        }
+        const unsigned int count = MIN(CHUNK_ITEMS, pool->max_items - capacity);
+        unsigned char *chunk = malloc(count * pool->stride);
+        if (chunk == NULL) {
+                pthread_mutex_unlock(&pool->grow_lock);
+                return NULL;
+        }
+        atomic_fetch_add_explicit(&pool->heap_allocs, 1, memory_order_relaxed);
+        const uint32_t first_idx = pool->chunk_count * CHUNK_ITEMS;
+        pool->chunks[pool->chunk_count++] = chunk;
+        for (unsigned int i = 0; i < count; ++i) {
+                struct item_hdr *hdr = item_at(pool, first_idx + i);
+                hdr->pool = pool;
+                hdr->idx = first_idx + i;
+                if (i > 0) { // first item is returned directly
+                        pool_push(pool, hdr);
+                }
+        }
+        atomic_store_explicit(&pool->capacity, capacity + count, memory_order_relaxed);
+        pthread_mutex_unlock(&pool->grow_lock);
+        return item_at(pool, first_idx);
+}
+
+static void pool_unref(struct packet_pool *pool)
+{
+        if (atomic_fetch_sub_explicit(&pool->refs, 1, memory_order_acq_rel) > 1) {
+                return;
+        }
+        for (int i = 0; i < pool->chunk_count; ++i) {
+                free(pool->chunks[i]);
+        }
+        pthread_mutex_destroy(&pool->grow_lock);
+        free(pool);
+}
+
+struct packet_pool *packet_pool_create(size_t item_size, unsigned int max_items)
+{
+        struct packet_pool *pool = calloc(1, sizeof *pool);
+        if (pool == NULL) {
+                return NULL;
+        }
+        atomic_init(&pool->head, IDX_NONE);
+        atomic_init(&pool->refs, 1);
+        atomic_init(&pool->allocs, 0);
+        atomic_init(&pool->heap_allocs, 0);
+        atomic_init(&pool->capacity, 0);
+        pool->item_size = item_size;
+        pool->stride = (sizeof(struct item_hdr) + item_size + ITEM_ALIGN - 1) /
+                       ITEM_ALIGN * ITEM_ALIGN;
+        pool->max_items = MIN(max_items, (unsigned) CHUNK_ITEMS * MAX_CHUNKS);
+        pthread_mutex_init(&pool->grow_lock, NULL);
+        return pool;
+}
+
+void packet_pool_destroy(struct packet_pool *pool)
+{
+        if (pool != NULL) {
+                pool_unref(pool);
+        }
+}
+
+void *packet_pool_alloc(struct packet_pool *pool)
+{
+        atomic_fetch_add_explicit(&pool->allocs, 1, memory_order_relaxed);
+        struct item_hdr *hdr = pool_pop(pool);
+        if (hdr == NULL) {
+                hdr = pool_grow(pool);
+        }
+        if (hdr == NULL) {
+                hdr = malloc(sizeof *hdr + pool->item_size);
+                if (hdr == NULL) {
+                        return NULL;
+                }
+                hdr->pool = pool;
+                hdr->idx = IDX_HEAP;
+                atomic_fetch_add_explicit(&pool->heap_allocs, 1,
+                                          memory_order_relaxed);
+        }
+        atomic_fetch_add_explicit(&pool->refs, 1, memory_order_relaxed);
+        return hdr + 1;
+}
+
+void packet_pool_free(void *item)
+{
+        if (item == NULL) {
+                return;
+        }
+        struct item_hdr *hdr = (struct item_hdr *) item - 1;
+        struct packet_pool *pool = hdr->pool;
+        if (hdr->idx == IDX_HEAP) {
+                free(hdr);
+        } else {
+                pool_push(pool, hdr);
+        }
+        pool_unref(pool);
+}
+
+void *packet_pool_scratch(void *item)
+{
+        return ((struct item_hdr *) item - 1)->scratch;
+}
+
+void packet_pool_get_stats(const void *item, struct packet_pool_stats *stats)
+{
+        const struct packet_pool *pool = ((const struct item_hdr *) item - 1)->pool;
+        stats->allocs = atomic_load_explicit(&pool->allocs, memory_order_relaxed);
+        stats->heap_allocs = atomic_load_explicit(&pool->heap_allocs, memory_order_relaxed);
+        stats->capacity = atomic_load_explicit(&pool->capacity, memory_order_relaxed);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file   utils/packet_pool.h
+ * @brief  lock-free pool of fixed-size packet buffers
+ *
+ * Items are preallocated in chunks and recycled through a lock-free free
+ * list, so that steady-state allocation does not touch the heap. Items can
+ * be allocated and freed from different threads (typically network reader
+ * and decoder thread).
+ *
+ * Each item carries a small scratch area (PACKET_POOL_SCRATCH_LEN bytes)
+ * that is owned by the current holder of the item. It is intended for
+ * intrusive list links so that the consumer doesn't need to allocate its
+ * own bookkeeping per item (see struct coded_data).
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_PACKET_POOL_H_5C0E2B7A_3D41_4F8E_9A6B_1E2F7C9D0A43
+#define UTILS_PACKET_POOL_H_5C0E2B7A_3D41_4F8E_9A6B_1E2F7C9D0A43
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#define PACKET_POOL_SCRATCH_LEN 48
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct packet_pool;
+
+struct packet_pool_stats {
+        unsigned long long allocs;      ///< total number of allocated items
+        unsigned long long heap_allocs; ///< allocations that needed malloc (pool growth or pool exhausted)
+        unsigned int capacity;          ///< number of items currently owned by the pool
+};
+
+/**
+ * @param item_size  usable size of each item
+ * @param max_items  maximal number of pooled items, the pool grows on demand
+ *                   up to this value; if exhausted, items are malloc'ed
+ */
+struct packet_pool *packet_pool_create(size_t item_size, unsigned int max_items);
+/**
+ * Releases the pool. Items still in use remain valid, the memory is
+ * reclaimed after the last of them is freed with packet_pool_free().
+ */
+void packet_pool_destroy(struct packet_pool *pool);
+/// @returns item of item_size bytes, alignment is that of max_align_t
+void *packet_pool_alloc(struct packet_pool *pool);
+/// returns item to its pool, may be called from any thread; NULL is no-op
+void packet_pool_free(void *item);
+/// @returns PACKET_POOL_SCRATCH_LEN bytes of scratch space associated with item
+void *packet_pool_scratch(void *item);
+/// fills statistics of pool owning item
+void packet_pool_get_stats(const void *item, struct packet_pool_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_PACKET_POOL_H_5C0E2B7A_3D41_4F8E_9A6B_1E2F7C9D0A43
@@ -36,51 +36,94 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
 
+#include "debug.h"
+#include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/parallel_conv.h"
 #include "utils/worker.h"
 
 struct parallel_pix_conv_data {
         decoder_t decode;
-        int height;
         unsigned char *out_data;
         int out_linesize;
         const unsigned char *in_data;
         int in_linesize;
 };
 
-static void *parallel_pix_conv_task(void *arg) {
+static void parallel_pix_conv_task(size_t start, size_t end, void *arg) {
         struct parallel_pix_conv_data *data = arg;
-        for (int y = 0; y < data->height; ++y) {
-                data->decode(data->out_data, data->in_data, data->out_linesize, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
-                data->out_data += data->out_linesize;
-                data->in_data += data->in_linesize;
+        unsigned char *out = data->out_data + start * data->out_linesize;
+        const unsigned char *in = data->in_data + start * data->in_linesize;
+        for (size_t y = start; y < end; ++y) {
+                data->decode(out, in, data->out_linesize, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                out += data->out_linesize;
+                in += data->in_linesize;
         }
-        return NULL;
 }
 
-/// @todo utilize respawn_parallel
+/**
+ * Rows are processed by the work-stealing pool in ranges of at most
+ * height/threads lines.
+ */
 void parallel_pix_conv(int height, char *out, int out_linesize, const char *in, int in_linesize, decoder_t decode, int threads)
 {
         if (threads == 0) {
                 threads = get_cpu_core_count();
         }
         assert(threads > 0);
-        struct parallel_pix_conv_data data[threads];
+        struct parallel_pix_conv_data data = {
+                .decode = decode,
+                .out_data = (unsigned char *) out,
+                .out_linesize = out_linesize,
+                .in_data = (const unsigned char *) in,
+                .in_linesize = in_linesize,
+        };
+        task_parallel_for(height, DIV_ROUNDED_UP(height, threads), parallel_pix_conv_task, &data);
+}
 
-        for (ptrdiff_t i = 0; i < threads; ++i) {
-                data[i].decode = decode;
-                data[i].height = height / threads;
-                data[i].out_data = (unsigned char *) out + i * data[i].height * out_linesize;
-                data[i].out_linesize = out_linesize;
-                data[i].in_data = (const unsigned char *) in + i * data[i].height * in_linesize;
-                data[i].in_linesize = in_linesize;
-                if (i == threads - 1) {
-                        data[i].height = height - (threads - 1) * (height / threads);
-                }
-        }
+struct parallel_rows_data {
+        parallel_rows_callback_t c;
+        void *udata;
+        int height;
+        int row_align;
+};
+
+static void parallel_rows_task(size_t start, size_t end, void *arg) {
+        struct parallel_rows_data *data = arg;
+        data->c(start * data->row_align, MIN((int) end * data->row_align, data->height), data->udata);
+}
 
-        task_run_parallel(parallel_pix_conv_task, threads, data, sizeof data[0], NULL);
+void parallel_rows(int height, int row_align, parallel_rows_callback_t c, void *udata, int threads)
+{
+        if (threads == 0) {
+                threads = get_cpu_core_count();
+        }
+        assert(threads > 0 && row_align > 0);
+        const int row_blocks = (height + row_align - 1) / row_align;
+        if (threads > row_blocks) {
+                threads = row_blocks > 0 ? row_blocks : 1;
+        }
+        if (threads == 1) {
+                c(0, height, udata);
+                return;
+        }
+        struct parallel_rows_data data = { c, udata, height, row_align };
+        task_parallel_for(row_blocks, DIV_ROUNDED_UP(row_blocks, threads), parallel_rows_task, &data);
 }
 
+int parse_thread_count(const char *val)
+{
+        char *endptr = NULL;
+        errno = 0;
+        const long threads = strtol(val, &endptr, 10);
+        if (errno != 0 || endptr == val || *endptr != '\0' || threads < 0 ||
+            threads > INT_MAX) {
+                log_msg(LOG_LEVEL_ERROR, "Wrong thread count: %s\n", val);
+                return -1;
+        }
+        return (int) threads;
+}
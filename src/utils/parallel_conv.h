@@ -46,10 +46,37 @@ extern "C" {
 
 /**
  * Runs specified decoder in parallel
- * @param threads number of threads; use 0 to use all logical threads
+ * @param threads number of threads; use 0 to use all logical threads (rows are
+ *                processed by the worker pool in ranges of height/threads lines)
  */
 void parallel_pix_conv(int height, char *out, int out_linesize, const char *in, int in_linesize, decoder_t decode, int threads);
 
+/**
+ * @param start_row  first row of the slice
+ * @param end_row    row after the last row of the slice
+ */
+typedef void (*parallel_rows_callback_t)(int start_row, int end_row, void *udata);
+
+/**
+ * Runs callback on contiguous slices of rows [0, height) in parallel
+ *
+ * Slice boundaries are multiples of row_align (eg. 2 to keep pairs of
+ * interlaced lines together), each slice is processed by one thread. Slices
+ * have at most height/threads rows and are scheduled in the worker pool.
+ *
+ * @param threads number of threads; use 0 to use all logical threads, 1 runs
+ *                the callback in the calling thread
+ */
+void parallel_rows(int height, int row_align, parallel_rows_callback_t c, void *udata, int threads);
+
+/**
+ * Parses value of the threads=<n> option of modules using parallel_rows()
+ *
+ * @returns thread count (0 - all logical threads) or -1 if the value is not
+ *          a non-negative number (error is printed)
+ */
+int parse_thread_count(const char *val);
+
 #ifdef __cplusplus
 }
 #endif
@@ -36,14 +36,31 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <pthread.h>
 #include <queue>
 #include <set>
+#include <thread>
 #include <vector>
-
-#include "utils/macros.h" // for MAX_CPU_CORES
-#include "utils/misc.h"   // get_cpu_core_count
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "host.h"         // for ADD_TO_PARAM, get_commandline_param
+#include "utils/macros.h" // for MAX_CPU_CORES, DIV_ROUNDED_UP
+#include "utils/misc.h"   // get_cpu_core_count, ug_strerror
 #include "utils/thread.h"
 #include "utils/worker.h"
 
@@ -283,10 +300,461 @@ void *wait_task(task_result_handle_t handle)
 }
 
 /**
- * This combines task_run_async() + wait_task()
+ * @brief Persistent work-stealing pool for data-parallel calls
+ *
+ * Each pool thread owns a deque of index ranges. The owner takes ranges from
+ * the back and splits those larger than the grain in halves, pushing the
+ * upper half back, idle threads steal from the front of other deques (the
+ * largest ranges). A caller that is not a pool thread distributes the
+ * initial pieces, processes one of them and then helps with the rest. A
+ * call from a pool thread (nested parallelism) pushes the range to its own
+ * deque so the thread keeps working instead of blocking.
+ *
+ * Unlike task_run_async(), the tasks must not block for long (eg. waiting
+ * for other tasks) because the number of the threads is fixed.
+ */
+namespace {
+struct ws_batch {
+        parallel_for_callback_t m_callback;
+        void *m_udata;
+        size_t m_grain;
+        std::atomic<size_t> m_remaining; ///< indices not yet processed
+        std::mutex m_lock;
+        std::condition_variable m_cv;
+        bool m_done = false;
+};
+
+struct ws_range {
+        ws_batch *batch;
+        size_t start;
+        size_t end;
+};
+
+struct ws_deque {
+        std::mutex m_lock;
+        std::deque<ws_range> m_ranges;
+};
+
+enum ws_affinity {
+        WS_AFFINITY_NONE,
+        WS_AFFINITY_CPU,  ///< each thread pinned to one CPU
+        WS_AFFINITY_NODE, ///< threads spread over NUMA nodes, pinned to node CPUs
+};
+
+thread_local int ws_thread_idx = -1; ///< index of the pool thread, -1 if not a pool thread
+
+class ws_pool {
+public:
+        ws_pool();
+        ~ws_pool();
+        void parallel_for(size_t count, size_t grain, parallel_for_callback_t c, void *udata);
+        void get_stats(struct worker_pool_stats *stats);
+
+private:
+        void thread_loop(int idx, enum ws_affinity affinity);
+        bool find_work(int self, ws_range *range);
+        void push(int idx, ws_range range);
+        void run_range(int self, ws_range range);
+        void help_until_done(int self, ws_batch *batch);
+        static void finish(ws_batch *batch, size_t count);
+
+        vector<std::unique_ptr<ws_deque>> m_deques; ///< one per pool thread
+        vector<std::thread> m_threads;
+        std::atomic<unsigned> m_next_deque{0};
+
+        std::mutex m_sleep_lock;
+        std::condition_variable m_sleep_cv;
+        std::atomic<uint64_t> m_epoch{0}; ///< incremented when work is pushed
+        std::atomic<int> m_sleepers{0};
+        bool m_should_exit = false;
+
+        std::atomic<unsigned long long> m_batches{0};
+        std::atomic<unsigned long long> m_inlined{0};
+        std::atomic<unsigned long long> m_ranges{0};
+        std::atomic<unsigned long long> m_steals{0};
+        std::atomic<long long> m_idle_ns{0};
+        std::atomic<size_t> m_max_queue_depth{0};
+};
+} // end of anonymous namespace
+
+ADD_TO_PARAM("worker-threads", "* worker-threads=<n>\n"
+                "  Number of threads of the pool for parallel tasks (default: logical cores - 1).\n");
+ADD_TO_PARAM("worker-affinity", "* worker-affinity=cpu|node\n"
+                "  Pin parallel worker threads to CPUs or spread them over NUMA nodes.\n");
+
+#ifdef __linux__
+/// @returns CPUs listed in sysfs cpulist format (eg. "0-3,8-11") that are also in allowed
+static vector<int> parse_cpulist(const char *path, const cpu_set_t *allowed)
+{
+        vector<int> ret;
+        FILE *f = fopen(path, "r");
+        if (f == nullptr) {
+                return ret;
+        }
+        int first = 0;
+        int last = 0;
+        while (fscanf(f, "%d", &first) == 1) {
+                last = first;
+                int c = fgetc(f);
+                if (c == '-') {
+                        if (fscanf(f, "%d", &last) != 1) {
+                                break;
+                        }
+                        c = fgetc(f);
+                }
+                for (int i = first; i <= last && i < CPU_SETSIZE; ++i) {
+                        if (CPU_ISSET(i, allowed)) {
+                                ret.push_back(i);
+                        }
+                }
+                if (c != ',') {
+                        break;
+                }
+        }
+        fclose(f);
+        return ret;
+}
+
+static void ws_set_affinity(int idx, enum ws_affinity affinity)
+{
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof allowed, &allowed) != 0) {
+                return;
+        }
+        vector<int> cpus;
+        if (affinity == WS_AFFINITY_NODE) {
+                vector<vector<int>> nodes;
+                for (int i = 0;; ++i) {
+                        char path[128];
+                        snprintf(path, sizeof path, "/sys/devices/system/node/node%d/cpulist", i);
+                        if (access(path, R_OK) != 0) {
+                                break;
+                        }
+                        vector<int> node = parse_cpulist(path, &allowed);
+                        if (!node.empty()) {
+                                nodes.push_back(node);
+                        }
+                }
+                if (!nodes.empty()) {
+                        cpus = nodes[idx % nodes.size()];
+                }
+        } else {
+                for (int i = 0; i < CPU_SETSIZE; ++i) {
+                        if (CPU_ISSET(i, &allowed)) {
+                                cpus.push_back(i);
+                        }
+                }
+                if (!cpus.empty()) {
+                        cpus = { cpus[idx % cpus.size()] };
+                }
+        }
+        if (cpus.empty()) {
+                return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+                CPU_SET(cpu, &set);
+        }
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+        if (rc != 0) {
+                log_msg(LOG_LEVEL_WARNING, "[worker] Cannot set thread affinity: %s\n", ug_strerror(rc));
+        } else {
+                log_msg(LOG_LEVEL_DEBUG, "[worker] Thread %d pinned to %zu CPU(s) starting with %d\n",
+                                idx, cpus.size(), cpus[0]);
+        }
+}
+#else
+static void ws_set_affinity(int idx, enum ws_affinity affinity)
+{
+        (void) idx;
+        if (affinity != WS_AFFINITY_NONE) {
+                log_msg_once(LOG_LEVEL_WARNING, 0x5EAFF1, "[worker] Thread affinity is not supported on this platform.\n");
+        }
+}
+#endif
+
+ws_pool::ws_pool()
+{
+        int threads = min<int>(get_cpu_core_count(), MAX_CPU_CORES) - 1;
+        if (const char *val = get_commandline_param("worker-threads")) {
+                threads = min<int>(atoi(val), MAX_CPU_CORES);
+        }
+        enum ws_affinity affinity = WS_AFFINITY_NONE;
+        if (const char *val = get_commandline_param("worker-affinity")) {
+                if (strcmp(val, "cpu") == 0) {
+                        affinity = WS_AFFINITY_CPU;
+                } else if (strcmp(val, "node") == 0) {
+                        affinity = WS_AFFINITY_NODE;
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, "[worker] Unknown affinity: %s\n", val);
+                }
+        }
+        threads = std::max(threads, 0);
+        for (int i = 0; i < threads; ++i) {
+                m_deques.emplace_back(new ws_deque());
+        }
+        for (int i = 0; i < threads; ++i) {
+                m_threads.emplace_back(&ws_pool::thread_loop, this, i, affinity);
+        }
+}
+
+ws_pool::~ws_pool()
+{
+        {
+                std::lock_guard<std::mutex> lk(m_sleep_lock);
+                m_should_exit = true;
+                m_epoch += 1;
+        }
+        m_sleep_cv.notify_all();
+        for (auto &t : m_threads) {
+                t.join();
+        }
+}
+
+void ws_pool::push(int idx, ws_range range)
+{
+        ws_deque &d = *m_deques[idx];
+        size_t depth = 0;
+        {
+                std::lock_guard<std::mutex> lk(d.m_lock);
+                d.m_ranges.push_back(range);
+                depth = d.m_ranges.size();
+        }
+        size_t max_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+        while (depth > max_depth && !m_max_queue_depth.compare_exchange_weak(max_depth, depth)) {
+        }
+        // pairs with the sleeper incrementing m_sleepers and rechecking m_epoch
+        m_epoch.fetch_add(1);
+        if (m_sleepers.load() > 0) {
+                { std::lock_guard<std::mutex> lk(m_sleep_lock); }
+                m_sleep_cv.notify_one();
+        }
+}
+
+/**
+ * Takes a range from the back of own deque (if self is a pool thread) or
+ * steals one from the front of another deque.
+ */
+bool ws_pool::find_work(int self, ws_range *range)
+{
+        if (self >= 0) {
+                ws_deque &d = *m_deques[self];
+                std::lock_guard<std::mutex> lk(d.m_lock);
+                if (!d.m_ranges.empty()) {
+                        *range = d.m_ranges.back();
+                        d.m_ranges.pop_back();
+                        return true;
+                }
+        }
+        const unsigned count = m_deques.size();
+        const unsigned first = m_next_deque.fetch_add(1, std::memory_order_relaxed);
+        for (unsigned i = 0; i < count; ++i) {
+                const unsigned victim = (first + i) % count;
+                if ((int) victim == self) {
+                        continue;
+                }
+                ws_deque &d = *m_deques[victim];
+                std::lock_guard<std::mutex> lk(d.m_lock);
+                if (!d.m_ranges.empty()) {
+                        *range = d.m_ranges.front();
+                        d.m_ranges.pop_front();
+                        m_steals.fetch_add(1, std::memory_order_relaxed);
+                        return true;
+                }
+        }
+        return false;
+}
+
+void ws_pool::finish(ws_batch *batch, size_t count)
+{
+        if (batch->m_remaining.fetch_sub(count) == count) {
+                // notified under the lock - the waiter may destroy the batch right after unlock
+                std::lock_guard<std::mutex> lk(batch->m_lock);
+                batch->m_done = true;
+                batch->m_cv.notify_one();
+        }
+}
+
+void ws_pool::run_range(int self, ws_range range)
+{
+        ws_batch *batch = range.batch;
+        while (range.end - range.start > batch->m_grain) {
+                const size_t mid = range.start + (range.end - range.start) / 2;
+                // a caller other than pool thread publishes to the pool deques
+                const int dst = self >= 0 ? self
+                        : (int) (m_next_deque.fetch_add(1, std::memory_order_relaxed) % m_deques.size());
+                push(dst, { batch, mid, range.end });
+                range.end = mid;
+        }
+        batch->m_callback(range.start, range.end, batch->m_udata);
+        m_ranges.fetch_add(1, std::memory_order_relaxed);
+        finish(batch, range.end - range.start);
+}
+
+void ws_pool::help_until_done(int self, ws_batch *batch)
+{
+        ws_range range{};
+        while (batch->m_remaining.load() != 0 && find_work(self, &range)) {
+                run_range(self, range);
+        }
+        std::unique_lock<std::mutex> lk(batch->m_lock);
+        batch->m_cv.wait(lk, [batch] { return batch->m_done; });
+}
+
+void ws_pool::thread_loop(int idx, enum ws_affinity affinity)
+{
+        set_thread_name("worker_ws");
+        ws_thread_idx = idx;
+        if (affinity != WS_AFFINITY_NONE) {
+                ws_set_affinity(idx, affinity);
+        }
+        enum { SPIN_ROUNDS = 16 };
+        ws_range range{};
+        while (true) {
+                bool found = false;
+                for (int i = 0; i < SPIN_ROUNDS && !found; ++i) {
+                        found = find_work(idx, &range);
+                        if (!found) {
+                                std::this_thread::yield();
+                        }
+                }
+                if (found) {
+                        run_range(idx, range);
+                        continue;
+                }
+                const uint64_t epoch = m_epoch.load();
+                if (find_work(idx, &range)) {
+                        run_range(idx, range);
+                        continue;
+                }
+                const auto t0 = std::chrono::steady_clock::now();
+                std::unique_lock<std::mutex> lk(m_sleep_lock);
+                m_sleepers.fetch_add(1);
+                m_sleep_cv.wait(lk, [&] { return m_should_exit || m_epoch.load() != epoch; });
+                m_sleepers.fetch_sub(1);
+                if (m_should_exit) {
+                        return;
+                }
+                lk.unlock();
+                m_idle_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now() - t0).count(),
+                                std::memory_order_relaxed);
+        }
+}
+
+void ws_pool::parallel_for(size_t count, size_t grain, parallel_for_callback_t c, void *udata)
+{
+        const size_t threads = m_threads.size();
+        if (grain == 0) { // about 4 ranges per thread
+                grain = std::max<size_t>(DIV_ROUNDED_UP(count, 4 * (threads + 1)), 1);
+        }
+        if (count <= grain || threads == 0) {
+                m_inlined.fetch_add(1, std::memory_order_relaxed);
+                for (size_t start = 0; start < count; start += grain) {
+                        c(start, min(count, start + grain), udata);
+                }
+                return;
+        }
+        m_batches.fetch_add(1, std::memory_order_relaxed);
+
+        ws_batch batch;
+        batch.m_callback = c;
+        batch.m_udata = udata;
+        batch.m_grain = grain;
+        batch.m_remaining = count;
+
+        const int self = ws_thread_idx;
+        if (self >= 0) {
+                push(self, { &batch, 0, count });
+                help_until_done(self, &batch);
+                return;
+        }
+
+        // one piece per pool thread + caller, subsequently split by the owners
+        const size_t pieces = min(DIV_ROUNDED_UP(count, grain), threads + 1);
+        const size_t piece_len = count / pieces;
+        const unsigned first = m_next_deque.fetch_add(pieces - 1, std::memory_order_relaxed);
+        for (size_t i = 1; i < pieces; ++i) {
+                const size_t start = i * piece_len;
+                const size_t end = i == pieces - 1 ? count : start + piece_len;
+                push((first + i) % threads, { &batch, start, end });
+        }
+        run_range(-1, { &batch, 0, piece_len });
+        help_until_done(-1, &batch);
+}
+
+void ws_pool::get_stats(struct worker_pool_stats *stats)
+{
+        stats->threads = m_threads.size();
+        stats->queue_depth = 0;
+        for (auto &d : m_deques) {
+                std::lock_guard<std::mutex> lk(d->m_lock);
+                stats->queue_depth += d->m_ranges.size();
+        }
+        stats->max_queue_depth = m_max_queue_depth;
+        stats->batches = m_batches;
+        stats->inlined = m_inlined;
+        stats->ranges = m_ranges;
+        stats->steals = m_steals;
+        stats->idle_time = m_idle_ns / 1E9;
+}
+
+static ws_pool &get_ws_pool()
+{
+        static ws_pool pool; // created on first use, when command-line params are already set
+        return pool;
+}
+
+/**
+ * Runs callback on the range [0, count) split into subranges of at most
+ * grain indices in the work-stealing pool. Calling thread participates and
+ * the function returns when the whole range is processed.
+ *
+ * If called from a pool thread, the range is pushed to its queue and the
+ * thread works on it (and possibly other queued ranges) meanwhile.
+ *
+ * @param grain  maximal count of indices passed to a callback invocation, 0
+ *               to select automatically; the range is processed by the
+ *               calling thread at once if count <= grain
+ */
+void task_parallel_for(size_t count, size_t grain, parallel_for_callback_t c, void *udata)
+{
+        get_ws_pool().parallel_for(count, grain, c, udata);
+}
+
+void worker_pool_get_stats(struct worker_pool_stats *stats)
+{
+        get_ws_pool().get_stats(stats);
+}
+
+struct task_run_parallel_data {
+        runnable_t task;
+        char *data;
+        size_t data_size;
+        void **res;
+};
+
+static void task_run_parallel_callback(size_t start, size_t end, void *udata)
+{
+        auto *d = (struct task_run_parallel_data *) udata;
+        for (size_t i = start; i < end; ++i) {
+                void *ret = d->task(d->data + i * d->data_size);
+                if (d->res != nullptr) {
+                        d->res[i] = ret;
+                }
+        }
+}
+
+/**
+ * Runs task for every element of data in the work-stealing pool and waits
+ * for completion (see task_parallel_for()).
  *
  * @param task         task to be run
- * @param worker_count number of workers to be run
+ * @param worker_count number of data elements (each element is passed to
+ *                     one task invocation); tasks may run concurrently but
+ *                     not necessarily all at the same time
  * @param data         pointer to data array to be passed to task
  * @param data_size    size of element of data
  * @param res          (optional) pointer to result array, may be NULL
@@ -294,34 +762,28 @@ void *wait_task(task_result_handle_t handle)
 void task_run_parallel(runnable_t task, int worker_count, void *data, size_t data_size, void **res)
 {
         if (worker_count == 1) {
-                task(data);
-                return;
-        }
-
-        vector<task_result_handle_t> tasks(worker_count);
-        for (int i = 0; i < worker_count; ++i) {
-                tasks[i] = task_run_async(task, (void *)((char *) data + i * data_size));
-        }
-        for (int i = 0; i < worker_count; ++i) {
+                void *ret = task(data);
                 if (res != nullptr) {
-                        res[i] = wait_task(tasks[i]);
-                } else {
-                        wait_task(tasks[i]);
+                        res[0] = ret;
                 }
+                return;
         }
+
+        struct task_run_parallel_data d = { task, (char *) data, data_size, res };
+        task_parallel_for(worker_count, 1, task_run_parallel_callback, &d);
 }
 
 struct respawn_parallel_data {
         respawn_parallel_callback_t c;
-        void *in;
-        void *out;
-        size_t data_len;
+        char *in;
+        char *out;
+        size_t size;
         void *udata;
 };
-static void *respawn_parallel_task(void *arg) {
+static void respawn_parallel_task(size_t start, size_t end, void *arg) {
         auto data = (struct respawn_parallel_data *) arg;
-        data->c(data->in, data->out, data->data_len, data->udata);
-        return NULL;
+        data->c(data->in + start * data->size, data->out + start * data->size,
+                        (end - start) * data->size, data->udata);
 }
 /**
  * Automatically respawns threads to convert in to out
@@ -331,20 +793,6 @@ static void *respawn_parallel_task(void *arg) {
  */
 void respawn_parallel(void *in, void *out, size_t nmemb, size_t size, respawn_parallel_callback_t c, void *udata)
 {
-        const int threads = min<int>(get_cpu_core_count(), MAX_CPU_CORES);
-        struct respawn_parallel_data data[MAX_CPU_CORES];
-
-        for (int i = 0; i < threads; ++i) {
-                data[i].c = c;
-                data[i].in = (char *) in + i * (nmemb / threads) * size;
-                data[i].out = (char *) out + i * (nmemb / threads) * size;
-                data[i].data_len = (nmemb / threads) * size;
-                data[i].udata = udata;
-                if (i == threads - 1) {
-                        data[i].data_len = size * (nmemb - (threads - 1) * (nmemb / threads));
-                }
-        }
-
-        task_run_parallel(respawn_parallel_task, threads, data, sizeof data[0], NULL);
+        struct respawn_parallel_data data = { c, (char *) in, (char *) out, size, udata };
+        task_parallel_for(nmemb, 0, respawn_parallel_task, &data);
 }
-
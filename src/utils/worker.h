@@ -55,6 +55,25 @@ void task_run_async_detached(runnable_t task, void *data);
 void *wait_task(task_result_handle_t handle);
 void task_run_parallel(runnable_t task, int worker_count, void *data, size_t data_size, void **res);
 
+/**
+ * @param start  first index of the range
+ * @param end    index after the last index of the range
+ */
+typedef void (*parallel_for_callback_t)(size_t start, size_t end, void *udata);
+void task_parallel_for(size_t count, size_t grain, parallel_for_callback_t c, void *udata);
+
+struct worker_pool_stats {
+        int threads;                     ///< pool threads (callers participate as well)
+        size_t queue_depth;              ///< ranges currently queued
+        size_t max_queue_depth;          ///< maximal observed length of a worker queue
+        unsigned long long batches;      ///< parallel calls dispatched to the pool
+        unsigned long long inlined;      ///< parallel calls run in the calling thread
+        unsigned long long ranges;       ///< ranges executed
+        unsigned long long steals;       ///< ranges taken from other threads' queues
+        double idle_time;                ///< time the pool threads spent sleeping [s]
+};
+void worker_pool_get_stats(struct worker_pool_stats *stats);
+
 /**
  * @param data_len   in/out processed block length in bytes (multpile of respawn_parallel's size param)
  */
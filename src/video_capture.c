@@ -62,6 +62,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "module.h"
+#include "utils/latency_trace.h"
 #include "utils/macros.h"
 #include "video_capture.h"
 #include "video_capture_params.h"
@@ -175,8 +176,10 @@ int initialize_video_capture(struct module *parent,
                 return ret;
         }
 
-        ret = capture_filter_init(&d->mod, vidcap_params_get_capture_filter(param),
-                &d->capture_filter);
+        // nested captures (eg. swmix inputs) may be created outside of the
+        // module tree, the filter looks up the control in the root module
+        ret = capture_filter_init(parent != NULL ? &d->mod : NULL,
+                vidcap_params_get_capture_filter(param), &d->capture_filter);
         if (ret < 0) {
                 log_msg(LOG_LEVEL_ERROR, "Unable to initialize capture filter: %s.\n",
                         vidcap_params_get_capture_filter(param));
@@ -220,8 +223,18 @@ struct video_frame *vidcap_grab(struct vidcap *state, struct audio_frame **audio
         assert(state->magic == VIDCAP_MAGIC);
         struct video_frame *frame;
         frame = state->funcs->grab(state->state, audio);
-        if (frame != NULL)
-                frame = capture_filter(state->capture_filter, frame);
+        if (frame == NULL) {
+                return NULL;
+        }
+        const time_ns_t capture_time = get_time_in_ns();
+        frame = capture_filter(state->capture_filter, frame);
+        if (frame != NULL) {
+                frame->capture_time = capture_time;
+                frame->filter_end = get_time_in_ns();
+                latency_trace_record_interval(LATENCY_STAGE_CAPTURE_FILTER,
+                                              frame->capture_time,
+                                              frame->filter_end);
+        }
         return frame;
 }
 
@@ -63,12 +63,14 @@
 #include "utils/color_out.h"
 #include "utils/fs.h"
 #include "utils/macros.h"
+#include "utils/misc.h"
 #include "utils/ring_buffer.h"
 #include "utils/worker.h"
 #include "video.h"
 #include "video_capture.h"
 #include "video_export.h"
 
+#include <errno.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -79,6 +81,9 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #define BUFFER_LEN_MAX 40
 #define MAX_CLIENTS 16
@@ -98,6 +103,7 @@ struct tile_data {
 
 struct processed_entry {
         struct processed_entry *next;
+        bool mapped; ///< tile data point to a mapped segment
         int count;
         struct tile_data tiles[];
 };
@@ -152,6 +158,19 @@ struct audio_state {
         struct message_queue message_queue;
 }; 
 
+/// segment of the segmented export (see video_export.h)
+struct import_segment {
+        char *map; ///< NULL if not mapped (read from file instead)
+        size_t len;
+};
+
+struct import_tile_ref {
+        int segment;
+        int tile_idx;
+        uint32_t data_len;
+        uint64_t offset;
+};
+
 struct vidcap_import_state {
         struct module mod;
         struct module *parent;
@@ -174,6 +193,10 @@ struct vidcap_import_state {
         struct timeval prev_time;
         long video_frame_count;
 
+        int segment_count; ///< 0 - file per frame
+        struct import_segment *segments;
+        struct import_tile_ref *tile_refs; ///< [video_frame_count][tile_count]
+
         bool has_video;
         bool finished;
         bool loop;
@@ -263,7 +286,8 @@ static long strtol_checked(const char *line, const char *prefix, long min_val, l
         return val;
 }
 
-static struct video_desc parse_video_desc_info(FILE *info, long *video_frame_count) {
+/// @param[out] segments segment count, 0 if the sequence is not segmented
+static struct video_desc parse_video_desc_info(FILE *info, long *video_frame_count, int *segments) {
         struct video_desc desc = { 0 };
 
         char line[512];
@@ -271,7 +295,7 @@ static struct video_desc parse_video_desc_info(FILE *info, long *video_frame_cou
         while (fgets(line, sizeof(line), info) != NULL) {
                 long val = 0;
                 if(strncmp(line, "version ", strlen("version ")) == 0) {
-                        if (strtol_checked(line, "version ", VIDEO_EXPORT_SUMMARY_VERSION, VIDEO_EXPORT_SUMMARY_VERSION) == LONG_MIN) {
+                        if (strtol_checked(line, "version ", VIDEO_EXPORT_SUMMARY_VERSION_FILES, VIDEO_EXPORT_SUMMARY_VERSION) == LONG_MIN) {
                                 return (struct video_desc) { 0 };
                         }
                         items_found |= 1U<<0U;
@@ -322,6 +346,11 @@ static struct video_desc parse_video_desc_info(FILE *info, long *video_frame_cou
                         };
                         *video_frame_count = val;
                         items_found |= 1U<<6U;
+                } else if(strncmp(line, "segments ", strlen("segments ")) == 0) { // optional
+                        if ((val = strtol_checked(line, "segments ", 1, INT_MAX)) == LONG_MIN) {
+                                return (struct video_desc) { 0 };
+                        };
+                        *segments = (int) val;
                 }
         }
 
@@ -371,6 +400,128 @@ static int get_tile_count(const char *directory, codec_t color_spec, char *tile_
         return tile_count;
 }
 
+/**
+ * Appends tile references from the index of the segment to refs.
+ *
+ * @param[in,out] ref_capacity allocated size of refs (in elements)
+ */
+static bool load_segment_index(struct vidcap_import_state *s, int segment,
+                               struct import_tile_ref **refs, size_t *ref_count,
+                               size_t *ref_capacity, int *tile_count)
+{
+        char name[MAX_PATH_SIZE];
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_INDEX_NAME, s->directory, segment);
+        FILE *f = fopen(name, "rb");
+        if (f == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open index %s: %s\n", name, ug_strerror(errno));
+                return false;
+        }
+        struct video_export_index_entry entry;
+        while (fread(&entry, sizeof entry, 1, f) == 1) {
+                if (entry.offset + entry.data_len > s->segments[segment].len) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Index %s refers past the segment end, truncated recording?\n", name);
+                        break;
+                }
+                if (*ref_count == *ref_capacity) {
+                        *ref_capacity = MAX(2 * *ref_capacity, 1024);
+                        *refs = (struct import_tile_ref *) realloc(*refs, *ref_capacity * sizeof **refs);
+                        assert(*refs != NULL);
+                }
+                (*refs)[*ref_count] = (struct import_tile_ref) { segment,
+                        entry.tile_idx, entry.data_len, entry.offset };
+                *ref_count += 1;
+                *tile_count = MAX(*tile_count, entry.tile_idx + 1);
+        }
+        fclose(f);
+        return true;
+}
+
+static bool open_segment(struct vidcap_import_state *s, int segment)
+{
+        char name[MAX_PATH_SIZE];
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_SEGMENT_NAME, s->directory, segment);
+        int flags = O_RDONLY;
+#ifdef _WIN32
+        flags |= O_BINARY;
+#endif
+        int fd = open(name, flags);
+        struct stat sb;
+        if (fd == -1 || fstat(fd, &sb) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open segment %s: %s\n", name, ug_strerror(errno));
+                if (fd != -1) {
+                        close(fd);
+                }
+                return false;
+        }
+        s->segments[segment].len = sb.st_size;
+#ifndef _WIN32
+        if (sb.st_size > 0) {
+                // private writable mapping so that the frame can be modified
+                // downstream (copy-on-write)
+                void *map = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                if (map == MAP_FAILED) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot map %s: %s\n", name, ug_strerror(errno));
+                } else {
+                        madvise(map, sb.st_size, MADV_SEQUENTIAL);
+                        s->segments[segment].map = (char *) map;
+                }
+        }
+#endif
+        close(fd);
+        return true;
+}
+
+/**
+ * Maps the segments and assembles frames from segment indices. Only frames
+ * with all tiles present are used.
+ */
+static bool load_segments(struct vidcap_import_state *s, int segment_count, long *frame_count)
+{
+        s->segments = (struct import_segment *) calloc(segment_count, sizeof *s->segments);
+        s->segment_count = segment_count;
+        struct import_tile_ref *refs = NULL;
+        size_t ref_count = 0;
+        size_t ref_capacity = 0;
+        int tile_count = 0;
+        for (int i = 0; i < segment_count; ++i) {
+                if (!open_segment(s, i) ||
+                    !load_segment_index(s, i, &refs, &ref_count, &ref_capacity, &tile_count)) {
+                        free(refs);
+                        return false;
+                }
+        }
+
+        s->tile_refs = (struct import_tile_ref *) malloc(MAX(ref_count, 1) * sizeof *s->tile_refs);
+        long frames = 0;
+        for (size_t i = 0; i + tile_count <= ref_count; ) {
+                bool complete = true;
+                for (int t = 0; t < tile_count; ++t) {
+                        complete = complete && refs[i + t].tile_idx == t;
+                }
+                if (!complete) { // skip to the next frame start
+                        i += 1;
+                        continue;
+                }
+                for (int t = 0; t < tile_count; ++t) {
+                        s->tile_refs[frames * tile_count + t] = refs[i + t];
+                }
+                frames += 1;
+                i += tile_count;
+        }
+        free(refs);
+
+        if (frames == 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "No frames found in segments.\n");
+                return false;
+        }
+        if (frames < *frame_count) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Only %ld of %ld frames indexed.\n", frames, *frame_count);
+        }
+        *frame_count = frames;
+        s->video_desc.tile_count = tile_count;
+        return true;
+}
+
 static bool initialize_import(struct vidcap_import_state *s, char *tmp, FILE **info, unsigned int flags) {
         bool disable_audio = false;
 
@@ -460,16 +611,22 @@ static bool initialize_import(struct vidcap_import_state *s, char *tmp, FILE **i
 
         if (s->has_video) {
                 long frame_count = 0;
-                s->video_desc = parse_video_desc_info(*info, &frame_count);
+                int segments = 0;
+                s->video_desc = parse_video_desc_info(*info, &frame_count, &segments);
                 if (s->video_desc.width == 0) {
                         return false;
                 }
-                s->video_frame_count = s->video_frame_count == 0 ? frame_count : MIN(s->video_frame_count, frame_count);
-
-                s->video_desc.tile_count = get_tile_count(s->directory, s->video_desc.color_spec, &s->tile_delim);
-                if (s->video_desc.tile_count == 0) {
-                        return false;
+                if (segments > 0) {
+                        if (!load_segments(s, segments, &frame_count)) {
+                                return false;
+                        }
+                } else {
+                        s->video_desc.tile_count = get_tile_count(s->directory, s->video_desc.color_spec, &s->tile_delim);
+                        if (s->video_desc.tile_count == 0) {
+                                return false;
+                        }
                 }
+                s->video_frame_count = s->video_frame_count == 0 ? frame_count : MIN(s->video_frame_count, frame_count);
         }
 
         // override metadata fps setting
@@ -576,7 +733,7 @@ static void free_entry(struct processed_entry *entry)
         if (entry == NULL) {
                 return;
         }
-        for (int i = 0; i < entry->count; ++i) {
+        for (int i = 0; i < entry->count && !entry->mapped; ++i) {
                 aligned_free(entry->tiles[i].data);
         }
 
@@ -610,6 +767,16 @@ static void cleanup_common(struct vidcap_import_state *s) {
 
         free(s->directory);
 
+        for (int i = 0; i < s->segment_count; ++i) {
+#ifndef _WIN32
+                if (s->segments[i].map != NULL) {
+                        munmap(s->segments[i].map, s->segments[i].len);
+                }
+#endif
+        }
+        free(s->segments);
+        free(s->tile_refs);
+
         // audio
         if(s->audio_state.has_audio) {
                 ring_buffer_destroy(s->audio_state.data);
@@ -833,10 +1000,75 @@ struct video_reader_data {
         unsigned int tile_count;
         struct processed_entry *entry;
         bool o_direct;
+
+        // segmented sequence
+        const char *directory;
+        const struct import_segment *segments;
+        const struct import_tile_ref *tile_refs; ///< refs of the frame, NULL if not segmented
 };
 
 #define ALLOC_ALIGN 512
 
+static bool read_segment_tile(const struct video_reader_data *data,
+                              const struct import_tile_ref *ref, char *buf)
+{
+        char name[MAX_PATH_SIZE];
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_SEGMENT_NAME, data->directory, ref->segment);
+        int flags = O_RDONLY;
+#ifdef _WIN32
+        flags |= O_BINARY;
+#endif
+        int fd = open(name, flags);
+        if (fd == -1) {
+                perror("open");
+                return false;
+        }
+        bool ret = lseek(fd, ref->offset, SEEK_SET) != (off_t) -1;
+        size_t bytes = 0;
+        while (ret && bytes < ref->data_len) {
+                ssize_t res = read(fd, buf + bytes, ref->data_len - bytes);
+                ret = res > 0;
+                bytes += ret ? res : 0;
+        }
+        if (!ret) {
+                perror("read");
+        }
+        close(fd);
+        return ret;
+}
+
+/**
+ * Frame from a mapped segment is passed without copying, the pages are just
+ * requested to be read ahead (the frame is queued before it is played).
+ */
+static void *segment_reader_callback(struct video_reader_data *data)
+{
+        data->entry->mapped = data->segments[data->tile_refs[0].segment].map != NULL;
+        for (unsigned int i = 0; i < data->tile_count; i++) {
+                const struct import_tile_ref *ref = &data->tile_refs[i];
+                const struct import_segment *seg = &data->segments[ref->segment];
+                data->entry->tiles[i].data_len = ref->data_len;
+#ifndef _WIN32
+                if (data->entry->mapped) {
+                        data->entry->tiles[i].data = seg->map + ref->offset;
+                        // offsets are aligned to VIDEO_EXPORT_SEGMENT_ALIGN, the page may be bigger
+                        const size_t page = sysconf(_SC_PAGESIZE);
+                        const size_t start = ref->offset / page * page;
+                        madvise(seg->map + start, ref->offset + ref->data_len - start, MADV_WILLNEED);
+                        continue;
+                }
+#endif
+                data->entry->tiles[i].data = (char *) aligned_malloc(ref->data_len, ALLOC_ALIGN);
+                if (!read_segment_tile(data, ref, data->entry->tiles[i].data)) {
+                        data->entry->count = i + 1;
+                        free_entry(data->entry);
+                        data->entry = NULL;
+                        return NULL;
+                }
+        }
+        return data;
+}
+
 static void *video_reader_callback(void *arg)
 {
         struct video_reader_data *data =
@@ -847,6 +1079,10 @@ static void *video_reader_callback(void *arg)
         data->entry->next = NULL;
         data->entry->count = data->tile_count;
 
+        if (data->tile_refs != NULL) {
+                return segment_reader_callback(data);
+        }
+
         for (unsigned int i = 0; i < data->tile_count; i++) {
                 char name[1048];
                 char tile_idx[3] = "";
@@ -991,6 +1227,10 @@ static void * video_reading_thread(void *args)
                                         get_codec_file_extension(s->video_desc.color_spec),
                                         sizeof(data->file_name_suffix));
                         data->entry = NULL;
+                        data->directory = s->directory;
+                        data->segments = s->segments;
+                        data->tile_refs = s->segment_count == 0 ? NULL :
+                                &s->tile_refs[(index + i) * s->video_desc.tile_count];
                         task_handle[i] = task_run_async(video_reader_callback, data);
                 }
 
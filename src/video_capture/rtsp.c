@@ -1206,6 +1206,9 @@ vidcap_rtsp_done(void *state) {
     }
 
     vf_free(s->vrtsp_state.out_frame);
+    if (s->vrtsp_state.decode_data.decode == decode_frame_h264) {
+        decode_frame_h264_done(&s->vrtsp_state.decode_data);
+    }
     free(s->vrtsp_state.control);
     free(s->artsp_state.control);
 
@@ -35,8 +35,12 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 /**
- * @todo
- * The XGetImage() is a bit slow, consider using XShm as OBS does.
+ * @note
+ * If available, the screen is grabbed with MIT-SHM into shared-memory
+ * XImages reused from a pool (XGetImage() is slow). With XDamage, only the
+ * regions changed since the previous frame (plus the cursor) are converted
+ * into the persistent frame and their area is passed in the frame metadata
+ * (damaged_area).
  */
 
 #ifdef HAVE_CONFIG_H
@@ -58,14 +62,25 @@
 
 #include "audio/types.h"
 
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif // HAVE_XSHM
 
 #include <X11/Xlib.h>
 #ifdef HAVE_XFIXES
 #include <X11/extensions/Xfixes.h>
 #endif // HAVE_XFIXES
+#ifdef HAVE_XSHM
+#include <X11/extensions/XShm.h>
+#endif // HAVE_XSHM
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif // HAVE_XDAMAGE
 #include <X11/Xutil.h>
 
 #define MOD_NAME "[screen capture] "
@@ -79,16 +94,27 @@ static void show_help()
 {
         printf("Screen capture\n");
         printf("Usage\n");
-        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH]\n");
+        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH][:noshm][:nodamage]\n");
         printf("\t\t<fps> - preferred grabbing fps (otherwise unlimited)\n");
         printf("\t\tdisplay - display to capture (including the colon!)\n");
         printf("\t\tgeomoetry | size - viewport to use (both option mean the same - size is just a convenient name)\n");
+        printf("\t\tnoshm - do not use MIT-SHM extension (use XGetImage)\n");
+        printf("\t\tnodamage - do not use XDamage extension (convert whole screen every frame)\n");
 }
 
-struct grabbed_data;
+struct shm_image {
+        XImage *image;
+#ifdef HAVE_XSHM
+        XShmSegmentInfo info;
+#endif // HAVE_XSHM
+        struct shm_image *next;
+};
 
 struct grabbed_data {
-        XImage *data;
+        XImage *data; ///< NULL if nothing changed since previous item
+        struct shm_image *shm; ///< pool image that data belongs to (or NULL)
+        XRectangle *rects; ///< changed regions, NULL means whole frame
+        int rect_count;
         struct grabbed_data *next;
 };
 
@@ -119,8 +145,194 @@ struct vidcap_screen_x11_state {
         bool initialized;
         int cpu_count;
         char *req_display;
+
+        bool no_shm;
+        bool no_damage;
+        bool use_shm;
+        struct shm_image *shm_pool; ///< free images, guarded by lock
+#ifdef HAVE_XDAMAGE
+        Damage damage; ///< None if damage is not tracked
+        XserverRegion damage_region;
+#endif // HAVE_XDAMAGE
+        XRectangle cursor_rect; ///< cursor position in the last grabbed image
+        unsigned long cursor_serial;
 };
 
+#ifdef HAVE_XSHM
+static bool x_error;
+
+static int x_error_handler(Display *dpy, XErrorEvent *ev)
+{
+        (void) dpy, (void) ev;
+        x_error = true;
+        return 0;
+}
+
+static void destroy_shm_image(struct vidcap_screen_x11_state *s, struct shm_image *img)
+{
+        XShmDetach(s->dpy, &img->info);
+        img->image->data = NULL; // not owned by the image
+        XDestroyImage(img->image);
+        shmdt(img->info.shmaddr);
+        free(img);
+}
+
+/**
+ * @param probe  catch the attach error (eg. for remote displays), this
+ *               replaces the process-wide Xlib error handler so it is done
+ *               only for the first image in initialize()
+ */
+static struct shm_image *create_shm_image(struct vidcap_screen_x11_state *s, bool probe)
+{
+        struct shm_image *img = calloc(1, sizeof *img);
+        int scr = DefaultScreen(s->dpy);
+        img->image = XShmCreateImage(s->dpy, DefaultVisual(s->dpy, scr),
+                                     DefaultDepth(s->dpy, scr), ZPixmap, NULL,
+                                     &img->info, s->tile->width,
+                                     s->tile->height);
+        if (img->image == NULL) {
+                free(img);
+                return NULL;
+        }
+        img->info.shmid = shmget(IPC_PRIVATE, (size_t) img->image->bytes_per_line * img->image->height, IPC_CREAT | 0600);
+        if (img->info.shmid == -1) {
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "shmget");
+                XDestroyImage(img->image);
+                free(img);
+                return NULL;
+        }
+        img->info.shmaddr = img->image->data = shmat(img->info.shmid, NULL, 0);
+        // mark for removal now, the segment is destroyed after last detach
+        shmctl(img->info.shmid, IPC_RMID, NULL);
+        if (img->info.shmaddr == (void *) -1) {
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "shmat");
+                img->image->data = NULL;
+                XDestroyImage(img->image);
+                free(img);
+                return NULL;
+        }
+        img->info.readOnly = False;
+
+        if (!probe) {
+                XShmAttach(s->dpy, &img->info);
+                return img;
+        }
+        XSync(s->dpy, False);
+        x_error = false;
+        int (*old_handler)(Display *, XErrorEvent *) = XSetErrorHandler(x_error_handler);
+        XShmAttach(s->dpy, &img->info);
+        XSync(s->dpy, False);
+        XSetErrorHandler(old_handler);
+        if (x_error) {
+                img->image->data = NULL;
+                XDestroyImage(img->image);
+                shmdt(img->info.shmaddr);
+                free(img);
+                return NULL;
+        }
+        return img;
+}
+
+static struct shm_image *get_shm_image(struct vidcap_screen_x11_state *s)
+{
+        pthread_mutex_lock(&s->lock);
+        struct shm_image *img = s->shm_pool;
+        if (img) {
+                s->shm_pool = img->next;
+        }
+        pthread_mutex_unlock(&s->lock);
+        return img ? img : create_shm_image(s, false);
+}
+#endif // HAVE_XSHM
+
+static void release_item(struct vidcap_screen_x11_state *s, struct grabbed_data *item)
+{
+        if (item->shm) {
+                pthread_mutex_lock(&s->lock);
+                item->shm->next = s->shm_pool;
+                s->shm_pool = item->shm;
+                pthread_mutex_unlock(&s->lock);
+        } else if (item->data) {
+                XDestroyImage(item->data);
+        }
+        free(item->rects);
+        free(item);
+}
+
+#ifdef HAVE_XDAMAGE
+static void init_damage(struct vidcap_screen_x11_state *s)
+{
+        int event_base = 0;
+        int error_base = 0;
+        int major = 2;
+        int minor = 0;
+        if (!XFixesQueryExtension(s->dpy, &event_base, &error_base) ||
+                        !XFixesQueryVersion(s->dpy, &major, &minor) ||
+                        !XDamageQueryExtension(s->dpy, &event_base, &error_base)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "XDamage not available, converting whole screen\n");
+                return;
+        }
+        s->damage = XDamageCreate(s->dpy, s->root, XDamageReportNonEmpty);
+        s->damage_region = XFixesCreateRegion(s->dpy, NULL, 0);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using XDamage\n");
+}
+
+static void add_rect(struct vidcap_screen_x11_state *s, struct grabbed_data *item, int x, int y, int w, int h)
+{
+        const int x0 = MAX(x, 0);
+        const int y0 = MAX(y, 0);
+        const int x1 = MIN(x + w, (int) s->tile->width);
+        const int y1 = MIN(y + h, (int) s->tile->height);
+        if (x0 >= x1 || y0 >= y1) {
+                return;
+        }
+        item->rects[item->rect_count++] = (XRectangle){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+/**
+ * Stores regions damaged since the last call and the cursor areas (if the
+ * cursor changed) to item->rects in viewport coordinates.
+ *
+ * @returns false if nothing has changed
+ */
+static bool get_damage(struct vidcap_screen_x11_state *s, struct grabbed_data *item, const XRectangle *cursor, bool cursor_changed)
+{
+        while (XPending(s->dpy) > 0) { // discard DamageNotify events
+                XEvent ev;
+                XNextEvent(s->dpy, &ev);
+        }
+        XDamageSubtract(s->dpy, s->damage, None, s->damage_region);
+        int count = 0;
+        XRectangle *damaged = XFixesFetchRegion(s->dpy, s->damage_region, &count);
+
+        item->rects = malloc((count + 2) * sizeof(XRectangle));
+        for (int i = 0; i < count; ++i) {
+                add_rect(s, item, damaged[i].x - s->x, damaged[i].y - s->y,
+                         damaged[i].width, damaged[i].height);
+        }
+        if (damaged) {
+                XFree(damaged);
+        }
+        if (cursor_changed) {
+                add_rect(s, item, s->cursor_rect.x, s->cursor_rect.y,
+                         s->cursor_rect.width, s->cursor_rect.height);
+                add_rect(s, item, cursor->x, cursor->y, cursor->width,
+                         cursor->height);
+        }
+        return item->rect_count > 0;
+}
+
+/// waits for a damage event at most one frame time
+static void wait_for_damage(struct vidcap_screen_x11_state *s)
+{
+        if (XPending(s->dpy) > 0) {
+                return;
+        }
+        struct pollfd pfd = { .fd = ConnectionNumber(s->dpy), .events = POLLIN };
+        poll(&pfd, 1, (int) (1000 / s->frame->fps));
+}
+#endif // HAVE_XDAMAGE
+
 static bool initialize(struct vidcap_screen_x11_state *s) {
         s->frame = vf_alloc(1);
         s->tile = vf_get_tile(s->frame, 0);
@@ -168,55 +380,131 @@ static bool initialize(struct vidcap_screen_x11_state *s) {
 
         s->tile->data = (char *) malloc(s->tile->data_len);
 
+#ifdef HAVE_XSHM
+        if (!s->no_shm) {
+                if (XShmQueryExtension(s->dpy)) {
+                        // try to create the first image to check that it works
+                        struct shm_image *img = create_shm_image(s, true);
+                        if (img) {
+                                s->shm_pool = img;
+                                s->use_shm = true;
+                        }
+                }
+                log_msg(s->use_shm ? LOG_LEVEL_VERBOSE : LOG_LEVEL_WARNING, MOD_NAME "%s\n",
+                                s->use_shm ? "Using MIT-SHM" : "MIT-SHM not available, using XGetImage");
+        }
+#endif // HAVE_XSHM
+#ifdef HAVE_XDAMAGE
+        if (!s->no_damage) {
+                init_damage(s);
+        }
+#endif // HAVE_XDAMAGE
+
         pthread_create(&s->worker_id, NULL, grab_thread, s);
 
         return true;
 }
 
 
+#ifdef HAVE_XFIXES
+static void blend_cursor(struct vidcap_screen_x11_state *s, XImage *image, const XFixesCursorImage *cursor, const XRectangle *pos)
+{
+        for(int y = MAX(0, -pos->y); y < cursor->height; ++y) {
+                if (pos->y + y >= (int) s->tile->height) {
+                        break;
+                }
+                uint32_t *image_data = (uint32_t *)(void *) (image->data + (size_t) (pos->y + y) * image->bytes_per_line);
+                for(int x = MAX(0, -pos->x); x < cursor->width; ++x) {
+                        if (pos->x + x >= (int) s->tile->width) {
+                                break;
+                        }
+                        uint_fast32_t cursor_pix = cursor->pixels[x + y * cursor->width];
+                        int alpha = cursor_pix >> 24 & 0xff;
+                        int r1 = cursor_pix >> 16 & 0xff,
+                            g1 = cursor_pix >> 8 & 0xff,
+                            b1 = cursor_pix >> 0 & 0xff;
+                        uint_fast32_t image_pix = image_data[pos->x + x];
+                        int r2 = image_pix >> 16 & 0xff,
+                            g2 = image_pix >> 8 & 0xff,
+                            b2 = image_pix >> 0 & 0xff;
+                        float scale_image = (float) (255 - alpha)/ 255;
+                        float scale_cursor = (float) alpha / 255;
+
+                        image_data[pos->x + x] =
+                                ((int) (r1 * scale_cursor + r2 * scale_image) & 0xff) << 16 |
+                                ((int) (g1 * scale_cursor + g2 * scale_image) & 0xff) << 8 |
+                                ((int) (b1 * scale_cursor + b2 * scale_image) & 0xff) << 0;
+                }
+        }
+}
+#endif // HAVE_XFIXES
+
+static XImage *grab_image(struct vidcap_screen_x11_state *s, struct shm_image **shm)
+{
+#ifdef HAVE_XSHM
+        if (s->use_shm) {
+                *shm = get_shm_image(s);
+                if (*shm != NULL && XShmGetImage(s->dpy, s->root, (*shm)->image, s->x, s->y, AllPlanes)) {
+                        return (*shm)->image;
+                }
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "XShmGetImage failed, using XGetImage\n");
+                if (*shm != NULL) {
+                        destroy_shm_image(s, *shm);
+                        *shm = NULL;
+                }
+                s->use_shm = false;
+        }
+#else
+        (void) shm;
+#endif // HAVE_XSHM
+        return XGetImage(s->dpy,s->root, s->x, s->y, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
+}
+
 static void *grab_thread(void *args)
 {
         struct vidcap_screen_x11_state *s = args;
+        bool first = true;
 
         while(!s->should_exit_worker) {
-                struct grabbed_data *new_item = malloc(sizeof(struct grabbed_data));
+                struct grabbed_data *new_item = calloc(1, sizeof(struct grabbed_data));
+                XRectangle cursor_rect = { 0 };
+                bool cursor_changed = false;
 
 #ifdef HAVE_XFIXES
                 XFixesCursorImage *cursor =
                         XFixesGetCursorImage (s->dpy);
+                if (cursor) {
+                        cursor_rect = (XRectangle){ cursor->x - cursor->xhot - s->x,
+                                cursor->y - cursor->yhot - s->y, cursor->width, cursor->height };
+                        cursor_changed = cursor->cursor_serial != s->cursor_serial ||
+                                cursor_rect.x != s->cursor_rect.x || cursor_rect.y != s->cursor_rect.y;
+                        s->cursor_serial = cursor->cursor_serial;
+                }
 #endif // HAVE_XFIXES
-                new_item->data = XGetImage(s->dpy,s->root, s->x, s->y, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
-                assert(new_item->data != NULL);
+
+                bool changed = true;
+#ifdef HAVE_XDAMAGE
+                if (s->damage != None && !first) {
+                        changed = get_damage(s, new_item, &cursor_rect, cursor_changed);
+                        if (!changed) { // frame repeated
+                                wait_for_damage(s);
+                        }
+                }
+#endif // HAVE_XDAMAGE
+                (void) cursor_changed, (void) first;
+                first = false;
+
+                if (changed) {
+                        new_item->data = grab_image(s, &new_item->shm);
+                        assert(new_item->data != NULL);
+                        s->cursor_rect = cursor_rect;
+                }
 
 #ifdef HAVE_XFIXES
                 if (cursor) {
-                        uint32_t *image_data = (uint32_t *)(void *) new_item->data->data;
-                        for(int x = 0; x < cursor->width; ++x) {
-                                for(int y = 0; y < cursor->height; ++y) {
-                                        if(cursor->x + x >= (int) s->tile->width ||
-                                                        cursor->y + y >= (int) s->tile->height)
-                                                continue;
-                                        //image_data[x + y * s->tile->width] = cursor->pixels[x + y * cursor->width];
-                                        uint_fast32_t cursor_pix = cursor->pixels[x + y * cursor->width];
-                                        ///fprintf(stderr, "%d %d\n", cursor->x + x, cursor->y + y);
-                                        int alpha = cursor_pix >> 24 & 0xff;
-                                        int r1 = cursor_pix >> 16 & 0xff,
-                                            g1 = cursor_pix >> 8 & 0xff,
-                                            b1 = cursor_pix >> 0 & 0xff;
-                                        uint_fast32_t image_pix = image_data[cursor->x + x + (cursor->y + y) * s->tile->width];
-                                        int r2 = image_pix >> 16 & 0xff,
-                                            g2 = image_pix >> 8 & 0xff,
-                                            b2 = image_pix >> 0 & 0xff;
-                                        float scale_image = (float) (255 - alpha)/ 255;
-                                        float scale_cursor = (float) alpha / 255;
-
-                                        image_data[cursor->x + x + (cursor->y + y) * s->tile->width] =
-                                                ((int) (r1 * scale_cursor + r2 * scale_image) & 0xff) << 16 |
-                                                ((int) (g1 * scale_cursor + g2 * scale_image) & 0xff) << 8 |
-                                                ((int) (b1 * scale_cursor + b2 * scale_image) & 0xff) << 0;
-                                }
+                        if (changed) {
+                                blend_cursor(s, new_item->data, cursor, &cursor_rect);
                         }
-
                         XFree(cursor);
                 }
 #endif // HAVE_XFIXES
@@ -295,6 +583,10 @@ static _Bool parse_fmt(struct vidcap_screen_x11_state *s, char *fmt) {
                         s->req_display = realloc(s->req_display, strlen(s->req_display) + 1 + strlen(tok) + 1);
                         strcat(s->req_display, ":");
                         strcat(s->req_display, tok);
+                } else if (strcmp(tok, "noshm") == 0) {
+                        s->no_shm = true;
+                } else if (strcmp(tok, "nodamage") == 0) {
+                        s->no_damage = true;
                 } else if (strstr(tok, "geometry=") == tok || strstr(tok, "size=") == tok) {
                         char *val = strchr(tok, '=') + 1;
                         s->width = atoi(val);
@@ -392,13 +684,28 @@ static void vidcap_screen_x11_done(void *state)
                 while(s->queue_len > 0) {
                         struct grabbed_data *item = s->head;
                         s->head = s->head->next;
-                        XDestroyImage(item->data);
-                        free(item);
                         s->queue_len -= 1;
+                        pthread_mutex_unlock(&s->lock);
+                        release_item(s, item);
+                        pthread_mutex_lock(&s->lock);
                 }
         }
         pthread_mutex_unlock(&s->lock);
 
+#ifdef HAVE_XSHM
+        while (s->shm_pool) {
+                struct shm_image *img = s->shm_pool;
+                s->shm_pool = img->next;
+                destroy_shm_image(s, img);
+        }
+#endif // HAVE_XSHM
+#ifdef HAVE_XDAMAGE
+        if (s->damage != None) {
+                XDamageDestroy(s->dpy, s->damage);
+                XFixesDestroyRegion(s->dpy, s->damage_region);
+        }
+#endif // HAVE_XDAMAGE
+
         if(s->tile)
                 free(s->tile->data);
 
@@ -407,6 +714,43 @@ static void vidcap_screen_x11_done(void *state)
         free(s);
 }
 
+struct convert_rects_data {
+        struct vidcap_screen_x11_state *s;
+        struct grabbed_data *item;
+};
+
+static void convert_rect_rows(int start_row, int end_row, void *udata)
+{
+        const struct convert_rects_data *d = udata;
+        const size_t dst_linesize = vc_get_linesize(d->s->tile->width, RGB);
+        for (int i = 0; i < d->item->rect_count; ++i) {
+                const XRectangle *r = &d->item->rects[i];
+                const int y0 = MAX(start_row, r->y);
+                const int y1 = MIN(end_row, r->y + r->height);
+                for (int y = y0; y < y1; ++y) {
+                        vc_copylineBGRAtoRGB((unsigned char *) d->s->tile->data + y * dst_linesize + r->x * 3,
+                                        (unsigned char *) d->item->data->data + (size_t) y * d->item->data->bytes_per_line + r->x * 4,
+                                        r->width * 3, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                }
+        }
+}
+
+/**
+ * Converts the changed regions of the item to the persistent frame.
+ * @returns changed area relative to the frame size
+ */
+static float convert_rects(struct vidcap_screen_x11_state *s, struct grabbed_data *item)
+{
+        struct convert_rects_data d = { s, item };
+        parallel_rows(s->tile->height, 1, convert_rect_rows, &d, s->cpu_count);
+
+        long long area = 0;
+        for (int i = 0; i < item->rect_count; ++i) {
+                area += item->rects[i].width * item->rects[i].height;
+        }
+        return MIN(1.0F, (float) area / (s->tile->width * s->tile->height));
+}
+
 static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_frame **audio)
 {
         struct vidcap_screen_x11_state *s = (struct vidcap_screen_x11_state *) state;
@@ -448,14 +792,28 @@ static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_fra
          * some configurations, but seems to work currently. To be corrected if there is an
          * opposite case.
          */
-        parallel_pix_conv(s->tile->height, s->tile->data,
-                          vc_get_linesize(s->tile->width, RGB),
-                          &item->data->data[0],
-                          vc_get_linesize(s->tile->width, RGBA),
-                          vc_copylineBGRAtoRGB, s->cpu_count);
+        float damaged_area = 1.0F;
+        if (item->data == NULL) {
+                damaged_area = 0.0F;
+        } else if (item->rects == NULL) {
+                parallel_pix_conv(s->tile->height, s->tile->data,
+                                  vc_get_linesize(s->tile->width, RGB),
+                                  &item->data->data[0],
+                                  item->data->bytes_per_line,
+                                  vc_copylineBGRAtoRGB, s->cpu_count);
+        } else {
+                damaged_area = convert_rects(s, item);
+        }
+        release_item(s, item);
 
-        XDestroyImage(item->data);
-        free(item);
+#ifdef HAVE_XDAMAGE
+        if (s->damage != None) {
+                s->frame->flags |= DAMAGE_VALID;
+                s->frame->damaged_area = damaged_area;
+        }
+#else
+        (void) damaged_area;
+#endif // HAVE_XDAMAGE
 
         if(s->fps > 0.0) {
                 struct timeval cur_time;
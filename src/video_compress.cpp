@@ -360,6 +360,16 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
 
         // sync APIs - pass poisoned pill to the queue but not to compressions,
         if (!frame) { // which doesn't need that but use NULL frame differently
+                // tile API - fetch frames buffered by the compression (end of
+                // stream is NULL frame after NULL returned, see compress_tile_t)
+                while (s->funcs->compress_tile_func) {
+                        shared_ptr<video_frame> out = compress_frame_tiles(proxy, {});
+                        if (!out) {
+                                break;
+                        }
+                        out->compress_end = get_time_in_ns();
+                        proxy->queue.push(out);
+                }
                 proxy->queue.push(shared_ptr<video_frame>());
                 return;
         }
@@ -439,30 +449,26 @@ static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy
         // frame pointer may no longer be valid
         frame = NULL;
 
-        vector<task_result_handle_t> task_handle(tile_cnt);
-
         vector <compress_worker_data> data_tile(tile_cnt);
         for (int i = 0; i < tile_cnt; ++i) {
                 struct compress_worker_data *data = &data_tile[i];
                 data->state = s->state[i];
                 data->frame = separate_tiles[i];
                 data->callback = s->funcs->compress_tile_func;
-
-                task_handle[i] = task_run_async(compress_tile_callback, data);
         }
+        // single tile is compressed in the calling thread
+        task_run_parallel(compress_tile_callback, tile_cnt, data_tile.data(),
+                          sizeof data_tile[0], nullptr);
 
         vector<shared_ptr<video_frame>> compressed_tiles(separate_tiles.size());
 
         bool failed = false;
         for(unsigned int i = 0; i < separate_tiles.size(); ++i) {
-                struct compress_worker_data *data = (struct compress_worker_data *)
-                        wait_task(task_handle[i]);
-
-                if(!data->ret) {
+                if(!data_tile[i].ret) {
                         failed = true;
                 }
 
-                compressed_tiles[i] = data->ret;
+                compressed_tiles[i] = data_tile[i].ret;
         }
 
         if (failed) {
@@ -126,7 +126,9 @@ typedef  std::shared_ptr<video_frame> (*compress_frame_t)(struct module *state,
  * 
  * @param[in]     state         driver internal state
  * @param[in]     in_frame      uncompressed frame containing exactly one tile;
- *                              empty shared_ptr to fetch remaining tiles
+ *                              empty shared_ptr to fetch remaining tiles, if
+ *                              passed when the previous call returned NULL,
+ *                              the stream has ended (output buffered frames)
  * @return                      compressed frame with one tile, may be NULL if compression failed or no compressed frame was output
  */
 typedef  std::shared_ptr<video_frame> (*compress_tile_t)(struct module *state, std::shared_ptr<video_frame> in_frame);
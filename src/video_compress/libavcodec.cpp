@@ -37,6 +37,7 @@
 
 #define __STDC_CONSTANT_MACROS
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cinttypes>
@@ -72,6 +73,7 @@
 #include "utils/misc.h"
 #include "utils/string.h" // replace_all
 #include "utils/text.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_compress.h"
 
@@ -99,6 +101,7 @@ using std::function;
 using std::list;
 using std::invalid_argument;
 using std::map;
+using std::max;
 using std::min;
 using std::regex;
 using std::set;
@@ -108,6 +111,7 @@ using std::stoi;
 using std::string;
 using std::thread;
 using std::to_string;
+using std::vector;
 using namespace std::string_literals;
 
 // NOLINTNEXTLINE(*-macro-usage): for correct TOSTRING expansion
@@ -124,6 +128,8 @@ enum {
 constexpr const codec_t DEFAULT_CODEC       = JPEG;
 constexpr const int     DEFAULT_GOP_SIZE    = 20;
 constexpr int           DEFAULT_SLICE_COUNT = 32;
+constexpr int           DEFAULT_PIPELINE_DEPTH = 2;
+constexpr int           MAX_PIPELINE_DEPTH = 8;
 
 constexpr const char *DEFAULT_AMF_RC        = "cqp";
 constexpr const char *DEFAULT_AMF_USAGE     = "ultralowlatency";
@@ -259,6 +265,15 @@ struct aux_header {
         size_t buf_len = 0;
 };
 
+/// pixel format conversion of a frame running concurrently with encoding
+struct conv_pipeline_slot {
+        struct to_lavc_vid_conv *conv = nullptr;
+        shared_ptr<video_frame> tx;
+        AVFrame *frame = nullptr; ///< conversion result
+        time_ns_t dur_ns = 0;
+        task_result_handle_t handle = nullptr; ///< non-null if in flight
+};
+
 struct state_video_compress_libav {
         state_video_compress_libav(struct module *parent) {
                 module_init_default(&module_data);
@@ -269,13 +284,27 @@ struct state_video_compress_libav {
         }
         ~state_video_compress_libav() {
                 av_packet_free(&pkt);
+                pipeline_destroy();
                 to_lavc_vid_conv_destroy(&pixfmt_conversion);
         }
+        void pipeline_destroy() {
+                for (unsigned i = 0; i < pipeline.size(); ++i) {
+                        if (pipeline[i].handle != nullptr) {
+                                wait_task(pipeline[i].handle);
+                        }
+                        if (i > 0) { // slot 0 uses pixfmt_conversion
+                                to_lavc_vid_conv_destroy(&pipeline[i].conv);
+                        }
+                }
+                pipeline.clear();
+                pipeline_submit_idx = pipeline_pending = 0;
+        }
 
         struct module       module_data;
 
         struct video_desc   saved_desc{};
         struct to_lavc_vid_conv *pixfmt_conversion = nullptr;
+        enum AVPixelFormat  conv_pix_fmt = AV_PIX_FMT_NONE; ///< output of pixfmt_conversion
         AVPacket           *pkt = av_packet_alloc();
         // for every core - parts of the above
         AVCodecContext     *codec_ctx = nullptr;
@@ -305,7 +334,17 @@ struct state_video_compress_libav {
 
         int conv_thread_count = clamp<unsigned int>(thread::hardware_concurrency(), 1, INT_MAX); ///< number of threads used for UG conversions
 
+        /// frames converted ahead of the encoder, 1 - conversion and encoding run serially
+        int pipeline_depth = 1;
+        vector<conv_pipeline_slot> pipeline; ///< ring, empty if not pipelined
+        unsigned pipeline_submit_idx = 0;
+        unsigned pipeline_pending = 0;
+        list<shared_ptr<video_frame>> drained; ///< output of pipeline_drain() to be returned
+        bool last_call_output = false; ///< last compress_tile returned a frame
+
         double    mov_avg_comp_duration = 0;
+        double    mov_avg_conv_duration = 0;
+        double    mov_avg_enc_duration  = 0;
         long      mov_avg_frames        = 0;
         time_ns_t duration_warn_last_print = 0;
         int64_t   max_pts_diff_reported    = 0;
@@ -400,7 +439,7 @@ void usage(bool full) {
                                "subsampling>][:depth=<depth>"
                                "][:rgb|:yuv][:gop=<gop>]\n\t\t"
                                "[:[disable_]intra_refresh][:threads=<threads>]["
-                               ":slices=<slices>][safe]\n\t\t[:<lavc_opt>=<val>]*")
+                               ":slices=<slices>][safe][:pipeline[=<n>]]\n\t\t[:<lavc_opt>=<val>]*")
               << "\n\t" << SBOLD(SRED("-c libavcodec") << ":[full]help") << "\n";
         col() << "\nwhere\n";
         col() << "\t" << SBOLD("<encoder>") << " specifies encoder (eg. nvenc or libx264 for H.264)\n";
@@ -424,6 +463,10 @@ void usage(bool full) {
         col() << "\t" << SBOLD("<gop>") << " specifies GOP size\n";
         col() << "\t" << SBOLD("<lavc_opt>") << " arbitrary option to be passed directly to libavcodec (eg. preset=veryfast), eventual colons must be backslash-escaped (eg. for x264opts)\n";
         col() << "\t" << SBOLD("safe") << " use opts for (HW) decode compatibility - 420, no intra refresh and interlacing\n";
+        col() << "\t" << SBOLD("pipeline[=<n>]")
+              << " convert pixel format of up to <n> frames concurrently with "
+                 "encoding (default "
+              << DEFAULT_PIPELINE_DEPTH << "), adds " << "<n>-1 frames latency\n";
         if (full) {
                 col() << "\t" << SBOLD("header_inserter[=no]")
                       << " repeat H.264/HEVC VPS/SPS/PPS hdrs (fixes problems "
@@ -596,6 +639,18 @@ parse_fmt(struct state_video_compress_libav *s, char *fmt) noexcept(false)
                 } else if (strstr(item, "header_inserter") == item) {
                         s->params.header_inserter_req =
                             strstr(item, "=no") == nullptr ? 1 : 0;
+                } else if (strcmp(item, "pipeline") == 0 ||
+                           strstr(item, "pipeline=") == item) {
+                        s->pipeline_depth = DEFAULT_PIPELINE_DEPTH;
+                        if (strchr(item, '=') != nullptr) {
+                                s->pipeline_depth = stoi(strchr(item, '=') + 1);
+                        }
+                        if (s->pipeline_depth < 1 ||
+                            s->pipeline_depth > MAX_PIPELINE_DEPTH) {
+                                MSG(ERROR, "Pipeline depth must be 1-%d!\n",
+                                    MAX_PIPELINE_DEPTH);
+                                return -1;
+                        }
                 } else if (strcmp(item, "safe") == 0) {
                         s->params.periodic_intra     = 0;
                         s->params.periodic_intra     = 0;
@@ -1081,6 +1136,7 @@ static bool configure_swscale(struct state_video_compress_libav *s, struct video
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Failed to get sws input conversion.\n"); // shouldn't happen normally, but user may choose imposible codec
                 return false;
         }
+        s->conv_pix_fmt = sws_in_format;
 
         s->sws_ctx = getSwsContext(desc.width,
                         desc.height,
@@ -1153,6 +1209,32 @@ try_open_remaining_pixfmts(state_video_compress_libav *s, video_desc desc,
         return AV_PIX_FMT_NONE;
 }
 
+/**
+ * Creates conversion states for the frames converted ahead. Every slot needs
+ * its own because the converted AVFrame is owned by the conversion.
+ */
+static bool configure_pipeline(struct state_video_compress_libav *s, struct video_desc desc)
+{
+        s->pipeline_destroy();
+        if (s->pipeline_depth == 1) {
+                return true;
+        }
+        s->pipeline.resize(s->pipeline_depth);
+        s->pipeline[0].conv = s->pixfmt_conversion;
+        for (unsigned i = 1; i < s->pipeline.size(); ++i) {
+                s->pipeline[i].conv = to_lavc_vid_conv_init(
+                    desc.color_spec, desc.width, desc.height, s->conv_pix_fmt,
+                    s->conv_thread_count);
+                if (s->pipeline[i].conv == nullptr) {
+                        s->pipeline_destroy();
+                        return false;
+                }
+        }
+        MSG(VERBOSE, "Pipelining pixel format conversion of %d frames.\n",
+            s->pipeline_depth);
+        return true;
+}
+
 static bool configure_with(struct state_video_compress_libav *s, struct video_desc desc)
 {
         s->saved_desc = {};
@@ -1223,14 +1305,21 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         s->compressed_desc = desc;
         s->compressed_desc.color_spec = ug_codec;
         s->compressed_desc.tile_count = 1;
-        s->mov_avg_frames = s->mov_avg_comp_duration = 0;
+        s->mov_avg_frames = 0;
+        s->mov_avg_comp_duration = s->mov_avg_conv_duration =
+            s->mov_avg_enc_duration = 0;
 
+        s->pipeline_destroy(); // references pixfmt_conversion
         to_lavc_vid_conv_destroy(&s->pixfmt_conversion);
+        s->conv_pix_fmt = pix_fmt;
         if ((s->pixfmt_conversion = to_lavc_vid_conv_init(desc.color_spec, desc.width, desc.height, pix_fmt, s->conv_thread_count)) == nullptr) {
                 if (!configure_swscale(s, desc, pix_fmt)) {
                         return false;
                 }
         }
+        if (!configure_pipeline(s, desc)) {
+                return false;
+        }
 
         // we need to store extradata for HuffYUV/FFV1 in the beginning
         if (libav_codec_has_extradata(ug_codec)) {
@@ -1248,13 +1337,30 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         return true;
 }
 
-/// print hint to improve performance if not making it
-static void check_duration(struct state_video_compress_libav *s, time_ns_t dur_pixfmt_change_ns, time_ns_t dur_total_ns)
+/**
+ * print hint to improve performance if not making it
+ *
+ * If pipelined, the conversion runs concurrently with encoding so the
+ * throughput is limited by the slower of the stages, not by their sum.
+ */
+static void check_duration(struct state_video_compress_libav *s, time_ns_t dur_pixfmt_change_ns, time_ns_t dur_encode_ns)
 {
         enum { REPEAT_INT_SEC = 30 };
         constexpr int mov_window = 100;
+        const bool pipelined = !s->pipeline.empty();
+        const time_ns_t dur_total_ns =
+            pipelined ? max(dur_pixfmt_change_ns, dur_encode_ns)
+                      : dur_pixfmt_change_ns + dur_encode_ns;
         double duration = dur_total_ns / NS_IN_SEC_DBL;
         s->mov_avg_comp_duration = (s->mov_avg_comp_duration * (mov_window - 1) + duration) / mov_window;
+        s->mov_avg_conv_duration =
+            (s->mov_avg_conv_duration * (mov_window - 1) +
+             dur_pixfmt_change_ns / NS_IN_SEC_DBL) /
+            mov_window;
+        s->mov_avg_enc_duration =
+            (s->mov_avg_enc_duration * (mov_window - 1) +
+             dur_encode_ns / NS_IN_SEC_DBL) /
+            mov_window;
         s->mov_avg_frames += 1;
         if (s->mov_avg_frames < 2 * mov_window || s->mov_avg_comp_duration < 1 / s->compressed_desc.fps) {
                 return;
@@ -1266,6 +1372,11 @@ static void check_duration(struct state_video_compress_libav *s, time_ns_t dur_p
         s->duration_warn_last_print = now;
         log_msg(LOG_LEVEL_WARNING, MOD_NAME "Average compression time of last %d frames is %f ms but time per frame is only %f ms!\n",
                         mov_window, s->mov_avg_comp_duration * 1000, 1000 / s->compressed_desc.fps);
+        log_msg(LOG_LEVEL_WARNING,
+                MOD_NAME "Stages: pixfmt conversion %f ms, encoding %f ms (%s).\n",
+                s->mov_avg_conv_duration * 1000,
+                s->mov_avg_enc_duration * 1000,
+                pipelined ? "pipelined" : "serial");
         string hint;
         string quality_hurt = "latency";
         if (regex_match(s->codec_ctx->codec->name, regex(".*nvenc.*"))) {
@@ -1295,6 +1406,11 @@ static void check_duration(struct state_video_compress_libav *s, time_ns_t dur_p
 
         bool src_rgb = codec_is_a_rgb(s->saved_desc.color_spec);
         bool dst_rgb = av_pix_fmt_desc_get(s->codec_ctx->pix_fmt)->flags & AV_PIX_FMT_FLAG_RGB;
+        if (!pipelined && s->mov_avg_conv_duration > s->mov_avg_comp_duration / 4) {
+                MSG(WARNING, "Consider adding \"pipeline\" option to "
+                             "overlap pixfmt conversion with encoding at "
+                             "the expense of latency.\n");
+        }
         if (src_rgb != dst_rgb && dur_pixfmt_change_ns / NS_IN_SEC_DBL > s->mov_avg_comp_duration / 4) {
                 LOG(LOG_LEVEL_WARNING)
                     << MOD_NAME "Also pixfmt change of last frame took "
@@ -1465,32 +1581,50 @@ receive_packet(state_video_compress_libav *s)
         return out_vf_from_pkt(s, s->pkt);
 }
 
-static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
+static void *pipeline_conv_task(void *arg)
 {
-        auto *s = (state_video_compress_libav *) mod->priv_data;
-        list<shared_ptr<void>> cleanup_callbacks; // at function exit handlers
-
-        libavcodec_check_messages(s);
-
-        if (tx && !video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
-                                            s->saved_desc, PARAM_TILE_COUNT)) {
-                cleanup(s);
-                if (!configure_with(s, video_desc_from_frame(tx.get()))) {
-                        return {};
-                }
-        }
-
-        if (!tx) { // reading further encoded frames
-                return receive_packet(s);
-        }
+        auto *slot = (struct conv_pipeline_slot *) arg;
+        const time_ns_t t0 = get_time_in_ns();
+        slot->frame = to_lavc_vid_conv(slot->conv, slot->tx->tiles[0].data);
+        slot->dur_ns = get_time_in_ns() - t0;
+        return slot;
+}
 
-        time_ns_t t0 = get_time_in_ns();
-        struct AVFrame *frame = to_lavc_vid_conv(s->pixfmt_conversion, tx->tiles[0].data);
-        if (!frame) {
-                return {};
-        }
-        time_ns_t t1 = get_time_in_ns();
+/**
+ * Passes tx for conversion and, if the ring is full, returns the oldest
+ * converted frame (waiting for its conversion to finish if needed).
+ *
+ * @param[out] src      frame the returned AVFrame was converted from
+ * @param[out] dur_ns   duration of the conversion of the returned frame
+ * @returns converted frame, nullptr if nothing to encode yet or on failure
+ */
+static AVFrame *pipeline_push(struct state_video_compress_libav *s,
+                              shared_ptr<video_frame> tx,
+                              shared_ptr<video_frame> *src, time_ns_t *dur_ns)
+{
+        const unsigned depth = s->pipeline.size();
+        struct conv_pipeline_slot *slot = &s->pipeline[s->pipeline_submit_idx];
+        assert(slot->handle == nullptr);
+        slot->tx = std::move(tx);
+        slot->handle = task_run_async(pipeline_conv_task, slot);
+        s->pipeline_submit_idx = (s->pipeline_submit_idx + 1) % depth;
+        if (++s->pipeline_pending < depth) {
+                return nullptr;
+        }
+
+        // oldest slot is the one following the just submitted
+        slot = &s->pipeline[s->pipeline_submit_idx];
+        wait_task(slot->handle);
+        slot->handle = nullptr;
+        s->pipeline_pending -= 1;
+        *src = std::move(slot->tx);
+        *dur_ns = slot->dur_ns;
+        return slot->frame;
+}
 
+/// hw upload or software scaling of the converted frame (if used)
+static AVFrame *prepare_frame(struct state_video_compress_libav *s, AVFrame *frame)
+{
         debug_file_dump("lavc-avframe", serialize_video_avframe, frame);
 #ifdef HWACC_VAAPI
         if(s->hwenc){
@@ -1511,6 +1645,100 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
                 frame = s->sws_frame;
         }
 #endif //HAVE_SWSCALE
+        return frame;
+}
+
+/**
+ * Encodes the frames left in the pipeline and flushes the encoder, the
+ * output is stored to s->drained. The codec context needs to be reopened
+ * afterwards (cleanup() + configure_with()).
+ */
+static void pipeline_drain(struct state_video_compress_libav *s)
+{
+        const unsigned depth = s->pipeline.size();
+        for (; s->pipeline_pending > 0; s->pipeline_pending -= 1) {
+                struct conv_pipeline_slot *slot =
+                    &s->pipeline[(s->pipeline_submit_idx + depth -
+                                  s->pipeline_pending) % depth];
+                wait_task(slot->handle);
+                slot->handle = nullptr;
+                const shared_ptr<video_frame> tx = std::move(slot->tx);
+                if (slot->frame == nullptr) {
+                        continue;
+                }
+                AVFrame *frame = prepare_frame(s, slot->frame);
+                frame->pts = s->cur_pts++;
+                store_metadata(s, tx.get(), frame->pts);
+                if (int ret = avcodec_send_frame(s->codec_ctx, frame)) {
+                        print_libav_error(LOG_LEVEL_WARNING, "[lavc] Error encoding frame", ret);
+                }
+        }
+        if (int ret = avcodec_send_frame(s->codec_ctx, nullptr)) {
+                print_libav_error(LOG_LEVEL_WARNING, MOD_NAME "Cannot flush encoder", ret);
+                return;
+        }
+        while (avcodec_receive_packet(s->codec_ctx, s->pkt) == 0) {
+                shared_ptr<video_frame> out = out_vf_from_pkt(s, s->pkt);
+                if (!out) {
+                        continue;
+                }
+                if (s->store_orig_format) {
+                        write_orig_format(out.get(), s->saved_desc.color_spec);
+                }
+                s->drained.push_back(std::move(out));
+        }
+        MSG(VERBOSE, "Drained %zu frames from the pipeline.\n", s->drained.size());
+}
+
+static shared_ptr<video_frame> compress_tile(struct state_video_compress_libav *s, shared_ptr<video_frame> tx)
+{
+        list<shared_ptr<void>> cleanup_callbacks; // at function exit handlers
+
+        libavcodec_check_messages(s);
+
+        if (tx && !video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
+                                            s->saved_desc, PARAM_TILE_COUNT)) {
+                if (s->pipeline_pending > 0) {
+                        pipeline_drain(s);
+                }
+                cleanup(s);
+                if (!configure_with(s, video_desc_from_frame(tx.get()))) {
+                        s->drained.clear();
+                        return {};
+                }
+        }
+
+        if (!tx) { // reading further encoded frames
+                if (s->pipeline_pending > 0 && !s->last_call_output) {
+                        // called again after returning nothing - end of
+                        // stream (see compress_tile_t)
+                        pipeline_drain(s);
+                        cleanup(s);
+                        s->saved_desc = {};
+                }
+                return s->codec_ctx != nullptr ? receive_packet(s)
+                                               : shared_ptr<video_frame>();
+        }
+
+        time_ns_t t0 = get_time_in_ns();
+        time_ns_t dur_pixfmt_change_ns = 0;
+        struct AVFrame *frame = nullptr;
+        if (s->pipeline.empty()) {
+                frame = to_lavc_vid_conv(s->pixfmt_conversion, tx->tiles[0].data);
+                dur_pixfmt_change_ns = get_time_in_ns() - t0;
+        } else { // encode previously converted frame, tx is being converted meanwhile
+                shared_ptr<video_frame> src;
+                frame = pipeline_push(s, std::move(tx), &src, &dur_pixfmt_change_ns);
+                tx = std::move(src);
+                if (!tx) { // pipeline not yet filled
+                        return receive_packet(s);
+                }
+        }
+        if (!frame) {
+                return {};
+        }
+        time_ns_t t1 = get_time_in_ns();
+        frame = prepare_frame(s, frame);
         time_ns_t t2 = get_time_in_ns();
 
         /* encode the image */
@@ -1524,10 +1752,10 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
         shared_ptr<video_frame> out = receive_packet(s);
         time_ns_t t3 = get_time_in_ns();
         LOG(LOG_LEVEL_DEBUG2) << MOD_NAME << "duration pixfmt change: "
-                << (t1 - t0) / NS_IN_SEC_DBL <<
+                << dur_pixfmt_change_ns / NS_IN_SEC_DBL <<
                 " s, dump+swscale " << (t2 - t1) / (double) NS_IN_SEC <<
                 " s, compression " << (t3 - t2) / (double) NS_IN_SEC << " s\n";
-        check_duration(s, t1 - t0, t3 - t0);
+        check_duration(s, dur_pixfmt_change_ns, t3 - t1);
 
         if (!out) {
                 return {};
@@ -1540,11 +1768,36 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
         return out;
 }
 
+static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
+{
+        auto *s = (state_video_compress_libav *) mod->priv_data;
+        shared_ptr<video_frame> out = compress_tile(s, std::move(tx));
+        if (!s->drained.empty()) { // drained frames precede the current
+                if (out) {
+                        s->drained.push_back(std::move(out));
+                }
+                out = std::move(s->drained.front());
+                s->drained.pop_front();
+        }
+        s->last_call_output = out != nullptr;
+        return out;
+}
+
 static void cleanup(struct state_video_compress_libav *s)
 {
+        // frames being converted ahead are dropped (unless pipeline_drain())
+        for (auto &slot : s->pipeline) {
+                if (slot.handle != nullptr) {
+                        wait_task(slot.handle);
+                        slot.handle = nullptr;
+                }
+                slot.tx = nullptr;
+        }
+        s->pipeline_submit_idx = s->pipeline_pending = 0;
+
         if(s->codec_ctx) {
 		int ret = avcodec_send_frame(s->codec_ctx, NULL);
-		if (ret != 0) {
+		if (ret != 0 && ret != AVERROR_EOF) { // EOF - already drained
 			log_msg(LOG_LEVEL_WARNING, "[lavc] Unexpected return value %d\n",
 					ret);
 		}
@@ -37,6 +37,7 @@
  */
 
 #include <condition_variable>
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <map>
@@ -45,6 +46,7 @@
 #include <queue>
 #include <thread>
 #include <string_view>
+#include <vector>
 
 #include "config.h"    // for HAVE_OPENCV2_OPENCV_HPP
 #include "debug.h"
@@ -53,7 +55,9 @@
 #include "module.h"
 #include "utils/color_out.h"
 #include "utils/misc.h"
+#include "utils/parallel_conv.h"
 #include "utils/string_view_utils.hpp"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_codec.h"
 #include "video_display.h"
@@ -87,6 +91,7 @@ struct Participant{
         void to_cv_frame();
         void frame_recieved(unique_frame &&f);
         void set_pos_keep_aspect(int x, int y, int w, int h);
+        void draw(cv::Mat& mixed_luma, cv::Mat& mixed_chroma);
 
         unique_frame frame;
         clock::time_point last_time_recieved;
@@ -97,6 +102,12 @@ struct Participant{
         unsigned y = 0;
         unsigned width = 0;
         unsigned height = 0;
+        bool visible = false; ///< placed by the current layout
+
+        /* Scaled tile is cached directly in the mixer canvas, it needs to
+         * be redrawn only if there is a new frame or the tile moved. */
+        bool new_frame = false;
+        bool redraw = false;
 
         cv::Mat luma;
         cv::Mat chroma;
@@ -108,6 +119,8 @@ void Participant::frame_recieved(unique_frame &&f){
 
         src_w = frame->tiles[0].width;
         src_h = frame->tiles[0].height;
+        new_frame = true;
+        redraw = true;
 }
 
 void Participant::set_pos_keep_aspect(int x, int y, int w, int h){
@@ -126,6 +139,8 @@ void Participant::set_pos_keep_aspect(int x, int y, int w, int h){
 
         this->x = x;
         this->y = y;
+        visible = true;
+        redraw = true;
 }
 
 void Participant::to_cv_frame(){
@@ -183,6 +198,86 @@ void Participant::to_cv_frame(){
         }
 }
 
+/**
+ * Scales the participant to its place in the canvas. Participants occupy
+ * disjoint rectangles so this may be called for more of them in parallel.
+ */
+void Participant::draw(cv::Mat& mixed_luma, cv::Mat& mixed_chroma){
+        if(new_frame){
+                to_cv_frame();
+                new_frame = false;
+        }
+        redraw = false;
+        if(width == 0 || height == 0)
+                return;
+
+        cv::Size l_size(width, height);
+        cv::Size c_size(width / 2, height);
+        cv::resize(luma, mixed_luma(cv::Rect(x, y, width, height)), l_size, 0, 0);
+        cv::resize(chroma, mixed_chroma(cv::Rect(x / 2, y, width / 2, height)), c_size, 0, 0);
+}
+
+struct draw_data{
+        std::vector<Participant *> participants;
+        cv::Mat *mixed_luma;
+        cv::Mat *mixed_chroma;
+};
+
+void draw_participants(size_t start, size_t end, void *udata){
+        auto *d = static_cast<draw_data *>(udata);
+        for(size_t i = start; i < end; i++){
+                d->participants[i]->draw(*d->mixed_luma, *d->mixed_chroma);
+        }
+}
+
+struct pack_data{
+        unsigned char *dst;
+        size_t dst_linesize;
+        const cv::Mat *mixed_luma;
+        const cv::Mat *mixed_chroma;
+};
+
+void pack_uyvy(int start_row, int end_row, void *udata){
+        auto *d = static_cast<pack_data *>(udata);
+        unsigned char *dst = d->dst + (size_t) start_row * d->dst_linesize;
+        const unsigned char *chroma_src = d->mixed_chroma->ptr(start_row);
+        const unsigned char *luma_src = d->mixed_luma->ptr(start_row);
+        size_t dst_len = (size_t) (end_row - start_row) * d->dst_linesize;
+
+#ifdef __SSSE3__
+        __m128i y_shuff = _mm_set_epi8(7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0, -1);
+        __m128i uv_shuff = _mm_set_epi8(-1, 7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0);
+        while(dst_len >= 32){
+               __m128i luma = _mm_loadu_si128((__m128i const*)(const void *) luma_src);
+               luma_src += 16;
+               __m128i chroma = _mm_loadu_si128((__m128i const*)(const void *) chroma_src);
+               chroma_src += 16;
+
+               __m128i res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
+               _mm_storeu_si128((__m128i *)(void *) dst, res);
+               dst += 16;
+
+               luma = _mm_bsrli_si128(luma, 8);
+               chroma = _mm_bsrli_si128(chroma, 8);
+
+               res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
+               _mm_storeu_si128((__m128i *)(void *) dst, res);
+               dst += 16;
+
+               dst_len -= 32;
+        }
+#endif
+
+        while(dst_len >= 4){
+                *dst++ = *chroma_src++;
+                *dst++ = *luma_src++;
+                *dst++ = *chroma_src++;
+                *dst++ = *luma_src++;
+
+                dst_len -= 4;
+        }
+}
+
 class Video_mixer{
 public:
         enum class Layout{ Invalid, Tiled, One_big };
@@ -254,7 +349,7 @@ void Video_mixer::one_big_layout(){
                         continue;
                 }
 
-                if(pos * tile_width > width)
+                if((pos + 1) * tile_width > width)
                         continue;
 
                 t.set_pos_keep_aspect(pos * tile_width, big_height, tile_width, small_height);
@@ -266,6 +361,11 @@ void Video_mixer::recompute_layout(){
         mixed_luma.setTo(16);
         mixed_chroma.setTo(128);
 
+        for(auto& [ssrc, p] : participants){
+                (void) ssrc;
+                p.visible = false;
+        }
+
         if(!primary_ssrc && !participants.empty()){
                 primary_ssrc = participants.begin()->first;
         }
@@ -319,57 +419,22 @@ void Video_mixer::get_mixed(video_frame *result){
         if(recompute)
                 recompute_layout();
 
+        draw_data draw{{}, &mixed_luma, &mixed_chroma};
         for(auto&& [ssrc, p] : participants){
                 (void) ssrc;
-                p.to_cv_frame();
-
-                PROFILE_DETAIL("resize participant");
-                cv::Size l_size(p.width, p.height);
-                cv::Size c_size(p.width / 2, p.height);
-                cv::resize(p.luma, mixed_luma(cv::Rect(p.x, p.y, p.width, p.height)), l_size, 0, 0);
-                cv::resize(p.chroma, mixed_chroma(cv::Rect(p.x / 2, p.y, p.width / 2, p.height)), c_size, 0, 0);
-                PROFILE_DETAIL("");
+                if(p.frame && p.visible && p.redraw)
+                        draw.participants.push_back(&p);
         }
 
-        unsigned char *dst = reinterpret_cast<unsigned char *>(result->tiles[0].data);
-        unsigned char *chroma_src = mixed_chroma.ptr(0);
-        unsigned char *luma_src = mixed_luma.ptr(0);
+        PROFILE_DETAIL("resize participants");
+        task_parallel_for(draw.participants.size(), 1, draw_participants, &draw);
+
         assert(mixed_luma.isContinuous() && mixed_chroma.isContinuous());
         PROFILE_DETAIL("Convert to ug frame");
-        unsigned dst_len = result->tiles[0].data_len;
-
-#ifdef __SSSE3__
-        __m128i y_shuff = _mm_set_epi8(7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0, -1);
-        __m128i uv_shuff = _mm_set_epi8(-1, 7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0);
-        while(dst_len >= 32){
-               __m128i luma = _mm_load_si128((__m128i const*)(const void *) luma_src); 
-               luma_src += 16;
-               __m128i chroma = _mm_load_si128((__m128i const*)(const void *) chroma_src); 
-               chroma_src += 16;
-
-               __m128i res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
-               _mm_storeu_si128((__m128i *)(void *) dst, res);
-               dst += 16;
-
-               luma = _mm_bsrli_si128(luma, 8);
-               chroma = _mm_bsrli_si128(chroma, 8);
-
-               res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
-               _mm_storeu_si128((__m128i *)(void *) dst, res);
-               dst += 16;
-
-               dst_len -= 32;
-        }
-#endif
-
-        while(dst_len >= 4){
-                *dst++ = *chroma_src++;
-                *dst++ = *luma_src++;
-                *dst++ = *chroma_src++;
-                *dst++ = *luma_src++;
-
-                dst_len -= 4;
-        }
+        pack_data pack{reinterpret_cast<unsigned char *>(result->tiles[0].data),
+                2 * width, &mixed_luma, &mixed_chroma};
+        parallel_rows(std::min<unsigned>(height, result->tiles[0].data_len / pack.dst_linesize),
+                        1, pack_uyvy, &pack, 0);
 }
 
 std::vector<uint32_t> Video_mixer::get_participant_ssrc_list() const{
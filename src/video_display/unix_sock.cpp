@@ -97,7 +97,6 @@ struct state_unix_sock {
         struct video_desc desc;
         struct video_desc display_desc;
 
-        Ipc_frame_uniq ipc_frame;
         Ipc_frame_writer_uniq frame_writer;
 
         int target_width = -1;
@@ -173,7 +172,6 @@ static void *display_unix_sock_init(struct module *parent,
         }
 
         s->parent = parent;
-        s->ipc_frame.reset(ipc_frame_new());
         s->frame_writer.reset(ipc_frame_writer_new(socket_path.c_str()));
         if(!s->frame_writer){
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to init ipc writer for path %s\n", socket_path.c_str());
@@ -214,7 +212,13 @@ static void display_unix_sock_run(void *state)
                 int scale = ipc_frame_get_scale_factor(tile->width, tile->height,
                                 s->target_width, s->target_height);
 
-                if(!s->ipc_conv(s->ipc_frame.get(), frame.get(),
+                /* Converted frame (plus possible tmp space for scaling)
+                 * is placed directly to the shared memory if the reader
+                 * supports it, size is upper bound for the unscaled case */
+                size_t max_size = vc_get_datalen(tile->width, tile->height, frame->color_spec)
+                        + vc_get_datalen(tile->width, tile->height, RGB);
+                Ipc_frame *ipc_frame = ipc_frame_writer_acquire(s->frame_writer.get(), max_size);
+                if(!ipc_frame || !s->ipc_conv(ipc_frame, frame.get(),
                                         RGB, scale))
                 {
                         log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unable to convert\n");
@@ -222,7 +226,7 @@ static void display_unix_sock_run(void *state)
                 }
 
                 errno = 0;
-                if(!ipc_frame_writer_write(s->frame_writer.get(), s->ipc_frame.get())){
+                if(!ipc_frame_writer_write(s->frame_writer.get(), ipc_frame)){
                         perror(MOD_NAME "Unable to send frame");
                         continue;
                 }
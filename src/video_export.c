@@ -35,21 +35,31 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
 #include <assert.h>                     // for assert
 #include <compat/platform_semaphore.h>
+#include <fcntl.h>                      // for open, O_CREAT, O_DIRECT...
 #include <pthread.h>
 #include <stdint.h>                     // for uint32_t
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>                     // for memcpy, memset, strdup
+#include <unistd.h>                     // for close, ftruncate, write
 
+#include "debug.h"
 #include "types.h"                      // for tile, video_frame, video_desc
 #include "utils/fs.h"                   // for MAX_PATH_SIZE
+#include "utils/macros.h"               // for DIV_ROUNDED_UP
+#include "utils/misc.h"                 // for ug_strerror
 #include "video_codec.h"
 #include "video_export.h"
 #include "video_frame.h"                // for video_desc_from_frame, video_...
 
 #define MAX_QUEUE_SIZE 300
+#define MOD_NAME "[Video export] "
 
 /*
  * we do not need to have possible stalls, so IO is performend in a separate thread
@@ -58,15 +68,23 @@ static void *video_export_thread(void *arg);
 void output_summary(struct video_export *s);
 
 struct output_entry {
-        char *filename;
-        char *data;
+        char *filename; ///< NULL for segmented export
+        char *data;     ///< aligned to VIDEO_EXPORT_SEGMENT_ALIGN
         int data_len;
+        int tile_idx;
 
         struct output_entry *next;
 };
 
 struct video_export {
         char *path;
+        size_t segment_size; ///< 0 - file per frame
+
+        // segmented export, used by the export thread only
+        int segment_fd;
+        FILE *segment_index;
+        uint64_t segment_offset;
+        int segments; ///< number of created segments
 
         uint32_t total;
 
@@ -81,6 +99,110 @@ struct video_export {
         pthread_t thread_id;
 };
 
+static void close_segment(struct video_export *s)
+{
+        if (s->segment_fd == -1) {
+                return;
+        }
+        // drop the unused preallocated space
+        if (ftruncate(s->segment_fd, s->segment_offset) != 0) {
+                perror(MOD_NAME "ftruncate");
+        }
+        close(s->segment_fd);
+        fclose(s->segment_index);
+        s->segment_fd = -1;
+        s->segment_index = NULL;
+}
+
+static bool open_segment(struct video_export *s)
+{
+        char name[MAX_PATH_SIZE];
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_SEGMENT_NAME, s->path,
+                 s->segments);
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef _WIN32
+        flags |= O_BINARY;
+#endif
+#ifdef O_DIRECT
+        s->segment_fd = open(name, flags | O_DIRECT, 0666);
+#endif
+        if (s->segment_fd == -1) { // O_DIRECT not available (eg. tmpfs)
+                s->segment_fd = open(name, flags, 0666);
+        }
+        if (s->segment_fd == -1) {
+                perror(MOD_NAME "open");
+                return false;
+        }
+#ifdef __linux__
+        int rc = posix_fallocate(s->segment_fd, 0, s->segment_size);
+        if (rc != 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot preallocate segment: %s\n", ug_strerror(rc));
+        }
+#endif
+
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_INDEX_NAME, s->path,
+                 s->segments);
+        s->segment_index = fopen(name, "wb");
+        if (s->segment_index == NULL) {
+                perror(MOD_NAME "fopen");
+                close(s->segment_fd);
+                s->segment_fd = -1;
+                return false;
+        }
+        s->segment_offset = 0;
+        s->segments += 1;
+        return true;
+}
+
+/**
+ * Appends the tile to the current segment. Data length is padded to the
+ * alignment so that O_DIRECT can be used.
+ */
+static void write_segment_entry(struct video_export *s, struct output_entry *entry)
+{
+        const size_t len = DIV_ROUNDED_UP((size_t) entry->data_len, VIDEO_EXPORT_SEGMENT_ALIGN) * VIDEO_EXPORT_SEGMENT_ALIGN;
+        // start a new segment only with a new frame
+        if (s->segment_fd != -1 && entry->tile_idx == 0 &&
+            s->segment_offset > 0 && s->segment_offset + len > s->segment_size) {
+                close_segment(s);
+        }
+        if (s->segment_fd == -1 && !open_segment(s)) {
+                return;
+        }
+
+        size_t written = 0;
+        while (written < len) {
+                ssize_t ret = write(s->segment_fd, entry->data + written, len - written);
+                if (ret <= 0) {
+                        perror(MOD_NAME "write");
+                        // drop the partially written tile (truncated to
+                        // segment_offset), the next tile opens a new segment
+                        close_segment(s);
+                        return;
+                }
+                written += ret;
+        }
+        struct video_export_index_entry idx = { s->segment_offset,
+                entry->data_len, entry->tile_idx, 0 };
+        if (fwrite(&idx, sizeof idx, 1, s->segment_index) != 1) {
+                perror(MOD_NAME "fwrite");
+        }
+        s->segment_offset += len;
+}
+
+static void write_file_entry(struct output_entry *entry)
+{
+        FILE *out = fopen(entry->filename, "wb");
+        if (out == NULL) {
+                perror("fopen");
+        } else {
+                if (fwrite(entry->data, entry->data_len, 1, out) != 1) {
+                        perror("fwrite");
+                }
+                fclose(out);
+        }
+}
+
 static void *video_export_thread(void *arg)
 {
         struct video_export *s = (struct video_export *) arg;
@@ -102,19 +224,17 @@ static void *video_export_thread(void *arg)
 
                 // poison
                 if(current->data == NULL) {
+                        free(current);
+                        close_segment(s);
                         return NULL;
                 }
 
-                FILE *out = fopen(current->filename, "wb");
-                if (out == NULL) {
-                        perror("fopen");
+                if (s->segment_size != 0) {
+                        write_segment_entry(s, current);
                 } else {
-                        if (fwrite(current->data, current->data_len, 1, out) != 1) {
-                                perror("fwrite");
-                        }
-                        fclose(out);
+                        write_file_entry(current);
                 }
-                free(current->data);
+                aligned_free(current->data);
                 free(current->filename);
                 free(current);
         }
@@ -122,7 +242,7 @@ static void *video_export_thread(void *arg)
         // never get here
 }
 
-struct video_export * video_export_init(const char *path)
+struct video_export * video_export_init(const char *path, size_t segment_size)
 {
         struct video_export *s = calloc(1, sizeof *s);
         assert(s != NULL);
@@ -133,6 +253,8 @@ struct video_export * video_export_init(const char *path)
         assert(path != NULL);
         s->path = strdup(path);
         s->head = s->tail = NULL;
+        s->segment_size = segment_size;
+        s->segment_fd = -1;
 
         memset(&s->saved_desc, 0, sizeof(s->saved_desc));
 
@@ -157,7 +279,7 @@ void output_summary(struct video_export *s)
                 return;
         }
 
-        fprintf(summary, "version %d\n", VIDEO_EXPORT_SUMMARY_VERSION);
+        fprintf(summary, "version %d\n", s->segment_size != 0 ? VIDEO_EXPORT_SUMMARY_VERSION : VIDEO_EXPORT_SUMMARY_VERSION_FILES);
         fprintf(summary, "width %d\n", s->saved_desc.width);
         fprintf(summary, "height %d\n", s->saved_desc.height);
         uint32_t fourcc = get_fourcc(s->saved_desc.color_spec);
@@ -165,6 +287,9 @@ void output_summary(struct video_export *s)
         fprintf(summary, "fps %.2f\n", s->saved_desc.fps);
         fprintf(summary, "interlacing %d\n", (int) s->saved_desc.interlacing);
         fprintf(summary, "count %d\n", s->total);
+        if (s->segment_size != 0) {
+                fprintf(summary, "segments %d\n", s->segments);
+        }
 
         fclose(summary);
 }
@@ -224,19 +349,25 @@ void video_export(struct video_export *s, struct video_frame *frame)
                 struct output_entry *entry = malloc(sizeof(struct output_entry));
 
                 entry->data_len = frame->tiles[i].data_len;
-                entry->data = (char *) malloc(entry->data_len);
-                entry->filename = malloc(MAX_PATH_SIZE);
+                const size_t alloc_len = DIV_ROUNDED_UP((size_t) entry->data_len, VIDEO_EXPORT_SEGMENT_ALIGN) * VIDEO_EXPORT_SEGMENT_ALIGN;
+                entry->data = (char *) aligned_malloc(alloc_len, VIDEO_EXPORT_SEGMENT_ALIGN);
+                memset(entry->data + entry->data_len, 0, alloc_len - entry->data_len);
+                entry->tile_idx = (int) i;
+                entry->filename = NULL;
                 entry->next = NULL;
 
-                if(frame->tile_count == 1) {
-                        snprintf(entry->filename, MAX_PATH_SIZE, "%s/%08d.%s", s->path,
-                                 s->total,
-                                 get_codec_file_extension(frame->color_spec));
-                } else {
-                        // add also tile index
-                        snprintf(entry->filename, MAX_PATH_SIZE, "%s/%08d_%d.%s", s->path,
-                                 s->total, i,
-                                 get_codec_file_extension(frame->color_spec));
+                if (s->segment_size == 0) { // otherwise written to a segment
+                        entry->filename = malloc(MAX_PATH_SIZE);
+                        if (frame->tile_count == 1) {
+                                snprintf(entry->filename, MAX_PATH_SIZE, "%s/%08d.%s", s->path,
+                                         s->total,
+                                         get_codec_file_extension(frame->color_spec));
+                        } else {
+                                // add also tile index
+                                snprintf(entry->filename, MAX_PATH_SIZE, "%s/%08d_%d.%s", s->path,
+                                         s->total, i,
+                                         get_codec_file_extension(frame->color_spec));
+                        }
                 }
                 memcpy(entry->data, frame->tiles[i].data, entry->data_len);
 
@@ -248,7 +379,8 @@ void video_export(struct video_export *s, struct video_frame *frame)
                                                 MAX_QUEUE_SIZE,
                                                 s->total); // we increment total size to keep the index
                                 pthread_mutex_unlock(&s->lock);
-                                free(entry->data);
+                                aligned_free(entry->data);
+                                free(entry->filename);
                                 free(entry);
                                 return;
                         }
@@ -38,16 +38,47 @@
 #ifndef _VIDEO_EXPORT_H_
 #define _VIDEO_EXPORT_H_
 
-#define VIDEO_EXPORT_SUMMARY_VERSION 1
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+/// version 2 adds the segmented layout (key "segments" in video.info)
+#define VIDEO_EXPORT_SUMMARY_VERSION 2
+#define VIDEO_EXPORT_SUMMARY_VERSION_FILES 1 ///< one file per frame (tile)
+
+/*
+ * Segmented layout - tiles are appended to segment files (offsets
+ * aligned to VIDEO_EXPORT_SEGMENT_ALIGN), each segment has a binary index
+ * of struct video_export_index_entry records (host byte order).
+ */
+#define VIDEO_EXPORT_SEGMENT_ALIGN 4096
+#define VIDEO_EXPORT_SEGMENT_NAME "video_%05d.seg"
+#define VIDEO_EXPORT_INDEX_NAME "video_%05d.idx"
+#define VIDEO_EXPORT_DEFAULT_SEGMENT_SIZE (1024 * 1024 * 1024)
 
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
 
+struct video_export_index_entry {
+        uint64_t offset;   ///< tile offset in the segment file
+        uint32_t data_len;
+        uint16_t tile_idx; ///< tile 0 starts a new frame
+        uint16_t reserved;
+};
+
 struct video_export;
 struct video_frame;
 
-struct video_export * video_export_init(const char *path);
+/**
+ * @param segment_size  if non-zero, use segmented layout with segments of
+ *                      (at most) this size instead of a file per frame
+ */
+struct video_export * video_export_init(const char *path, size_t segment_size);
 void video_export_destroy(struct video_export *state);
 void video_export(struct video_export *state, struct video_frame *frame);
 
@@ -63,6 +63,7 @@
 #include "tfrc.h"
 #include "transmit.h"
 #include "tv.h"
+#include "utils/net.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
 #include "video.h"
@@ -75,9 +76,14 @@
 #include "utils/worker.h"
 
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
+#include <thread>
 #include <utility>
 
+#define MOD_NAME "[video_rxtx/ultragrid_rtp] "
+
 using namespace std;
 
 ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &params) :
@@ -125,7 +131,14 @@ ultragrid_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame) noexcept
 {
         m_video_desc = video_desc_from_frame(tx_frame.get());
         if (m_fec_state) {
-                tx_frame = m_fec_state->encode(tx_frame);
+                auto fec_frame = m_fec_state->encode(tx_frame);
+                if (fec_frame) { // keep latency trace timestamps
+                        fec_frame->capture_time   = tx_frame->capture_time;
+                        fec_frame->filter_end     = tx_frame->filter_end;
+                        fec_frame->compress_start = tx_frame->compress_start;
+                        fec_frame->compress_end   = tx_frame->compress_end;
+                }
+                tx_frame = std::move(fec_frame);
         }
 
         auto data = new pair<ultragrid_rtp_video_rxtx *, shared_ptr<video_frame>>(this, tx_frame);
@@ -275,22 +288,268 @@ struct vcodec_state *ultragrid_rtp_video_rxtx::new_video_decoder(struct display
         return state;
 }
 
+ADD_TO_PARAM("decoder-cut-through",
+                "* decoder-cut-through\n"
+                "  Assemble video frames incrementally as packets arrive and pass them to\n"
+                "  decoder as soon as complete (instead of waiting for playout delay).\n"
+                "  Packets of a frame reordered after a subsequent frame are dropped.\n");
+ADD_TO_PARAM("rx-workers",
+                "* rx-workers=<n>\n"
+                "  Receive video with <n> threads, each with its own socket bound to the\n"
+                "  RX port (SO_REUSEPORT) and own participants and decoders - the kernel\n"
+                "  keeps each sender on one thread. Useful for multi-sender receivers, needs\n"
+                "  a display accepting multiple sources (eg. conference). Not available\n"
+                "  for multicast (every socket would receive every datagram).\n");
+
+/// RTCP and participant timeouts needn't be processed on every received packet
+#define RTCP_HOUSEKEEPING_INTERVAL (10 * MS_IN_NS)
+
+/**
+ * Receive shard - RTP session with its own participant database. Shards
+ * other than the main one are created with rx-workers and share the RX port.
+ */
+struct ultragrid_rtp_video_rxtx::rx_shard {
+        struct rtp *device = nullptr;
+        struct pdb *participants = nullptr;
+        int port = 0;
+        int last_buf_size = 0;
+        time_ns_t next_housekeeping = 0;
+        struct vcodec_state *shared_decoder = nullptr; // SHARED_DECODER only
+        thread worker;
+};
+
+/**
+ * Creates decoder for a participant that started sending.
+ * @retval false decoder cannot be created
+ */
+bool ultragrid_rtp_video_rxtx::assign_decoder(struct rx_shard *shard, struct pdb_e *cp)
+{
+#ifdef SHARED_DECODER
+        cp->decoder_state = shard->shared_decoder;
+        return true;
+#else
+        (void) shard;
+        lock_guard<mutex> lk(m_decoders_lock);
+        // we are assigning our display so we make sure it is removed from other dispaly
+
+        struct multi_sources_supp_info supp_for_mult_sources;
+        size_t len = sizeof(multi_sources_supp_info);
+        int ret = display_ctl_property(m_display_device,
+                        DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES, &supp_for_mult_sources, &len);
+        if (!ret) {
+                supp_for_mult_sources.val = false;
+        }
+
+        struct display *d;
+        if (supp_for_mult_sources.val == false) {
+                remove_display_from_decoders(); // must be called before creating new decoder state
+                d = m_display_device;
+        } else {
+                d = supp_for_mult_sources.fork_display(supp_for_mult_sources.state);
+                assert(d != NULL);
+                m_display_copies.push_back(d);
+        }
+
+        cp->decoder_state = new_video_decoder(d);
+        cp->decoder_state_deleter = destroy_video_decoder;
+
+        if (cp->decoder_state == NULL) {
+                log_msg(LOG_LEVEL_FATAL, "Fatal: unable to create decoder state for "
+                                "participant %u.\n", cp->ssrc);
+                exit_uv(1);
+                return false;
+        }
+        return true;
+#endif // SHARED_DECODER
+}
+
+/**
+ * Processes RTCP and RTP participant timeouts at most once per
+ * RTCP_HOUSEKEEPING_INTERVAL.
+ */
+void ultragrid_rtp_video_rxtx::shard_housekeeping(struct rx_shard *shard, time_ns_t curr_time, uint32_t ts)
+{
+        if (curr_time < shard->next_housekeeping) {
+                return;
+        }
+        rtp_update(shard->device, curr_time);
+        rtp_send_ctrl(shard->device, ts, nullptr, curr_time);
+        shard->next_housekeeping = curr_time + RTCP_HOUSEKEEPING_INTERVAL;
+}
+
+/**
+ * Decodes and renders frames of participants of the shard.
+ * @retval true at least one frame was decoded
+ */
+bool ultragrid_rtp_video_rxtx::decode_participants(struct rx_shard *shard, time_ns_t curr_time)
+{
+        bool decoded = false;
+        pdb_iter_t it;
+        struct pdb_e *cp = pdb_iter_init(shard->participants, &it);
+        while (cp != NULL) {
+                if (tfrc_feedback_is_due(cp->tfrc_state, curr_time)) {
+                        debug_msg("tfrc rate %f\n",
+                                  tfrc_feedback_txrate(cp->tfrc_state,
+                                                       curr_time));
+                }
+
+                if(cp->decoder_state == NULL &&
+                                !pbuf_is_empty(cp->playout_buffer)) { // the second check is needed because we want to assign display to participant that really sends data
+                        if (!assign_decoder(shard, cp)) {
+                                break;
+                        }
+                }
+
+                struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
+
+                /* Decode and render video... */
+                if (m_cut_through && vdecoder_state != nullptr) {
+                        if (pbuf_decode_cut_through(cp->playout_buffer, curr_time,
+                                                    &video_frame_cut_through_decoder,
+                                                    vdecoder_state)) {
+                                decoded = true;
+                        }
+                } else if (pbuf_decode
+                    (cp->playout_buffer, curr_time, decode_video_frame, vdecoder_state)) {
+                        decoded = true;
+                }
+
+                if(vdecoder_state && vdecoder_state->decoded % 100 == 99) {
+                        int new_size = vdecoder_state->max_frame_size * 110ull / 100;
+                        if(new_size > shard->last_buf_size) {
+                                if (rtp_set_recv_buf(shard->device, new_size)) {
+                                        debug_msg("Recv buffer adjusted to %d\n", new_size);
+                                } else {
+                                        display_buf_increase_warning(new_size);
+                                }
+                                shard->last_buf_size = new_size;
+                        }
+                }
+
+                pbuf_remove(cp->playout_buffer, curr_time);
+                cp = pdb_iter_next(&it);
+        }
+        pdb_iter_done(&it);
+        return decoded;
+}
+
+/**
+ * Loop of an additional receive shard. Control messages are processed by the
+ * main receiver loop, shard only follows RX port changes.
+ */
+void ultragrid_rtp_video_rxtx::shard_loop(struct rx_shard *shard)
+{
+        set_thread_name("receiver_shard");
+        while (!m_should_exit) {
+                time_ns_t curr_time = get_time_in_ns();
+                uint32_t ts = (m_common.start_time - curr_time) / 100'000 * 9; // at 90000 Hz
+
+                if (curr_time >= shard->next_housekeeping) {
+                        unique_lock<mutex> lk(m_network_devices_lock);
+                        if (shard->port != m_recv_port_number) {
+                                struct rtp *device = initialize_network(m_requested_receiver.c_str(),
+                                                m_recv_port_number, m_send_port_number,
+                                                shard->participants, m_common.force_ip_version,
+                                                m_common.mcast_if, m_common.ttl);
+                                if (device != nullptr) {
+                                        destroy_rtp_device(shard->device);
+                                        shard->device = device;
+                                }
+                                shard->port = m_recv_port_number; // do not retry on failure
+                        }
+                }
+                shard_housekeeping(shard, curr_time, ts);
+
+                struct timeval timeout = { 0, 1000 };
+                rtp_recv_r(shard->device, &timeout, ts);
+
+                decode_participants(shard, curr_time);
+        }
+
+        destroy_rtp_device(shard->device);
+        pdb_destroy(&shard->participants);
+}
+
+/**
+ * Starts additional receive shards requested by rx-workers.
+ */
+void ultragrid_rtp_video_rxtx::start_rx_shards(std::list<rx_shard> &shards)
+{
+        const char *workers_param = get_commandline_param("rx-workers");
+        if (workers_param == nullptr) {
+                return;
+        }
+        const int workers = atoi(workers_param);
+        if (workers <= 1) {
+                return;
+        }
+#ifdef SHARED_DECODER
+        log_msg(LOG_LEVEL_WARNING, MOD_NAME "rx-workers not supported with shared decoder, ignoring.\n");
+        return;
+#endif
+        // SO_REUSEPORT balances only unicast, multicast datagrams are
+        // delivered to all sockets bound to the port
+        const char *receiver = m_requested_receiver.c_str();
+        const bool any_addr = strcmp(receiver, "0.0.0.0") == 0 ||
+                              strcmp(receiver, "::") == 0;
+        if (is_addr_multicast(receiver) ||
+            (any_addr && strlen(m_common.mcast_if) > 0)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "rx-workers not supported "
+                        "with multicast, using single receiver thread.\n");
+                return;
+        }
+        struct multi_sources_supp_info supp_for_mult_sources;
+        size_t len = sizeof(multi_sources_supp_info);
+        if (!display_ctl_property(m_display_device, DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES,
+                                  &supp_for_mult_sources, &len) ||
+            !supp_for_mult_sources.val) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "rx-workers needs a display accepting "
+                        "multiple sources, using single receiver thread.\n");
+                return;
+        }
+
+        lock_guard<mutex> lk(m_network_devices_lock);
+        for (int i = 1; i < workers; ++i) {
+                rx_shard &shard = shards.emplace_back();
+                shard.participants = pdb_init("video", &video_offset);
+                shard.port = m_recv_port_number;
+                shard.device = initialize_network(m_requested_receiver.c_str(),
+                                m_recv_port_number, m_send_port_number,
+                                shard.participants, m_common.force_ip_version,
+                                m_common.mcast_if, m_common.ttl);
+                if (shard.device == nullptr) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create receive shard %d!\n", i);
+                        pdb_destroy(&shard.participants);
+                        shards.pop_back();
+                        break;
+                }
+                shard.last_buf_size = rtp_get_recv_buf(shard.device);
+                shard.worker = thread(&ultragrid_rtp_video_rxtx::shard_loop, this, &shard);
+        }
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Receiving with %zu threads.\n", shards.size() + 1);
+}
+
 void *ultragrid_rtp_video_rxtx::receiver_loop()
 {
         set_thread_name(__func__);
-        struct pdb_e *cp;
         int fr;
-        int last_buf_size = rtp_get_recv_buf(m_network_device);
+        struct rx_shard main_shard;
+        main_shard.participants = m_participants;
+        main_shard.last_buf_size = rtp_get_recv_buf(m_network_device);
+        m_cut_through = get_commandline_param("decoder-cut-through") != nullptr;
 
 #ifdef SHARED_DECODER
-        struct vcodec_state *shared_decoder = new_video_decoder(m_display_device);
-        if(shared_decoder == NULL) {
+        main_shard.shared_decoder = new_video_decoder(m_display_device);
+        if(main_shard.shared_decoder == NULL) {
                 fprintf(stderr, "Unable to create decoder!\n");
                 exit_uv(1);
                 return NULL;
         }
 #endif // SHARED_DECODER
 
+        std::list<rx_shard> shards;
+        start_rx_shards(shards);
+
         fr = 1;
 
         time_ns_t last_not_timeout = 0;
@@ -301,8 +560,8 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                 time_ns_t curr_time = get_time_in_ns();
                 uint32_t ts = (m_common.start_time - curr_time) / 100'000 * 9; // at 90000 Hz
 
-                rtp_update(m_network_device, curr_time);
-                rtp_send_ctrl(m_network_device, ts, nullptr, curr_time);
+                main_shard.device = m_network_device; // may be replaced by RX port change
+                shard_housekeeping(&main_shard, curr_time, ts);
 
                 /* Receive packets from the network... The timeout is adjusted */
                 /* to match the video capture rate, so the transmitter works.  */
@@ -332,80 +591,17 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                 }
 
                 /* Decode and render for each participant in the conference... */
-                pdb_iter_t it;
-                cp = pdb_iter_init(m_participants, &it);
-                while (cp != NULL) {
-                        if (tfrc_feedback_is_due(cp->tfrc_state, curr_time)) {
-                                debug_msg("tfrc rate %f\n",
-                                          tfrc_feedback_txrate(cp->tfrc_state,
-                                                               curr_time));
-                        }
-
-                        if(cp->decoder_state == NULL &&
-                                        !pbuf_is_empty(cp->playout_buffer)) { // the second check is needed because we want to assign display to participant that really sends data
-#ifdef SHARED_DECODER
-                                cp->decoder_state = shared_decoder;
-#else
-                                // we are assigning our display so we make sure it is removed from other dispaly
-
-                                struct multi_sources_supp_info supp_for_mult_sources;
-                                size_t len = sizeof(multi_sources_supp_info);
-                                int ret = display_ctl_property(m_display_device,
-                                                DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES, &supp_for_mult_sources, &len);
-                                if (!ret) {
-                                        supp_for_mult_sources.val = false;
-                                }
-
-                                struct display *d;
-                                if (supp_for_mult_sources.val == false) {
-                                        remove_display_from_decoders(); // must be called before creating new decoder state
-                                        d = m_display_device;
-                                } else {
-                                        d = supp_for_mult_sources.fork_display(supp_for_mult_sources.state);
-                                        assert(d != NULL);
-                                        m_display_copies.push_back(d);
-                                }
-
-                                cp->decoder_state = new_video_decoder(d);
-                                cp->decoder_state_deleter = destroy_video_decoder;
-
-                                if (cp->decoder_state == NULL) {
-                                        log_msg(LOG_LEVEL_FATAL, "Fatal: unable to create decoder state for "
-                                                        "participant %u.\n", cp->ssrc);
-                                        exit_uv(1);
-                                        break;
-                                }
-#endif // SHARED_DECODER
-                        }
-
-                        struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
-
-                        /* Decode and render video... */
-                        if (pbuf_decode
-                            (cp->playout_buffer, curr_time, decode_video_frame, vdecoder_state)) {
-                                fr = 1;
-                        }
-
-                        if(vdecoder_state && vdecoder_state->decoded % 100 == 99) {
-                                int new_size = vdecoder_state->max_frame_size * 110ull / 100;
-                                if(new_size > last_buf_size) {
-                                        if (rtp_set_recv_buf(m_network_device, new_size)) {
-                                                debug_msg("Recv buffer adjusted to %d\n", new_size);
-                                        } else {
-                                                display_buf_increase_warning(new_size);
-                                        }
-                                        last_buf_size = new_size;
-                                }
-                        }
-
-                        pbuf_remove(cp->playout_buffer, curr_time);
-                        cp = pdb_iter_next(&it);
+                if (decode_participants(&main_shard, curr_time)) {
+                        fr = 1;
                 }
-                pdb_iter_done(&it);
+        }
+
+        for (auto &shard : shards) {
+                shard.worker.join();
         }
 
 #ifdef SHARED_DECODER
-        destroy_video_decoder(shared_decoder);
+        destroy_video_decoder(main_shard.shared_decoder);
 #else
         /* Because decoders work asynchronously we need to make sure
          * that display won't be called */
@@ -66,6 +66,13 @@ private:
         virtual void send_frame_async(std::shared_ptr<video_frame>);
         virtual void *(*get_receiver_thread() noexcept)(void *arg) override;
 
+        struct rx_shard;
+        void start_rx_shards(std::list<rx_shard> &shards);
+        void shard_loop(struct rx_shard *shard);
+        void shard_housekeeping(struct rx_shard *shard, time_ns_t curr_time, uint32_t ts);
+        bool decode_participants(struct rx_shard *shard, time_ns_t curr_time);
+        bool assign_decoder(struct rx_shard *shard, struct pdb_e *cp);
+
         void receiver_process_messages();
         void remove_display_from_decoders();
         struct vcodec_state *new_video_decoder(struct display *d);
@@ -77,6 +84,8 @@ private:
                                                       ///< and used simultaneously from
                                                       ///< multiple decoders, here are
                                                       ///< saved forked states
+        std::mutex       m_decoders_lock; ///< decoder creation from receive shards
+        bool             m_cut_through = false;
 
         /**
          * This variables serve as a notification when asynchronous sending exits
@@ -234,7 +234,9 @@ static const struct vo_postprocess_info vo_pp_crop_info = {
 static const struct capture_filter_info capture_filter_crop_info = {
         cf_crop_init,
         crop_done,
-        cf_crop_filter
+        cf_crop_filter,
+        NULL,
+        NULL,
 };
 
 REGISTER_MODULE(crop, &vo_pp_crop_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
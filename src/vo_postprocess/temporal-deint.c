@@ -52,7 +52,11 @@
 #include "lib_common.h"
 #include "tv.h"
 #include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/misc.h" // get_cpu_core_count
+#include "utils/parallel_conv.h"
 #include "utils/text.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
@@ -71,6 +75,9 @@ struct state_df {
         bool deinterlace;
         bool nodelay;
         bool force;
+        int threads; ///< 0 - all logical cores
+        int slices;  ///< number of row slices processed in parallel
+        unsigned char *scratch; ///< 2 lines per slice (DF slice boundaries)
 
         time_ns_t frame_received;
 };
@@ -78,6 +85,7 @@ struct state_df {
 static void print_common_opts() {
         color_printf("\t" TBOLD("force  ") " - apply deinterlacing even if input is not interlaced\n");
         color_printf("\t" TBOLD("nodelay") " - do not delay the other frame to keep timing. Both frames are output in burst. May not work correctly (depends on display).\n");
+        color_printf("\t" TBOLD("threads=<n>") " - number of threads (default 0 - all cores)\n");
 }
 
 static void df_usage()
@@ -89,7 +97,7 @@ static void df_usage()
                 "and blending can be used.\n\n";
         color_printf("%s", wrap_paragraph(desc));
         color_printf("Usage:\n");
-        color_printf("\t" TBOLD(TRED("-p double_framerate") "[:d][:nodelay]") "\n");
+        color_printf("\t" TBOLD(TRED("-p double_framerate") "[:d][:nodelay][:force][:threads=<n>]") "\n");
         color_printf("\nwhere:\n");
         color_printf("\t" TBOLD("d      ") " - blend the output\n");
         print_common_opts();
@@ -99,16 +107,30 @@ static void * init_common(enum algo algo, const char *config) {
         bool deinterlace = false;
         bool force = false;
         bool nodelay = false;
-
-        if (strcmp(config, "d") == 0) {
-                deinterlace = true;
-        } else if (strcmp(config, "nodelay") == 0) {
-                nodelay = true;
-        } else if (strcmp(config, "force") == 0) {
-                force = true;
-        } else if (strlen(config) > 0) {
-                log_msg(LOG_LEVEL_ERROR, "Unknown config: %s\n", config);
-                return NULL;
+        int threads = 0;
+
+        char cfg[STR_LEN];
+        snprintf_ch(cfg, "%s", config);
+        char *item = NULL;
+        char *save_ptr = NULL;
+        char *tmp = cfg;
+        while ((item = strtok_r(tmp, ":", &save_ptr)) != NULL) {
+                tmp = NULL;
+                if (strcmp(item, "d") == 0) {
+                        deinterlace = true;
+                } else if (strcmp(item, "nodelay") == 0) {
+                        nodelay = true;
+                } else if (strcmp(item, "force") == 0) {
+                        force = true;
+                } else if (strncmp(item, "threads=", strlen("threads=")) == 0) {
+                        threads = parse_thread_count(item + strlen("threads="));
+                        if (threads < 0) {
+                                return NULL;
+                        }
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, "Unknown config: %s\n", item);
+                        return NULL;
+                }
         }
 
         struct state_df *s = calloc(1, sizeof *s);
@@ -121,6 +143,7 @@ static void * init_common(enum algo algo, const char *config) {
         s->deinterlace = deinterlace;
         s->force = force;
         s->nodelay = nodelay;
+        s->threads = threads;
 
         if (s->nodelay && get_commandline_param("decoder-drop-policy") == NULL) {
                 log_msg(LOG_LEVEL_NOTICE, MOD_NAME "nodelay option used, setting drop policy to %s timeout.\n", TIMEOUT);
@@ -178,6 +201,7 @@ common_postprocess_reconfigure(void *state, struct video_desc desc)
 
         free(s->buffers[0]);
         free(s->buffers[1]);
+        free(s->scratch);
         
         s->in->color_spec = desc.color_spec;
         s->in->fps = desc.fps;
@@ -197,6 +221,15 @@ common_postprocess_reconfigure(void *state, struct video_desc desc)
         s->buffers[0] = (char *) malloc(in_tile->data_len);
         s->buffers[1] = (char *) malloc(in_tile->data_len);
         in_tile->data = s->buffers[s->buffer_current];
+
+        s->slices = s->threads > 0 ? s->threads : get_cpu_core_count();
+        s->slices = MAX(MIN(s->slices, (int) desc.height), 1);
+        s->scratch = malloc(2 * s->slices *
+                        vc_get_linesize(desc.width, desc.color_spec));
+        if (s->buffers[0] == NULL || s->buffers[1] == NULL || s->scratch == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate buffers!\n");
+                return false;
+        }
         
         return true;
 }
@@ -211,65 +244,98 @@ static struct video_frame * common_getf(void *state)
         return s->in;
 }
 
-/// @todo perhaps suboptimal
-static void perform_df(struct state_df *s, struct video_frame *in, struct video_frame *out, int req_pitch)
+struct deint_data {
+        struct state_df *s;
+        bool have_in; ///< first field of the frame (in != NULL)
+        struct video_frame *out;
+        int pitch;
+        int linesize;
+        int slice_height; ///< DF only
+};
+
+/// @returns input line from which is out line y constructed
+static const char *df_src_line(const struct deint_data *d, int y)
 {
-        if(in != NULL) {
-                char *src = s->buffers[(s->buffer_current + 1) % 2] + vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-                char *dst = out->tiles[0].data + req_pitch;
-                for (unsigned y = 0; y < out->tiles[0].height; y += 2) {
-                        memcpy(dst, src, vc_get_linesize(s->in->tiles[0].width, s->in->color_spec));
-                        dst += 2 * req_pitch;
-                        src += 2 * vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-                }
-                src = s->buffers[s->buffer_current];
-                dst = out->tiles[0].data;
-                for (unsigned y = 1; y < out->tiles[0].height; y += 2) {
-                        memcpy(dst, src, vc_get_linesize(s->in->tiles[0].width, s->in->color_spec));
-                        dst += 2 * req_pitch;
-                        src += 2 * vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-                }
-        } else {
-                char *src = s->buffers[s->buffer_current];
-                char *dst = out->tiles[0].data;
-                for (unsigned y = 0; y < out->tiles[0].height; ++y) {
-                        memcpy(dst, src, vc_get_linesize(s->in->tiles[0].width, s->in->color_spec));
-                        dst += req_pitch;
-                        src += vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-                }
+        const struct state_df *s = d->s;
+        int buf = s->buffer_current;
+        if (d->have_in && y % 2 == 1) { // odd lines from the previous frame
+                buf = (s->buffer_current + 1) % 2;
         }
+        return s->buffers[buf] + (size_t) y * d->linesize;
+}
 
-        if (s->deinterlace) {
-                if (!vc_deinterlace_ex(out->color_spec,
-                                (unsigned char *) out->tiles[0].data, vc_get_linesize(out->tiles[0].width, out->color_spec),
-                                (unsigned char *) out->tiles[0].data, vc_get_linesize(out->tiles[0].width, out->color_spec),
-                                out->tiles[0].height)) {
-                         log_msg_once(LOG_LEVEL_ERROR, DFR_DEINTERLACE_IMPOSSIBLE_MSG_ID, MOD_NAME "Cannot deinterlace, unsupported pixel format '%s'!\n", get_codec_name(out->color_spec));
-                }
+/**
+ * @param tmp  scratch space for 2 lines
+ */
+static void df_rows(const struct deint_data *d, int start_row, int end_row, unsigned char *tmp)
+{
+        struct video_frame *out = d->out;
+        for (int y = start_row; y < end_row; ++y) {
+                memcpy(out->tiles[0].data + (size_t) y * d->pitch, df_src_line(d, y), d->linesize);
+        }
+
+        if (!d->s->deinterlace) {
+                return;
+        }
+        unsigned char *first = (unsigned char *) out->tiles[0].data + (size_t) start_row * d->linesize;
+        if (!vc_deinterlace_ex(out->color_spec, first, d->linesize,
+                                first, d->linesize, end_row - start_row)) {
+                log_msg_once(LOG_LEVEL_ERROR, DFR_DEINTERLACE_IMPOSSIBLE_MSG_ID, MOD_NAME "Cannot deinterlace, unsupported pixel format '%s'!\n", get_codec_name(out->color_spec));
+                return;
+        }
+        // last line of the slice is blended with the first line of the next
+        // one, which may be already overwritten - take it from the source
+        if (end_row < (int) out->tiles[0].height) {
+                unsigned char *last = first + (size_t) (end_row - start_row - 1) * d->linesize;
+                memcpy(tmp, last, d->linesize);
+                memcpy(tmp + d->linesize, df_src_line(d, end_row), d->linesize);
+                vc_deinterlace_ex(out->color_spec, tmp, d->linesize, last, d->linesize, 2);
         }
 }
 
-static void perform_bob(struct state_df *s, struct video_frame *in, struct video_frame *out, int pitch)
+static void df_slices(size_t start, size_t end, void *udata)
 {
-        int linesize = vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-        char *dst = out->tiles[0].data;
-        char *src = s->buffers[s->buffer_current] + (in ? 0 : linesize);
-        if (in == NULL) {
-                memcpy(dst, src, linesize); // copy first line up
-                dst += pitch; // then copy every even line to subsequent odd line
-        }
-        unsigned y = in ? 0 : 1;
-        for ( ; y < out->tiles[0].height - 1; y += 2) {
-                memcpy(dst, src, linesize);
-                memcpy(dst + pitch, src, linesize);
-                dst += 2 * pitch;
-                src += 2 * linesize;
+        const struct deint_data *d = udata;
+        const int height = d->out->tiles[0].height;
+        for (size_t i = start; i < end; ++i) {
+                const int start_row = (int) i * d->slice_height;
+                const int end_row = MIN(start_row + d->slice_height, height);
+                if (start_row < end_row) {
+                        df_rows(d, start_row, end_row,
+                                        d->s->scratch + 2 * i * d->linesize);
+                }
         }
-        if (y < out->tiles[0].height) {
-                memcpy(dst, dst - pitch, linesize);
+}
+
+static void perform_df(struct state_df *s, struct video_frame *in, struct video_frame *out, int req_pitch)
+{
+        struct deint_data d = { s, in != NULL, out, req_pitch,
+                vc_get_linesize(s->in->tiles[0].width, s->in->color_spec),
+                DIV_ROUNDED_UP((int) out->tiles[0].height, s->slices) };
+        // slices are made explicitly so that each has its scratch lines
+        task_parallel_for(s->slices, 1, df_slices, &d);
+}
+
+/// doubles lines of one field - even lines if have_in, odd otherwise
+static void bob_rows(int start_row, int end_row, void *udata)
+{
+        struct deint_data *d = udata;
+        const int height = d->out->tiles[0].height;
+        const char *src = d->s->buffers[d->s->buffer_current];
+        for (int y = start_row; y < end_row; ++y) {
+                const int src_y = d->have_in ? y & ~1 : MIN(y | 1, height - 1);
+                memcpy(d->out->tiles[0].data + (size_t) y * d->pitch,
+                                src + (size_t) src_y * d->linesize, d->linesize);
         }
 }
 
+static void perform_bob(struct state_df *s, struct video_frame *in, struct video_frame *out, int pitch)
+{
+        struct deint_data d = { s, in != NULL, out, pitch,
+                vc_get_linesize(s->in->tiles[0].width, s->in->color_spec), 0 };
+        parallel_rows(out->tiles[0].height, 1, bob_rows, &d, s->threads);
+}
+
 /// copied from vc_deinterlace_ex
 ///
 /// consider merging with vc_deinterlace_ex but perhaps not needed (that func
@@ -471,6 +537,7 @@ static void common_done(void *state)
         
         free(s->buffers[0]);
         free(s->buffers[1]);
+        free(s->scratch);
         vf_free(s->in);
         free(s);
 }
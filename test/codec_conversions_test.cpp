@@ -4,12 +4,16 @@
 #include "config_win32.h"
 #endif
 
+#include <cstring>
 #include <iostream>
 #include <list>
+#include <random>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "pixfmt_conv.h"
 #include "unit_common.h"
 #include "video_codec.h"
 #include "video_capture/testcard_common.h"
@@ -20,8 +24,10 @@ using std::pair;
 using std::string;
 using std::to_string;
 using std::ostringstream;
+using std::vector;
 
 extern "C" int codec_conversion_test_testcard_uyvy_to_i420(void);
+extern "C" int codec_conversion_test_simd_line_decoders_bit_exact(void);
 
 int codec_conversion_test_testcard_uyvy_to_i420(void)
 {
@@ -77,3 +83,51 @@ int codec_conversion_test_testcard_uyvy_to_i420(void)
         return 0;
 }
 
+
+/**
+ * Checks that SIMD line decoders produce exactly the same output as the
+ * scalar ones, including the bytes past dst_len that must stay untouched.
+ */
+int codec_conversion_test_simd_line_decoders_bit_exact(void)
+{
+        const int widths[] = { 1, 2, 3, 5, 6, 7, 8, 13, 16, 31, 47, 48, 64, 127, 1920, 3843 };
+        const int shifts[][3] = { DEFAULT_RGB_SHIFT_INIT, { 16, 8, 0 }, { 24, 16, 8 } };
+        const enum pixfmt_conv_isa isas[] = { PIXFMT_CONV_ISA_AVX2, PIXFMT_CONV_ISA_AVX512 };
+        enum { SLACK = 128, CANARY = 0xA5 };
+        std::mt19937 gen(1234);
+
+        for (int in = VIDEO_CODEC_FIRST; in < VIDEO_CODEC_END; ++in) {
+                for (int out = VIDEO_CODEC_FIRST; out < VIDEO_CODEC_END; ++out) {
+                        decoder_t scalar = get_decoder_from_to_isa((codec_t) in, (codec_t) out, PIXFMT_CONV_ISA_SCALAR);
+                        if (scalar == nullptr) {
+                                continue;
+                        }
+                        for (auto isa : isas) {
+                                decoder_t simd = get_decoder_from_to_isa((codec_t) in, (codec_t) out, isa);
+                                if (simd == nullptr || simd == scalar) {
+                                        continue;
+                                }
+                                for (int width : widths) {
+                                        int dst_len = vc_get_linesize(width, (codec_t) out);
+                                        // some decoders round up to whole output blocks (eg. 48 px of v210)
+                                        vector<unsigned char> src(vc_get_linesize(width + 48, (codec_t) in) + MAX_PADDING);
+                                        for (auto &b : src) {
+                                                b = gen();
+                                        }
+                                        for (const auto &sh : shifts) {
+                                                vector<unsigned char> expected(dst_len + SLACK, CANARY);
+                                                vector<unsigned char> actual(dst_len + SLACK, CANARY);
+                                                scalar(expected.data(), src.data(), dst_len, sh[0], sh[1], sh[2]);
+                                                simd(actual.data(), src.data(), dst_len, sh[0], sh[1], sh[2]);
+                                                ostringstream oss;
+                                                oss << get_codec_name((codec_t) in) << "->" << get_codec_name((codec_t) out)
+                                                        << " " << pixfmt_conv_isa_name(isa) << " width " << width
+                                                        << " shifts " << sh[0] << "," << sh[1] << "," << sh[2];
+                                                ASSERT_MESSAGE(oss.str(), memcmp(expected.data(), actual.data(), expected.size()) == 0);
+                                        }
+                                }
+                        }
+                }
+        }
+        return 0;
+}
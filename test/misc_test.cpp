@@ -1,27 +1,189 @@
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>          // for fclose, remove
 #include <cstring>         // for strcmp
 #include <cmath>           // for abs
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
 #include <list>
 #include <sstream>
 #include <string>          // for allocator, basic_string, operator+, string
+#include <thread>
+#include <vector>
 
+#include "../ldgm/matrix-gen/matrix-generator.h"
+#include "../tools/ipc_frame.h"
+#include "../tools/ipc_frame_unix.h"
+#include "../ldgm/src/ldgm-session-cpu.h"
+#include "audio/playback/mixer_kernels.hpp"
+#include "capture_filter.h"
 #include "color.h"
+#include "crypto/crc.h"
+#include "crypto/openssl_decrypt.h"
+#include "crypto/openssl_encrypt.h"
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "messaging.h"
+#include "module.h"
+#include "rtp/pbuf.h"
+#include "rtp/rs.h"
+#include "rtp/rtp_types.h"
+#include "rtp/rtpenc_h264.h"
 #include "types.h"
+#include "ug_runtime_error.hpp"
+#include "utils/fs.h"
+#include "utils/gf256.h"
+#include "utils/latency_trace.h"
+#include "utils/macros.h"
 #include "utils/net.h"
+#include "utils/packet_pool.h"
+#include "utils/parallel_conv.h"
 #include "utils/string.h"
+#include "utils/worker.h"
 #include "unit_common.h"
 #include "video.h"
+#include "video_capture.h"
+#include "video_capture_params.h"
+#include "video_export.h"
 #include "video_frame.h"
+#include "vo_postprocess.h"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 extern "C" {
+int misc_test_audio_mixer_normalize();
+int misc_test_capture_filter_in_place();
 int misc_test_color_coeff_range();
+int misc_test_deinterlace_bob();
+int misc_test_filter_threads_opt();
+int misc_test_gf256();
+int misc_test_h264_start_code_scan();
+int misc_test_ipc_frame_shm();
+int misc_test_latency_trace();
+int misc_test_ldgm();
+int misc_test_log_async_overflow();
+int misc_test_log_rate_limit();
 int misc_test_net_getsockaddr();
+int misc_test_openssl_batch();
 int misc_test_net_sockaddr_compare_v4_mapped();
+int misc_test_packet_pool();
+int misc_test_pbuf_reorder();
 int misc_test_replace_all();
+int misc_test_rs_multiblock();
 int misc_test_video_desc_io_op_symmetry();
+int misc_test_video_export_segmented();
+int misc_test_worker_parallel_for();
 }
 
 using namespace std;
 
+template<class algo>
+static int
+mixer_check_normalize(const vector<sample_type_mixed> &mix)
+{
+        vector<sample_type_source> part(mix.size(), 0);
+        mix_minus_one<algo>(mix.data(), part.data(), part.size());
+        for (size_t i = 0; i < mix.size(); ++i) {
+                ASSERT_EQUAL((int) algo::normalize(mix[i]), (int) part[i]);
+        }
+        return 0;
+}
+
+/**
+ * checks that the SIMD mixer kernels normalize samples at the thresholds
+ * the same way as the scalar normalize()
+ */
+int misc_test_audio_mixer_normalize()
+{
+        using log_algo = logarithmic_mix_algo;
+        const sample_type_mixed boundaries[] = {
+                log_algo::thr_min - 1, log_algo::thr_min, log_algo::thr_min + 1,
+                log_algo::thr_max - 1, log_algo::thr_max, log_algo::thr_max + 1,
+                0, -1, INT16_MIN, INT16_MAX, INT16_MIN - 1, INT16_MAX + 1,
+        };
+        for (sample_type_mixed b : boundaries) {
+                // whole SIMD blocks containing just a single boundary value
+                // plus a scalar tail
+                vector<sample_type_mixed> mix(19, 0);
+                for (size_t i = 0; i < mix.size(); i += 3) {
+                        mix[i] = b;
+                }
+                ASSERT_EQUAL(0, mixer_check_normalize<log_algo>(mix));
+                ASSERT_EQUAL(0, mixer_check_normalize<linear_mix_algo>(mix));
+        }
+        return 0;
+}
+
+/**
+ * checks that the second flip of "flip,flip" is done in place on the frame
+ * from the pool of the first one and that the stats command reports it
+ */
+int misc_test_capture_filter_in_place()
+{
+        enum { FRAMES = 3 };
+        struct module root;
+        module_init_default(&root);
+        root.cls = MODULE_CLASS_ROOT;
+        struct capture_filter *cf = nullptr;
+        ASSERT_EQUAL(0, capture_filter_init(&root, "flip:threads=1,flip:threads=1", &cf));
+
+        struct video_desc desc { 16, 8, UYVY, 30.0, PROGRESSIVE, 1 };
+        struct video_frame *in = vf_alloc_desc_data(desc);
+        for (unsigned i = 0; i < in->tiles[0].data_len; ++i) {
+                in->tiles[0].data[i] = (char) (i * 7);
+        }
+        const std::string orig(in->tiles[0].data, in->tiles[0].data_len);
+        for (int i = 0; i < FRAMES; ++i) {
+                struct video_frame *out = capture_filter(cf, in);
+                ASSERT(out != nullptr && out != in);
+                const bool same = orig == std::string(out->tiles[0].data, out->tiles[0].data_len);
+                VIDEO_FRAME_DISPOSE(out);
+                ASSERT(same);
+        }
+
+        // messages are processed by capture_filter() called from this thread
+        std::atomic<bool> answered{false};
+        struct response *r = nullptr;
+        std::thread sender([&] {
+                auto *msg = (struct msg_universal *) new_message(sizeof(struct msg_universal));
+                strncpy(msg->text, "stats", sizeof msg->text - 1);
+                r = send_message_sync(&root, "filter", (struct message *) msg, 1000, 0);
+                answered = true;
+        });
+        while (!answered) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                struct video_frame *out = capture_filter(cf, in);
+                VIDEO_FRAME_DISPOSE(out);
+        }
+        sender.join();
+        ASSERT_EQUAL(RESPONSE_OK, response_get_status(r));
+        unsigned long frames[2] = {}, in_place[2] = {}, avg_us = 0, allocs = 0;
+        ASSERT_EQUAL(6, sscanf(response_get_text(r),
+                                "0 flip frames %lu in_place %lu avg_us %lu allocs %lu;"
+                                "1 flip frames %lu in_place %lu",
+                                &frames[0], &in_place[0], &avg_us, &allocs,
+                                &frames[1], &in_place[1]));
+        free_response(r);
+        ASSERT(frames[0] >= FRAMES);
+        ASSERT_EQUAL(0UL, in_place[0]); // input frame is owned by the caller
+        ASSERT_EQUAL(frames[0], frames[1]);
+        ASSERT_EQUAL(frames[1], in_place[1]);
+
+        capture_filter_destroy(cf);
+        vf_free(in);
+        module_done(&root);
+        return 0;
+}
+
 /**
  * check that scaled coefficient for minimal values match approximately minimal
  * value of nominal range (== there is not significant shift)
@@ -118,6 +280,541 @@ int misc_test_net_sockaddr_compare_v4_mapped() {
         return 0;
 }
 
+/**
+ * checks that deinterlace_bob doubles lines of the right field - line 0 of
+ * the odd-field frame must be taken from the source line 1
+ */
+int misc_test_deinterlace_bob()
+{
+        const auto *pp = static_cast<const struct vo_postprocess_info *>(load_library(
+            "deinterlace_bob", LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION));
+        if (pp == nullptr) {
+                return 1;
+        }
+        void *state = pp->init("threads=4");
+        ASSERT(state != nullptr);
+        const struct video_desc desc = { 16, 9, UYVY, 1000.0, INTERLACED_MERGED, 1 };
+        ASSERT(pp->reconfigure(state, desc));
+        struct video_frame *in = pp->getf(state);
+        const int linesize = vc_get_linesize(desc.width, desc.color_spec);
+        for (unsigned y = 0; y < desc.height; ++y) {
+                memset(in->tiles[0].data + y * linesize, (int) y + 1, linesize);
+        }
+        struct video_frame *out = vf_alloc_desc_data(desc);
+
+        ASSERT(pp->vo_postprocess(state, in, out, linesize)); // even field
+        for (unsigned y = 0; y < desc.height; ++y) {
+                ASSERT_EQUAL((int) (y & ~1U) + 1, (int) out->tiles[0].data[y * linesize]);
+        }
+        ASSERT(pp->vo_postprocess(state, nullptr, out, linesize)); // odd field
+        for (unsigned y = 0; y < desc.height; ++y) {
+                const unsigned src_y = std::min(y | 1U, desc.height - 1);
+                ASSERT_EQUAL((int) src_y + 1, (int) out->tiles[0].data[y * linesize]);
+        }
+        vf_free(out);
+        pp->done(state);
+        return 0;
+}
+
+/**
+ * concurrently allocates and frees items from multiple threads and checks
+ * that no item is handed out twice at a time
+ */
+int misc_test_packet_pool()
+{
+        enum { THREADS = 4, ITERATIONS = 100000, HELD = 8, ITEM_SIZE = 100 };
+        struct packet_pool *pool = packet_pool_create(ITEM_SIZE, 1024);
+        std::vector<std::thread> threads;
+        std::vector<bool> ok(THREADS, true);
+        for (int t = 0; t < THREADS; ++t) {
+                threads.emplace_back([&, t] {
+                        unsigned char *held[HELD] = {};
+                        for (int i = 0; i < ITERATIONS; ++i) {
+                                unsigned char *&slot = held[i % HELD];
+                                if (slot != nullptr) {
+                                        ok[t] = ok[t] && slot[0] == t &&
+                                                slot[ITEM_SIZE - 1] == t;
+                                        packet_pool_free(slot);
+                                }
+                                slot = (unsigned char *) packet_pool_alloc(pool);
+                                slot[0] = slot[ITEM_SIZE - 1] = t;
+                        }
+                        for (auto *item : held) {
+                                packet_pool_free(item);
+                        }
+                });
+        }
+        for (auto &t : threads) {
+                t.join();
+        }
+        for (int t = 0; t < THREADS; ++t) {
+                ASSERT_MESSAGE("pool item modified by other thread", ok[t]);
+        }
+
+        // item outlives the pool owner
+        void *item = packet_pool_alloc(pool);
+        struct packet_pool_stats stats;
+        packet_pool_get_stats(item, &stats);
+        ASSERT_EQUAL((unsigned long long) THREADS * ITERATIONS + 1,
+                     stats.allocs);
+        ASSERT_LE_MESSAGE("pool allocated from heap in steady state", 4,
+                          stats.heap_allocs);
+        packet_pool_destroy(pool);
+        packet_pool_free(item);
+        return 0;
+}
+
+/**
+ * checks that invalid threads=<n> option values are rejected by filters
+ * instead of reaching parallel_rows()
+ */
+int misc_test_filter_threads_opt()
+{
+        ASSERT_EQUAL(0, parse_thread_count("0"));
+        ASSERT_EQUAL(4, parse_thread_count("4"));
+        const char *invalid[] = { "-1", "", "2x", "x", "99999999999" };
+        for (const char *val : invalid) {
+                ASSERT_MESSAGE(val, parse_thread_count(val) == -1);
+        }
+
+        struct capture_filter *cf = nullptr;
+        ASSERT_EQUAL(-1, capture_filter_init(nullptr, "flip:threads=-1", &cf));
+        ASSERT_EQUAL(0, capture_filter_init(nullptr, "flip:threads=2", &cf));
+        capture_filter_destroy(cf);
+        return 0;
+}
+
+/**
+ * checks that all GF(2^8) kernels supported by the CPU compute the same
+ * matrix product as the scalar reference (length is not a multiple of any
+ * vector width)
+ */
+int misc_test_gf256()
+{
+        enum { ROWS = 3, COLS = 5, LEN = 1500 };
+        ASSERT_EQUAL(0x1D, gf256_mul(0x80, 2)); // reduction by 0x11D
+        ASSERT_EQUAL(1, gf256_mul(0x8E, 2));
+
+        uint8_t mat[ROWS * COLS];
+        struct gf256_coef coefs[ROWS * COLS];
+        for (int i = 0; i < ROWS * COLS; ++i) {
+                mat[i] = i * 59 + 1;
+                gf256_coef_init(&coefs[i], mat[i]);
+        }
+        std::vector<uint8_t> src_data(COLS * LEN);
+        for (int i = 0; i < COLS * LEN; ++i) {
+                src_data[i] = i * 7 + i / 256;
+        }
+        const uint8_t *src[COLS];
+        for (int c = 0; c < COLS; ++c) {
+                src[c] = &src_data[c * LEN];
+        }
+        std::vector<uint8_t> ref(ROWS * LEN);
+        for (int r = 0; r < ROWS; ++r) {
+                for (int i = 0; i < LEN; ++i) {
+                        for (int c = 0; c < COLS; ++c) {
+                                ref[r * LEN + i] ^= gf256_mul(mat[r * COLS + c], src[c][i]);
+                        }
+                }
+        }
+
+        for (int k = GF256_KERNEL_SCALAR; k <= GF256_KERNEL_GFNI; ++k) {
+                if (!gf256_set_kernel((enum gf256_kernel) k)) {
+                        continue;
+                }
+                std::vector<uint8_t> out(ROWS * LEN);
+                uint8_t *dst[ROWS];
+                for (int r = 0; r < ROWS; ++r) {
+                        dst[r] = &out[r * LEN];
+                }
+                gf256_mul_matrix(dst, ROWS, src, COLS, coefs, LEN);
+                ASSERT_MESSAGE(gf256_get_kernel_name(), out == ref);
+        }
+        gf256_set_kernel(GF256_KERNEL_AUTO);
+        return 0;
+}
+
+/**
+ * checks that a video frame split to multiple RS blocks is recovered after
+ * losing n - k symbols of every block (including the header symbol) for all
+ * GF(2^8) kernels and that one more lost symbol is reported
+ */
+int misc_test_rs_multiblock()
+{
+        enum { K = 6, N = 9, BLOCKS = 4 };
+        commandline_params["rs-block-size"] = "16k";
+        std::unique_ptr<rs> enc;
+        try {
+                enc = std::make_unique<rs>("6:9", false);
+        } catch (ug_runtime_error &) { // zfec not compiled in
+                commandline_params.erase("rs-block-size");
+                return 1;
+        }
+        commandline_params.erase("rs-block-size");
+
+        // 60000 B of data + headers span 4 blocks of 16 KiB
+        struct video_desc desc { 200, 150, UYVY, 30.0, PROGRESSIVE, 1 };
+        std::shared_ptr<video_frame> in(vf_alloc_desc_data(desc), vf_free);
+        for (unsigned i = 0; i < in->tiles[0].data_len; ++i) {
+                in->tiles[0].data[i] = (char) (i * 31 + i / 251);
+        }
+
+        for (int k = GF256_KERNEL_SCALAR; k <= GF256_KERNEL_GFNI; ++k) {
+                if (!gf256_set_kernel((enum gf256_kernel) k)) {
+                        continue;
+                }
+                std::shared_ptr<video_frame> out = enc->encode(in);
+                ASSERT_EQUAL((unsigned) BLOCKS, out->fec_params.seed);
+                const unsigned ss = out->fec_params.symbol_size;
+                const int len = out->tiles[0].data_len;
+                ASSERT_EQUAL(ss * N * BLOCKS, (unsigned) len);
+
+                // symbol j of block b is at index j * BLOCKS + b
+                std::vector<char> buf(out->tiles[0].data, out->tiles[0].data + len);
+                std::map<int, int> received;
+                for (int j = 0; j < N; ++j) {
+                        for (int b = 0; b < BLOCKS; ++b) {
+                                const int idx = j * BLOCKS + b;
+                                if ((j - b + N) % (N / (N - K)) == 0) {
+                                        memset(&buf[idx * ss], 0xAA, ss);
+                                } else {
+                                        received[idx * ss] = ss;
+                                }
+                        }
+                }
+                std::vector<char> lossy = buf;
+                rs dec(K, N, BLOCKS);
+                char *data = nullptr;
+                int data_len = 0;
+                ASSERT_MESSAGE(gf256_get_kernel_name(),
+                               dec.decode(buf.data(), len, &data, &data_len, received));
+                const int hdr_len = data_len - (int) in->tiles[0].data_len;
+                ASSERT_EQUAL((int) sizeof(video_payload_hdr_t), hdr_len);
+                ASSERT_MESSAGE(gf256_get_kernel_name(),
+                               memcmp(data + hdr_len, in->tiles[0].data, in->tiles[0].data_len) == 0);
+
+                received.erase(1 * BLOCKS * ss); // one more symbol of block 0
+                ASSERT(!dec.decode(lossy.data(), len, &data, &data_len, received));
+        }
+        gf256_set_kernel(GF256_KERNEL_AUTO);
+        return 0;
+}
+
+static void ipc_frame_test_fill(Ipc_frame *f, int width, int height, char seed)
+{
+        f->header.width = width;
+        f->header.height = height;
+        f->header.data_len = width * height * 3;
+        f->header.color_spec = IPC_FRAME_COLOR_RGB;
+        for (int i = 0; i < f->header.data_len; ++i) {
+                f->data[i] = (char) (seed + i * 13);
+        }
+}
+
+static bool ipc_frame_test_check(const Ipc_frame *f, int width, int height, char seed)
+{
+        if (f->header.width != width || f->header.height != height ||
+            f->header.data_len != width * height * 3) {
+                return false;
+        }
+        for (int i = 0; i < f->header.data_len; ++i) {
+                if (f->data[i] != (char) (seed + i * 13)) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+/**
+ * passes frames over the unix socket - acquired frames, copied frames and a
+ * bigger frame forcing a new shared memory ring (Linux) - and reads them
+ * both with acquire and read
+ */
+int misc_test_ipc_frame_shm()
+{
+        std::string path = std::string(get_temp_dir()) + "ug_ipc_frame_test";
+        Ipc_frame_reader_uniq reader(ipc_frame_reader_new(path.c_str()));
+        ASSERT_MESSAGE("cannot create reader", reader != nullptr);
+        Ipc_frame_writer_uniq writer(ipc_frame_writer_new(path.c_str()));
+        ASSERT_MESSAGE("cannot create writer", writer != nullptr);
+        ipc_frame_reader_wait_connect(reader.get());
+
+        bool write_ok = true;
+        std::thread writer_thread([&] {
+                Ipc_frame *f = ipc_frame_writer_acquire(writer.get(), 64 * 48 * 3);
+                ipc_frame_test_fill(f, 64, 48, 1);
+                write_ok = write_ok && ipc_frame_writer_write(writer.get(), f);
+
+                Ipc_frame_uniq own(ipc_frame_new());
+                ipc_frame_reserve(own.get(), 64 * 48 * 3);
+                ipc_frame_test_fill(own.get(), 64, 48, 2);
+                write_ok = write_ok && ipc_frame_writer_write(writer.get(), own.get());
+
+                for (char seed = 3; seed < 8; ++seed) {
+                        f = ipc_frame_writer_acquire(writer.get(), 640 * 480 * 3);
+                        ipc_frame_test_fill(f, 640, 480, seed);
+                        write_ok = write_ok && ipc_frame_writer_write(writer.get(), f);
+                }
+        });
+
+        for (char seed = 1; seed < 7; ++seed) {
+                const Ipc_frame *f = ipc_frame_reader_acquire(reader.get());
+                ASSERT_MESSAGE("acquire failed", f != nullptr);
+                const int width = seed < 3 ? 64 : 640;
+                ASSERT_MESSAGE("frame corrupted", ipc_frame_test_check(f, width, width * 3 / 4, seed));
+#ifdef __linux__
+                ASSERT_MESSAGE("frame not passed in shared memory", f->shm);
+#endif
+        }
+        Ipc_frame_uniq copy(ipc_frame_new());
+        ASSERT_MESSAGE("read failed", ipc_frame_reader_read(reader.get(), copy.get()));
+        ASSERT_MESSAGE("frame corrupted", ipc_frame_test_check(copy.get(), 640, 480, 7));
+
+        writer_thread.join();
+        ASSERT_MESSAGE("write failed", write_ok);
+        return 0;
+}
+
+/**
+ * checks histogram percentiles (within the bucket precision) and
+ * serialization of the RTP header extension
+ */
+int misc_test_latency_trace()
+{
+        struct latency_stats st;
+        latency_trace_get(LATENCY_STAGE_DISPLAY, &st, true); // clear
+        for (int i = 1; i <= 1000; ++i) {
+                latency_trace_record(LATENCY_STAGE_DISPLAY, i * NS_IN_US);
+        }
+        latency_trace_record(LATENCY_STAGE_DISPLAY, -1); // ignored
+        latency_trace_get(LATENCY_STAGE_DISPLAY, &st, true);
+        ASSERT_EQUAL(1000ULL, st.count);
+        ASSERT_EQUAL(1000LL, st.max / NS_IN_US);
+        ASSERT(st.p50 / NS_IN_US >= 500 && st.p50 / NS_IN_US <= 500 * 1.04);
+        ASSERT(st.p99 / NS_IN_US >= 990 && st.p99 / NS_IN_US <= 1000);
+        latency_trace_get(LATENCY_STAGE_DISPLAY, &st, false);
+        ASSERT_EQUAL(0ULL, st.count);
+
+        const struct latency_trace_ext in = { 1792213552396123456LL, 1, 2, 3, 4, 5 };
+        unsigned char extn[4 + 4 * LATENCY_TRACE_EXT_WORDS] = {};
+        latency_trace_ext_format(&in, (uint32_t *)(void *) (extn + 4));
+        struct latency_trace_ext out{};
+        ASSERT(!latency_trace_ext_parse(extn, LATENCY_TRACE_EXT_WORDS, 0xBEDE, &out));
+        ASSERT(latency_trace_ext_parse(extn, LATENCY_TRACE_EXT_WORDS,
+                                       LATENCY_TRACE_EXT_TYPE, &out));
+        ASSERT_EQUAL(in.capture_time, out.capture_time);
+        ASSERT_EQUAL(in.filter_us, out.filter_us);
+        ASSERT_EQUAL(in.send_us, out.send_us);
+
+        // remote sender stages must not mix with the local ones
+        latency_trace_get(LATENCY_STAGE_COMPRESS, &st, true);
+        latency_trace_get(LATENCY_STAGE_REMOTE_COMPRESS, &st, true);
+        latency_trace_record(LATENCY_STAGE_COMPRESS, 7 * NS_IN_US);
+        latency_trace_record_sender(&out);
+        latency_trace_get(LATENCY_STAGE_COMPRESS, &st, true);
+        ASSERT_EQUAL(1ULL, st.count);
+        ASSERT_EQUAL(7LL, st.max / NS_IN_US);
+        latency_trace_get(LATENCY_STAGE_REMOTE_COMPRESS, &st, true);
+        ASSERT_EQUAL(1ULL, st.count);
+        ASSERT_EQUAL((long long) in.compress_us, st.max / NS_IN_US);
+        ASSERT(strcmp(latency_stage_name(LATENCY_STAGE_REMOTE_COMPRESS),
+                      latency_stage_name(LATENCY_STAGE_COMPRESS)) != 0);
+        return 0;
+}
+
+/**
+ * checks that LDGM parity matches the naive implementation (packet size is
+ * not a multiple of SIMD width) and that lost data symbols are recovered
+ */
+int misc_test_ldgm()
+{
+        enum { K = 256, M = 192, C = 5, FRAME_SIZE = 100000 };
+        const char *matrix_fname = nullptr;
+        FILE *f = get_temp_file(&matrix_fname);
+        ASSERT_MESSAGE("cannot create temporary file", f != nullptr);
+        fclose(f);
+        std::string matrix_path = matrix_fname;
+        ASSERT_EQUAL(0, generate_ldgm_matrix(&matrix_path[0], K, M, C, 1, 0));
+
+        LDGM_session_cpu session;
+        session.set_params(K, M, C);
+        session.set_pcMatrix(&matrix_path[0]);
+        remove(matrix_path.c_str());
+
+        std::vector<char> frame(FRAME_SIZE);
+        for (int i = 0; i < FRAME_SIZE; ++i) {
+                frame[i] = (char) (i * 7 + i / 251);
+        }
+        int buf_size = 0;
+        char *out = session.encode_frame(frame.data(), FRAME_SIZE, &buf_size);
+        const int ps = buf_size / (K + M);
+        std::vector<char> parity(M * ps);
+        session.encode_naive(out, parity.data());
+        ASSERT_MESSAGE("LDGM parity differs from naive implementation",
+                       memcmp(out + K * ps, parity.data(), parity.size()) == 0);
+
+        std::map<int, int> valid_data;
+        for (int i = 0; i < K + M; ++i) {
+                if (i == 5 || i == 100) {
+                        memset(out + i * ps, 0, ps);
+                } else {
+                        valid_data[i * ps] = ps;
+                }
+        }
+        int frame_size = 0;
+        char *decoded = session.decode_frame(out, buf_size, &frame_size, valid_data);
+        ASSERT_EQUAL(FRAME_SIZE, frame_size);
+        ASSERT_MESSAGE("LDGM recovered data differ",
+                       memcmp(decoded, frame.data(), FRAME_SIZE) == 0);
+        session.free_out_buf(out);
+        return 0;
+}
+
+/**
+ * fills the per-thread log ring while the flusher is blocked on a full
+ * stdout (pipe) and checks that the overflow is counted as dropped and that
+ * log_flush() writes records of more threads in the timestamp order
+ */
+int misc_test_log_async_overflow()
+{
+        enum { INTERLEAVED = 10, FLOOD = 2000 }; // FLOOD records > 2 rings
+        int pipefd[2];
+        ASSERT(pipe(pipefd) == 0);
+        fflush(stdout);
+        const int saved_stdout = dup(STDOUT_FILENO);
+        ASSERT(saved_stdout != -1);
+        dup2(pipefd[1], STDOUT_FILENO);
+        // fill the pipe so that the flusher blocks in its first write
+        const int flags = fcntl(pipefd[1], F_GETFL);
+        fcntl(pipefd[1], F_SETFL, flags | O_NONBLOCK);
+        const char nl = '\n';
+        while (write(pipefd[1], &nl, 1) == 1) {
+        }
+        fcntl(pipefd[1], F_SETFL, flags);
+
+        const int saved_log_level = log_level;
+        log_level = LOG_LEVEL_INFO;
+        log_async_start();
+        // odd records from another thread (ring) to have something to sort
+        for (int i = 0; i < INTERLEAVED; ++i) {
+                if (i % 2 == 0) {
+                        log_msg(LOG_LEVEL_INFO, "logtest %d\n", i);
+                } else {
+                        thread([i] {
+                                log_msg(LOG_LEVEL_INFO, "logtest %d\n", i);
+                        }).join();
+                }
+        }
+        const string pad(100, 'x');
+        for (int i = INTERLEAVED; i < INTERLEAVED + FLOOD; ++i) {
+                log_msg(LOG_LEVEL_INFO, "logtest %d %s\n", i, pad.c_str());
+        }
+
+        string out;
+        thread reader([&out, fd = pipefd[0]] {
+                char buf[4096];
+                ssize_t ret = 0;
+                while ((ret = read(fd, buf, sizeof buf)) > 0) {
+                        out.append(buf, ret);
+                }
+        });
+        log_flush();
+        log_async_stop();
+        log_level = saved_log_level;
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        close(pipefd[1]);
+        reader.join();
+        close(pipefd[0]);
+
+        int written = 0;
+        int dropped = 0;
+        int last = -1;
+        istringstream iss(out);
+        string line;
+        while (getline(iss, line)) {
+                int seq = 0;
+                size_t pos = 0;
+                if ((pos = line.find("logtest ")) != string::npos &&
+                    sscanf(line.c_str() + pos, "logtest %d", &seq) == 1) {
+                        ASSERT_MESSAGE("log records out of order", seq > last);
+                        last = seq;
+                        written += 1;
+                } else if ((pos = line.find("Log: ")) != string::npos) {
+                        int count = 0;
+                        const int parsed =
+                            sscanf(line.c_str() + pos, "Log: %d", &count);
+                        ASSERT_EQUAL(1, parsed);
+                        dropped += count;
+                }
+        }
+        ASSERT(written >= INTERLEAVED);
+        ASSERT(dropped > 0);
+        ASSERT_EQUAL(INTERLEAVED + FLOOD, written + dropped);
+        return 0;
+}
+
+/**
+ * checks that a rate-limited message passes once per interval and that
+ * suppressed messages are counted
+ */
+int misc_test_log_rate_limit()
+{
+        struct log_rate_limit rl{};
+        ASSERT(log_rate_limit_pass(LOG_LEVEL_DEBUG2, &rl, 60000));
+        for (int i = 0; i < 3; ++i) {
+                ASSERT(!log_rate_limit_pass(LOG_LEVEL_DEBUG2, &rl, 60000));
+        }
+        ASSERT_EQUAL(3U, rl.suppressed);
+        rl.next = get_time_in_ns(); // interval elapsed
+        ASSERT(log_rate_limit_pass(LOG_LEVEL_DEBUG2, &rl, 60000));
+        ASSERT_EQUAL(0U, rl.suppressed);
+        return 0;
+}
+
+static int
+pbuf_reorder_check_decoded(struct coded_data *cdata, void *data,
+                           struct pbuf_stats * /* stats */)
+{
+        auto *seqs = static_cast<std::vector<int> *>(data);
+        for (; cdata != nullptr; cdata = cdata->nxt) {
+                seqs->push_back(cdata->seqno);
+        }
+        return 1;
+}
+
+/**
+ * inserts packets of a frame (crossing seqno wrap-around) in scrambled order
+ * incl. duplicates and checks that decoder gets them in descending order
+ */
+int misc_test_pbuf_reorder()
+{
+        enum { PKTS = 300, FIRST_SEQ = 65500 };
+        struct packet_pool *pool = packet_pool_create(sizeof(rtp_packet), PKTS);
+        struct pbuf *pbuf = pbuf_init("test", nullptr);
+        for (int i = 0; i < PKTS + 10; ++i) {
+                // stride 7 is co-prime with PKTS so every packet is visited
+                const int idx = i < PKTS ? (i * 7 + PKTS / 2) % PKTS : i % PKTS;
+                auto *pkt = static_cast<rtp_packet *>(packet_pool_alloc(pool));
+                memset(pkt, 0, sizeof *pkt);
+                pkt->seq = FIRST_SEQ + idx;
+                pkt->ts = 1000;
+                pkt->m = idx == PKTS - 1;
+                pbuf_insert(pbuf, pkt);
+        }
+        std::vector<int> seqs;
+        ASSERT_EQUAL(1, pbuf_decode(pbuf, get_time_in_ns() + NS_IN_SEC,
+                                    pbuf_reorder_check_decoded, &seqs));
+        ASSERT_EQUAL(PKTS, (int) seqs.size());
+        for (int i = 0; i < PKTS; ++i) {
+                ASSERT_EQUAL((FIRST_SEQ + PKTS - 1 - i) % (1 << 16), seqs[i]);
+        }
+        pbuf_destroy(pbuf);
+        packet_pool_destroy(pool);
+        return 0;
+}
+
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wstring-concatenation"
 #endif
@@ -156,3 +853,312 @@ int misc_test_video_desc_io_op_symmetry()
         }
         return 0;
 }
+
+/**
+ * exports frames 'a', 'b', ... to segments of 3 frames and checks that import
+ * returns the expected frames in order
+ *
+ * @param fsize_limit  if non-zero, limit of the file size (to make writes fail)
+ */
+static int export_import_segmented(rlim_t fsize_limit, const std::string &expected_frames)
+{
+        enum { FRAMES = 5, SEGMENT_FRAMES = 3, MAX_SEGMENTS = 3 };
+        struct video_desc desc { 64, 32, UYVY, 1000.0, PROGRESSIVE, 1 };
+        const size_t data_len = vc_get_datalen(desc.width, desc.height, desc.color_spec);
+        assert(data_len % VIDEO_EXPORT_SEGMENT_ALIGN == 0); // no padding
+
+        const std::string dir = std::string(get_temp_dir()) + "ug_export_segmented_test";
+        if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+                return 1;
+        }
+        struct rlimit orig_limit;
+        getrlimit(RLIMIT_FSIZE, &orig_limit);
+        if (fsize_limit != 0) {
+                struct rlimit limit = orig_limit;
+                limit.rlim_cur = fsize_limit;
+                signal(SIGXFSZ, SIG_IGN); // write() fails with EFBIG instead
+                setrlimit(RLIMIT_FSIZE, &limit);
+        }
+        struct video_export *exp = video_export_init(dir.c_str(), SEGMENT_FRAMES * data_len);
+        ASSERT(exp != nullptr);
+        struct video_frame *frame = vf_alloc_desc_data(desc);
+        for (int i = 0; i < FRAMES; ++i) {
+                memset(frame->tiles[0].data, 'a' + i, data_len);
+                video_export(exp, frame);
+        }
+        vf_free(frame);
+        video_export_destroy(exp);
+        setrlimit(RLIMIT_FSIZE, &orig_limit);
+        signal(SIGXFSZ, SIG_DFL);
+
+        struct module root; // import registers keyboard controls
+        module_init_default(&root);
+        root.cls = MODULE_CLASS_ROOT;
+        struct vidcap_params *params = vidcap_params_allocate();
+        vidcap_params_set_device(params, ("import:" + dir + ":noaudio").c_str());
+        struct vidcap *cap = nullptr;
+        const int rc = initialize_video_capture(&root, params, &cap);
+        vidcap_params_free_struct(params);
+        ASSERT_EQUAL(VIDCAP_INIT_OK, rc);
+        for (char c : expected_frames) {
+                struct audio_frame *audio = nullptr;
+                struct video_frame *f = nullptr;
+                for (int attempt = 0; f == nullptr && attempt < 1000; ++attempt) {
+                        f = vidcap_grab(cap, &audio);
+                }
+                ASSERT_MESSAGE(std::string("frame ") + c, f != nullptr);
+                ASSERT_EQUAL(data_len, (size_t) f->tiles[0].data_len);
+                const std::string expected(data_len, c);
+                const bool same = memcmp(f->tiles[0].data, expected.data(), data_len) == 0;
+                VIDEO_FRAME_DISPOSE(f);
+                ASSERT_MESSAGE(std::string("frame ") + c, same);
+        }
+        vidcap_done(cap);
+        module_done(&root);
+
+        for (int i = 0; i < MAX_SEGMENTS; ++i) {
+                char name[MAX_PATH_SIZE];
+                snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_SEGMENT_NAME, dir.c_str(), i);
+                remove(name);
+                snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_INDEX_NAME, dir.c_str(), i);
+                remove(name);
+        }
+        remove((dir + "/video.info").c_str());
+        rmdir(dir.c_str());
+        return 0;
+}
+
+/**
+ * checks segmented export/import roundtrip across the segment boundary and
+ * that a failed tile write (file size limit hit in the middle of the 3rd
+ * frame) does not corrupt the frames written after it
+ */
+int misc_test_video_export_segmented()
+{
+        ASSERT_EQUAL(0, export_import_segmented(0, "abcde"));
+        // 2.5 frames - the 3rd frame fails, 4th starts a new segment
+        ASSERT_EQUAL(0, export_import_segmented(5 * 2048, "abde"));
+        return 0;
+}
+
+/// reference for rtpenc_get_next_nal() - position of the first start code
+static long naive_start_code(const unsigned char *buf, long len, long from)
+{
+        for (long i = from; i + 4 <= len; ++i) { // NAL has at least 1 byte
+                if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+/**
+ * checks that the (vectorized) start code scan finds the same NAL units as
+ * a naive search for 3- and 4-byte start codes at various alignments
+ */
+int misc_test_h264_start_code_scan()
+{
+        enum { LEN = 1000, ROUNDS = 200 };
+        std::vector<unsigned char> buf(LEN + 64);
+        unsigned seed = 1;
+        for (int round = 0; round < ROUNDS; ++round) {
+                const long len = LEN - round;
+                for (long i = 0; i < len; ++i) {
+                        seed = seed * 1103515245 + 12345;
+                        buf[i] = (seed >> 16) & 0x3; // frequent zeros
+                }
+                for (int i = 0; i < 4; ++i) { // plant 3B and 4B start codes
+                        seed = seed * 1103515245 + 12345;
+                        const long pos = (seed >> 8) % (len - 4);
+                        memcpy(&buf[pos], "\0\0\0\1" + (i % 2), 4 - (i % 2));
+                }
+                const unsigned char *start = buf.data();
+                const unsigned char *const end = buf.data() + len;
+                long expected = naive_start_code(buf.data(), len, 0);
+                while (true) {
+                        const unsigned char *nal_end = nullptr;
+                        const unsigned char *nal =
+                            rtpenc_get_next_nal(start, end - start, &nal_end);
+                        if (expected == -1) {
+                                ASSERT(nal == nullptr);
+                                break;
+                        }
+                        ASSERT(nal == buf.data() + expected + 3);
+                        const long next =
+                            naive_start_code(buf.data(), len, expected + 3);
+                        const unsigned char *exp_end =
+                            next == -1 ? end : buf.data() + next;
+                        if (next > 0 && buf[next - 1] == 0 &&
+                            next - 1 >= expected + 3) {
+                                exp_end -= 1; // 4-byte start code
+                        }
+                        ASSERT(nal_end == exp_end);
+                        if (next == -1) {
+                                break;
+                        }
+                        start = buf.data() + next;
+                        expected = next;
+                }
+        }
+        return 0;
+}
+
+struct worker_test_data {
+        std::vector<std::atomic<int>> *hits;
+        size_t grain;
+        bool nested;
+};
+
+static void worker_test_mark(size_t start, size_t end, void *udata)
+{
+        auto *d = (struct worker_test_data *) udata;
+        if (d->nested) { // each index expands to 10 nested ones
+                struct worker_test_data nested = { d->hits, 3, false };
+                for (size_t i = start; i < end; ++i) {
+                        task_parallel_for(10, nested.grain,
+                                          [](size_t s, size_t e, void *ud) {
+                                                  auto *n = (struct worker_test_data *) ud;
+                                                  for (size_t j = s; j < e; ++j) {
+                                                          (*n->hits)[j] += 1;
+                                                  }
+                                          },
+                                          &nested);
+                }
+                return;
+        }
+        // range longer than grain is recorded as an extra hit
+        const int inc = d->grain == 0 || end - start <= d->grain ? 1 : 2;
+        for (size_t i = start; i < end; ++i) {
+                (*d->hits)[i] += inc;
+        }
+}
+
+static void *worker_test_task(void *arg)
+{
+        return (char *) arg + 1;
+}
+
+/**
+ * checks that the parallel for visits every index exactly once for various
+ * grains (including nested calls) and that task_run_parallel() collects
+ * results in order
+ */
+int misc_test_worker_parallel_for()
+{
+        const size_t counts[] = { 0, 1, 7, 1000, 100003 };
+        const size_t grains[] = { 0, 1, 13, 1000000 };
+        for (size_t count : counts) {
+                for (size_t grain : grains) {
+                        std::vector<std::atomic<int>> hits(count);
+                        struct worker_test_data d = { &hits, grain, false };
+                        task_parallel_for(count, grain, worker_test_mark, &d);
+                        for (size_t i = 0; i < count; ++i) {
+                                ASSERT_EQUAL_MESSAGE("index " + to_string(i), 1, hits[i].load());
+                        }
+                }
+        }
+
+        std::vector<std::atomic<int>> hits(10);
+        struct worker_test_data d = { &hits, 1, true };
+        task_parallel_for(50, 1, worker_test_mark, &d);
+        for (auto &h : hits) {
+                ASSERT_EQUAL(50, h.load());
+        }
+
+        char data[37];
+        void *res[37];
+        task_run_parallel(worker_test_task, 37, data, 1, res);
+        for (int i = 0; i < 37; ++i) {
+                ASSERT(res[i] == data + i + 1);
+        }
+
+        struct worker_pool_stats stats;
+        worker_pool_get_stats(&stats);
+        ASSERT_EQUAL(0U, stats.queue_depth);
+        return 0;
+}
+
+/**
+ * checks that packets encrypted in a batch decrypt both per-packet and in a
+ * batch for all ciphers, that IVs differ and that sliced CRC32 matches the
+ * bytewise one
+ */
+int misc_test_openssl_batch()
+{
+        for (size_t len = 0; len < 100; ++len) {
+                char buf[100];
+                for (size_t i = 0; i < len; ++i) {
+                        buf[i] = (char) (i * 37 + len);
+                }
+                uint32_t crc = 0xFFFFFFFF;
+                for (size_t i = 0; i < len; ++i) {
+                        crc = updateCRC32(buf[i], crc);
+                }
+                ASSERT_EQUAL(~crc, crc32buf(buf, len));
+        }
+
+        const auto *enc = static_cast<const struct openssl_encrypt_info *>(load_library(
+            "openssl_encrypt", LIBRARY_CLASS_UNDEFINED, OPENSSL_ENCRYPT_ABI_VERSION));
+        const auto *dec = static_cast<const struct openssl_decrypt_info *>(load_library(
+            "openssl_decrypt", LIBRARY_CLASS_UNDEFINED, OPENSSL_DECRYPT_ABI_VERSION));
+        if (enc == nullptr || dec == nullptr) {
+                return 1;
+        }
+        enum { PKTS = 50, LEN = 1000, AAD_LEN = 24 };
+        const char *ciphers[] = { "gcm", "cbc", "ctr", "cfb", "ecb" };
+        for (const char *cipher : ciphers) {
+                struct openssl_encrypt *e = nullptr;
+                struct openssl_decrypt *d = nullptr;
+                const string pass = string("passphrase:cipher=") + cipher;
+                if (enc->init(&e, pass.c_str()) != 0) {
+                        continue; // not compiled in
+                }
+                ASSERT_EQUAL(0, dec->init(&d, pass.c_str()));
+                const enum openssl_mode mode = enc->get_cipher(e);
+
+                vector<char> plain(PKTS * LEN);
+                for (size_t i = 0; i < plain.size(); ++i) {
+                        plain[i] = (char) (i * 7 + i / LEN);
+                }
+                char aad[AAD_LEN] = "header";
+                vector<char> cipher_arena(PKTS * (LEN + MAX_CRYPTO_EXCEED));
+                vector<struct openssl_crypt_pkt> pkts(PKTS);
+                for (int i = 0; i < PKTS; ++i) {
+                        pkts[i] = { &plain[i * LEN], LEN - i, aad, AAD_LEN, mode,
+                                    &cipher_arena[i * (LEN + MAX_CRYPTO_EXCEED)], 0 };
+                }
+                ASSERT_MESSAGE(cipher, enc->encrypt_batch(e, pkts.data(), PKTS));
+                char single[LEN + MAX_CRYPTO_EXCEED];
+                const int single_len = enc->encrypt(e, plain.data(), LEN, aad, AAD_LEN, single);
+                ASSERT(single_len > 0);
+
+                set<string> ivs;
+                vector<char> out_arena(PKTS * (LEN + MAX_CRYPTO_EXCEED));
+                vector<struct openssl_crypt_pkt> dpkts(PKTS);
+                for (int i = 0; i < PKTS; ++i) {
+                        ASSERT(pkts[i].out_len > 0);
+                        ivs.insert(string(pkts[i].out + 4, 16));
+                        char out[LEN + MAX_CRYPTO_EXCEED];
+                        ASSERT_EQUAL(LEN - i, dec->decrypt(d, pkts[i].out, pkts[i].out_len, aad, AAD_LEN, out, mode));
+                        ASSERT(memcmp(out, &plain[i * LEN], LEN - i) == 0);
+                        dpkts[i] = { pkts[i].out, pkts[i].out_len, aad, AAD_LEN, mode,
+                                     &out_arena[i * (LEN + MAX_CRYPTO_EXCEED)], 0 };
+                }
+                ivs.insert(string(single + 4, 16));
+                ASSERT_EQUAL_MESSAGE(cipher, (size_t) PKTS + 1, ivs.size());
+                pkts[3].out[30] ^= 1; // corrupt - must be rejected
+                dec->decrypt_batch(d, dpkts.data(), PKTS);
+                for (int i = 0; i < PKTS; ++i) {
+                        if (i == 3) {
+                                ASSERT_EQUAL_MESSAGE(cipher, 0, dpkts[i].out_len);
+                                continue;
+                        }
+                        ASSERT_EQUAL(LEN - i, dpkts[i].out_len);
+                        ASSERT(memcmp(dpkts[i].out, &plain[i * LEN], LEN - i) == 0);
+                }
+                enc->destroy(e);
+                dec->destroy(d);
+        }
+        return 0;
+}
+
@@ -76,6 +76,7 @@ long packet_rate = 13600;
 #define DEFINE_TEST(func) { #func, func, false }
 
 DECLARE_TEST(codec_conversion_test_testcard_uyvy_to_i420);
+DECLARE_TEST(codec_conversion_test_simd_line_decoders_bit_exact);
 DECLARE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r10k);
 DECLARE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r12l);
 DECLARE_TEST(ff_codec_conversions_test_yuv444p16le_from_to_rg48);
@@ -86,11 +87,28 @@ DECLARE_TEST(get_framerate_test_3000);
 DECLARE_TEST(get_framerate_test_free);
 DECLARE_TEST(gpujpeg_test_simple);
 DECLARE_TEST(libavcodec_test_get_decoder_from_uv_to_uv);
+DECLARE_TEST(misc_test_audio_mixer_normalize);
+DECLARE_TEST(misc_test_capture_filter_in_place);
 DECLARE_TEST(misc_test_color_coeff_range);
+DECLARE_TEST(misc_test_deinterlace_bob);
+DECLARE_TEST(misc_test_filter_threads_opt);
+DECLARE_TEST(misc_test_gf256);
+DECLARE_TEST(misc_test_h264_start_code_scan);
+DECLARE_TEST(misc_test_ipc_frame_shm);
+DECLARE_TEST(misc_test_latency_trace);
+DECLARE_TEST(misc_test_ldgm);
+DECLARE_TEST(misc_test_log_async_overflow);
+DECLARE_TEST(misc_test_log_rate_limit);
 DECLARE_TEST(misc_test_net_getsockaddr);
 DECLARE_TEST(misc_test_net_sockaddr_compare_v4_mapped);
+DECLARE_TEST(misc_test_openssl_batch);
+DECLARE_TEST(misc_test_packet_pool);
+DECLARE_TEST(misc_test_pbuf_reorder);
 DECLARE_TEST(misc_test_replace_all);
+DECLARE_TEST(misc_test_rs_multiblock);
 DECLARE_TEST(misc_test_video_desc_io_op_symmetry);
+DECLARE_TEST(misc_test_video_export_segmented);
+DECLARE_TEST(misc_test_worker_parallel_for);
 
 struct {
         const char *name;
@@ -110,6 +128,7 @@ struct {
         DEFINE_QUIET_TEST(test_video_display),
 #endif
         DEFINE_TEST(codec_conversion_test_testcard_uyvy_to_i420),
+        DEFINE_TEST(codec_conversion_test_simd_line_decoders_bit_exact),
 #if defined HAVE_LAVC
         DEFINE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r10k),
         DEFINE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r12l),
@@ -122,11 +141,28 @@ struct {
         DEFINE_TEST(get_framerate_test_free),
         DEFINE_TEST(gpujpeg_test_simple),
         DEFINE_TEST(libavcodec_test_get_decoder_from_uv_to_uv),
+        DEFINE_TEST(misc_test_audio_mixer_normalize),
+        DEFINE_TEST(misc_test_capture_filter_in_place),
         DEFINE_TEST(misc_test_color_coeff_range),
+        DEFINE_TEST(misc_test_deinterlace_bob),
+        DEFINE_TEST(misc_test_filter_threads_opt),
+        DEFINE_TEST(misc_test_gf256),
+        DEFINE_TEST(misc_test_h264_start_code_scan),
+        DEFINE_TEST(misc_test_ipc_frame_shm),
+        DEFINE_TEST(misc_test_latency_trace),
+        DEFINE_TEST(misc_test_ldgm),
+        DEFINE_TEST(misc_test_log_async_overflow),
+        DEFINE_TEST(misc_test_log_rate_limit),
         DEFINE_TEST(misc_test_net_getsockaddr),
         DEFINE_TEST(misc_test_net_sockaddr_compare_v4_mapped),
+        DEFINE_TEST(misc_test_openssl_batch),
+        DEFINE_TEST(misc_test_packet_pool),
+        DEFINE_TEST(misc_test_pbuf_reorder),
         DEFINE_TEST(misc_test_replace_all),
+        DEFINE_TEST(misc_test_rs_multiblock),
         DEFINE_TEST(misc_test_video_desc_io_op_symmetry),
+        DEFINE_TEST(misc_test_video_export_segmented),
+        DEFINE_TEST(misc_test_worker_parallel_for),
 };
 
 static bool test_helper(const char *name, int (*func)(), bool quiet) {
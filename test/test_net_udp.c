@@ -45,6 +45,8 @@
 
 #include "debug.h"
 #include "rtp/net_udp.h"
+#include "rtp/rtp.h"
+#include "utils/packet_pool.h"
 #include "test_net_udp.h"
 
 #define BUFSIZE 1024
@@ -132,6 +134,116 @@ int test_net_udp(void)
         hname = udp_host_addr(s1);      /* we need this for the unicast test... */
         udp_exit(s1);
 
+        /**********************************************************************/
+        /* Multithreaded reader - receive several packets in a batch...       */
+        printf
+            ("Testing UDP/IP networking (IPv4 loopback batch) .......................... ");
+        fflush(stdout);
+        s1 = udp_init("127.0.0.1", 5004, 5004, 1, 0, true);
+        if (s1 == NULL) {
+                printf("FAIL\n");
+                printf("  Cannot initialize socket\n");
+                return -1;
+        }
+        enum { BATCH_PKTS = 8 };
+        for (i = 0; i < BATCH_PKTS; i++) {
+                buf1[0] = (char) i;
+                if (udp_send(s1, buf1, BUFSIZE) < 0) {
+                        printf("FAIL\n");
+                        perror("  Cannot send packet");
+                        goto abort_batch;
+                }
+        }
+        for (i = 0; i < BATCH_PKTS; ) {
+                char *bufs[BATCH_PKTS];
+                int lens[BATCH_PKTS];
+                timeout.tv_sec = 1;
+                timeout.tv_usec = 0;
+                if (!udp_not_empty(s1, &timeout)) {
+                        printf("FAIL\n");
+                        printf("  No data waiting\n");
+                        goto abort_batch;
+                }
+                int count = udp_recv_data_batch(s1, bufs, lens, BATCH_PKTS - i);
+                bool ok = true;
+                for (int j = 0; j < count; ++j, ++i) {
+                        char *data = bufs[j] + RTP_PACKET_HEADER_SIZE;
+                        buf1[0] = (char) i;
+                        ok = ok && lens[j] == BUFSIZE && memcmp(buf1, data, BUFSIZE) == 0;
+                        packet_pool_free(bufs[j]);
+                }
+                if (!ok) {
+                        printf("FAIL\n");
+                        printf("  Buffer corrupt or reordered\n");
+                        goto abort_batch;
+                }
+        }
+        printf("Ok\n");
+ abort_batch:
+        udp_exit(s1);
+
+        /**********************************************************************/
+        /* Send a batch with sendmmsg() and receive it with recvmmsg()...     */
+        printf
+            ("Testing UDP/IP networking (IPv4 loopback mmsg batch) ..................... ");
+        fflush(stdout);
+        s1 = udp_init("127.0.0.1", 5004, 5004, 1, 0, false);
+        if (s1 == NULL) {
+                printf("FAIL\n");
+                printf("  Cannot initialize socket\n");
+                return -1;
+        }
+        {
+                static char send_bufs[BATCH_PKTS][BUFSIZE];
+                static char recv_bufs[BATCH_PKTS][BUFSIZE];
+                char *sbufs[BATCH_PKTS];
+                char *rbufs[BATCH_PKTS];
+                int slens[BATCH_PKTS];
+                int rlens[BATCH_PKTS];
+                for (i = 0; i < BATCH_PKTS; i++) {
+                        randomize(send_bufs[i], BUFSIZE);
+                        send_bufs[i][0] = (char) i;
+                        sbufs[i] = send_bufs[i];
+                        rbufs[i] = recv_bufs[i];
+                        slens[i] = BUFSIZE - i; // distinct lengths
+                }
+                struct sockaddr_in dst = { 0 };
+                dst.sin_family = AF_INET;
+                dst.sin_port = htons(5004);
+                dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                if (udp_sendto_batch(s1, sbufs, slens, BATCH_PKTS,
+                                     (struct sockaddr *) &dst,
+                                     sizeof dst) != BATCH_PKTS) {
+                        printf("FAIL\n");
+                        perror("  Cannot send batch");
+                        goto abort_mmsg_batch;
+                }
+                for (i = 0; i < BATCH_PKTS;) {
+                        timeout.tv_sec = 1;
+                        timeout.tv_usec = 0;
+                        int count = udp_recvfrom_batch(
+                            s1, rbufs + i, BUFSIZE, rlens + i, BATCH_PKTS - i,
+                            &timeout, NULL, NULL);
+                        if (count <= 0) {
+                                printf("FAIL\n");
+                                printf("  No data waiting\n");
+                                goto abort_mmsg_batch;
+                        }
+                        i += count;
+                }
+                for (i = 0; i < BATCH_PKTS; i++) {
+                        if (rlens[i] != slens[i] ||
+                            memcmp(send_bufs[i], recv_bufs[i], slens[i]) != 0) {
+                                printf("FAIL\n");
+                                printf("  Buffer corrupt or reordered\n");
+                                goto abort_mmsg_batch;
+                        }
+                }
+        }
+        printf("Ok\n");
+ abort_mmsg_batch:
+        udp_exit(s1);
+
         /**********************************************************************/
         /* Now we send a packet to ourselves via our real network address...  */
         printf
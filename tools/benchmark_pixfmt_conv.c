@@ -0,0 +1,585 @@
+/**
+ * @file   benchmark_pixfmt_conv.c
+ * @brief  benchmark of UltraGrid pixel format conversions
+ *
+ * Measures every line decoder returned by get_decoder_from_to() (including
+ * each SIMD variant), scaling of parallel_pix_conv() with the thread count
+ * and vc_deinterlace_ex(). Each measurement is preceded by warm-up runs, the
+ * median of the samples is reported as ns per line and GB/s of the output
+ * (destination) data. Output is CSV or JSON so that runs can be compared.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "pixfmt_conv.h"
+#include "utils/parallel_conv.h"
+#include "video_codec.h"
+
+#define MAX_RESOLUTIONS 8
+#define MAX_THREAD_COUNTS 16
+#define MAX_CODEC_FILTERS 16
+
+enum bench {
+        BENCH_CONV        = 1 << 0,
+        BENCH_PARALLEL    = 1 << 1,
+        BENCH_DEINTERLACE = 1 << 2,
+};
+
+struct resolution {
+        int width;
+        int height;
+};
+
+struct opts {
+        bool json;
+        int benches;
+        int warmup;
+        int samples;
+        struct resolution res[MAX_RESOLUTIONS];
+        int res_count;
+        int threads[MAX_THREAD_COUNTS];
+        int thread_count;
+        codec_t codecs[MAX_CODEC_FILTERS];
+        int codec_count;
+};
+
+struct record {
+        const char *bench;
+        codec_t in;
+        codec_t out;
+        const char *variant;
+        struct resolution res;
+        int threads;
+        double median_s;     ///< median duration of one frame
+        size_t dst_bytes;    ///< output bytes of one frame
+};
+
+static int record_count;
+
+static double
+get_time_s(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec / 1E9;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+        double x = *(const double *) a;
+        double y = *(const double *) b;
+        return (x > y) - (x < y);
+}
+
+static double
+median(double *vals, int count)
+{
+        qsort(vals, count, sizeof vals[0], cmp_double);
+        return count % 2 == 1 ? vals[count / 2]
+                              : (vals[count / 2 - 1] + vals[count / 2]) / 2;
+}
+
+/// fills buffer with pseudo-random data (xorshift, rand() is too slow for 8K)
+static void
+fill_random(unsigned char *buf, size_t len)
+{
+        uint64_t x = 0x9E3779B97F4A7C15ULL;
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                memcpy(buf + i, &x, 8);
+        }
+        for (; i < len; ++i) {
+                buf[i] = (unsigned char) i;
+        }
+}
+
+static void
+print_header(const struct opts *o)
+{
+        if (o->json) {
+                printf("[");
+        } else {
+                printf("bench,in,out,variant,width,height,threads,median_ms,"
+                       "ns_per_line,gbps\n");
+        }
+}
+
+static void
+print_footer(const struct opts *o)
+{
+        if (o->json) {
+                printf("\n]\n");
+        }
+}
+
+static void
+print_record(const struct opts *o, const struct record *r)
+{
+        const double ns_per_line = r->median_s * 1E9 / r->res.height;
+        const double gbps = r->dst_bytes / r->median_s / 1E9;
+        if (o->json) {
+                printf("%s\n  { \"bench\": \"%s\", \"in\": \"%s\", "
+                       "\"out\": \"%s\", \"variant\": \"%s\", "
+                       "\"width\": %d, \"height\": %d, \"threads\": %d, "
+                       "\"median_ms\": %.4f, \"ns_per_line\": %.1f, "
+                       "\"gbps\": %.3f }",
+                       record_count == 0 ? "" : ",", r->bench,
+                       get_codec_name(r->in), get_codec_name(r->out),
+                       r->variant, r->res.width, r->res.height, r->threads,
+                       r->median_s * 1E3, ns_per_line, gbps);
+        } else {
+                printf("%s,%s,%s,%s,%d,%d,%d,%.4f,%.1f,%.3f\n", r->bench,
+                       get_codec_name(r->in), get_codec_name(r->out),
+                       r->variant, r->res.width, r->res.height, r->threads,
+                       r->median_s * 1E3, ns_per_line, gbps);
+        }
+        fflush(stdout);
+        record_count += 1;
+}
+
+static bool
+codec_selected(const struct opts *o, codec_t in, codec_t out)
+{
+        if (o->codec_count == 0) {
+                return true;
+        }
+        for (int i = 0; i < o->codec_count; ++i) {
+                if (o->codecs[i] == in || o->codecs[i] == out) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+struct frame_bufs {
+        unsigned char *src;
+        unsigned char *dst;
+        size_t src_linesize;
+        size_t dst_linesize;
+};
+
+static bool
+alloc_bufs(struct frame_bufs *b, struct resolution res, codec_t in,
+           codec_t out)
+{
+        b->src_linesize = vc_get_linesize(res.width, in);
+        b->dst_linesize = vc_get_linesize(res.width, out);
+        const size_t src_len = b->src_linesize * res.height + MAX_PADDING;
+        const size_t dst_len = b->dst_linesize * res.height + MAX_PADDING;
+        b->src = malloc(src_len);
+        b->dst = malloc(dst_len);
+        if (b->src == NULL || b->dst == NULL) {
+                free(b->src);
+                free(b->dst);
+                return false;
+        }
+        fill_random(b->src, src_len);
+        memset(b->dst, 0, dst_len); // fault the pages in
+        return true;
+}
+
+static void
+free_bufs(struct frame_bufs *b)
+{
+        free(b->src);
+        free(b->dst);
+}
+
+enum run_type {
+        RUN_LINES,
+        RUN_PARALLEL,
+        RUN_DEINTERLACE,
+};
+
+struct run_params {
+        enum run_type type;
+        const struct frame_bufs *b;
+        int height;
+        decoder_t dec;
+        codec_t codec;
+        int threads;
+};
+
+static void
+run_once(const struct run_params *p)
+{
+        const struct frame_bufs *b = p->b;
+        switch (p->type) {
+        case RUN_LINES:
+                for (int y = 0; y < p->height; ++y) {
+                        p->dec(b->dst + y * b->dst_linesize,
+                               b->src + y * b->src_linesize,
+                               (int) b->dst_linesize, DEFAULT_R_SHIFT,
+                               DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                }
+                break;
+        case RUN_PARALLEL:
+                parallel_pix_conv(p->height, (char *) b->dst,
+                                  (int) b->dst_linesize, (const char *) b->src,
+                                  (int) b->src_linesize, p->dec, p->threads);
+                break;
+        case RUN_DEINTERLACE:
+                vc_deinterlace_ex(p->codec, b->src, b->src_linesize, b->dst,
+                                  b->dst_linesize, p->height);
+                break;
+        }
+}
+
+/// @returns median duration of one run in seconds
+static double
+measure(const struct opts *o, const struct run_params *p)
+{
+        double samples[o->samples];
+        for (int i = 0; i < o->warmup; ++i) {
+                run_once(p);
+        }
+        for (int i = 0; i < o->samples; ++i) {
+                double t0 = get_time_s();
+                run_once(p);
+                samples[i] = get_time_s() - t0;
+        }
+        return median(samples, o->samples);
+}
+
+static void
+benchmark_conv(const struct opts *o, struct resolution res)
+{
+        for (int i = VIDEO_CODEC_FIRST; i < VIDEO_CODEC_END; ++i) {
+                for (int j = VIDEO_CODEC_FIRST; j < VIDEO_CODEC_END; ++j) {
+                        codec_t in = (codec_t) i;
+                        codec_t out = (codec_t) j;
+                        if (i == j || get_decoder_from_to(in, out) == NULL ||
+                            !codec_selected(o, in, out)) {
+                                continue;
+                        }
+                        struct frame_bufs b;
+                        if (!alloc_bufs(&b, res, in, out)) {
+                                fprintf(stderr, "Cannot allocate buffers!\n");
+                                continue;
+                        }
+                        decoder_t last = NULL;
+                        for (int isa = PIXFMT_CONV_ISA_SCALAR;
+                             isa <= PIXFMT_CONV_ISA_AVX512; ++isa) {
+                                decoder_t dec = get_decoder_from_to_isa(
+                                    in, out, (enum pixfmt_conv_isa) isa);
+                                if (dec == NULL || dec == last) {
+                                        continue;
+                                }
+                                last = dec;
+                                struct run_params p = { RUN_LINES, &b,
+                                                        res.height, dec, in, 1 };
+                                struct record r = {
+                                        "conv", in, out,
+                                        pixfmt_conv_isa_name(isa), res, 1,
+                                        measure(o, &p),
+                                        b.dst_linesize * res.height
+                                };
+                                print_record(o, &r);
+                        }
+                        free_bufs(&b);
+                }
+        }
+}
+
+static void
+benchmark_parallel(const struct opts *o, struct resolution res)
+{
+        for (int i = VIDEO_CODEC_FIRST; i < VIDEO_CODEC_END; ++i) {
+                for (int j = VIDEO_CODEC_FIRST; j < VIDEO_CODEC_END; ++j) {
+                        codec_t in = (codec_t) i;
+                        codec_t out = (codec_t) j;
+                        decoder_t dec = get_decoder_from_to(in, out);
+                        if (i == j || dec == NULL ||
+                            !codec_selected(o, in, out)) {
+                                continue;
+                        }
+                        struct frame_bufs b;
+                        if (!alloc_bufs(&b, res, in, out)) {
+                                fprintf(stderr, "Cannot allocate buffers!\n");
+                                continue;
+                        }
+                        for (int t = 0; t < o->thread_count; ++t) {
+                                struct run_params p = { RUN_PARALLEL, &b,
+                                                        res.height, dec, in,
+                                                        o->threads[t] };
+                                struct record r = {
+                                        "parallel", in, out, "auto", res,
+                                        o->threads[t], measure(o, &p),
+                                        b.dst_linesize * res.height
+                                };
+                                print_record(o, &r);
+                        }
+                        free_bufs(&b);
+                }
+        }
+}
+
+static void
+benchmark_deinterlace(const struct opts *o, struct resolution res)
+{
+        for (int i = VIDEO_CODEC_FIRST; i < VIDEO_CODEC_END; ++i) {
+                codec_t c = (codec_t) i;
+                if (is_codec_opaque(c) || codec_is_planar(c) ||
+                    !codec_selected(o, c, c)) {
+                        continue;
+                }
+                struct frame_bufs b;
+                if (!alloc_bufs(&b, res, c, c)) {
+                        fprintf(stderr, "Cannot allocate buffers!\n");
+                        continue;
+                }
+                struct run_params p = { RUN_DEINTERLACE, &b, res.height, NULL,
+                                        c, 1 };
+                if (vc_deinterlace_ex(c, b.src, b.src_linesize, b.dst,
+                                      b.dst_linesize, res.height)) {
+                        struct record r = { "deinterlace", c, c, "-", res, 1,
+                                            measure(o, &p),
+                                            b.dst_linesize * res.height };
+                        print_record(o, &r);
+                }
+                free_bufs(&b);
+        }
+}
+
+static bool
+parse_resolutions(struct opts *o, char *arg)
+{
+        o->res_count = 0;
+        char *save_ptr = NULL;
+        char *item = NULL;
+        while ((item = strtok_r(arg, ",", &save_ptr)) != NULL) {
+                arg = NULL;
+                if (o->res_count == MAX_RESOLUTIONS) {
+                        return false;
+                }
+                struct resolution *r = &o->res[o->res_count++];
+                if (strcmp(item, "1080p") == 0) {
+                        *r = (struct resolution){ 1920, 1080 };
+                } else if (strcmp(item, "4k") == 0 ||
+                           strcmp(item, "2160p") == 0) {
+                        *r = (struct resolution){ 3840, 2160 };
+                } else if (strcmp(item, "8k") == 0 ||
+                           strcmp(item, "4320p") == 0) {
+                        *r = (struct resolution){ 7680, 4320 };
+                } else if (sscanf(item, "%dx%d", &r->width, &r->height) != 2 ||
+                           r->width <= 0 || r->height <= 0) {
+                        fprintf(stderr, "Wrong resolution: %s\n", item);
+                        return false;
+                }
+        }
+        return o->res_count > 0;
+}
+
+static bool
+parse_threads(struct opts *o, char *arg)
+{
+        o->thread_count = 0;
+        char *save_ptr = NULL;
+        char *item = NULL;
+        while ((item = strtok_r(arg, ",", &save_ptr)) != NULL) {
+                arg = NULL;
+                if (o->thread_count == MAX_THREAD_COUNTS) {
+                        return false;
+                }
+                char *endptr = NULL;
+                long val = strtol(item, &endptr, 0);
+                if (*endptr != '\0' || val < 0) {
+                        fprintf(stderr, "Wrong thread count: %s\n", item);
+                        return false;
+                }
+                o->threads[o->thread_count++] = (int) val;
+        }
+        return o->thread_count > 0;
+}
+
+static bool
+parse_benches(struct opts *o, char *arg)
+{
+        o->benches = 0;
+        char *save_ptr = NULL;
+        char *item = NULL;
+        while ((item = strtok_r(arg, ",", &save_ptr)) != NULL) {
+                arg = NULL;
+                if (strcmp(item, "conv") == 0) {
+                        o->benches |= BENCH_CONV;
+                } else if (strcmp(item, "parallel") == 0) {
+                        o->benches |= BENCH_PARALLEL;
+                } else if (strcmp(item, "deinterlace") == 0) {
+                        o->benches |= BENCH_DEINTERLACE;
+                } else {
+                        fprintf(stderr, "Unknown benchmark: %s\n", item);
+                        return false;
+                }
+        }
+        return o->benches != 0;
+}
+
+/// default thread counts - powers of 2 up to the number of CPUs and the count
+static void
+set_default_threads(struct opts *o)
+{
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus < 1) {
+                cpus = 1;
+        }
+        o->thread_count = 0;
+        for (int t = 1; t < cpus && o->thread_count < MAX_THREAD_COUNTS - 1;
+             t *= 2) {
+                o->threads[o->thread_count++] = t;
+        }
+        o->threads[o->thread_count++] = (int) cpus;
+}
+
+static void
+usage(const char *progname)
+{
+        printf("Usage:\n"
+               "\t%s [-f csv|json] [-b <bench>[,...]] [-r <res>[,...]]\n"
+               "\t\t[-t <threads>[,...]] [-c <codec>]... [-w <warmup>] "
+               "[-n <samples>]\n\n"
+               "where\n"
+               "\t-f - output format (default csv)\n"
+               "\t-b - benchmarks to run: conv (line decoders, every SIMD "
+               "variant),\n"
+               "\t     parallel (parallel_pix_conv thread sweep), deinterlace "
+               "(default all)\n"
+               "\t-r - resolutions: 1080p, 4k (2160p), 8k (4320p) or <W>x<H> "
+               "(default 1080p,4k,8k)\n"
+               "\t-t - thread counts for parallel, 0 means all CPUs "
+               "(default powers of 2 up to the CPU count)\n"
+               "\t-c - only conversions from/to the codec (may be repeated)\n"
+               "\t-w - warm-up runs before measurement (default 2)\n"
+               "\t-n - measured runs, median is reported (default 9)\n\n"
+               "Reported are median ns per line and GB/s of output data.\n",
+               progname);
+}
+
+int
+main(int argc, char *argv[])
+{
+        // silence warnings about reducing bit depth - not relevant here
+        log_level = LOG_LEVEL_ERROR;
+
+        struct opts o = {
+                .benches = BENCH_CONV | BENCH_PARALLEL | BENCH_DEINTERLACE,
+                .warmup  = 2,
+                .samples = 9,
+                .res = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } },
+                .res_count = 3,
+        };
+        set_default_threads(&o);
+
+        int opt = 0;
+        while ((opt = getopt(argc, argv, "b:c:f:hn:r:t:w:")) != -1) {
+                switch (opt) {
+                case 'b':
+                        if (!parse_benches(&o, optarg)) {
+                                return 1;
+                        }
+                        break;
+                case 'c':
+                        if (o.codec_count == MAX_CODEC_FILTERS) {
+                                fprintf(stderr, "Too many codecs!\n");
+                                return 1;
+                        }
+                        o.codecs[o.codec_count] = get_codec_from_name(optarg);
+                        if (o.codecs[o.codec_count] == VIDEO_CODEC_NONE) {
+                                fprintf(stderr, "Unknown codec: %s\n", optarg);
+                                return 1;
+                        }
+                        o.codec_count += 1;
+                        break;
+                case 'f':
+                        if (strcmp(optarg, "json") == 0) {
+                                o.json = true;
+                        } else if (strcmp(optarg, "csv") != 0) {
+                                fprintf(stderr, "Unknown format: %s\n", optarg);
+                                return 1;
+                        }
+                        break;
+                case 'h':
+                        usage(argv[0]);
+                        return 0;
+                case 'n':
+                        o.samples = atoi(optarg);
+                        break;
+                case 'r':
+                        if (!parse_resolutions(&o, optarg)) {
+                                return 1;
+                        }
+                        break;
+                case 't':
+                        if (!parse_threads(&o, optarg)) {
+                                return 1;
+                        }
+                        break;
+                case 'w':
+                        o.warmup = atoi(optarg);
+                        break;
+                default:
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+        if (optind != argc || o.samples < 1 || o.warmup < 0) {
+                usage(argv[0]);
+                return 1;
+        }
+
+        print_header(&o);
+        for (int i = 0; i < o.res_count; ++i) {
+                if ((o.benches & BENCH_CONV) != 0) {
+                        benchmark_conv(&o, o.res[i]);
+                }
+                if ((o.benches & BENCH_PARALLEL) != 0) {
+                        benchmark_parallel(&o, o.res[i]);
+                }
+                if ((o.benches & BENCH_DEINTERLACE) != 0) {
+                        benchmark_deinterlace(&o, o.res[i]);
+                }
+        }
+        print_footer(&o);
+}
@@ -0,0 +1,167 @@
+/**
+ * @file   benchmark_udp_recv.c
+ * @brief  loopback benchmark of the multithreaded net_udp receive path
+ *
+ * Compares legacy per-packet reception (select() + recvfrom(), udp-batch=1)
+ * with batched recvmmsg() reception. A forked child floods loopback with
+ * datagrams, parent measures received packets/s and CPU time per received
+ * Gbit (reader thread + consumer).
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "rtp/net_udp.h"
+#include "utils/packet_pool.h"
+
+#define PORT 15004
+#define BATCH 64
+
+static char batch_param[32];
+
+/// replaces host.cpp implementation, only udp-batch is recognized
+const char *
+get_commandline_param(const char *key)
+{
+        if (strcmp(key, "udp-batch") == 0 && batch_param[0] != '\0') {
+                return batch_param;
+        }
+        return NULL;
+}
+
+char *uv_argv[] = { "benchmark_udp_recv", NULL };
+
+void
+register_param(const char *param, const char *doc)
+{
+        (void) param;
+        (void) doc;
+}
+
+bool
+tok_in_argv(char **argv, const char *tok)
+{
+        (void) argv, (void) tok;
+        return false;
+}
+
+void
+handle_error(int status)
+{
+        exit(status);
+}
+
+static void
+run_sender(int payload_len)
+{
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in dst = { .sin_family = AF_INET,
+                                   .sin_port = htons(PORT),
+                                   .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+        char *buf = calloc(1, payload_len);
+        while (1) {
+                sendto(fd, buf, payload_len, 0, (struct sockaddr *) &dst,
+                       sizeof dst);
+        }
+}
+
+static double
+get_cpu_time()
+{
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1E6 +
+               usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1E6;
+}
+
+static double
+get_wall_time()
+{
+        struct timespec ts;
+        timespec_get(&ts, TIME_UTC);
+        return ts.tv_sec + ts.tv_nsec / 1E9;
+}
+
+static void
+benchmark(const char *name, int batch, double duration, int payload_len)
+{
+        snprintf(batch_param, sizeof batch_param, "%d", batch);
+        socket_udp *s = udp_init("127.0.0.1", PORT, PORT + 2, 255, 4, true);
+        if (s == NULL) {
+                fprintf(stderr, "Cannot initialize socket!\n");
+                exit(EXIT_FAILURE);
+        }
+        udp_set_recv_buf(s, 16 * 1024 * 1024);
+
+        pid_t sender = fork();
+        if (sender == 0) {
+                run_sender(payload_len);
+        }
+
+        long long packets = 0;
+        long long bytes   = 0;
+        const double cpu_start = get_cpu_time();
+        const double start     = get_wall_time();
+        double       now       = start;
+        while ((now = get_wall_time()) - start < duration) {
+                struct timeval timeout = { 0, 100000 };
+                if (!udp_not_empty(s, &timeout)) {
+                        continue;
+                }
+                char *buffers[BATCH];
+                int   lens[BATCH];
+                const int count = udp_recv_data_batch(s, buffers, lens, BATCH);
+                for (int i = 0; i < count; ++i) {
+                        bytes += lens[i];
+                        packet_pool_free(buffers[i]);
+                }
+                packets += count;
+        }
+        const double cpu = get_cpu_time() - cpu_start;
+        const double elapsed = now - start;
+
+        kill(sender, SIGKILL);
+        waitpid(sender, NULL, 0);
+        udp_exit(s);
+
+        const double gbits = bytes * 8 / 1E9;
+        printf("%-8s batch=%-3d %10.0f pkt/s %8.3f Gbps %8.3f CPU s/Gbit "
+               "(CPU %.0f %%)\n",
+               name, batch, packets / elapsed, gbits / elapsed,
+               gbits > 0 ? cpu / gbits : 0, cpu / elapsed * 100);
+}
+
+int
+main(int argc, char *argv[])
+{
+        log_level = LOG_LEVEL_ERROR;
+        double duration    = 5;
+        int    payload_len = 1400;
+
+        if (argc > 1) {
+                if (strcmp(argv[1], "help") == 0 || argc > 3) {
+                        printf("Usage:\n%s [seconds [payload_len]]\n",
+                               argv[0]);
+                        return strcmp(argv[1], "help") != 0;
+                }
+                duration = atof(argv[1]);
+                if (argc > 2) {
+                        payload_len = atoi(argv[2]);
+                }
+        }
+
+        benchmark("legacy", 1, duration, payload_len);
+        benchmark("batched", BATCH, duration, payload_len);
+}
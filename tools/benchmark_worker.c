@@ -0,0 +1,177 @@
+/**
+ * @file   benchmark_worker.c
+ * @brief  latency and throughput benchmark of the worker pool
+ *
+ * Measures the cost of a small task_run_parallel() call (the dispatch and
+ * wake-up overhead dominates) compared with running the tasks with
+ * task_run_async() + wait_task() (thread per task) and throughput of
+ * task_parallel_for() with a sweep of grain sizes. Every index is checked
+ * to be processed exactly once.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "debug.h"
+#include "utils/worker.h"
+
+static char threads_param[32];
+static char affinity_param[32];
+
+/// replaces host.cpp implementation, only worker-* params are recognized
+const char *
+get_commandline_param(const char *key)
+{
+        if (strcmp(key, "worker-threads") == 0 && threads_param[0] != '\0') {
+                return threads_param;
+        }
+        if (strcmp(key, "worker-affinity") == 0 && affinity_param[0] != '\0') {
+                return affinity_param;
+        }
+        return NULL;
+}
+
+char *uv_argv[] = { "benchmark_worker", NULL };
+
+void
+register_param(const char *param, const char *doc)
+{
+        (void) param;
+        (void) doc;
+}
+
+bool
+tok_in_argv(char **argv, const char *tok)
+{
+        (void) argv, (void) tok;
+        return false;
+}
+
+static double
+get_wall_time()
+{
+        struct timespec ts;
+        timespec_get(&ts, TIME_UTC);
+        return ts.tv_sec + ts.tv_nsec / 1E9;
+}
+
+struct small_task {
+        volatile unsigned sum;
+        char pad[60];
+};
+
+static void *
+small_task(void *arg)
+{
+        struct small_task *t = arg;
+        for (unsigned i = 0; i < 256; ++i) {
+                t->sum += i;
+        }
+        return NULL;
+}
+
+static void
+benchmark_small_tasks(int tasks, int iterations)
+{
+        struct small_task data[tasks];
+        memset(data, 0, sizeof data);
+        task_result_handle_t handles[tasks];
+
+        double start = get_wall_time();
+        for (int i = 0; i < iterations; ++i) {
+                for (int j = 0; j < tasks; ++j) {
+                        handles[j] = task_run_async(small_task, &data[j]);
+                }
+                for (int j = 0; j < tasks; ++j) {
+                        wait_task(handles[j]);
+                }
+        }
+        const double async = (get_wall_time() - start) / iterations;
+
+        start = get_wall_time();
+        for (int i = 0; i < iterations; ++i) {
+                task_run_parallel(small_task, tasks, data, sizeof data[0],
+                                  NULL);
+        }
+        const double parallel = (get_wall_time() - start) / iterations;
+
+        printf("small tasks=%-3d async+wait %8.2f us/call, "
+               "task_run_parallel %8.2f us/call\n",
+               tasks, async * 1E6, parallel * 1E6);
+}
+
+struct for_data {
+        atomic_uchar *hits;
+        volatile unsigned long long sum;
+};
+
+static void
+for_callback(size_t start, size_t end, void *udata)
+{
+        struct for_data *d = udata;
+        unsigned long long sum = 0;
+        for (size_t i = start; i < end; ++i) {
+                atomic_fetch_add_explicit(&d->hits[i], 1, memory_order_relaxed);
+                sum += i * i;
+        }
+        d->sum += sum > 0; // keep the loop
+}
+
+static bool
+benchmark_parallel_for(size_t count, size_t grain, int iterations)
+{
+        struct for_data d = { calloc(count, sizeof d.hits[0]), 0 };
+        const double start = get_wall_time();
+        for (int i = 0; i < iterations; ++i) {
+                task_parallel_for(count, grain, for_callback, &d);
+        }
+        const double elapsed = (get_wall_time() - start) / iterations;
+        bool ok = true;
+        for (size_t i = 0; i < count; ++i) {
+                ok = ok && d.hits[i] == (unsigned char) iterations;
+        }
+        printf("parallel_for count=%zu grain=%-7zu %8.3f ms/call %8.1f Mitems/s%s\n",
+               count, grain, elapsed * 1E3, count / elapsed / 1E6,
+               ok ? "" : " MISMATCH");
+        free((void *) d.hits);
+        return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+        log_level = LOG_LEVEL_ERROR;
+
+        if (argc > 1 && strcmp(argv[1], "help") == 0) {
+                printf("Usage:\n%s [threads [cpu|node]]\n", argv[0]);
+                return 0;
+        }
+        if (argc > 1) {
+                snprintf(threads_param, sizeof threads_param, "%s", argv[1]);
+        }
+        if (argc > 2) {
+                snprintf(affinity_param, sizeof affinity_param, "%s", argv[2]);
+        }
+
+        const int task_counts[] = { 2, 4, 8, 16 };
+        for (unsigned i = 0; i < sizeof task_counts / sizeof task_counts[0]; ++i) {
+                benchmark_small_tasks(task_counts[i], 2000);
+        }
+        bool ok = true;
+        const size_t grains[] = { 0, 256, 4096, 65536 };
+        for (unsigned i = 0; i < sizeof grains / sizeof grains[0]; ++i) {
+                ok = benchmark_parallel_for(1 << 22, grains[i], 20) && ok;
+        }
+
+        struct worker_pool_stats stats;
+        worker_pool_get_stats(&stats);
+        printf("pool: %d threads, %llu batches, %llu inlined, %llu ranges, "
+               "%llu steals, max queue %zu, idle %.3f s\n",
+               stats.threads, stats.batches, stats.inlined, stats.ranges,
+               stats.steals, stats.max_queue_depth, stats.idle_time);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -54,18 +54,22 @@ Ipc_frame *ipc_frame_new(){
 
         frame->data = nullptr;
         frame->alloc_size = 0;
+        frame->shm = false;
 
         return frame;
 }
 
 void ipc_frame_free(Ipc_frame *frame){
-        free(frame->data);
+        if(!frame->shm)
+                free(frame->data);
         free(frame);
 }
 
 bool ipc_frame_reserve(Ipc_frame *frame, size_t size){
         if(size <= frame->alloc_size)
                 return true;
+        if(frame->shm)
+                return false;
 
         auto newbuf = static_cast<char *>(realloc(frame->data, size));
         if(!newbuf)
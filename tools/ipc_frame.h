@@ -25,6 +25,7 @@ struct Ipc_frame{
         char *data;
 
         size_t alloc_size;
+        bool shm; ///< data point to a shared memory slot (never reallocated nor freed)
 };
 
 bool ipc_frame_parse_header(struct Ipc_frame_header *hdr, const char *buf);
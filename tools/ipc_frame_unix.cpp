@@ -24,13 +24,74 @@ typedef int fd_t;
 typedef SOCKET fd_t;
 #endif
 
+#ifdef __linux__
+#include <sys/mman.h>
+#define IPC_FRAME_SHM 1
+#endif
+
 #include <cerrno>
+#include <cstdint>
 #include "ipc_frame_unix.h"
 
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL 0
 #endif
 
+/*
+ * Shared memory transport (Linux only)
+ *
+ * After accepting a connection, the reader sends a hello control message.
+ * A writer that understands it creates a memfd-backed ring of frame slots
+ * and passes the fd to the reader once (SCM_RIGHTS, along with a setup
+ * header). Afterwards only frame headers with a slot index are sent, the
+ * reader returns slots with a release control message. Writers not knowing
+ * the hello keep sending the frame data inline, which is also used by
+ * readers that do not send the hello.
+ *
+ * Transport fields are stored in the reserved part of the frame header.
+ */
+namespace{
+enum Ipc_msg_type : int32_t {
+        IPC_MSG_FRAME_INLINE = 0, ///< frame data follow the header
+        IPC_MSG_FRAME_SHM = 1,    ///< frame data are in shm slot
+        IPC_MSG_SHM_SETUP = 2,    ///< new slot ring, fd passed with the header
+};
+
+enum Ipc_hdr_offsets {
+        IPC_HDR_TYPE = 16,
+        IPC_HDR_SLOT = 20,
+        IPC_HDR_GENERATION = 24,
+        IPC_HDR_SLOT_COUNT = 28,
+        IPC_HDR_SLOT_SIZE = 32,
+};
+
+/// control messages from reader to writer
+enum Ipc_ctl_type : uint32_t {
+        IPC_CTL_HELLO = 0x55474831,   ///< reader supports shm ("UGH1")
+        IPC_CTL_RELEASE = 0x55475231, ///< slot is free again ("UGR1")
+};
+
+struct Ipc_ctl_msg{
+        uint32_t type;
+        uint32_t slot;
+        uint32_t generation;
+        uint32_t reserved;
+};
+
+constexpr int IPC_SHM_SLOTS = 3;
+
+uint32_t hdr_get(const char *buf, int off){
+        uint32_t val;
+        memcpy(&val, buf + off, sizeof val);
+        return val;
+}
+
+void hdr_set(char *buf, int off, uint32_t val){
+        memcpy(buf + off, &val, sizeof val);
+}
+
+} //anon namespace
+
 namespace{
 struct Wsa_guard{
         Wsa_guard(){
@@ -54,6 +115,16 @@ struct Ipc_frame_reader{
         fd_t listen_fd;
         fd_t data_fd;
         std::string path;
+
+        Ipc_frame_uniq frame{ipc_frame_new()}; ///< acquired frame with inline data
+#ifdef IPC_FRAME_SHM
+        Ipc_frame shm_frame{};                 ///< acquired frame in shm slot
+        int acquired_slot = -1;
+        char *shm_map = nullptr;
+        size_t shm_slot_size = 0;
+        uint32_t shm_slot_count = 0;
+        uint32_t shm_generation = 0;
+#endif
 };
 
 Ipc_frame_reader *ipc_frame_reader_new(const char *path){
@@ -89,9 +160,22 @@ Ipc_frame_reader *ipc_frame_reader_new(const char *path){
         return reader.release();
 }
 
+static void reader_disconnect(Ipc_frame_reader *reader){
+        CLOSESOCKET(reader->data_fd);
+        reader->data_fd = INVALID_SOCKET;
+#ifdef IPC_FRAME_SHM
+        reader->acquired_slot = -1;
+        if(reader->shm_map)
+                munmap(reader->shm_map, reader->shm_slot_size * reader->shm_slot_count);
+        reader->shm_map = nullptr;
+        reader->shm_slot_size = 0;
+        reader->shm_slot_count = 0;
+#endif
+}
+
 void ipc_frame_reader_free(struct Ipc_frame_reader *reader){
         if(reader->data_fd != INVALID_SOCKET)
-                CLOSESOCKET(reader->data_fd);
+                reader_disconnect(reader);
         if(reader->listen_fd != INVALID_SOCKET)
                 CLOSESOCKET(reader->listen_fd);
 
@@ -100,13 +184,41 @@ void ipc_frame_reader_free(struct Ipc_frame_reader *reader){
         delete reader;
 }
 
-static size_t blocking_read(fd_t fd, char *dst, size_t size){
+/**
+ * @param[out] passed_fd  if not NULL, receives a file descriptor passed
+ *                        along with the data (or -1), others are closed
+ */
+static size_t blocking_read(fd_t fd, char *dst, size_t size, int *passed_fd = nullptr){
         size_t bytes_read = 0;
 
         while(bytes_read < size){
+#ifdef IPC_FRAME_SHM
+                iovec iov{dst + bytes_read, size - bytes_read};
+                alignas(cmsghdr) char cbuf[CMSG_SPACE(sizeof(int))];
+                msghdr msg{};
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                msg.msg_control = cbuf;
+                msg.msg_controllen = sizeof cbuf;
+                ssize_t read_now = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+                if(read_now <= 0)
+                        break;
+
+                for(cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)){
+                        if(c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+                                continue;
+                        int recv_fd;
+                        memcpy(&recv_fd, CMSG_DATA(c), sizeof recv_fd);
+                        if(passed_fd && *passed_fd == -1)
+                                *passed_fd = recv_fd;
+                        else
+                                close(recv_fd);
+                }
+#else
                 int read_now = recv(fd, dst + bytes_read, size - bytes_read, 0);
                 if(read_now <= 0)
                         break;
+#endif
 
                 bytes_read += read_now;
         }
@@ -131,11 +243,26 @@ static bool socket_read_avail(fd_t fd){
         return ret > 0;
 }
 
+static bool reader_send_ctl(Ipc_frame_reader *reader, uint32_t type, uint32_t slot, uint32_t generation){
+        Ipc_ctl_msg msg{type, slot, generation, 0};
+        return send(reader->data_fd, reinterpret_cast<const char *>(&msg), sizeof msg, MSG_NOSIGNAL) == sizeof msg;
+}
+
+static void reader_on_connected(Ipc_frame_reader *reader){
+#ifdef IPC_FRAME_SHM
+        if(reader->data_fd != INVALID_SOCKET)
+                reader_send_ctl(reader, IPC_CTL_HELLO, 0, 0);
+#else
+        (void) reader;
+#endif
+}
+
 static bool try_accept(struct Ipc_frame_reader *reader){
         if(!socket_read_avail(reader->listen_fd))
                 return false;
 
         reader->data_fd = accept(reader->listen_fd, nullptr, 0);
+        reader_on_connected(reader);
         return true;
 }
 
@@ -155,37 +282,170 @@ void ipc_frame_reader_wait_connect(struct Ipc_frame_reader *reader){
                 return;
 
         reader->data_fd = accept(reader->listen_fd, nullptr, 0);
+        reader_on_connected(reader);
 }
 
-static bool do_frame_read(Ipc_frame_reader *reader, Ipc_frame *dst){
+#ifdef IPC_FRAME_SHM
+static bool reader_map_ring(Ipc_frame_reader *reader, const char *header_buf, int fd){
+        if(fd == -1)
+                return false;
+
+        if(reader->shm_map)
+                munmap(reader->shm_map, reader->shm_slot_size * reader->shm_slot_count);
+        reader->shm_map = nullptr;
+        reader->shm_slot_count = hdr_get(header_buf, IPC_HDR_SLOT_COUNT);
+        reader->shm_slot_size = hdr_get(header_buf, IPC_HDR_SLOT_SIZE);
+        reader->shm_generation = hdr_get(header_buf, IPC_HDR_GENERATION);
+
+        void *map = mmap(nullptr, reader->shm_slot_size * reader->shm_slot_count,
+                        PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(map == MAP_FAILED){
+                perror("ipc_frame_reader mmap");
+                reader->shm_slot_count = 0;
+                return false;
+        }
+        reader->shm_map = static_cast<char *>(map);
+        return true;
+}
+#endif
+
+/**
+ * Reads next frame header, handles shared memory setup messages.
+ *
+ * @param[out] slot  shm slot containing the frame data or -1 if the data
+ *                   follow inline
+ */
+static bool read_frame_header(Ipc_frame_reader *reader, Ipc_frame_header *hdr, int *slot){
         char header_buf[IPC_FRAME_HEADER_LEN];
 
-        if(blocking_read(reader->data_fd, header_buf, IPC_FRAME_HEADER_LEN) != IPC_FRAME_HEADER_LEN)
+        while(true){
+                int passed_fd = -1;
+                if(blocking_read(reader->data_fd, header_buf, IPC_FRAME_HEADER_LEN, &passed_fd) != IPC_FRAME_HEADER_LEN){
+                        if(passed_fd != -1)
+                                close(passed_fd);
+                        return false;
+                }
+
+                uint32_t type = hdr_get(header_buf, IPC_HDR_TYPE);
+#ifdef IPC_FRAME_SHM
+                if(type == IPC_MSG_SHM_SETUP){
+                        if(!reader_map_ring(reader, header_buf, passed_fd))
+                                return false;
+                        continue;
+                }
+#endif
+                if(passed_fd != -1)
+                        close(passed_fd);
+
+                if(!ipc_frame_parse_header(hdr, header_buf) || hdr->data_len < 0)
+                        return false;
+
+                *slot = -1;
+                if(type == IPC_MSG_FRAME_INLINE)
+                        return true;
+#ifdef IPC_FRAME_SHM
+                if(type == IPC_MSG_FRAME_SHM
+                                && hdr_get(header_buf, IPC_HDR_GENERATION) == reader->shm_generation
+                                && hdr_get(header_buf, IPC_HDR_SLOT) < reader->shm_slot_count
+                                && (size_t) hdr->data_len <= reader->shm_slot_size)
+                {
+                        *slot = hdr_get(header_buf, IPC_HDR_SLOT);
+                        return true;
+                }
+#endif
                 return false;
+        }
+}
 
-        if(!ipc_frame_parse_header(&dst->header, header_buf))
+static bool do_frame_read(Ipc_frame_reader *reader, Ipc_frame *dst){
+        int slot = -1;
+        if(!read_frame_header(reader, &dst->header, &slot))
                 return false;
 
         if(!ipc_frame_reserve(dst, dst->header.data_len))
                 return false;
 
+#ifdef IPC_FRAME_SHM
+        if(slot >= 0){
+                memcpy(dst->data, reader->shm_map + slot * reader->shm_slot_size, dst->header.data_len);
+                return reader_send_ctl(reader, IPC_CTL_RELEASE, slot, reader->shm_generation);
+        }
+#endif
+
         int read_data = blocking_read(reader->data_fd, dst->data, dst->header.data_len);
 
         return read_data == dst->header.data_len;
 }
 
 bool ipc_frame_reader_read(Ipc_frame_reader *reader, Ipc_frame *dst){
+        ipc_frame_reader_release(reader);
         bool ret = do_frame_read(reader, dst);
         if(!ret){
-                CLOSESOCKET(reader->data_fd);
-                reader->data_fd = INVALID_SOCKET;
+                reader_disconnect(reader);
         }
 
         return ret;
 }
 
+const Ipc_frame *ipc_frame_reader_acquire(Ipc_frame_reader *reader){
+        ipc_frame_reader_release(reader);
+
+        Ipc_frame *frame = reader->frame.get();
+        int slot = -1;
+        if(!read_frame_header(reader, &frame->header, &slot)){
+                reader_disconnect(reader);
+                return nullptr;
+        }
+
+#ifdef IPC_FRAME_SHM
+        if(slot >= 0){
+                reader->shm_frame.header = frame->header;
+                reader->shm_frame.data = reader->shm_map + slot * reader->shm_slot_size;
+                reader->shm_frame.alloc_size = reader->shm_slot_size;
+                reader->shm_frame.shm = true;
+                reader->acquired_slot = slot;
+                return &reader->shm_frame;
+        }
+#endif
+
+        if(!ipc_frame_reserve(frame, frame->header.data_len)
+                        || blocking_read(reader->data_fd, frame->data, frame->header.data_len) != (size_t) frame->header.data_len)
+        {
+                reader_disconnect(reader);
+                return nullptr;
+        }
+        return frame;
+}
+
+void ipc_frame_reader_release(Ipc_frame_reader *reader){
+#ifdef IPC_FRAME_SHM
+        if(reader->acquired_slot < 0)
+                return;
+
+        reader_send_ctl(reader, IPC_CTL_RELEASE, reader->acquired_slot, reader->shm_generation);
+        reader->acquired_slot = -1;
+#else
+        (void) reader;
+#endif
+}
+
 struct Ipc_frame_writer{
         fd_t data_fd;
+
+        Ipc_frame_uniq frame{ipc_frame_new()}; ///< acquired frame if shm is not used
+#ifdef IPC_FRAME_SHM
+        bool shm_enabled = false;              ///< reader sent hello
+        Ipc_frame shm_frame{};                 ///< acquired frame in shm slot
+        int acquired_slot = -1;
+        char *shm_map = nullptr;
+        size_t shm_slot_size = 0;
+        uint32_t shm_generation = 0;
+        std::array<bool, IPC_SHM_SLOTS> slot_busy{};
+
+        Ipc_ctl_msg ctl_msg{};                 ///< partially received control message
+        size_t ctl_msg_len = 0;
+#endif
 };
 
 Ipc_frame_writer *ipc_frame_writer_new(const char *path){
@@ -217,35 +477,194 @@ Ipc_frame_writer *ipc_frame_writer_new(const char *path){
 void ipc_frame_writer_free(struct Ipc_frame_writer *writer){
         if(writer->data_fd != INVALID_SOCKET)
                 CLOSESOCKET(writer->data_fd);
+#ifdef IPC_FRAME_SHM
+        if(writer->shm_map)
+                munmap(writer->shm_map, writer->shm_slot_size * IPC_SHM_SLOTS);
+#endif
 
         delete writer;
 }
 
 namespace{
 
-void block_write(fd_t fd, void *buf, size_t size){
+bool block_write(fd_t fd, const void *buf, size_t size){
         size_t written = 0;
-        char *src = static_cast<char *>(buf);
+        const char *src = static_cast<const char *>(buf);
 
         while(written < size){
                 int ret = send(fd, src + written, size - written, MSG_NOSIGNAL);
                 if(ret == -1)
-                        return;
+                        return false;
                 written += ret;
         }
+        return true;
 }
 
+#ifdef IPC_FRAME_SHM
+bool send_with_fd(fd_t sock, const char *buf, size_t size, int fd){
+        iovec iov{const_cast<char *>(buf), size};
+        alignas(cmsghdr) char cbuf[CMSG_SPACE(sizeof(int))] = {};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof cbuf;
+        cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(c), &fd, sizeof fd);
+
+        ssize_t ret = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if(ret == -1)
+                return false;
+        return block_write(sock, buf + ret, size - ret);
+}
+
+/**
+ * Processes control messages sent by the reader.
+ * @param block  wait for at least one message
+ * @retval false connection error
+ */
+bool writer_process_ctl(Ipc_frame_writer *writer, bool block){
+        auto *buf = reinterpret_cast<char *>(&writer->ctl_msg);
+        while(true){
+                int ret = recv(writer->data_fd, buf + writer->ctl_msg_len,
+                                sizeof writer->ctl_msg - writer->ctl_msg_len,
+                                block ? 0 : MSG_DONTWAIT);
+                if(ret == 0)
+                        return false;
+                if(ret < 0){
+                        if(errno == EINTR)
+                                continue;
+                        return !block && (errno == EAGAIN || errno == EWOULDBLOCK);
+                }
+                writer->ctl_msg_len += ret;
+                if(writer->ctl_msg_len < sizeof writer->ctl_msg)
+                        continue;
+
+                writer->ctl_msg_len = 0;
+                const Ipc_ctl_msg &msg = writer->ctl_msg;
+                if(msg.type == IPC_CTL_HELLO){
+                        writer->shm_enabled = true;
+                } else if(msg.type == IPC_CTL_RELEASE
+                                && msg.generation == writer->shm_generation
+                                && msg.slot < IPC_SHM_SLOTS)
+                {
+                        writer->slot_busy[msg.slot] = false;
+                }
+                block = false;
+        }
+}
+
+/// creates new slot ring big enough for size and passes it to the reader
+bool writer_setup_ring(Ipc_frame_writer *writer, size_t size){
+        const size_t page = sysconf(_SC_PAGESIZE);
+        const size_t slot_size = (size + page - 1) / page * page;
+        if(slot_size * IPC_SHM_SLOTS > UINT32_MAX)
+                return false;
+
+        int fd = memfd_create("ug_ipc_frame", MFD_CLOEXEC);
+        if(fd == -1){
+                perror("ipc_frame_writer memfd_create");
+                return false;
+        }
+        void *map = MAP_FAILED;
+        if(ftruncate(fd, slot_size * IPC_SHM_SLOTS) == 0){
+                map = mmap(nullptr, slot_size * IPC_SHM_SLOTS,
+                                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if(map == MAP_FAILED){
+                perror("ipc_frame_writer shm setup");
+                close(fd);
+                return false;
+        }
+
+        if(writer->shm_map)
+                munmap(writer->shm_map, writer->shm_slot_size * IPC_SHM_SLOTS);
+        writer->shm_map = static_cast<char *>(map);
+        writer->shm_slot_size = slot_size;
+        writer->shm_generation += 1;
+        writer->slot_busy = {};
+
+        std::array<char, IPC_FRAME_HEADER_LEN> header;
+        Ipc_frame_header hdr{};
+        ipc_frame_write_header(&hdr, header.data());
+        hdr_set(header.data(), IPC_HDR_TYPE, IPC_MSG_SHM_SETUP);
+        hdr_set(header.data(), IPC_HDR_GENERATION, writer->shm_generation);
+        hdr_set(header.data(), IPC_HDR_SLOT_COUNT, IPC_SHM_SLOTS);
+        hdr_set(header.data(), IPC_HDR_SLOT_SIZE, slot_size);
+        bool ret = send_with_fd(writer->data_fd, header.data(), header.size(), fd);
+        close(fd);
+        return ret;
+}
+
+/**
+ * @returns free shm slot with at least size bytes (waits for the reader to
+ * release one if needed) or -1 if shm is not used
+ */
+int writer_get_slot(Ipc_frame_writer *writer, size_t size){
+        if(!writer_process_ctl(writer, false) || !writer->shm_enabled)
+                return -1;
+
+        if(size > writer->shm_slot_size && !writer_setup_ring(writer, size)){
+                writer->shm_enabled = false;
+                return -1;
+        }
+
+        while(true){
+                for(int i = 0; i < IPC_SHM_SLOTS; i++){
+                        if(!writer->slot_busy[i])
+                                return i;
+                }
+                if(!writer_process_ctl(writer, true))
+                        return -1;
+        }
+}
+#endif
+
 } //anon namespace
 
+Ipc_frame *ipc_frame_writer_acquire(Ipc_frame_writer *writer, size_t size){
+#ifdef IPC_FRAME_SHM
+        int slot = writer_get_slot(writer, size);
+        if(slot >= 0){
+                writer->acquired_slot = slot;
+                writer->shm_frame.header = Ipc_frame_header{};
+                writer->shm_frame.data = writer->shm_map + slot * writer->shm_slot_size;
+                writer->shm_frame.alloc_size = writer->shm_slot_size;
+                writer->shm_frame.shm = true;
+                return &writer->shm_frame;
+        }
+#endif
+        if(!ipc_frame_reserve(writer->frame.get(), size))
+                return nullptr;
+        return writer->frame.get();
+}
+
 bool ipc_frame_writer_write(struct Ipc_frame_writer *writer, const struct Ipc_frame *f){
         std::array<char, IPC_FRAME_HEADER_LEN> header;
 
         ipc_frame_write_header(&f->header, header.data());
 
-        errno = 0;
-        block_write(writer->data_fd, header.data(), header.size());
-        block_write(writer->data_fd, f->data, f->header.data_len);
+#ifdef IPC_FRAME_SHM
+        int slot = -1;
+        if(f == &writer->shm_frame){
+                slot = writer->acquired_slot;
+        } else if((slot = writer_get_slot(writer, f->header.data_len)) >= 0){
+                memcpy(writer->shm_map + slot * writer->shm_slot_size, f->data, f->header.data_len);
+        }
+        writer->acquired_slot = -1;
+        if(slot >= 0){
+                hdr_set(header.data(), IPC_HDR_TYPE, IPC_MSG_FRAME_SHM);
+                hdr_set(header.data(), IPC_HDR_SLOT, slot);
+                hdr_set(header.data(), IPC_HDR_GENERATION, writer->shm_generation);
+                writer->slot_busy[slot] = true;
+                return block_write(writer->data_fd, header.data(), header.size());
+        }
+#endif
 
-        return errno == 0;
+        return block_write(writer->data_fd, header.data(), header.size())
+                && block_write(writer->data_fd, f->data, f->header.data_len);
 }
 
@@ -12,6 +12,18 @@ bool ipc_frame_reader_has_frame(struct Ipc_frame_reader *reader);
 bool ipc_frame_reader_is_connected(struct Ipc_frame_reader *reader);
 bool ipc_frame_reader_read(struct Ipc_frame_reader *reader, struct Ipc_frame *dst);
 
+/**
+ * @brief Returns next frame without copying
+ *
+ * If the writer uses shared memory (Linux), the returned frame points
+ * directly to it. The frame is owned by the reader and stays valid until
+ * ipc_frame_reader_release() or next ipc_frame_reader_acquire() call.
+ *
+ * @returns frame or NULL on failure (reader is disconnected)
+ */
+const struct Ipc_frame *ipc_frame_reader_acquire(struct Ipc_frame_reader *reader);
+void ipc_frame_reader_release(struct Ipc_frame_reader *reader);
+
 void ipc_frame_reader_wait_connect(struct Ipc_frame_reader *reader);
 
 struct Ipc_frame_writer;
@@ -19,6 +31,17 @@ struct Ipc_frame_writer;
 Ipc_frame_writer *ipc_frame_writer_new(const char *path);
 void ipc_frame_writer_free(struct Ipc_frame_writer *writer);
 
+/**
+ * @brief Returns frame to be filled and passed to ipc_frame_writer_write()
+ *
+ * If the reader supports it, the frame data are placed in the shared memory
+ * so that the frame is passed without copying. The frame is owned by the
+ * writer.
+ *
+ * @param size  maximal data size that will be needed (ipc_frame_reserve()
+ *              fails for bigger size)
+ */
+struct Ipc_frame *ipc_frame_writer_acquire(struct Ipc_frame_writer *writer, size_t size);
 bool ipc_frame_writer_write(struct Ipc_frame_writer *writer, const struct Ipc_frame *f);
 
 #ifdef __cplusplus
@@ -29,7 +29,7 @@ public:
                 jpeg_destroy_compress(&compress_ctx);
         }
 
-        bool write_img(Ipc_frame *f, const std::string& path){
+        bool write_img(const Ipc_frame *f, const std::string& path){
                 assert(f->header.color_spec == IPC_FRAME_COLOR_RGB);
                 File_uniq outfile(fopen(path.c_str(), "wb"));
                 if (!outfile) {
@@ -63,7 +63,6 @@ int main(int argc, char **argv){
         }
 
         Ipc_frame_reader_uniq reader(ipc_frame_reader_new(argv[1]));
-        Ipc_frame_uniq ipc_frame(ipc_frame_new());
 
         Img_writer img_writer;
 
@@ -75,7 +74,7 @@ int main(int argc, char **argv){
                 printf("Waiting for connection...\n");
                 ipc_frame_reader_wait_connect(reader.get());
                 printf("Connected...\n");
-                while(ipc_frame_reader_read(reader.get(), ipc_frame.get())){
+                while(const Ipc_frame *ipc_frame = ipc_frame_reader_acquire(reader.get())){
                         auto now = clock::now();
                         if(now < next_frame)
                                 continue;
@@ -83,7 +82,7 @@ int main(int argc, char **argv){
                         std::string path = argv[2];
                         std::string tmp_path = path + ".swp";
 
-                        img_writer.write_img(ipc_frame.get(), tmp_path);
+                        img_writer.write_img(ipc_frame, tmp_path);
                         std::filesystem::rename(tmp_path, path);
 
                         next_frame = std::max(next_frame + frame_time, now);